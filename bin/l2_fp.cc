@@ -3,6 +3,7 @@
 #include "l2_fp_configuration_lua.h"
 #include "fp_logger.h"
 #include "log_timing.h"
+#include "profiler.h"
 #include <signal.h>
 #include <iostream>
 #include <fstream>
@@ -10,6 +11,8 @@
 #include <fenv.h>
 #include <H5Cpp.h>
 #include <ctime>
+#include <vector>
+#include <boost/foreach.hpp>
 #include "version.h"
 
 using namespace FullPhysics;
@@ -59,6 +62,234 @@ void floating_point_exception(int signum, siginfo_t *sip, void *scp)
   exit(5);
 }
 
+//-----------------------------------------------------------------------
+/// Run the retrieval (or forward model only) for the sounding
+/// described by the given configuration, and write the output.
+//-----------------------------------------------------------------------
+
+void run_retrieval(const boost::shared_ptr<L2FpConfigurationLua>& config,
+                   LogTiming& log_timing, bool save_test,
+                   const std::string& save_test_file)
+{
+  Profiler::reset();
+  // Set up output object
+  boost::shared_ptr<Output> output;
+  config->output(output, output_error);
+
+  std::ostringstream tstream;
+  tstream << "\n"
+          << "==============================================\n"
+          << "Setup:\n"
+          << *config->forward_model() << "\n"
+          << "==============================================\n";
+  Logger::info() << tstream.str() << "\n";
+
+  log_timing.write_to_log("Initialization");
+
+  boost::shared_ptr<ConnorSolver> solver = config->solver();
+  // Should have this merge with solver once we get this fully integrated
+  boost::shared_ptr<IterativeSolver> iterative_solver = 
+    config->iterative_solver();
+  if (solver) {
+    solver->add_observer(log_timing);
+
+    boost::shared_ptr<InitialGuess> ig(config->initial_guess());
+    blitz::Array<double, 1> initial_sv(ig->initial_guess());
+    blitz::Array<double, 1> apriori_sv(ig->apriori());
+    blitz::Array<double, 2> apriori_cov(ig->apriori_covariance());
+
+    // Launch solver and iterate till an exit condition is reached
+    bool have_sol = solver->solve(initial_sv, apriori_sv, apriori_cov);
+
+    // Statevector isn't generally set to the final solution by
+    // the Solver, so set it now.
+    config->forward_model()->state_vector()->update_state(solver->x_solution(), 
+                                                          solver->aposteriori_covariance());
+    
+    // Write output file
+    output->write();
+
+    if(have_sol)
+      Logger::info() << "Found solution\n";
+    else
+      Logger::info() << "Failed to find solution\n";
+
+    if(save_test) {        // Backdoor for generating test data.
+      std::ofstream save(save_test_file.c_str());
+      save <<
+        "# This test data was generated by capturing the state of the ConnorSolver\n"
+        "# after a run of l2_fp with the canned data used by \"make l2_fp_run\". You\n"
+        "# can regenerate this by running l2_fp with the \"-t\" option.\n\n";
+      save.precision(24);
+      solver->to_stream(save);
+    }
+  } else if(iterative_solver) {
+    // Note we don't have the setting of apriori and initial guess
+    // like with solver. We want to get that in place, but for now
+    // this gets set in the lua code and can't be changed here.
+    Logger::info() << "SOLVER: A solver from the new solver class hierarchy\n"
+;
+    iterative_solver->solve();
+
+    for( int i=0; i<=iterative_solver->num_accepted_steps(); i++ )
+     Logger::info()
+        << "   ========================================\n"
+        << "   At point[" << i <<"] " 
+	  << iterative_solver->accepted_points()[i] << "\n"
+        << "   Cost[" << i << "] = " 
+	  << iterative_solver->cost_at_accepted_points()[i] << "\n\n";
+
+    boost::shared_ptr<MaxAPosteriori> map = config->max_a_posteriori();
+
+    // Statevector isn't generally set to the final solution by
+    // the Solver, so set it now.
+    config->forward_model()->state_vector()->update_state
+	(map->parameters(), map->a_posteriori_covariance());
+    // Write output file
+    output->write();      
+    
+    if(iterative_solver->status() == IterativeSolver::SUCCESS) 
+	Logger::info() << "Found solution\n";
+    else
+	Logger::info() << "Failed to find solution\n";
+  } else {
+    // Run in forward model only mode if solver does not exist
+    // Only calculate jacobians if they are to be written to 
+    // the output file
+    Logger::info() << "Running forward model only, no retrieval.\n";
+    LuabindObject lua_config = config->lua_state().globals()["config"];
+    bool jac_calc = true;
+    if (not lua_config["write_jacobian"].is_nil())
+      jac_calc = lua_config["write_jacobian"].value<bool>();
+    Spectrum fm_radiance = config->forward_model()->radiance_all(jac_calc);
+
+    // Store the radiance we just calculated into the output product
+    output->register_data_source("/SpectralParameters/modeled_radiance", 
+                                 fm_radiance.spectral_range().data());
+    output->write();
+  }
+
+  // Report the time spent calculating each output dataset, if requested.
+  LuabindObject lua_config = config->lua_state().globals()["config"];
+  if(!lua_config.is_nil() && !lua_config["output_timing_report"].is_nil() &&
+     lua_config["output_timing_report"].value<bool>()) {
+    std::ostringstream os;
+    output->print_evaluation_time(os);
+    Logger::info() << os.str();
+  }
+
+  // If the profiler was compiled in, write out the profile for this
+  // sounding next to the output file.
+  if(Profiler::enabled()) {
+    std::ostringstream os;
+    os << Profiler() << "\n";
+    Logger::info() << os.str();
+    Profiler::write_json(config->output_name() + ".profile.json");
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Read the list of sounding ids used in batch mode. This is one
+/// sounding id per line, blank lines and lines starting with "#" are
+/// ignored.
+//-----------------------------------------------------------------------
+
+std::vector<std::string> read_sounding_id_list(const std::string& Fname)
+{
+  std::ifstream in(Fname.c_str());
+  if(!in.good())
+    throw Exception("Trouble opening sounding id list " + Fname);
+  std::vector<std::string> res;
+  std::string ln;
+  while(getline(in, ln)) {
+    size_t b = ln.find_first_not_of(" \t\r");
+    if(b == std::string::npos || ln[b] == '#')
+      continue;
+    size_t e = ln.find_last_not_of(" \t\r");
+    res.push_back(ln.substr(b, e - b + 1));
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Output file name used for a sounding in batch mode. We insert the
+/// sounding id before the extension, so "out.h5" becomes
+/// "out_<sounding id>.h5".
+//-----------------------------------------------------------------------
+
+std::string batch_output_name(const std::string& Out_file, 
+                              const std::string& Sounding_id)
+{
+  size_t t = Out_file.find_last_of(".");
+  size_t d = Out_file.find_last_of("/");
+  if(t == std::string::npos || (d != std::string::npos && t < d))
+    return Out_file + "_" + Sounding_id;
+  return Out_file.substr(0, t) + "_" + Sounding_id + Out_file.substr(t);
+}
+
+//-----------------------------------------------------------------------
+/// Process all the soundings in the given list. The Lua configuration
+/// is run once for each sounding, but in the same LuaState. Anything
+/// that depends only on static input (e.g., the ABSCO tables) is kept
+/// by the configuration from one sounding to the next, while the
+/// objects that depend on the sounding (e.g., the Level1b, met, and
+/// state vector) get recreated.
+///
+/// A failure in one sounding is reported, and then we go on to the
+/// next sounding. We return the number of soundings that failed.
+//-----------------------------------------------------------------------
+
+int run_batch(const std::string& Config_file, const std::string& Out_file,
+              const std::vector<std::string>& Sounding_id_list,
+              LogTiming& log_timing)
+{
+  size_t t = Config_file.find_last_of("/");
+  std::string dirbase = 
+    (t != std::string::npos ? Config_file.substr(0, t) : ".") + "/";
+  boost::shared_ptr<LuaState> ls(new LuaState(dirbase));
+  int number_fail = 0;
+  BOOST_FOREACH(const std::string& sid, Sounding_id_list) {
+    time_t tm;
+    std::string out_name = batch_output_name(Out_file, sid);
+    output_error.reset();
+    try {
+      Logger::info() << "Batch processing sounding " << sid << "\n";
+      boost::shared_ptr<L2FpConfigurationLua> config = 
+        L2FpConfigurationLua::load_sounding(ls, Config_file, sid, out_name);
+      Logger::set_implementation(config->logger());
+      time(&tm);
+      Logger::info() << "Sounding " << sid << " started at: " 
+                     << ctime(&tm) << "\n";
+      run_retrieval(config, log_timing, false, "");
+      log_timing.write_to_log("Sounding " + sid);
+      continue;
+    } catch(const Exception& e) {
+      std::cerr << "Exception thrown by Full Physics code for sounding " 
+                << sid << ":\n"
+                << e.what() << "\n"
+                << "Back trace:\n" << boost::trace(e) << "\n";
+    } catch(const std::exception& e) {
+      std::cerr << "System Exception thrown by Full Physics code for sounding "
+                << sid << ":\n"
+                << e.what() << "\n";
+    } catch(const H5::Exception& e) {
+      std::cerr << "HDF 5 Exception thrown by Full Physics code for sounding "
+                << sid << ":\n"
+                << e.getDetailMsg() << "\n";
+    } catch(...) {
+      std::cerr << "Unknown exception thrown for sounding " << sid << "\n";
+    }
+    ++number_fail;
+    if(output_error)
+      output_error->write_best_attempt();
+    log_timing.write_to_log("Sounding " + sid + " Error");
+  }
+  output_error.reset();
+  Logger::info() << "Batch processed " << Sounding_id_list.size() 
+                 << " soundings, " << number_fail << " failed\n";
+  return number_fail;
+}
+
 int main(int Argc, char** Argv)
 {
   // Need to create a logger before the one created by the configuration file
@@ -73,14 +304,20 @@ int main(int Argc, char** Argv)
     bool help = false;
     bool save_test = false;
     bool show_version = false;
+    bool batch = false;
     std::string save_test_file;
+    std::string batch_file;
     char ch;
-    while((ch = getopt(Argc, Argv, "t:vh")) != -1) {
+    while((ch = getopt(Argc, Argv, "t:b:vh")) != -1) {
       switch(ch) {
       case 't':
         save_test = true;
         save_test_file = optarg;
         break;
+      case 'b':
+        batch = true;
+        batch_file = optarg;
+        break;
       case 'v':
         show_version = true;
         break;
@@ -94,8 +331,8 @@ int main(int Argc, char** Argv)
 
     if(help) {
       std::cerr <<
-"Usage: l2_fp [-h] [-v] [-t <test file name>] [<configuration file>] \n"
-"   [<output file>]\n"
+"Usage: l2_fp [-h] [-v] [-t <test file name>] [-b <sounding id list>]\n"
+"   [<configuration file>] [<output file>]\n"
 "\n"
 "This program is used to do a Level 2 Full Physics retrieval. You\n"
 "can optionally specify a configuration file to use and an output\n"
@@ -109,7 +346,17 @@ int main(int Argc, char** Argv)
 "As a special backdoor, you can optionally specify -t. This causes\n"
 "the final state of the ConnorSolver object to be saved as the \n"
 "given file name. This file can then be used in unit tests. You\n"
-"wouldn't normally specify this option.\n";
+"wouldn't normally specify this option.\n"
+"\n"
+"With -b, we process a number of soundings in one process. The given\n"
+"file lists the sounding ids, one per line. The Lua configuration is\n"
+"run for each sounding in turn with the environment variable\n"
+"\"sounding_id\" set, reusing static inputs (e.g., ABSCO tables)\n"
+"loaded for earlier soundings. The output for each sounding goes to\n"
+"the output file name with the sounding id added before the\n"
+"extension (e.g., out_<sounding id>.h5). A sounding that fails is\n"
+"reported and skipped, and we exit with a nonzero status if any\n"
+"sounding failed.\n";
       return 1;
     }
 
@@ -139,10 +386,15 @@ int main(int Argc, char** Argv)
     }
 
     boost::shared_ptr<L2FpConfigurationLua> config;
+    bool have_lua_config = false;
     if(Argc > 0) {
       std::string fname(Argv[0]);
       if(fname.size() > 4 && fname.substr(fname.size() - 4) == ".lua") {
-        config.reset(new L2FpConfigurationLua(Argc, Argv));
+        have_lua_config = true;
+        // In batch mode, the configuration is loaded separately for
+        // each sounding by run_batch.
+        if(!batch)
+          config.reset(new L2FpConfigurationLua(Argc, Argv));
         Logger::info() << "Level 2 Full Physics" << "\n"
                        << "Major Version: " << MAJOR_VERSION << "\n"
                        << "CM Version: " << CM_VERSION << "\n";
@@ -184,109 +436,27 @@ int main(int Argc, char** Argv)
     // Turn off the automatic ending of a program when GSL has an
     // error. Instead, we handle these as exceptions.
     gsl_set_error_handler_off();
+    if(batch) {
+      if(!have_lua_config)
+        throw Exception("Batch mode requires a Lua configuration file.");
+      std::vector<std::string> sid_list = read_sounding_id_list(batch_file);
+      time(&tm);
+      Logger::info() << "Process started at: " << ctime(&tm) << "\n";
+      int number_fail = run_batch(Argv[0], (Argc > 1 ? Argv[1] : "out.h5"),
+                                  sid_list, log_timing);
+      log_timing.write_to_log("Final");
+      time(&tm);
+      Logger::info() << "Process ended at: " << ctime(&tm) << "\n";
+      Logger::info() << "Bye bye\n";
+      return (number_fail > 0 ? 1 : 0);
+    }
     if(!config)
       throw Exception("Failed to load Lua configuration.");
 
     Logger::set_implementation(config->logger());
     time(&tm);
     Logger::info() << "Process started at: " << ctime(&tm) << "\n";
-    // Set up output object
-    boost::shared_ptr<Output> output;
-    config->output(output, output_error);
-
-    std::ostringstream tstream;
-    tstream << "\n"
-            << "==============================================\n"
-            << "Setup:\n"
-            << *config->forward_model() << "\n"
-            << "==============================================\n";
-    Logger::info() << tstream.str() << "\n";
-
-    log_timing.write_to_log("Initialization");
-
-    boost::shared_ptr<ConnorSolver> solver = config->solver();
-    // Should have this merge with solver once we get this fully integrated
-    boost::shared_ptr<IterativeSolver> iterative_solver = 
-      config->iterative_solver();
-    if (solver) {
-      solver->add_observer(log_timing);
-
-      boost::shared_ptr<InitialGuess> ig(config->initial_guess());
-      blitz::Array<double, 1> initial_sv(ig->initial_guess());
-      blitz::Array<double, 1> apriori_sv(ig->apriori());
-      blitz::Array<double, 2> apriori_cov(ig->apriori_covariance());
-
-      // Launch solver and iterate till an exit condition is reached
-      bool have_sol = solver->solve(initial_sv, apriori_sv, apriori_cov);
-
-      // Statevector isn't generally set to the final solution by
-      // the Solver, so set it now.
-      config->forward_model()->state_vector()->update_state(solver->x_solution(), 
-                                                            solver->aposteriori_covariance());
-      
-      // Write output file
-      output->write();
-
-      if(have_sol)
-        Logger::info() << "Found solution\n";
-      else
-        Logger::info() << "Failed to find solution\n";
-
-      if(save_test) {        // Backdoor for generating test data.
-        std::ofstream save(save_test_file.c_str());
-        save <<
-          "# This test data was generated by capturing the state of the ConnorSolver\n"
-          "# after a run of l2_fp with the canned data used by \"make l2_fp_run\". You\n"
-          "# can regenerate this by running l2_fp with the \"-t\" option.\n\n";
-        save.precision(24);
-        solver->to_stream(save);
-      }
-    } else if(iterative_solver) {
-      // Note we don't have the setting of apriori and initial guess
-      // like with solver. We want to get that in place, but for now
-      // this gets set in the lua code and can't be changed here.
-      Logger::info() << "SOLVER: A solver from the new solver class hierarchy\n"
-;
-      iterative_solver->solve();
-
-      for( int i=0; i<=iterative_solver->num_accepted_steps(); i++ )
-       Logger::info()
-          << "   ========================================\n"
-          << "   At point[" << i <<"] " 
-	  << iterative_solver->accepted_points()[i] << "\n"
-          << "   Cost[" << i << "] = " 
-	  << iterative_solver->cost_at_accepted_points()[i] << "\n\n";
-
-      boost::shared_ptr<MaxAPosteriori> map = config->max_a_posteriori();
-
-      // Statevector isn't generally set to the final solution by
-      // the Solver, so set it now.
-      config->forward_model()->state_vector()->update_state
-	(map->parameters(), map->a_posteriori_covariance());
-      // Write output file
-      output->write();      
-      
-      if(iterative_solver->status() == IterativeSolver::SUCCESS) 
-	Logger::info() << "Found solution\n";
-      else
-	Logger::info() << "Failed to find solution\n";
-    } else {
-      // Run in forward model only mode if solver does not exist
-      // Only calculate jacobians if they are to be written to 
-      // the output file
-      Logger::info() << "Running forward model only, no retrieval.\n";
-      LuabindObject lua_config = config->lua_state().globals()["config"];
-      bool jac_calc = true;
-      if (not lua_config["write_jacobian"].is_nil())
-        jac_calc = lua_config["write_jacobian"].value<bool>();
-      Spectrum fm_radiance = config->forward_model()->radiance_all(jac_calc);
-
-      // Store the radiance we just calculated into the output product
-      output->register_data_source("/SpectralParameters/modeled_radiance", 
-                                   fm_radiance.spectral_range().data());
-      output->write();
-    }
-
+    run_retrieval(config, log_timing, save_test, save_test_file);
     log_timing.write_to_log("Final");
     time(&tm);
     Logger::info() << "Process ended at: " << ctime(&tm) << "\n";
@@ -16,7 +16,9 @@
 ------------------------------------------------------------
 
 ConfigCommon = { diagnostic = false, input_file_description = "",
-		 wrote_atmsphere_desc = false}
+		 wrote_atmsphere_desc = false,
+		 output_disable = {}, output_enable = {},
+		 output_timing_report = false}
 
 function ConfigCommon:new (o)
    o = o or {}   -- create object if user does not provide one
@@ -25,6 +27,25 @@ function ConfigCommon:new (o)
    return o
 end
 
+------------------------------------------------------------
+--- Objects that depend only on static input files (e.g., the
+--- ABSCO tables) are created through StaticInputRegistry, so
+--- a table gets read once per process and shared by every
+--- band, gas and configuration that uses it. This matters in
+--- particular when l2_fp processes a number of soundings in
+--- batch mode (the -b option).
+---
+--- Only objects that don't depend on the sounding are
+--- shared directly. Things that get attached to the state
+--- vector or depend on the pressure (IlsTableLinear,
+--- AerosolPropertyHdf) get a new object each time that
+--- shares the tables read from the file.
+------------------------------------------------------------
+
+function ConfigCommon.static_hdf_file(fname)
+   return StaticInputRegistry.hdf_file(fname)
+end
+
 ------------------------------------------------------------
 -- Log diagnostic messages if requested.
 ------------------------------------------------------------
@@ -328,6 +349,37 @@ function CreatorMultiSpec:initial_guess(i)
    return ig 
 end
 
+------------------------------------------------------------
+--- Create the OutputManifest used to select the datasets
+--- written out. Returns nil if we write everything.
+---
+--- output_disable lists the datasets to leave out of the
+--- output. These are regular expressions matched against the
+--- dataset name (see OutputManifest), e.g.
+--- { "xco2_gain_vector$", "averaging_kernel" }. Datasets
+--- matching output_enable are written even if they match
+--- output_disable.
+---
+--- If output_timing_report is true, l2_fp also logs the time
+--- spent calculating each output dataset.
+------------------------------------------------------------
+
+function ConfigCommon:create_output_manifest()
+   local disable = self.output_disable or {}
+   local enable = self.output_enable or {}
+   if(#disable == 0 and #enable == 0) then
+      return nil
+   end
+   local m = OutputManifest()
+   for i, p in ipairs(disable) do
+      m:disable(p)
+   end
+   for i, p in ipairs(enable) do
+      m:enable(p)
+   end
+   return m
+end
+
 ------------------------------------------------------------
 --- Overall function for doing configuration
 ------------------------------------------------------------
@@ -372,6 +424,7 @@ function ConfigCommon:do_config()
    number_band = self.spec_win:number_spectrometer()
    iteration_output = self.iteration_output
    register_output = self.register_output
+   output_manifest = self:create_output_manifest()
 end
 
 ------------------------------------------------------------
@@ -380,7 +433,7 @@ end
 
 function ConfigCommon:h()
    if(self.static_file and not self.h_v) then 
-      self.h_v = HdfFile(self.static_file)
+      self.h_v = ConfigCommon.static_hdf_file(self.static_file)
       self.input_file_description = self.input_file_description .. 
 	 "Static input file:   " .. self.static_file .. "\n"
    end   
@@ -395,7 +448,7 @@ function ConfigCommon:h_solar()
    -- Use static_solar_file if found, otherwise use the same static input
    -- file that we use for everything else (self:h()).
    if(self.static_solar_file and not self.h_solar_v) then 
-      self.h_solar_v = HdfFile(self.static_solar_file) 
+      self.h_solar_v = ConfigCommon.static_hdf_file(self.static_solar_file) 
       self.input_file_description = self.input_file_description .. 
 	 "Solar input file:    " .. self.static_solar_file .. "\n"
    end
@@ -409,7 +462,7 @@ function ConfigCommon:h_eof()
    -- Use static_eof_file if found, otherwise use the same static input
    -- file that we use for everything else (self:h()).
    if(self.static_eof_file and not self.h_eof_v) then 
-      self.h_eof_v = HdfFile(self.static_eof_file) 
+      self.h_eof_v = ConfigCommon.static_hdf_file(self.static_eof_file) 
       self.input_file_description = self.input_file_description .. 
 	 "EOF input file:    " .. self.static_eof_file .. "\n"
    end
@@ -442,7 +495,7 @@ function ConfigCommon:h_merra_aerosol()
    -- Use static_aerosol_file if found, otherwise use the same static input
    -- file that we use for everything else (self:h()).
    if(self.static_merra_aerosol_file and not self.h_merra_aerosol_v) then 
-      self.h_merra_aerosol_v = HdfFile(self.static_merra_aerosol_file) 
+      self.h_merra_aerosol_v = ConfigCommon.static_hdf_file(self.static_merra_aerosol_file) 
       self.input_file_description = self.input_file_description .. 
 	 "Merra Aerosol input file:  " .. self.static_merra_aerosol_file .. "\n"
    end
@@ -456,7 +509,7 @@ function ConfigCommon:h_aerosol()
    -- Use static_aerosol_file if found, otherwise use the same static input
    -- file that we use for everything else (self:h()).
    if(self.static_aerosol_file and not self.h_aerosol_v) then 
-      self.h_aerosol_v = HdfFile(self.static_aerosol_file) 
+      self.h_aerosol_v = ConfigCommon.static_hdf_file(self.static_aerosol_file) 
       self.input_file_description = self.input_file_description .. 
 	 "Aerosol input file:  " .. self.static_aerosol_file .. "\n"
    end
@@ -666,7 +719,7 @@ function ConfigCommon.hdf_aerosol_property(aer_group)
                 aer_group = config_name
              end
 
-             return AerosolPropertyHdf(self.config:h_aerosol(), aer_group .. "/Properties", self.config.pressure)
+             return StaticInputRegistry.aerosol_property_hdf(self.config:h_aerosol(), aer_group .. "/Properties", self.config.pressure)
           end
 end
 
@@ -680,10 +733,10 @@ function hdf_aerosol_property_file(fname, aer_group)
              if not aer_group then
                 aer_group = config_name
              end
-	     local h = HdfFile(fname)
+	     local h = StaticInputRegistry.hdf_file(fname)
 	     self.config.input_file_description = self.config.input_file_description ..
 		"Aerosol input file:  " .. fname .. "\n"
-             return AerosolPropertyHdf(h, aer_group .. "/Properties", self.config.pressure)
+             return StaticInputRegistry.aerosol_property_hdf(h, aer_group .. "/Properties", self.config.pressure)
           end
 end      
 
@@ -1046,7 +1099,9 @@ function ConfigCommon.ils_table:create()
    for i=1,self.config.number_pixel:rows() do
       local desc_band_name = self.config.common.desc_band_name:value(i-1)
       local hdf_band_name = self.config.common.hdf_band_name:value(i-1)
-      res[i] = IlsTableLinear(self.config:h(), i - 1, desc_band_name, hdf_band_name, hdf_group)
+      res[i] = StaticInputRegistry.ils_table_linear(self.config:h(), i - 1,
+                                                    desc_band_name,
+                                                    hdf_band_name, hdf_group)
    end
    return res
 end
@@ -1883,8 +1938,8 @@ function ConfigCommon.solar_absorption_table:create()
    local res = {}
    local i
    for i=1,self.config.number_pixel:rows() do
-      res[i] = SolarAbsorptionTable(self.config:h_solar(),
-                                    "/Solar/Absorption/Absorption_" .. i)
+      res[i] = StaticInputRegistry.solar_absorption_table(self.config:h_solar(),
+                           "/Solar/Absorption/Absorption_" .. i)
    end
    return res
 end
@@ -2783,8 +2838,14 @@ function ConfigCommon.aerosol_creator:create_parent_object(sub_object)
       self.vex:push_back(t.extinction)
       self.config.number_aerosol = self.config.number_aerosol + 1
    end
-   return AerosolOptical(self.vex, self.vap, self.config.pressure, 
-			 self.config.relative_humidity)
+   local res = AerosolOptical(self.vex, self.vap, self.config.pressure, 
+			      self.config.relative_humidity)
+   -- Optionally use a table of the aerosol properties, see
+   -- AerosolOptical for details.
+   if(self.table_spacing) then
+      res:table_spacing(self.table_spacing)
+   end
+   return res
 end
 
 function ConfigCommon.aerosol_creator:register_output(ro)
@@ -3081,39 +3142,61 @@ end
 
 function ConfigCommon.open_absco(self, fname, table_scale)
    if(os.getenv("abscodir")) then
-      return AbscoHdf(os.getenv("abscodir") .. "/" .. fname, table_scale)
+      return ConfigCommon.static_absco(os.getenv("abscodir") .. "/" .. fname,
+                                       table_scale)
    end
    local absco
    if(self.absco_local_path and
       pcall(function() absco = 
-               AbscoHdf(self.absco_local_path .. "/" .. fname, 
-			table_scale) end)) then
+               ConfigCommon.static_absco(self.absco_local_path .. "/" .. fname, 
+                                         table_scale) end)) then
       return absco
    end
    if(self.absco_path) then
-      return AbscoHdf(self.absco_path .. "/" .. fname, table_scale)
+      return ConfigCommon.static_absco(self.absco_path .. "/" .. fname, 
+                                       table_scale)
    end
    error({code=-1})
 end
 
+------------------------------------------------------------
+--- Open the AbscoHdf, reusing one we already have open if
+--- possible (see StaticInputRegistry).
+------------------------------------------------------------
+
+function ConfigCommon.static_absco(fname, table_scale)
+   if(table_scale) then
+      return StaticInputRegistry.absco_hdf(fname, table_scale)
+   end
+   return StaticInputRegistry.absco_hdf(fname)
+end
+
+function ConfigCommon.static_absco_byspecindex(fname, sb, table_scale)
+   return StaticInputRegistry.absco_hdf(fname, sb, 
+                               ConfigCommon.to_VectorDouble(table_scale))
+end
+
 ------------------------------------------------------------
 --- Handle when table_scale is an array.
 ------------------------------------------------------------
 
 function ConfigCommon.open_absco_byspecindex(self, fname, sb, table_scale)
-   local tsc = ConfigCommon.to_VectorDouble(table_scale)
    if(os.getenv("abscodir")) then
-      return AbscoHdf(os.getenv("abscodir") .. "/" .. fname, sb, tsc)
+      return ConfigCommon.static_absco_byspecindex(os.getenv("abscodir") .. 
+                                                   "/" .. fname, sb, 
+                                                   table_scale)
    end
    local absco
    if(self.absco_local_path and
       pcall(function() absco = 
-               AbscoHdf(self.absco_local_path .. "/" .. fname, sb, tsc) end)) then
+               ConfigCommon.static_absco_byspecindex(self.absco_local_path .. 
+                                                     "/" .. fname, sb, 
+                                                     table_scale) end)) then
       return absco
    end
    if(self.absco_path) then
-      return AbscoHdf(self.absco_path .. "/" .. fname, sb, 
-		      tsc)
+      return ConfigCommon.static_absco_byspecindex(self.absco_path .. "/" .. 
+                                                   fname, sb, table_scale)
    end
    error({code=-1})
 end
@@ -3537,6 +3620,25 @@ function ConfigCommon.nonuniform_spectrum_sampling:create()
                                      uspec_samp)
 end
 
+------------------------------------------------------------
+--- Adaptive spectral sampling. This picks a subset of the
+--- uniform high resolution grid based on the optical depth
+--- of the atmosphere.
+---
+--- Optional values:
+---  self.tolerance (default 1e-4)
+---  self.max_spacing_fraction (default 0.5)
+------------------------------------------------------------
+
+ConfigCommon.adaptive_spectrum_sampling = ConfigCommon.spectrum_sampling_base:new()
+
+function ConfigCommon.adaptive_spectrum_sampling:create()
+   local uspec_samp = SpectrumSamplingFixedSpacing(self:high_res_spacing())
+   return AdaptiveSpectrumSampling(self.config.atmosphere, uspec_samp,
+                                   self.tolerance or 1e-4,
+                                   self.max_spacing_fraction or 0.5)
+end
+
 
 ------------------------------------------------------------
 -- Create Stokes coefficient as constant values (not dependent
@@ -3627,6 +3729,16 @@ end
 ConfigCommon.radiative_transfer_lsi = RtCreator:new()
 
 function ConfigCommon.radiative_transfer_lsi:create()
+   local rt_low, rt_high = self:low_high_stream_rt()
+   return LsiRt.create(rt_low, rt_high, self.config:h(), "LSI")
+end
+
+------------------------------------------------------------
+--- Create the low and high stream RT used by the LSI (or
+--- other corrections such as PCA).
+------------------------------------------------------------
+
+function ConfigCommon.radiative_transfer_lsi:low_high_stream_rt()
    local sza = self.config.l1b:sza()
    local azm = self.config.l1b:azm()
    local zen = self.config.l1b:zen()
@@ -3674,7 +3786,22 @@ function ConfigCommon.radiative_transfer_lsi:create()
    rt_high = LRadRt.create(rt_high, self.config:spectral_bound(), 
                                sza, zen, azm, pure_nadir, true, true)
    rt_high = HresWrapper.create(rt_high)
-   return LsiRt.create(rt_low, rt_high, self.config:h(), "LSI")
+   return rt_low, rt_high
+end
+
+------------------------------------------------------------
+--- Same as radiative_transfer_lsi, but using a PCA based
+--- correction in place of the LSI. This uses the same
+--- lsi_constant values, and optionally:
+---   self.number_eof (default 4)
+------------------------------------------------------------
+
+ConfigCommon.radiative_transfer_pca = ConfigCommon.radiative_transfer_lsi:new()
+
+function ConfigCommon.radiative_transfer_pca:create()
+   local rt_low, rt_high = self:low_high_stream_rt()
+   return PcaRt.create(rt_low, rt_high, self.config:h(), "LSI",
+                       self.number_eof or 4)
 end
 
 ------------------------------------------------------------
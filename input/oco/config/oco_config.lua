@@ -117,6 +117,12 @@ end
 
 ------------------------------------------------------------
 --- Create a level 1b file were we read it from a HDF file.
+---
+--- If preload_number_frame is set, we read that many frames at a
+--- time through a Level1bOcoPreload. This is kept in a global
+--- variable, so when we process a number of soundings in the same
+--- process (l2_fp -b) the following soundings in the range don't
+--- need to read the file again.
 ------------------------------------------------------------
 
 OcoConfig.level1b_hdf = CreatorL1b:new()
@@ -124,7 +130,16 @@ OcoConfig.level1b_hdf = CreatorL1b:new()
 function OcoConfig.level1b_hdf:create_parent_object()
    local hv = self.config:l1b_hdf_file()
    local sid = self.config:l1b_sid_list()
-   l1b_oco = Level1bOco(hv, sid)
+   if(self.preload_number_frame) then
+      if(not level_1b_oco_preload or 
+         not level_1b_oco_preload:contains(self.config.spectrum_file, sid)) then
+         level_1b_oco_preload = Level1bOcoPreload(hv, sid, 
+                                                  self.preload_number_frame)
+      end
+      l1b_oco = Level1bOco(level_1b_oco_preload, sid)
+   else
+      l1b_oco = Level1bOco(hv, sid)
+   end
    l1b_oco.noise_model = self.config.noise
    return l1b_oco
 end
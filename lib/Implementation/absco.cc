@@ -11,6 +11,49 @@ REGISTER_LUA_DERIVED_CLASS(Absco, GasAbsorption)
 REGISTER_LUA_END()
 #endif
 
+/// @cond
+namespace {
+// This gives a quantized table the same Table(i, j, k) interface as
+// the float and double tables, so we can use the same interpolation
+// code. We dequantize each entry as we use it, so we only touch the
+// 16 bit data in memory.
+class AbscoQuantizedTable {
+public:
+  AbscoQuantizedTable(const Array<unsigned short, 3>& Data,
+		      const Array<double, 1>& Log_offset,
+		      const Array<double, 1>& Log_scale)
+    : data(Data), log_offset(Log_offset), log_scale(Log_scale) {}
+  double operator()(int i, int j, int k) const
+  { return Absco::dequantize(data(i, j, k), log_offset(i), log_scale(i)); }
+private:
+  const Array<unsigned short, 3>& data;
+  const Array<double, 1>& log_offset;
+  const Array<double, 1>& log_scale;
+};
+}
+/// @endcond
+
+//-----------------------------------------------------------------------
+/// Return the quantized data for the record for the given wave
+/// number (see read for which record this is). Data is
+/// number_layer() x number_temperature() x
+/// max(number_broadener_vmr(), 1), and Log_offset and Log_scale are
+/// number_layer() in size. The absorption cross section (before
+/// applying table_scale) is
+/// dequantize(Data(i, j, k), Log_offset(i), Log_scale(i)).
+///
+/// This is only available if is_quantized() is true. The returned
+/// arrays may point to internal storage, so they should be used
+/// before the next read.
+//-----------------------------------------------------------------------
+
+void Absco::read_quantized(double wn, Array<unsigned short, 3>& Data,
+			   Array<double, 1>& Log_offset,
+			   Array<double, 1>& Log_scale) const
+{
+  throw Exception("This Absco doesn't have quantized data");
+}
+
 //-----------------------------------------------------------------------
 /// Find interpolation factor in sorted array.
 //-----------------------------------------------------------------------
@@ -174,10 +217,10 @@ AbscoInterpolator::AbscoInterpolator
   }
 }
 
-template<class T> Array<double, 1> 
-AbscoInterpolator::absorption_cross_section_noderiv_calc(double wn) const
+template<class A> Array<double, 1> 
+AbscoInterpolator::absorption_cross_section_noderiv_calc
+(const A& a, double wn) const
 {
-  Array<T, 3> a(absco->read<T>(wn));
   for(int i = 0; i < res.rows(); ++i) {
     double t11 = a(ip(i), itp1(i), ib(i)) * (1 - ftp1(i)) + 
       a(ip(i), itp1(i) + 1, ib(i)) * ftp1(i);
@@ -196,9 +239,6 @@ AbscoInterpolator::absorption_cross_section_noderiv_calc(double wn) const
   return res.value();
 }
 
-template  Array<double, 1> AbscoInterpolator::absorption_cross_section_noderiv_calc<double>(double wn) const;
-template  Array<double, 1> AbscoInterpolator::absorption_cross_section_noderiv_calc<float>(double wn) const;
-
 //-----------------------------------------------------------------------
 /// Return absorption cross section, without derivatives.
 /// \param wn wave number
@@ -208,17 +248,23 @@ template  Array<double, 1> AbscoInterpolator::absorption_cross_section_noderiv_c
 Array<double, 1> AbscoInterpolator::absorption_cross_section_noderiv
 (double wn) const
 {
+  if(absco->is_quantized()) {
+    Array<unsigned short, 3> q;
+    Array<double, 1> log_offset, log_scale;
+    absco->read_quantized(wn, q, log_offset, log_scale);
+    return absorption_cross_section_noderiv_calc
+      (AbscoQuantizedTable(q, log_offset, log_scale), wn);
+  }
   if(absco->is_float())
-    return absorption_cross_section_noderiv_calc<float>(wn);
+    return absorption_cross_section_noderiv_calc(absco->read<float>(wn), wn);
   else
-    return absorption_cross_section_noderiv_calc<double>(wn);
+    return absorption_cross_section_noderiv_calc(absco->read<double>(wn), wn);
 }
 
-template<class T> ArrayAd<double, 1> 
-AbscoInterpolator::absorption_cross_section_deriv_calc(double wn) const
+template<class A> ArrayAd<double, 1> 
+AbscoInterpolator::absorption_cross_section_deriv_calc
+(const A& a, double wn) const
 {
-  Range ra(Range::all());
-  Array<T, 3> a(absco->read<T>(wn));
   // Turns out that jacobian calculation is faster if we use pointers. 
   // This is *not* true for things like itp1(i), the speed is the same 
   // (for gcc 4.6, -O2), so we leave these with the clearer expression.
@@ -273,9 +319,6 @@ AbscoInterpolator::absorption_cross_section_deriv_calc(double wn) const
   return res;
 }
 
-template  ArrayAd<double, 1> AbscoInterpolator::absorption_cross_section_deriv_calc<double>(double wn) const;
-template  ArrayAd<double, 1> AbscoInterpolator::absorption_cross_section_deriv_calc<float>(double wn) const;
-
 //-----------------------------------------------------------------------
 /// Return absorption cross section, with derivatives.
 /// \param wn wave number
@@ -285,8 +328,15 @@ template  ArrayAd<double, 1> AbscoInterpolator::absorption_cross_section_deriv_c
 ArrayAd<double, 1> AbscoInterpolator::absorption_cross_section_deriv
 (double wn) const
 {
+  if(absco->is_quantized()) {
+    Array<unsigned short, 3> q;
+    Array<double, 1> log_offset, log_scale;
+    absco->read_quantized(wn, q, log_offset, log_scale);
+    return absorption_cross_section_deriv_calc
+      (AbscoQuantizedTable(q, log_offset, log_scale), wn);
+  }
   if(absco->is_float())
-    return absorption_cross_section_deriv_calc<float>(wn);
+    return absorption_cross_section_deriv_calc(absco->read<float>(wn), wn);
   else
-    return absorption_cross_section_deriv_calc<double>(wn);
+    return absorption_cross_section_deriv_calc(absco->read<double>(wn), wn);
 }
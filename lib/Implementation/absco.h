@@ -6,6 +6,7 @@
 #include "null_deleter.h"
 #include <boost/any.hpp>
 #include <vector>
+#include <cmath>
 
 namespace FullPhysics {
 class Absco;
@@ -31,10 +32,10 @@ public:
 private:
   double interpol(double X, const std::vector<double>& Xv, 
 		  int& i, double& df_dx) const;
-  template<class T> blitz::Array<double, 1> 
-  absorption_cross_section_noderiv_calc(double wn) const;
-  template<class T> ArrayAd<double, 1> 
-  absorption_cross_section_deriv_calc(double wn) const;
+  template<class A> blitz::Array<double, 1> 
+  absorption_cross_section_noderiv_calc(const A& Table, double wn) const;
+  template<class A> ArrayAd<double, 1> 
+  absorption_cross_section_deriv_calc(const A& Table, double wn) const;
   boost::shared_ptr<Absco> absco;
   blitz::Array<double, 1> p;     // This is in Pascals
   ArrayAd<double, 1> t;		// This is in K
@@ -137,6 +138,32 @@ public:
 
   virtual bool is_float() const = 0;
 
+//-----------------------------------------------------------------------
+/// Some Absco tables are stored in a reduced precision form, as 16
+/// bit integers giving the log of the absorption cross section with
+/// an offset and scale for each wavenumber and pressure (see
+/// dequantize). This reduces the memory, and more importantly the
+/// memory bandwidth, we need for the tables by a factor of 2 over
+/// float.
+///
+/// If this is true, AbscoInterpolator uses read_quantized and
+/// converts only the table entries it actually interpolates. The
+/// read<T> functions still work, returning the full dequantized
+/// table.
+//-----------------------------------------------------------------------
+
+  virtual bool is_quantized() const { return false; }
+
+//-----------------------------------------------------------------------
+/// Convert a quantized table entry to the absorption cross section.
+/// A value of 0 is reserved for a cross section of 0 (or one too
+/// small to matter).
+//-----------------------------------------------------------------------
+
+  static double dequantize(unsigned short Q, double Log_offset,
+			   double Log_scale)
+  { return (Q == 0 ? 0.0 : std::exp(Log_offset + Log_scale * Q)); }
+
 //-----------------------------------------------------------------------
 /// Read the record for the highest wavenumber that is less than or
 /// equal to given wave number. The value returned in number_layer() x
@@ -165,6 +192,9 @@ protected:
 
   virtual blitz::Array<double, 3> read_double(double wn) const = 0;
   virtual blitz::Array<float, 3> read_float(double wn) const = 0;
+  virtual void read_quantized(double wn, blitz::Array<unsigned short, 3>& Data,
+			      blitz::Array<double, 1>& Log_offset,
+			      blitz::Array<double, 1>& Log_scale) const;
 private:
   double interpol(double X, const std::vector<double>& Xv, 
 		  int& i, double& df_dx) const;
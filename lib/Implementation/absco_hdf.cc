@@ -1,5 +1,6 @@
 #include "absco_hdf.h"
 #include "fp_exception.h"
+#include "profiler.h"
 #include <iomanip>
 using namespace FullPhysics;
 using namespace blitz;
@@ -107,10 +108,15 @@ void AbscoHdf::load_file(const std::string& Fname,
   cache_double_ubound = 0;
   cache_float_lbound = 0;
   cache_float_ubound = 0;
+  cache_quantized_lbound = 0;
+  cache_quantized_ubound = 0;
 
   // Reset caches
   read_cache_float.resize(0,0,0,0);
   read_cache_double.resize(0,0,0,0);
+  read_cache_quantized.resize(0,0,0,0);
+  read_cache_log_offset.resize(0,0);
+  read_cache_log_scale.resize(0,0);
 
   hfile.reset(new HdfFile(Fname));
   pgrid.reference(hfile->read_field<double, 1>("Pressure"));
@@ -122,10 +128,17 @@ void AbscoHdf::load_file(const std::string& Fname,
   // second one ends at the first "\0".
   std::string t = hfile->read_field<std::string>("Gas_Index");
   field_name = std::string("Gas_") + t.c_str() + "_Absorption";
-  // Determine if data is float or double. We use this to optimize the
-  // read. 
+  // Determine if data is float, double, or quantized. We use this to
+  // optimize the read. 
   H5::DataSet d = hfile->h5_file().openDataSet(field_name);
-  if(d.getDataType().getSize() == 4)
+  is_quantized_ = (d.getTypeClass() == H5T_INTEGER);
+  if(is_quantized_ && d.getDataType().getSize() != 2) {
+    Exception e;
+    e << "Quantized ABSCO data should be 16 bit integers. File " << Fname
+      << " has a size of " << d.getDataType().getSize() << " bytes";
+    throw e;
+  }
+  if(!is_quantized_ && d.getDataType().getSize() == 4)
     is_float_ = true;
   else
     is_float_ = false;
@@ -206,6 +219,8 @@ int AbscoHdf::wn_index(double Wn_in) const
 // See base class for description
 Array<double, 3> AbscoHdf::read_double(double Wn_in) const
 {
+  if(is_quantized_)
+    return read_dequantized<double>(Wn_in);
   int wi = wn_index(Wn_in);
   if(wi < cache_double_lbound ||
      wi >= cache_double_ubound)
@@ -217,6 +232,8 @@ Array<double, 3> AbscoHdf::read_double(double Wn_in) const
 // See base class for description
 Array<float, 3> AbscoHdf::read_float(double Wn_in) const
 {
+  if(is_quantized_)
+    return read_dequantized<float>(Wn_in);
   int wi = wn_index(Wn_in);
   if(wi < cache_float_lbound ||
      wi >= cache_float_ubound)
@@ -225,6 +242,45 @@ Array<float, 3> AbscoHdf::read_float(double Wn_in) const
                              wi - cache_float_lbound);
 }
 
+// See base class for description
+void AbscoHdf::read_quantized(double Wn_in, Array<unsigned short, 3>& Data,
+			      Array<double, 1>& Log_offset,
+			      Array<double, 1>& Log_scale) const
+{
+  if(!is_quantized_)
+    throw Exception("AbscoHdf file " + hfile->file_name() + 
+		    " doesn't have quantized data");
+  int wi = wn_index(Wn_in);
+  if(wi < cache_quantized_lbound ||
+     wi >= cache_quantized_ubound)
+    swap<unsigned short>(wi);
+  Range ra(Range::all());
+  Data.reference(read_cache<unsigned short>()(ra, ra, ra, 
+					      wi - cache_quantized_lbound));
+  Log_offset.reference(read_cache_log_offset(ra, wi - cache_quantized_lbound));
+  Log_scale.reference(read_cache_log_scale(ra, wi - cache_quantized_lbound));
+}
+
+//-----------------------------------------------------------------------
+/// Return the full table for a quantized file, converted to the given
+/// type. This is used by read_double and read_float; the
+/// AbscoInterpolator instead uses read_quantized directly and only
+/// converts the entries it needs.
+//-----------------------------------------------------------------------
+
+template<class T> Array<T, 3> AbscoHdf::read_dequantized(double Wn_in) const
+{
+  Array<unsigned short, 3> q;
+  Array<double, 1> log_offset, log_scale;
+  read_quantized(Wn_in, q, log_offset, log_scale);
+  Array<T, 3> res(q.shape());
+  for(int i = 0; i < res.extent(firstDim); ++i)
+    for(int j = 0; j < res.extent(secondDim); ++j)
+      for(int k = 0; k < res.extent(thirdDim); ++k)
+	res(i, j, k) = (T) dequantize(q(i, j, k), log_offset(i), log_scale(i));
+  return res;
+}
+
 //-----------------------------------------------------------------------
 /// Make sure the row i is found in the read_cache, possibly reading
 /// data if it isn't found.
@@ -232,6 +288,7 @@ Array<float, 3> AbscoHdf::read_float(double Wn_in) const
 
 template<class T> void AbscoHdf::swap(int i) const
 {
+  FP_PROFILE_SCOPE("AbscoHdf read");
   // First time through, set up space for cache.
  if(read_cache<T>().extent(fourthDim) == 0)
       read_cache<T>().resize(tgrid.rows(), tgrid.cols(), 
@@ -258,12 +315,30 @@ template<class T> void AbscoHdf::swap(int i) const
     read_cache<T>()(Range::all(), Range::all(), 0, Range(0, size(3) - 1)) =
       hfile->read_field<T, 3>(field_name, start2, size2);
   }
+  // Quantized data also has the offset and scale for each pressure
+  // and wavenumber.
+  if(is_quantized_) {
+    if(read_cache_log_offset.cols() != nl) {
+      read_cache_log_offset.resize(tgrid.rows(), nl);
+      read_cache_log_scale.resize(tgrid.rows(), nl);
+    }
+    TinyVector<int, 2> start2, size2;
+    start2 = 0, start(3);
+    size2 = tgrid.rows(), size(3);
+    Range r(0, size(3) - 1);
+    read_cache_log_offset(Range::all(), r) =
+      hfile->read_field<double, 2>(field_name + "_Log_Offset", start2, size2);
+    read_cache_log_scale(Range::all(), r) =
+      hfile->read_field<double, 2>(field_name + "_Log_Scale", start2, size2);
+  }
 }
 
 void AbscoHdf::print(std::ostream& Os) const
 {
   Os << "AbscoHdf" << "\n"
      << "  File name:    " << hfile->file_name() << "\n";
+  if(is_quantized_)
+    Os << "  Quantized:    true\n";
   if(sb.number_spectrometer() ==0)
     Os << "  Scale factor: " << table_scale_[0] << "\n";
   else {
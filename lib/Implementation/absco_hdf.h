@@ -16,6 +16,13 @@ namespace FullPhysics {
   default cache is about 50 MB, which is a bit large but not too
   large. This can be adjusted if needed, either up for better
   performance or down for less memory.
+
+  In addition to float and double tables, we support the reduced
+  precision tables written by absco_quantize.py. These store the
+  absorption as 16 bit unsigned integers, with the datasets
+  Gas_XX_Absorption_Log_Offset and Gas_XX_Absorption_Log_Scale giving
+  the offset and scale of the log of the absorption for each pressure
+  and wavenumber (see Absco::dequantize).
 *******************************************************************/
 class AbscoHdf: public Absco {
 public:
@@ -41,13 +48,17 @@ public:
   virtual blitz::Array<double, 2> temperature_grid() const {return tgrid;}
   virtual bool have_data(double wn) const;
   virtual bool is_float() const { return is_float_;}
+  virtual bool is_quantized() const { return is_quantized_;}
   virtual std::string file_name() const { return hfile->file_name(); } 
   virtual void print(std::ostream& Os) const;
 protected:
   virtual blitz::Array<double, 3> read_double(double wn) const;
   virtual blitz::Array<float, 3> read_float(double wn) const;
+  virtual void read_quantized(double wn, blitz::Array<unsigned short, 3>& Data,
+			      blitz::Array<double, 1>& Log_offset,
+			      blitz::Array<double, 1>& Log_scale) const;
 private:
-  bool is_float_;
+  bool is_float_, is_quantized_;
   int cache_nline;
   blitz::Array<double, 1> bvmr;
   boost::shared_ptr<HdfFile> hfile;
@@ -55,9 +66,15 @@ private:
   mutable int cache_double_ubound;
   mutable int cache_float_lbound;
   mutable int cache_float_ubound;
+  mutable int cache_quantized_lbound;
+  mutable int cache_quantized_ubound;
   template<class T> void bound_set(int lbound, int sz) const;
   mutable blitz::Array<double, 4> read_cache_double;
   mutable blitz::Array<float, 4> read_cache_float;
+  mutable blitz::Array<unsigned short, 4> read_cache_quantized;
+  mutable blitz::Array<double, 2> read_cache_log_offset;
+  mutable blitz::Array<double, 2> read_cache_log_scale;
+  template<class T> blitz::Array<T, 3> read_dequantized(double wn) const;
   template<class T> blitz::Array<T, 4>& read_cache() const;
   template<class T> void swap(int i) const;
   int wn_index(double Wn_in) const;
@@ -79,6 +96,10 @@ template<> inline blitz::Array<double, 4>& AbscoHdf::read_cache<double>() const
 template<> inline blitz::Array<float, 4>& AbscoHdf::read_cache<float>() const
 { return read_cache_float; }
 
+template<> inline blitz::Array<unsigned short, 4>& 
+AbscoHdf::read_cache<unsigned short>() const
+{ return read_cache_quantized; }
+
 template<> inline void AbscoHdf::bound_set<double>(int lbound, int sz) const
 {
   cache_double_lbound = lbound;
@@ -91,5 +112,11 @@ template<> inline void AbscoHdf::bound_set<float>(int lbound, int sz) const
   cache_float_ubound = lbound + sz;
 }
 
+template<> inline void AbscoHdf::bound_set<unsigned short>(int lbound, int sz) const
+{
+  cache_quantized_lbound = lbound;
+  cache_quantized_ubound = lbound + sz;
+}
+
 }
 #endif
@@ -3,6 +3,7 @@
 #include "ifstream_cs.h"
 #include "heritage_file.h"
 #include "spectral_bound.h"
+#include "hdf_file.h"
 #include <boost/timer.hpp>
 
 using namespace FullPhysics;
@@ -210,4 +211,90 @@ BOOST_AUTO_TEST_CASE(cache_boundary)
   BOOST_CHECK_CLOSE(data(0,0, 0), 2.5300142872229016e-33, 1e-8);
 }
 
+BOOST_AUTO_TEST_CASE(quantized)
+{
+  // Create a small quantized table from part of the O2 table, using the
+  // same encoding as absco_quantize.py.
+  std::string fname = "absco_hdf_quantized.hdf";
+  add_file_to_cleanup(fname);
+  {
+    HdfFile fin(absco_data_dir() + "/o2_v3.3.0-lowres.hdf");
+    HdfFile fout(fname, HdfFile::CREATE);
+    Array<double, 1> wn = fin.read_field<double, 1>("Wavenumber");
+    int wstart = 0;
+    while(wn(wstart) < 12929.94 - 0.1)
+      ++wstart;
+    // Start a little before, so 12929.94 isn't at the edge of the table.
+    wstart = std::max(wstart - 2, 0);
+    int nwn = 20;
+    Array<double, 1> pgrid = fin.read_field<double, 1>("Pressure");
+    Array<double, 2> tgrid = fin.read_field<double, 2>("Temperature");
+    std::string gindex = fin.read_field<std::string>("Gas_Index");
+    gindex = gindex.c_str();
+    std::string field_name = "Gas_" + gindex + "_Absorption";
+    TinyVector<int, 3> start, size;
+    start = 0, 0, wstart;
+    size = tgrid.rows(), tgrid.cols(), nwn;
+    Array<double, 3> a = fin.read_field<double, 3>(field_name, start, size);
+    Array<unsigned short, 3> q(a.shape());
+    Array<double, 2> log_offset(a.rows(), nwn), log_scale(a.rows(), nwn);
+    for(int i = 0; i < a.rows(); ++i)
+      for(int k = 0; k < nwn; ++k) {
+	double lmin = 1e300, lmax = -1e300;
+	for(int j = 0; j < a.cols(); ++j)
+	  if(a(i, j, k) > 0) {
+	    lmin = std::min(lmin, log(a(i, j, k)));
+	    lmax = std::max(lmax, log(a(i, j, k)));
+	  }
+	if(lmin > lmax)
+	  lmin = lmax = 0;
+	log_scale(i, k) = (lmax - lmin) / 65534;
+	log_offset(i, k) = lmin - log_scale(i, k);
+	for(int j = 0; j < a.cols(); ++j) {
+	  if(a(i, j, k) <= 0)
+	    q(i, j, k) = 0;
+	  else if(log_scale(i, k) == 0)
+	    q(i, j, k) = 1;
+	  else
+	    q(i, j, k) = (unsigned short) 
+	      (floor((log(a(i, j, k)) - lmin) / log_scale(i, k) + 0.5) + 1);
+	}
+      }
+    fout.write_field("Pressure", pgrid);
+    fout.write_field("Temperature", tgrid);
+    Array<double, 1> wnsub(wn(Range(wstart, wstart + nwn - 1)));
+    fout.write_field("Wavenumber", wnsub);
+    fout.write_field("Gas_Index", gindex);
+    fout.write_field(field_name, q);
+    fout.write_field(field_name + "_Log_Offset", log_offset);
+    fout.write_field(field_name + "_Log_Scale", log_scale);
+  }
+  AbscoHdf f(absco_data_dir() + "/o2_v3.3.0-lowres.hdf");
+  AbscoHdf fq(fname);
+  BOOST_CHECK(fq.is_quantized());
+  BOOST_CHECK(!fq.is_float());
+  BOOST_CHECK(!f.is_quantized());
+  Array<double, 3> dexpect(f.read<double>(12929.94));
+  Array<double, 3> d(fq.read<double>(12929.94));
+  BOOST_CHECK(max(abs(d - dexpect)) < 1e-4 * max(abs(dexpect)));
+  // Quantization error is well under 1e-4 relative, so a tolerance of
+  // 0.01% is plenty.
+  DoubleWithUnit pv(12250.0, units::Pa);
+  DoubleWithUnit tv(190.0, units::K);
+  DoubleWithUnit bv(0, units::dimensionless);
+  BOOST_CHECK_CLOSE(fq.absorption_cross_section(12929.94, pv, tv, bv).value,
+		    f.absorption_cross_section(12929.94, pv, tv, bv).value,
+		    1e-2);
+  AutoDerivativeWithUnit<double>
+    tvd(AutoDerivative<double>(190.0, 0, 1), units::K);
+  AutoDerivativeWithUnit<double>
+    bvd(AutoDerivative<double>(0.0), units::dimensionless);
+  AutoDerivative<double> absv = 
+    f.absorption_cross_section(12929.94, pv, tvd, bvd).value;
+  AutoDerivative<double> absvq = 
+    fq.absorption_cross_section(12929.94, pv, tvd, bvd).value;
+  BOOST_CHECK_CLOSE(absvq.value(), absv.value(), 1e-2);
+  BOOST_CHECK_CLOSE(absvq.gradient()(0), absv.gradient()(0), 1e-1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -4,8 +4,10 @@
 #include "old_constant.h"
 #include "ostream_pad.h"
 #include "absco.h"
+#include "profiler.h"
 #include <boost/lexical_cast.hpp>
 #include <boost/bind.hpp>
+#include <algorithm>
 using namespace FullPhysics;
 using namespace blitz;
 inline double sqr(double x) {return x * x;}
@@ -29,6 +31,46 @@ REGISTER_LUA_DERIVED_CLASS(AbsorberAbsco, Absorber)
 REGISTER_LUA_END()
 #endif
 
+/// @cond
+namespace {
+//-----------------------------------------------------------------------
+// Add sum over sublayers of Avjac(s, k) * Wpiv(s) to Jac(Col[k]). 
+// Avjac is Nsub x N, in C order. This version has a fixed number of
+// columns, so the sums can be kept in registers.
+//-----------------------------------------------------------------------
+
+template<int N> inline void add_absco_jac
+(const double* Avjac, const double* Wpiv, int Nsub, 
+ const std::vector<int>& Col, double* Jac)
+{
+  double t[N];
+  for(int k = 0; k < N; ++k)
+    t[k] = 0;
+  for(int s = 0; s < Nsub; ++s, Avjac += N)
+    for(int k = 0; k < N; ++k)
+      t[k] += Avjac[k] * Wpiv[s];
+  for(int k = 0; k < N; ++k)
+    Jac[Col[k]] += t[k];
+}
+
+//-----------------------------------------------------------------------
+// Same thing, for any number of columns.
+//-----------------------------------------------------------------------
+
+inline void add_absco_jac
+(const double* Avjac, const double* Wpiv, int Nsub, int Nabs,
+ const std::vector<int>& Col, double* Jac)
+{
+  for(int k = 0; k < Nabs; ++k) {
+    double t = 0;
+    for(int s = 0; s < Nsub; ++s)
+      t += Avjac[s * Nabs + k] * Wpiv[s];
+    Jac[Col[k]] += t;
+  }
+}
+}
+/// @endcond
+
 //----------------------------------------------------------------
 /// This is the portion of the optical depth calculation integrand
 /// that is independent on the wave number. We separate this out
@@ -297,6 +339,7 @@ void AbsorberAbsco::fill_tau_gas_cache() const
 {
   if(!cache_tau_gas_stale)
     return;
+  FP_PROFILE_SCOPE("AbsorberAbsco fill_tau_gas_cache");
   
   firstIndex i1; secondIndex i2; thirdIndex i3;
   Range ra(Range::all());
@@ -321,9 +364,12 @@ void AbsorberAbsco::fill_tau_gas_cache() const
     reference(ArrayAd<double, 3>(integrand_independent_wn_sub_t));
 
   // The integrand tends to be fairly sparse. Set up the nonzero
-  // columns and compress jacobian for each layer.
+  // columns and compress jacobian for each layer. We also apply the
+  // weight for each sublayer here, so tau_gas_der and tau_gas_nder
+  // don't need to do this for every wavenumber.
   integrand_nonzero_column.clear();
-  integrand_jac.clear();
+  integrand_weighted.clear();
+  integrand_jac_weighted.clear();
   for(int i = 0; i < number_layer(); ++i) {
     Range r = layer_range[i];
     ArrayAd<double, 3> piv(integrand_independent_wn_sub.value(ra, ra,r));
@@ -334,14 +380,18 @@ void AbsorberAbsco::fill_tau_gas_cache() const
       if(mv > 1e-20)
 	nz.push_back(j);
     }
+    Array<double, 3> iw(jac.rows(), jac.cols(), jac.depth());
+    iw = piv.value() * weight[i].value(i3);
     int k = 0;
-    Array<double, 4> ijac(jac.rows(), jac.cols(), jac.depth(), (int) nz.size());
+    Array<double, 4> ijac(jac.rows(), jac.cols(), (int) nz.size(), 
+			  jac.depth());
     BOOST_FOREACH(int m, nz) {
-      ijac(ra, ra, ra, k) = jac(ra,ra,ra,m);
+      ijac(ra, ra, k, ra) = jac(ra,ra,ra,m) * weight[i].value(i3);
       ++k;
     }
     integrand_nonzero_column.push_back(nz);
-    integrand_jac.push_back(ijac);
+    integrand_weighted.push_back(iw);
+    integrand_jac_weighted.push_back(ijac);
   }
 
   // Set up Absco interpolator for our sublayers
@@ -408,6 +458,26 @@ void AbsorberAbsco::fill_tau_gas_cache() const
 	      std::max(integrand_independent_wn_sub.number_variable(),
 		       tsub.number_variable()));
   taug.jacobian() = 0;
+
+  // The only columns of taug that can be nonzero are the ones we
+  // fill in tau_gas_der. Record this, so code using taug can skip
+  // the rest of the state vector.
+  if(!taug.is_constant()) {
+    std::vector<int> col(absco_nonzero_column);
+    for(int i = 0; i < number_layer(); ++i) {
+      col.insert(col.end(), pressure_nonzero_column[i].begin(),
+		 pressure_nonzero_column[i].end());
+      col.insert(col.end(), integrand_nonzero_column[i].begin(),
+		 integrand_nonzero_column[i].end());
+    }
+    std::sort(col.begin(), col.end());
+    col.erase(std::unique(col.begin(), col.end()), col.end());
+    boost::shared_ptr<JacobianColumnGroup> 
+      g(new JacobianColumnGroup(taug.cols(), taug.number_variable()));
+    for(int i = 0; i < taug.cols(); ++i)
+      g->add(i, col);
+    taug.column_group(g);
+  }
   cache_tau_gas_stale = false;
 }
 
@@ -445,11 +515,16 @@ AbsorberAbsco::tau_gas_nder(double wn, int spec_index) const
     if(gas_absorption[i]->have_data(wn)) {
       Array<double, 1> abcsub = 
 	absco_interp[i]->absorption_cross_section_noderiv(wn);
+      // AbscoInterpolator returns a contiguous array.
+      const double* av_all = abcsub.data();
       for(int j = 0; j < taug.rows(); ++j) {
-        Range r = layer_range[j];
-        Array<double, 1> av(abcsub(r));
-        Array<double, 1> piv(integrand_independent_wn_sub.value.value()(spec_index,i,r));
-        taug.value()(j, i) = sum(av * piv * weight[j].value);
+	int ns = layer_range[j].length();
+	const double* av = av_all + layer_range[j].first();
+	const double* wpiv = &integrand_weighted[j](spec_index, i, 0);
+	double v = 0;
+	for(int s = 0; s < ns; ++s)
+	  v += av[s] * wpiv[s];
+        taug.value()(j, i) = v;
       }
     } else
       for(int j =0; j < taug.rows(); ++j) {
@@ -488,46 +563,65 @@ AbsorberAbsco::tau_gas_der(double wn, int spec_index) const
   // profiling a l2_fp run).
   //----------------------------------------------------------------
 
-  // Temporary, if this works we can cache this
-  ArrayAdWithUnit<double, 1> pgrid(press->pressure_grid().convert(Unit("Pa")));
-
+  // We walk through the sublayers of each layer once, accumulating
+  // the value and the Jacobian directly into taug. Note that taug and
+  // the arrays returned by AbscoInterpolator are contiguous, in C
+  // order, so we can use pointers here.
+  int nabs = (int) absco_nonzero_column.size();
+  int nvar = taug.number_variable();
+  const Array<double, 3>& piv = integrand_independent_wn_sub.value.value();
   for(int i = 0; i < taug.cols(); ++i)
     if(gas_absorption[i]->have_data(wn)) {
       ArrayAd<double, 1> abcsub = 
 	absco_interp[i]->absorption_cross_section_deriv(wn);
+      const double* av_all = abcsub.value().data();
+      // Jacobian is compressed to absco_nonzero_column
+      const double* avjac_all = abcsub.jacobian().data();
       for(int j = 0; j < taug.rows(); ++j) {
-        Range r = layer_range[j];
-        ArrayAd<double, 1> av(abcsub(r));
-        Array<double, 1> piv(integrand_independent_wn_sub.value(spec_index,i,r).value());
-	Array<double, 1> jacv(taug.jacobian()(j, i, Range::all()));
-	taug.value()(j, i) = sum(av.value() * piv * weight[j].value);
+	int s0 = layer_range[j].first();
+	int ns = layer_range[j].length();
+	const double* av = av_all + s0;
+	const double* wpiv = &integrand_weighted[j](spec_index, i, 0);
+	double* jacv = taug.jacobian().data() + (j * taug.cols() + i) * nvar;
+	double v = 0;
+	for(int s = 0; s < ns; ++s)
+	  v += av[s] * wpiv[s];
+	taug.value()(j, i) = v;
 
 	// Zero out taug so we can add in the jacobian. Note that the 
         // rest of the Jacobian is already zero from when we sized it.
-	BOOST_FOREACH(int m, pressure_nonzero_column[j])
-	  jacv(m) = 0;
-	
-	BOOST_FOREACH(int m, absco_nonzero_column)
-	  jacv(m) = 0;
-
 	// Can skip integrand_nonzero_column because we do that first,
 	// and just assign to it.
-
-	// BOOST_FOREACH(int m, integrand_nonzero_column[j])
-	//   jacv(m) = 0;
-
-	int k = 0;
-	BOOST_FOREACH(int m, integrand_nonzero_column[j]) {
-	  Array<double, 1> intjac(integrand_jac[j](spec_index, i, ra, k));
-	  jacv(m) = sum(av.value() * intjac * weight[j].value);
-	  ++k;
+	BOOST_FOREACH(int m, pressure_nonzero_column[j])
+	  jacv[m] = 0;
+	BOOST_FOREACH(int m, absco_nonzero_column)
+	  jacv[m] = 0;
+
+	const std::vector<int>& icol = integrand_nonzero_column[j];
+	for(int k = 0; k < (int) icol.size(); ++k) {
+	  const double* wijac = &integrand_jac_weighted[j](spec_index, i, k, 0);
+	  double t = 0;
+	  for(int s = 0; s < ns; ++s)
+	    t += av[s] * wijac[s];
+	  jacv[icol[k]] = t;
 	}
 
-	k = 0;
-	BOOST_FOREACH(int m, absco_nonzero_column) {
-	  Array<double, 1> avjac(av.jacobian()(ra, k));
-	  jacv(m) += sum(avjac * piv * weight[j].value);
-	  ++k;
+	// The common case is a state vector where the only things
+	// that change the absco are the temperature offset and
+	// possibly the H2O scale factor, so we have special versions
+	// for 1 or 2 columns that keep the sums in registers.
+	const double* avjac = avjac_all + s0 * nabs;
+	switch(nabs) {
+	case 0:
+	  break;
+	case 1:
+	  add_absco_jac<1>(avjac, wpiv, ns, absco_nonzero_column, jacv);
+	  break;
+	case 2:
+	  add_absco_jac<2>(avjac, wpiv, ns, absco_nonzero_column, jacv);
+	  break;
+	default:
+	  add_absco_jac(avjac, wpiv, ns, nabs, absco_nonzero_column, jacv);
 	}
 
 	// If p1 and p2 are the pressures at the edge of the layer,
@@ -539,12 +633,11 @@ AbsorberAbsco::tau_gas_der(double wn, int spec_index) const
 	// Note assumption here that ends of range are for p1 and
 	// p2. This is true for Simpsons rule, but if you change
 	// create_sublayer this may need to be modified.
-	int i1 = av.rows() - 1;
-	int i2 = 0;
-	k = 0;
+	double edge1 = av[ns - 1] * piv(spec_index, i, s0 + ns - 1);
+	double edge2 = av[0] * piv(spec_index, i, s0);
+	int k = 0;
 	BOOST_FOREACH(int m, pressure_nonzero_column[j]) {
-	  jacv(m) += av.value()(i1) * piv(i1) * p1_grad[j](k) -
-	    av.value()(i2) * piv(i2) * p2_grad[j](k);
+	  jacv[m] += edge1 * p1_grad[j](k) - edge2 * p2_grad[j](k);
 	  ++k;
 	}
       }
@@ -40,9 +40,9 @@ public:
   // We use attach_notify to directly attach the various object that
   // AbsorberAbsco contains. This means we don't need to do anything with
   // changes to the StateVector in this class, it is already handled
-  // by the objects we contain.
-  virtual void notify_update(const StateVector& Sv) 
-  { notify_update_do(*this); }
+  // by the objects we contain. They notify us when they actually
+  // change, and we then notify our observers.
+  virtual void notify_update(const StateVector& Sv) {}
   virtual int number_species() const {return (int) vmr.size(); }
   virtual int number_spectrometer() const {return (int) alt.size();}
   virtual int number_layer() const { return press->number_layer(); }
@@ -192,9 +192,14 @@ private:
   mutable std::vector<blitz::Array<double, 1> > p1_grad;
   mutable std::vector<blitz::Array<double, 1> > p2_grad;
 
-  // Same thing for integrand_independent_wn_sub
+  // Same thing for integrand_independent_wn_sub. Since it doesn't
+  // depend on wn, we also multiply in the weight for each sublayer
+  // here. integrand_weighted is indexed by Spec_index, Species_index,
+  // sublayer, and integrand_jac_weighted by Spec_index, Species_index,
+  // nonzero column, sublayer (so the sublayers are contiguous).
   mutable std::vector<std::vector<int> > integrand_nonzero_column;
-  mutable std::vector<blitz::Array<double, 4> > integrand_jac;
+  mutable std::vector<blitz::Array<double, 3> > integrand_weighted;
+  mutable std::vector<blitz::Array<double, 4> > integrand_jac_weighted;
 
   // And for Absco (only Absco is not by layer)
   mutable std::vector<int> absco_nonzero_column;
@@ -0,0 +1,138 @@
+#include "adaptive_spectrum_sampling.h"
+#include "ostream_pad.h"
+#include "logger.h"
+#include <cmath>
+
+using namespace FullPhysics;
+using namespace blitz;
+
+#ifdef HAVE_LUA
+#include "register_lua.h"
+REGISTER_LUA_DERIVED_CLASS(AdaptiveSpectrumSampling, SpectrumSampling)
+.def(luabind::constructor<const boost::shared_ptr<RtAtmosphere>&,
+                          const boost::shared_ptr<SpectrumSampling>&>())
+.def(luabind::constructor<const boost::shared_ptr<RtAtmosphere>&,
+                          const boost::shared_ptr<SpectrumSampling>&,
+                          double>())
+.def(luabind::constructor<const boost::shared_ptr<RtAtmosphere>&,
+                          const boost::shared_ptr<SpectrumSampling>&,
+                          double, double>())
+REGISTER_LUA_END()
+#endif
+
+//-----------------------------------------------------------------------
+/// Constructor. We pick points from the Interpolated_sampling, using
+/// the optical depth from Atm.
+//-----------------------------------------------------------------------
+
+AdaptiveSpectrumSampling::AdaptiveSpectrumSampling
+(const boost::shared_ptr<RtAtmosphere>& Atm,
+ const boost::shared_ptr<SpectrumSampling>& Interpolated_sampling,
+ double Tolerance,
+ double Max_spacing_fraction)
+: SpectrumSampling(Atm->number_spectrometer()), atm(Atm),
+  interpolated_sampling(Interpolated_sampling), tol(Tolerance),
+  max_spacing_frac(Max_spacing_fraction),
+  grid(Atm->number_spectrometer()), 
+  grid_interpolated(Atm->number_spectrometer())
+{
+  range_min_check(Tolerance, 0.0);
+  range_min_check(Max_spacing_fraction, 0.0);
+}
+
+// See base class for description
+SpectralDomain AdaptiveSpectrumSampling::spectral_domain
+(int spec_index,
+ const SpectralDomain& Lowres_grid, 
+ const DoubleWithUnit& Ils_half_width) const
+{
+  range_check(spec_index, 0, number_spectrometer());
+  SpectralDomain ispec = interpolated_sampling->
+    spectral_domain(spec_index, Lowres_grid, Ils_half_width);
+  const Array<double, 1>& d = ispec.data();
+  int n = d.rows();
+
+  // Reuse the grid if we have already calculated it.
+  const Array<double, 1>& dlast = grid_interpolated[spec_index].data();
+  if(dlast.rows() == n && ispec.units().name() == 
+     grid_interpolated[spec_index].units().name() &&
+     (n == 0 || all(dlast == d)))
+    return grid[spec_index];
+  grid_interpolated[spec_index] = ispec.clone();
+  if(n < 3) {
+    grid[spec_index] = ispec;
+    return ispec;
+  }
+
+//-----------------------------------------------------------------------
+// Proxy for the radiance, and the largest gap we allow.
+//-----------------------------------------------------------------------
+
+  Array<double, 1> wn = ispec.wavenumber();
+  Array<double, 1> t(n);
+  for(int i = 0; i < n; ++i)
+    t(i) = exp(-sum(atm->optical_depth_wrt_iv(wn(i), spec_index).value()));
+  double hw;
+  if(Ils_half_width.units.is_commensurate(units::inv_cm))
+    hw = Ils_half_width.convert(units::inv_cm).value;
+  else {
+    DoubleWithUnit c = DoubleWithUnit((wn(0) + wn(n - 1)) / 2, units::inv_cm).
+      convert_wave(Ils_half_width.units);
+    DoubleWithUnit cp = c, cm = c;
+    cp += Ils_half_width;
+    cm -= Ils_half_width;
+    hw = fabs(cp.convert_wave(units::inv_cm).value -
+	      cm.convert_wave(units::inv_cm).value) / 2;
+  }
+  double max_gap = max_spacing_frac * hw;
+
+//-----------------------------------------------------------------------
+// Starting at each point we keep, extend the interval as far as we
+// can while linear interpolation across it stays within tolerance.
+//-----------------------------------------------------------------------
+
+  std::vector<double> res;
+  res.push_back(d(0));
+  int i0 = 0;
+  while(i0 < n - 1) {
+    int j = i0 + 1;
+    for(int jj = i0 + 2; jj < n && fabs(wn(jj) - wn(i0)) <= max_gap; ++jj) {
+      bool ok = true;
+      for(int k = i0 + 1; k < jj && ok; ++k) {
+	double f = (wn(k) - wn(i0)) / (wn(jj) - wn(i0));
+	ok = (fabs(t(i0) + f * (t(jj) - t(i0)) - t(k)) <= tol);
+      }
+      if(!ok)
+	break;
+      j = jj;
+    }
+    res.push_back(d(j));
+    i0 = j;
+  }
+  Logger::info() << "Adaptive spectrum sampling: Using " << res.size()
+		 << " of " << n << " points for spectrometer " 
+		 << spec_index + 1 << "\n";
+  Array<double, 1> sd(&res[0], shape((int) res.size()), duplicateData);
+  grid[spec_index] = SpectralDomain(sd, ispec.units());
+  return grid[spec_index];
+}
+
+//-----------------------------------------------------------------------
+/// Print to stream.
+//-----------------------------------------------------------------------
+
+void AdaptiveSpectrumSampling::print(std::ostream& Os) const 
+{ 
+  OstreamPad opad(Os, "    ");
+  Os << "AdaptiveSpectrumSampling\n"
+     << "  Tolerance:            " << tol << "\n"
+     << "  Max spacing fraction: " << max_spacing_frac << "\n"
+     << "  Interpolated spectrum sampling:\n";
+  opad << *interpolated_sampling << "\n";
+  opad.strict_sync();
+  for(int i = 0; i < number_spectrometer(); ++i)
+    if(grid[i].data().rows() > 0)
+      Os << "  Band " << i + 1 << ":\n"
+	 << "     grid_points: " << grid[i].data().rows() << " of "
+	 << grid_interpolated[i].data().rows() << "\n";
+}
@@ -0,0 +1,84 @@
+#ifndef ADAPTIVE_SPECTRUM_SAMPLING_H
+#define ADAPTIVE_SPECTRUM_SAMPLING_H
+#include "spectrum_sampling.h"
+#include "rt_atmosphere.h"
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace FullPhysics {
+/****************************************************************//**
+  This is a SpectrumSampling that picks a nonuniform subset of an
+  underlying Interpolated_sampling, adapted to the absorption lines
+  in each band. Like NonuniformSpectrumSampling, we only do the RT
+  calculation at the points returned by spectral_domain, and then
+  linearly interpolate (by interpolate_spectrum) to the full
+  Interpolated_sampling before applying the ILS.
+
+  Rather than reading a precomputed grid, we calculate the total
+  optical depth tau of the atmosphere at each point of the
+  Interpolated_sampling, and use exp(-tau) as a proxy for the
+  shape of the radiance. We then thin out the points, keeping a
+  point only if leaving it out would make the linear interpolation of
+  exp(-tau) between the kept points differ by more than Tolerance
+  from the full calculation. This keeps the dense sampling near line
+  cores, and drops most of the points in the continuum. Because the
+  ILS has unit area, bounding the interpolation error at each point
+  also bounds the error after the ILS convolution to roughly
+  Tolerance (as a fraction of the continuum radiance).
+
+  In addition, we never leave a gap larger than Max_spacing_fraction
+  of the ILS half width, so we still resolve the slower variation
+  from things like the surface and aerosols that aren't captured by
+  the optical depth alone.
+
+  The grid is calculated the first time it is requested for a band,
+  using the atmosphere state at that time (normally the apriori
+  state), and then reused for all later calls. It is recalculated if
+  the Interpolated_sampling grid changes.
+
+  Note that there are a few closely related classes, with similar 
+  sounding names. See \ref spectrum_doxygen for a description of each
+  of these.
+*******************************************************************/
+class AdaptiveSpectrumSampling : public SpectrumSampling {
+public:
+  AdaptiveSpectrumSampling
+  (const boost::shared_ptr<RtAtmosphere>& Atm,
+   const boost::shared_ptr<SpectrumSampling>& Interpolated_sampling,
+   double Tolerance = 1e-4,
+   double Max_spacing_fraction = 0.5);
+  virtual ~AdaptiveSpectrumSampling() {}
+
+  virtual SpectralDomain spectral_domain_interpolated(int Spec_index, 
+		 const SpectralDomain& Lowres_grid, 
+		 const DoubleWithUnit& Ils_half_width) const
+  { return interpolated_sampling->
+      spectral_domain(Spec_index, Lowres_grid, Ils_half_width); }
+  virtual SpectralDomain spectral_domain(int spec_index,
+		 const SpectralDomain& Lowres_grid, 
+		 const DoubleWithUnit& Ils_half_width) const;
+  virtual bool need_interpolation(int Spec_index) const { return true; }
+
+//-----------------------------------------------------------------------
+/// Tolerance we use on the interpolation error of exp(-tau).
+//-----------------------------------------------------------------------
+
+  double tolerance() const { return tol; }
+
+//-----------------------------------------------------------------------
+/// The largest gap we allow between points, as a fraction of the ILS
+/// half width.
+//-----------------------------------------------------------------------
+
+  double max_spacing_fraction() const { return max_spacing_frac; }
+  virtual void print(std::ostream& Os) const;
+private:
+  boost::shared_ptr<RtAtmosphere> atm;
+  boost::shared_ptr<SpectrumSampling> interpolated_sampling;
+  double tol, max_spacing_frac;
+  // Grid we have calculated for each band, along with the
+  // Interpolated_sampling grid it was calculated from.
+  mutable std::vector<SpectralDomain> grid, grid_interpolated;
+};
+}
+#endif
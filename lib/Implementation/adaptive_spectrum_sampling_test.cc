@@ -0,0 +1,46 @@
+#include "adaptive_spectrum_sampling.h"
+#include "spectrum_sampling_fixed_spacing.h"
+#include "unit_test_support.h"
+#include "configuration_fixture.h"
+
+using namespace FullPhysics;
+using namespace blitz;
+
+BOOST_FIXTURE_TEST_SUITE(adaptive_spectrum_sampling, ConfigurationFixture)
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  blitz::Array<double, 1> spec_spac_val(3);
+  spec_spac_val = 0.01;
+  ArrayWithUnit<double, 1> spec_spac_awu(spec_spac_val, units::inv_cm);
+  boost::shared_ptr<SpectrumSampling> 
+    fixed(new SpectrumSamplingFixedSpacing(spec_spac_awu));
+  AdaptiveSpectrumSampling ssamp(config_atmosphere, fixed, 1e-4);
+  BOOST_CHECK_CLOSE(ssamp.tolerance(), 1e-4, 1e-8);
+  for(int i = 0; i < 3; ++i) {
+    BOOST_CHECK(ssamp.need_interpolation(i));
+    Array<double, 1> full = 
+      fixed->spectral_domain(i, lowres_grid(i), ils_half_width(i)).data();
+    Array<double, 1> sd =
+      ssamp.spectral_domain(i, lowres_grid(i), ils_half_width(i)).data();
+    BOOST_CHECK_MATRIX_CLOSE
+      (ssamp.spectral_domain_interpolated(i, lowres_grid(i), 
+					  ils_half_width(i)).data(), full);
+    BOOST_CHECK(sd.rows() < full.rows());
+    BOOST_CHECK_CLOSE(sd(0), full(0), 1e-8);
+    BOOST_CHECK_CLOSE(sd(sd.rows() - 1), full(full.rows() - 1), 1e-8);
+    // Every point should be from the full grid, in order.
+    int j = 0;
+    for(int k = 0; k < sd.rows(); ++k) {
+      while(j < full.rows() && full(j) != sd(k))
+	++j;
+      BOOST_CHECK(j < full.rows());
+    }
+    // Second call should return the cached grid.
+    BOOST_CHECK_MATRIX_CLOSE
+      (ssamp.spectral_domain(i, lowres_grid(i), ils_half_width(i)).data(), 
+       sd);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
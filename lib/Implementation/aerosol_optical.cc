@@ -9,6 +9,8 @@ using namespace blitz;
 #ifdef HAVE_LUA
 #include "register_lua.h"
 typedef const boost::shared_ptr<AerosolExtinction>& (AerosolOptical::*a1)(int) const;
+typedef double (AerosolOptical::*a2)() const;
+typedef void (AerosolOptical::*a3)(double);
 REGISTER_LUA_DERIVED_CLASS(AerosolOptical, Aerosol)
 .def(luabind::constructor<const std::vector<boost::shared_ptr<AerosolExtinction> >&,
      const std::vector<boost::shared_ptr<AerosolProperty> >&,
@@ -16,6 +18,8 @@ REGISTER_LUA_DERIVED_CLASS(AerosolOptical, Aerosol)
      const boost::shared_ptr<RelativeHumidity>&>())
 .def("number_particle", &AerosolOptical::number_particle)
 .def("aerosol_extinction", ((a1) &AerosolOptical::aerosol_extinction))
+.def("table_spacing", ((a2) &AerosolOptical::table_spacing))
+.def("table_spacing", ((a3) &AerosolOptical::table_spacing))
 REGISTER_LUA_END()
 #endif
 
@@ -28,6 +32,9 @@ REGISTER_LUA_END()
 /// \param Reference_wn The wavenumber that Aext is given for. This
 ///    is optional, the default value matches the reference band given
 ///    in the ATB.
+/// \param Table_spacing The spacing of the wavenumber grid used for
+///    the table of extinction and scattering coefficients, in
+///    cm^-1. The default of 0 means we don't use a table.
 //-----------------------------------------------------------------------
 
 AerosolOptical::AerosolOptical
@@ -35,18 +42,23 @@ AerosolOptical::AerosolOptical
  const std::vector<boost::shared_ptr<AerosolProperty> >& Aerosol_prop,
  const boost::shared_ptr<Pressure>& Press,
  const boost::shared_ptr<RelativeHumidity>& Rh,
- double Reference_wn)
+ double Reference_wn,
+ double Table_spacing)
 : aext(Aext),
   aprop(Aerosol_prop),
   press(Press),
   rh(Rh),
   reference_wn_(Reference_wn),
   cache_is_stale(true),
+  rh_version(-1),
+  table_spacing_(Table_spacing),
+  table_wn(-1),
   // Need at least 1 jacobian var such as when not running a retrieval
   nvar(1)
 {
   if((int) aprop.size() != number_particle())
     throw Exception("aprop needs to be size of number_particle()");
+  range_min_check(Table_spacing, 0.0);
   for(int i = 0; i < number_particle(); ++i) {
     aprop[i]->add_observer(*this);
     aext[i]->add_observer(*this);
@@ -92,12 +104,22 @@ blitz::Array<std::string, 1> AerosolOptical::aerosol_name_arr() const
 //-----------------------------------------------------------------------
 /// We cache the part of the optical_depth_each_layer calculation that
 /// is independent of wn.
+///
+/// Some AerosolProperty (e.g., AerosolPropertyRhHdf) depend on the
+/// RelativeHumidity, which isn't something we can observe. So in
+/// addition to cache_is_stale (set by our observers) we compare the
+/// RelativeHumidity update_version() to what we used when we last
+/// filled in the cache.
 //-----------------------------------------------------------------------
 
 void AerosolOptical::fill_cache() const
 {
-  if(!cache_is_stale)
+  int rhv = (rh ? rh->update_version() : 0);
+  if(!cache_is_stale && rhv == rh_version)
     return;
+  std::vector<ArrayAd<double, 1> > ext_ref;
+  for(int j = 0; j < number_particle(); ++j)
+    ext_ref.push_back(aprop[j]->extinction_coefficient_each_layer(reference_wn_));
   od_ind_wn.resize(press->number_layer(), number_particle(), nvar);
   for(int i = 0; i < od_ind_wn.rows(); ++i) {
     AutoDerivativeWithUnit<double> delta_press = 
@@ -112,7 +134,7 @@ void AerosolOptical::fill_cache() const
       /// We scale the extinction coefficient return by aprop at the 
       /// reference wave number, so that aext of 1 means the extinction
       /// coefficient for a particle is 1.
-      od_ind_wn(i, j) = 1.0 / aprop[j]->extinction_coefficient_each_layer(reference_wn_)(i) *
+      od_ind_wn(i, j) = 1.0 / ext_ref[j](i) *
         dp * aext[j]->extinction_for_layer(i);
     }
   }
@@ -123,9 +145,133 @@ void AerosolOptical::fill_cache() const
 	    << od_ind_wn.jacobian() << std::endl;
   */
   nlay = press->number_layer();
+  ext_table.clear();
+  scat_table.clear();
+  ext_table.resize(number_particle());
+  scat_table.resize(number_particle());
+  // Record which columns of the Jacobian are nonzero, so code
+  // applying the chain rule can skip the rest of the state vector.
+  if(!od_ind_wn.is_constant())
+    od_ind_wn.column_group(JacobianColumnGroup::find(od_ind_wn.jacobian()));
+
+  // The extinction coefficient may also depend on the state vector
+  // (e.g., through the relative humidity), which adds to the nonzero
+  // columns of optical_depth_each_layer. The columns it depends on
+  // don't change with wavenumber, so we find these once here using
+  // the reference wavenumber rather than for every wavenumber. This
+  // means optical_depth_each_layer returns the same column group
+  // until the state changes.
+  ext_column_group.reset();
+  int ext_nvar = -1;
+  bool know_group = (od_ind_wn.is_constant() || od_ind_wn.column_group());
+  for(int j = 0; j < number_particle(); ++j)
+    if(!ext_ref[j].is_constant()) {
+      if(ext_nvar < 0)
+	ext_nvar = ext_ref[j].number_variable();
+      know_group = know_group && ext_ref[j].number_variable() == ext_nvar;
+    }
+  if(ext_nvar >= 0 && !od_ind_wn.is_constant())
+    know_group = know_group && od_ind_wn.number_variable() == ext_nvar;
+  if(ext_nvar >= 0 && know_group) {
+    boost::shared_ptr<JacobianColumnGroup> 
+      g(new JacobianColumnGroup(number_particle(), ext_nvar));
+    for(int j = 0; j < number_particle(); ++j) {
+      if(!od_ind_wn.is_constant())
+	g->add(j, *od_ind_wn.column_group(), j);
+      if(!ext_ref[j].is_constant())
+	g->add_all_slot(j, *JacobianColumnGroup::find(ext_ref[j].jacobian()));
+    }
+    ext_column_group = g;
+  }
+  table_wn = -1;
+  rh_version = rhv;
   cache_is_stale = false;
 }
 
+//-----------------------------------------------------------------------
+/// Fill in ext_wn and scat_wn for the given wavenumber by
+/// interpolating the table, adding any table entries we need.
+//-----------------------------------------------------------------------
+
+void AerosolOptical::fill_table(double wn) const
+{
+  if(wn == table_wn)
+    return;
+  int k = (int) floor(wn / table_spacing_);
+  double f = wn / table_spacing_ - k;
+  ext_wn.resize(number_particle());
+  scat_wn.resize(number_particle());
+  for(int i = 0; i < number_particle(); ++i) {
+    std::map<int, ArrayAd<double, 1> >* tab[2] = 
+      {&ext_table[i], &scat_table[i]};
+    std::vector<ArrayAd<double, 1> >* res[2] = {&ext_wn, &scat_wn};
+    for(int j = 0; j < 2; ++j) {
+      ArrayAd<double, 1> c[2];
+      for(int kk = 0; kk < 2; ++kk) {
+	std::map<int, ArrayAd<double, 1> >::iterator t = tab[j]->find(k + kk);
+	if(t == tab[j]->end()) {
+	  double wn_grid = (k + kk) * table_spacing_;
+	  ArrayAd<double, 1> v = (j == 0 ?
+		  aprop[i]->extinction_coefficient_each_layer(wn_grid) :
+		  aprop[i]->scattering_coefficient_each_layer(wn_grid));
+	  t = tab[j]->insert(std::make_pair(k + kk, v)).first;
+	}
+	c[kk].reference(t->second);
+      }
+      int nv = (c[0].is_constant() ? (c[1].is_constant() ? 0 : 
+		  c[1].number_variable()) : c[0].number_variable());
+      ArrayAd<double, 1>& r = (*res[j])[i];
+      r.resize(c[0].rows(), nv);
+      r.value() = (1 - f) * c[0].value() + f * c[1].value();
+      if(nv > 0) {
+	r.jacobian() = 0;
+	if(!c[0].is_constant())
+	  r.jacobian() += (1 - f) * c[0].jacobian();
+	if(!c[1].is_constant())
+	  r.jacobian() += f * c[1].jacobian();
+      }
+    }
+  }
+  ssa_wn.resize(nlay, number_particle());
+  for(int i = 0; i < number_particle(); ++i)
+    ssa_wn(Range::all(), i) = scat_wn[i].value() / ext_wn[i].value();
+  table_wn = wn;
+}
+
+//-----------------------------------------------------------------------
+/// Extinction coefficient for the given particle. This either comes
+/// from the table, or directly from the AerosolProperty. Note that
+/// the table version points to our cached values, so you shouldn't
+/// modify this.
+//-----------------------------------------------------------------------
+
+ArrayAd<double, 1> AerosolOptical::extinction_coefficient(double wn, int i) 
+  const
+{
+  if(table_spacing_ <= 0)
+    return aprop[i]->extinction_coefficient_each_layer(wn);
+  fill_cache();
+  fill_table(wn);
+  return ext_wn[i];
+}
+
+//-----------------------------------------------------------------------
+/// Scattering coefficient for the given particle. This either comes
+/// from the table, or directly from the AerosolProperty. Note that
+/// the table version points to our cached values, so you shouldn't
+/// modify this.
+//-----------------------------------------------------------------------
+
+ArrayAd<double, 1> AerosolOptical::scattering_coefficient(double wn, int i) 
+  const
+{
+  if(table_spacing_ <= 0)
+    return aprop[i]->scattering_coefficient_each_layer(wn);
+  fill_cache();
+  fill_table(wn);
+  return scat_wn[i];
+}
+
 //-----------------------------------------------------------------------
 /// This gives the optical depth for each layer, for the given wave
 /// number. Note this only includes the aerosol portion of this,
@@ -145,8 +291,12 @@ AerosolOptical::optical_depth_each_layer(double wn) const
   FunctionTimer ft(timer.function_timer());
   fill_cache();
   ArrayAd<double, 2> res(od_ind_wn.copy());
+  // The nonzero columns are the same as od_ind_wn, unless the
+  // extinction coefficient depends on the state vector. In that case
+  // we use the columns found in fill_cache.
+  bool ext_const = true;
   for(int i = 0; i < number_particle(); ++i) {
-    ArrayAd<double, 1> t = aprop[i]->extinction_coefficient_each_layer(wn);
+    ArrayAd<double, 1> t = extinction_coefficient(wn, i);
     if(res.is_constant() && !t.is_constant())
       res.resize_number_variable(t.number_variable());
     Array<double, 1> v(res.value()(ra, i));
@@ -154,8 +304,17 @@ AerosolOptical::optical_depth_each_layer(double wn) const
     v *= t.value();
     if(t.is_constant())
       jac = t.value()(i1) * jac(i1, i2);
-    else
+    else {
       jac = t.value()(i1) * jac(i1,i2) + v(i1) * t.jacobian()(i1, i2);
+      ext_const = false;
+    }
+  }
+  if(!ext_const) {
+    if(ext_column_group && 
+       ext_column_group->number_variable() == res.number_variable())
+      res.column_group(ext_column_group);
+    else
+      res.clear_column_group();
   }
   return res;
 }
@@ -185,8 +344,11 @@ ArrayAd<double, 1> AerosolOptical::ssa_each_layer
   firstIndex i1; secondIndex i2; thirdIndex i3;
   FunctionTimer ft(timer.function_timer());
   ArrayAd<double, 1> res(Od.copy());
-  ArrayAd<double, 1> t = aprop[particle_index]->scattering_coefficient_each_layer(wn);
-  ArrayAd<double, 1> t2 = aprop[particle_index]->extinction_coefficient_each_layer(wn);
+  // We modify t below, so make a copy if this is our table
+  ArrayAd<double, 1> t = scattering_coefficient(wn, particle_index);
+  if(table_spacing_ > 0)
+    t.reference(t.copy());
+  ArrayAd<double, 1> t2 = extinction_coefficient(wn, particle_index);
   t.value() /= t2.value();
   if(!t.is_constant() && !res.is_constant() &&
      res.number_variable() != t.number_variable())
@@ -233,6 +395,37 @@ AerosolOptical::ssa_each_layer(double wn) const
   return res;
 }
 
+//-----------------------------------------------------------------------
+/// This gives the single scatter albedo of each particle for each
+/// layer, i.e., the ratio of the scattering coefficient to the
+/// extinction coefficient. This is number_active_layer() x
+/// number_particle(). This uses the table if table_spacing() is
+/// greater than 0.
+///
+/// Note that the table version points to our cached values, so you
+/// shouldn't modify this.
+//-----------------------------------------------------------------------
+
+blitz::Array<double, 2> 
+AerosolOptical::particle_ssa_each_layer(double wn) const
+{
+  FunctionTimer ft(timer.function_timer());
+  if(table_spacing_ > 0) {
+    fill_cache();
+    fill_table(wn);
+    return ssa_wn;
+  }
+  Array<double, 2> res;
+  for(int i = 0; i < number_particle(); ++i) {
+    ArrayAd<double, 1> scat = aprop[i]->scattering_coefficient_each_layer(wn);
+    ArrayAd<double, 1> ext = aprop[i]->extinction_coefficient_each_layer(wn);
+    if(i == 0)
+      res.resize(ext.rows(), number_particle());
+    res(Range::all(), i) = scat.value() / ext.value();
+  }
+  return res;
+}
+
 //-----------------------------------------------------------------------
 /// This calculates the portion of the phase function moments that
 /// come from the aerosol for a single particle. This is
@@ -368,7 +561,7 @@ AerosolOptical::clone(const boost::shared_ptr<Pressure>& Press,
   std::vector<boost::shared_ptr<AerosolProperty> > aprop_clone;
   BOOST_FOREACH(const boost::shared_ptr<AerosolProperty>& i, aprop)
     aprop_clone.push_back(i->clone(Press, Rh));
-  boost::shared_ptr<Aerosol> res(new AerosolOptical(aext_clone, aprop_clone, Press, Rh));
+  boost::shared_ptr<Aerosol> res(new AerosolOptical(aext_clone, aprop_clone, Press, Rh, reference_wn_, table_spacing_));
   return res;
 }
 
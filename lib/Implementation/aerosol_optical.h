@@ -4,12 +4,25 @@
 #include "aerosol_property.h"
 #include "aerosol_extinction.h"
 #include <limits>
+#include <map>
 #include <vector>
 
 namespace FullPhysics {
 /****************************************************************//**
   Implementation of Aerosol. This particular implementation does 
   the aerosol calculation by using the aerosol optical properties.
+
+  Calculating the extinction and scattering coefficients from the
+  AerosolProperty for every wavenumber can be a noticeable part of
+  the forward model run time. The aerosol properties vary slowly with
+  wavenumber, so as an option we can instead build a table of the
+  coefficients on a coarse wavenumber grid (with spacing
+  table_spacing()) and linearly interpolate between these. The
+  table is filled in as needed, so it only covers the bands actually
+  used, and is thrown away whenever the Pressure, AerosolExtinction,
+  AerosolProperty or RelativeHumidity changes. The default
+  table_spacing of 0 turns this off, so we call the AerosolProperty
+  at each wavenumber.
 *******************************************************************/
 class AerosolOptical: public Aerosol,
                public Observer<Pressure>,
@@ -20,14 +33,26 @@ public:
 	  const std::vector<boost::shared_ptr<AerosolProperty> >& Aerosol_prop,
 	  const boost::shared_ptr<Pressure>& Press,
 	  const boost::shared_ptr<RelativeHumidity>& Rh,
-	  double Reference_wn = 1e4/0.755);
+	  double Reference_wn = 1e4/0.755,
+	  double Table_spacing = 0);
   virtual ~AerosolOptical() {}
   virtual void notify_add(StateVector& Sv);
   virtual void notify_remove(StateVector& Sv);
+//-----------------------------------------------------------------------
+/// The AerosolExtinction and AerosolProperty are attached to the
+/// StateVector themselves, and notify us if they actually change (see
+/// fill_cache for the RelativeHumidity). So the only thing we need to
+/// handle here is a change in the number of variables.
+//-----------------------------------------------------------------------
+
   virtual void notify_update(const StateVector& Sv) 
   {
-    nvar = Sv.state_with_derivative().number_variable();
-    notify_update_do(*this); 
+    int nv = Sv.state_with_derivative().number_variable();
+    if(nv != nvar) {
+      nvar = nv;
+      cache_is_stale = true;
+      notify_update_do(*this);
+    }
   }
 
   virtual ArrayAd<double, 2> optical_depth_each_layer(double wn) 
@@ -37,6 +62,7 @@ public:
 		 const ArrayAd<double, 1>& Od) const;
   virtual ArrayAd<double, 1> 
   ssa_each_layer(double wn) const;
+  virtual blitz::Array<double, 2> particle_ssa_each_layer(double wn) const;
 
 //-----------------------------------------------------------------------
 /// For performance, we cache some data as we calculate it. This
@@ -125,6 +151,21 @@ public:
   { range_check(i, 0, number_particle()); aprop[i] = V; 
     cache_is_stale = true; notify_update_do(*this); }
 
+//-----------------------------------------------------------------------
+/// Spacing of the wavenumber grid used for the table of extinction
+/// and scattering coefficients, in cm^-1. 0 means we don't use a table.
+//-----------------------------------------------------------------------
+
+  double table_spacing() const { return table_spacing_; }
+
+//-----------------------------------------------------------------------
+/// Set the table spacing, 0 turns the table off.
+//-----------------------------------------------------------------------
+
+  void table_spacing(double V)
+  { range_min_check(V, 0.0); table_spacing_ = V; 
+    cache_is_stale = true; notify_update_do(*this); }
+
 //-----------------------------------------------------------------------
 /// Return pressure
 //-----------------------------------------------------------------------
@@ -142,7 +183,28 @@ private:
   mutable bool cache_is_stale;
   mutable ArrayAd<double, 2> od_ind_wn;
   mutable int nlay;
+  // The RelativeHumidity update_version() that the cache was
+  // calculated for. 
+  mutable int rh_version;
+  // Columns of the Jacobian of optical_depth_each_layer that might be
+  // nonzero when the extinction coefficient depends on the state
+  // vector. This is null if we don't know the columns.
+  mutable boost::shared_ptr<const JacobianColumnGroup> ext_column_group;
+  // Table of extinction and scattering coefficients for each
+  // particle, indexed by the wavenumber grid index. We also keep the
+  // interpolated values for the last wavenumber, since
+  // optical_depth_each_layer and ssa_each_layer are called for the
+  // same wavenumber.
+  double table_spacing_;
+  mutable std::vector<std::map<int, ArrayAd<double, 1> > > ext_table, 
+    scat_table;
+  mutable double table_wn;
+  mutable std::vector<ArrayAd<double, 1> > ext_wn, scat_wn;
+  mutable blitz::Array<double, 2> ssa_wn;
   void fill_cache() const;
+  void fill_table(double wn) const;
+  ArrayAd<double, 1> extinction_coefficient(double wn, int i) const;
+  ArrayAd<double, 1> scattering_coefficient(double wn, int i) const;
   int nvar;
 };
 }
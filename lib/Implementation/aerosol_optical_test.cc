@@ -62,6 +62,55 @@ BOOST_AUTO_TEST_CASE(layer_parameters)
   
 }
 
+BOOST_AUTO_TEST_CASE(table)
+{
+  // The table should give very nearly the same results as calling
+  // the AerosolProperty directly.
+  boost::shared_ptr<AerosolOptical> a =
+    boost::dynamic_pointer_cast<AerosolOptical>(config_aerosol);
+  BOOST_CHECK_CLOSE(a->table_spacing(), 0.0, 1e-8);
+  Array<double, 1> wn(3);
+  wn = 12929.94, 12930.30, 13100.0;
+  std::vector<ArrayAd<double, 2> > od_expect;
+  std::vector<ArrayAd<double, 1> > ssa_expect;
+  for(int i = 0; i < wn.rows(); ++i) {
+    od_expect.push_back(a->optical_depth_each_layer(wn(i)));
+    ssa_expect.push_back(a->ssa_each_layer(wn(i)));
+  }
+  a->table_spacing(1.0);
+  for(int i = 0; i < wn.rows(); ++i) {
+    ArrayAd<double, 2> od = a->optical_depth_each_layer(wn(i));
+    BOOST_CHECK_MATRIX_CLOSE_TOL(od.value(), od_expect[i].value(), 1e-8);
+    BOOST_CHECK_MATRIX_CLOSE_TOL(od.jacobian(), od_expect[i].jacobian(), 
+				 1e-8);
+    BOOST_CHECK_MATRIX_CLOSE_TOL(a->ssa_each_layer(wn(i)).value(), 
+				 ssa_expect[i].value(), 1e-8);
+  }
+  a->table_spacing(0);
+}
+
+BOOST_AUTO_TEST_CASE(particle_ssa)
+{
+  // particle_ssa_each_layer should be what ssa_each_layer multiplies
+  // the optical depth by, with or without the table.
+  Range ra(Range::all());
+  boost::shared_ptr<AerosolOptical> a =
+    boost::dynamic_pointer_cast<AerosolOptical>(config_aerosol);
+  double wn = 12929.94;
+  ArrayAd<double, 2> od = a->optical_depth_each_layer(wn);
+  Array<double, 2> ssa = a->particle_ssa_each_layer(wn).copy();
+  BOOST_CHECK_EQUAL(ssa.cols(), a->number_particle());
+  for(int i = 0; i < a->number_particle(); ++i) {
+    Array<double, 1> expect(ssa.rows());
+    expect = ssa(ra, i) * od.value()(ra, i);
+    BOOST_CHECK_MATRIX_CLOSE(a->ssa_each_layer(wn, i, od(ra, i)).value(),
+			     expect);
+  }
+  a->table_spacing(1.0);
+  BOOST_CHECK_MATRIX_CLOSE_TOL(a->particle_ssa_each_layer(wn), ssa, 1e-8);
+  a->table_spacing(0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 BOOST_FIXTURE_TEST_SUITE(aerosol_jac, ConfigurationFixture)
@@ -96,6 +145,42 @@ BOOST_AUTO_TEST_CASE(optical_depth_jac)
   }
 }
 
+BOOST_AUTO_TEST_CASE(column_group)
+{
+  // The nonzero columns only change when the state does, so we should
+  // get the same column group for each wavenumber. 
+  boost::shared_ptr<AerosolOptical> a =
+    boost::dynamic_pointer_cast<AerosolOptical>(config_aerosol);
+  ArrayAd<double, 2> od1 = a->optical_depth_each_layer(12929.94);
+  ArrayAd<double, 2> od2 = a->optical_depth_each_layer(12930.30);
+  BOOST_CHECK(od1.column_group());
+  BOOST_CHECK(od1.column_group() == od2.column_group());
+}
+
+BOOST_AUTO_TEST_CASE(table_state_update)
+{
+  // Updating the StateVector so the aerosol changes needs to throw
+  // away the table.
+  boost::shared_ptr<AerosolOptical> a =
+    boost::dynamic_pointer_cast<AerosolOptical>(config_aerosol);
+  StateVector& sv = *config_state_vector;
+  Array<double, 1> sv0(sv.state().copy());
+  double wn = 12929.94;
+  a->table_spacing(1.0);
+  a->optical_depth_each_layer(wn);
+  Array<double, 1> svn(sv0.copy());
+  svn += epsilon * 10;
+  sv.update_state(svn);
+  Array<double, 2> od_table = a->optical_depth_each_layer(wn).value().copy();
+  Array<double, 1> ssa_table = a->ssa_each_layer(wn).value().copy();
+  a->table_spacing(0);
+  BOOST_CHECK_MATRIX_CLOSE_TOL(od_table, 
+			       a->optical_depth_each_layer(wn).value(), 1e-8);
+  BOOST_CHECK_MATRIX_CLOSE_TOL(ssa_table, a->ssa_each_layer(wn).value(),
+			       1e-8);
+  sv.update_state(sv0);
+}
+
 BOOST_AUTO_TEST_CASE(ssa_jac)
 {
   boost::shared_ptr<AerosolOptical> a =
@@ -15,14 +15,10 @@ REGISTER_LUA_END()
 /// Read the given group in the given file for the aerosol properties.
 //-----------------------------------------------------------------------
 
-AerosolPropertyHdf::AerosolPropertyHdf
-(const HdfFile& F, 
- const std::string& Group_name,
- const boost::shared_ptr<Pressure>& Press
-)
+AerosolPropertyHdfTable::AerosolPropertyHdfTable
+(const HdfFile& F, const std::string& Group_name)
 : hdf_file(F.file_name()), hdf_group(Group_name)
 {
-  press = Press;
   Array<double, 1> wn(F.read_field<double, 1>(Group_name + "/wave_number"));
   Array<double, 1> 
     qscatv(F.read_field<double, 1>(Group_name + "/scattering_coefficient"));
@@ -41,6 +37,39 @@ AerosolPropertyHdf::AerosolPropertyHdf
 					   pf_vec.begin()));
 }
 
+void AerosolPropertyHdfTable::print(std::ostream& Os) const 
+{ 
+  Os << "AerosolPropertyHdfTable:\n"
+     << "  Hdf file:  " << hdf_file << "\n"
+     << "  Hdf group: " << hdf_group << "\n";
+}
+
+//-----------------------------------------------------------------------
+/// Read the given group in the given file for the aerosol properties.
+//-----------------------------------------------------------------------
+
+AerosolPropertyHdf::AerosolPropertyHdf
+(const HdfFile& F, 
+ const std::string& Group_name,
+ const boost::shared_ptr<Pressure>& Press
+)
+: table(new AerosolPropertyHdfTable(F, Group_name))
+{
+  press = Press;
+}
+
+//-----------------------------------------------------------------------
+/// Use tables that have already been read, with the given Pressure.
+//-----------------------------------------------------------------------
+
+AerosolPropertyHdf::AerosolPropertyHdf
+(const boost::shared_ptr<AerosolPropertyHdfTable>& Table,
+ const boost::shared_ptr<Pressure>& Press)
+: table(Table)
+{
+  press = Press;
+}
+
 boost::shared_ptr<AerosolProperty> AerosolPropertyHdf::clone() const
 {
   boost::shared_ptr<RelativeHumidity> rh_dummy;
@@ -51,16 +80,15 @@ boost::shared_ptr<AerosolProperty> AerosolPropertyHdf::clone
 (const boost::shared_ptr<Pressure>& Press,
  const boost::shared_ptr<RelativeHumidity>& Rh) const
 {
-  HdfFile f(hdf_file);
   return boost::shared_ptr<AerosolProperty>
-    (new AerosolPropertyHdf(f, hdf_group, Press));
+    (new AerosolPropertyHdf(table, Press));
 }
 
 ArrayAd<double, 1> AerosolPropertyHdf::extinction_coefficient_each_layer
 (double wn) const
 {
   firstIndex i1; secondIndex i2;
-  AutoDerivative<double> t = (*qext)(wn);
+  AutoDerivative<double> t = (*table->qext)(wn);
   ArrayAd<double, 1> res(press->number_layer(), t.number_variable());
   res.value() = t.value();
   if(t.number_variable() > 0)
@@ -72,7 +100,7 @@ ArrayAd<double, 1> AerosolPropertyHdf::scattering_coefficient_each_layer
 (double wn) const
 {
   firstIndex i1; secondIndex i2;
-  AutoDerivative<double> t = (*qscat)(wn);
+  AutoDerivative<double> t = (*table->qscat)(wn);
   ArrayAd<double, 1> res(press->number_layer(), t.number_variable());
   res.value() = t.value();
   if(t.number_variable() > 0)
@@ -83,19 +111,17 @@ ArrayAd<double, 1> AerosolPropertyHdf::scattering_coefficient_each_layer
 ArrayAd<double, 3> AerosolPropertyHdf::phase_function_moment_each_layer
 (double wn, int nmom, int nscatt) const
 { 
-  firstIndex i1; secondIndex i2; thirdIndex i3; fourthIndex i4;
-  ArrayAd<double, 2> t = (*pf)(wn, nmom, nscatt);
-  ArrayAd<double, 3> res(t.rows(), press->number_layer(), 
-			 t.cols(), t.number_variable());
-  res.value() = t.value()(i1, i3);
-  if(t.number_variable() > 0)
-    res.jacobian() = t.jacobian()(i1, i3, i4);
+  firstIndex i1; secondIndex i2; thirdIndex i3;
+  table->pf->interpolate(wn, pf_buf, nmom, nscatt);
+  ArrayAd<double, 3> res(pf_buf.rows(), press->number_layer(), 
+			 pf_buf.cols(), 0);
+  res.value() = pf_buf(i1, i3);
   return res; 
 }
 
 void AerosolPropertyHdf::print(std::ostream& Os) const 
 { 
   Os << "AerosolPropertyHdf:\n"
-     << "  Hdf file:  " << hdf_file << "\n"
-     << "  Hdf group: " << hdf_group << "\n";
+     << "  Hdf file:  " << table->hdf_file << "\n"
+     << "  Hdf group: " << table->hdf_group << "\n";
 }
@@ -7,6 +7,23 @@
 #include <boost/shared_ptr.hpp>
 
 namespace FullPhysics {
+/****************************************************************//**
+  The tables read from the HDF group for AerosolPropertyHdf. These
+  don't depend on the Pressure, so they can be shared by every
+  AerosolPropertyHdf that uses the same group (see
+  StaticInputRegistry).
+*******************************************************************/
+class AerosolPropertyHdfTable : public Printable<AerosolPropertyHdfTable> {
+public:
+  AerosolPropertyHdfTable(const HdfFile& F, const std::string& Group_name);
+  virtual ~AerosolPropertyHdfTable() {}
+  boost::shared_ptr<LinearInterpolate<double, double> > qext;
+  boost::shared_ptr<LinearInterpolate<double, double> > qscat;
+  boost::shared_ptr<ScatteringMomentInterpolate> pf;
+  std::string hdf_file, hdf_group;
+  virtual void print(std::ostream& Os) const;
+};
+
 /****************************************************************//**
   This gives the Aerosol properties for an Aerosol. This particular
   implementation reads the Aerosol properties from the HDF group in
@@ -23,6 +40,8 @@ class AerosolPropertyHdf : public AerosolPropertyImpBase {
 public:
   AerosolPropertyHdf(const HdfFile& F, const std::string& Group_name,
 		     const boost::shared_ptr<Pressure>& Press);
+  AerosolPropertyHdf(const boost::shared_ptr<AerosolPropertyHdfTable>& Table,
+		     const boost::shared_ptr<Pressure>& Press);
   virtual ~AerosolPropertyHdf() {}
   virtual boost::shared_ptr<AerosolProperty> clone() const;
   virtual boost::shared_ptr<AerosolProperty> 
@@ -37,10 +56,10 @@ public:
 				   int nscatt = -1) const;
   virtual void print(std::ostream& Os) const;
 private:
-  boost::shared_ptr<LinearInterpolate<double, double> > qext;
-  boost::shared_ptr<LinearInterpolate<double, double> > qscat;
-  boost::shared_ptr<ScatteringMomentInterpolate> pf;
-  std::string hdf_file, hdf_group;
+  boost::shared_ptr<AerosolPropertyHdfTable> table;
+  // Scratch space, so we don't allocate a new array each time we
+  // interpolate the phase function moments.
+  mutable blitz::Array<double, 2> pf_buf;
 };
 }
 #endif
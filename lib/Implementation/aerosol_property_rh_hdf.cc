@@ -181,11 +181,9 @@ ArrayAd<double, 3> AerosolPropertyRhHdf::phase_function_moment_each_layer
 (double wn, int nmom, int nscatt) const
 { 
   firstIndex i1; secondIndex i2; thirdIndex i3; fourthIndex i4;
-  std::vector<blitz::Array<double, 2> > pfv;
-  for(int i = 0; i < (int) rh_val.size(); ++i) {
-    blitz::Array<double, 2> t((*pf[i])(wn, nmom, nscatt));
-    pfv.push_back(t);
-  }
+  std::vector<blitz::Array<double, 2> > pfv(rh_val.size());
+  for(int i = 0; i < (int) rh_val.size(); ++i)
+    pf[i]->interpolate(wn, pfv[i], nmom, nscatt);
   LinearInterpolate<double, blitz::Array<double, 2> >
     lin(rh_val_d.begin(), rh_val_d.end(), pfv.begin());
   blitz::Array<double, 1> rhl = rh->relative_humidity_layer().value();
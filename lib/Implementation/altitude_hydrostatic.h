@@ -33,23 +33,28 @@ public:
 //-----------------------------------------------------------------------
 /// For performance, we cache some data as we calculate it. This
 /// becomes stale when the pressure is changed, so we observe press
-/// and mark the cache when it changes. 
+/// and mark the cache when it changes. The altitude and gravity
+/// change with it, so we also notify our observers (which updates
+/// our update_version()).
 //-----------------------------------------------------------------------
 
   virtual void notify_update(const Pressure& P)
   {
     cache_is_stale = true;   
+    notify_update_do(*this);
   }
 
 //-----------------------------------------------------------------------
 /// For performance, we cache some data as we calculate it. This
 /// becomes stale when the temperature is changed, so we observe temperature
-/// and mark the cache when it changes. 
+/// and mark the cache when it changes. We also notify our observers,
+/// like for the pressure.
 //-----------------------------------------------------------------------
 
   virtual void notify_update(const Temperature& T)
   {
     cache_is_stale = true;   
+    notify_update_do(*this);
   }
 
   virtual AutoDerivativeWithUnit<double> 
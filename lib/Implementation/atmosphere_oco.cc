@@ -181,6 +181,10 @@ AtmosphereOco::AtmosphereOco(const boost::shared_ptr<Absorber>& absorberv,
 
 void AtmosphereOco::initialize()
 {
+  // Nothing is cached yet.
+  sv_size_version = -1;
+  absorber_version = pressure_version = temperature_version = 
+    aerosol_version = rh_version = -1;
   rayleigh.reset(new Rayleigh(pressure, alt, *constant));
   if(aerosol)
     aerosol->add_observer(*this);
@@ -246,6 +250,7 @@ void AtmosphereOco::set_aerosol(boost::shared_ptr<Aerosol>& new_aerosol, StateVe
     // Invalidate caches
     wn_tau_cache = -1;
     spec_index_tau_cache = -1;
+    sv_size_version = -1;
 }
 
 //-----------------------------------------------------------------------
@@ -325,17 +330,42 @@ std::string AtmosphereOco::timer_info() const
 }
 
 //-----------------------------------------------------------------------
-/// For performance, we cache some data as we calculate it. This
-/// becomes stale when the aerosol is changed, so we observe aerosol
-/// and mark the cache when it changes. 
+/// We check the update_version() of the aerosol in fill_cache, so
+/// all we need to do here is pass the notification on to our
+/// observers.
 //-----------------------------------------------------------------------
 
 void AtmosphereOco::notify_update(const Aerosol& A)
 {
-  wn_tau_cache = -1;
   notify_update_do(*this);
 }
 
+//-----------------------------------------------------------------------
+/// Return true if the state vector size or any of the objects we
+/// depend on have changed since we last filled in the cache. Rather
+/// than using a flag set by notify_update, we compare the
+/// update_version() of these objects to what we used when we filled
+/// in the cache. This means a state vector update that only changes
+/// something else (e.g., the ground) doesn't cause us to recalculate
+/// anything. 
+//-----------------------------------------------------------------------
+
+bool AtmosphereOco::cache_is_stale() const
+{
+  if(sv_size != sv_size_version ||
+     absorber->update_version() != absorber_version ||
+     pressure->update_version() != pressure_version ||
+     temperature->update_version() != temperature_version ||
+     (aerosol && aerosol->update_version() != aerosol_version) ||
+     (rh && rh->update_version() != rh_version) ||
+     alt_version.size() != alt.size())
+    return true;
+  for(int i = 0; i < (int) alt.size(); ++i)
+    if(alt[i]->update_version() != alt_version[i])
+      return true;
+  return false;
+}
+
 //-----------------------------------------------------------------------
 /// This handles filling the various cached variables. We first check
 /// to see if these values are already cached, if so then we skip the
@@ -345,6 +375,23 @@ void AtmosphereOco::notify_update(const Aerosol& A)
 
 bool AtmosphereOco::fill_cache(double wn, int spec_index) const
 {
+  if(cache_is_stale()) {
+    wn_tau_cache = -1;
+    if (totaltaug_cache)
+      totaltaug_cache->clear();
+    sv_size_version = sv_size;
+    absorber_version = absorber->update_version();
+    pressure_version = pressure->update_version();
+    temperature_version = temperature->update_version();
+    if(aerosol)
+      aerosol_version = aerosol->update_version();
+    if(rh)
+      rh_version = rh->update_version();
+    alt_version.resize(alt.size());
+    for(int i = 0; i < (int) alt.size(); ++i)
+      alt_version[i] = alt[i]->update_version();
+  }
+
   if(fabs(wn - wn_tau_cache) < 1e-6 &&
      spec_index == spec_index_tau_cache)
     return true;
@@ -402,40 +449,127 @@ const
 // column_optical_depth_water_vapor().
 //-----------------------------------------------------------------------
 
-  if(taur.is_constant())
-    taur.value() = rayleigh->optical_depth_each_layer(wn, spec_index).value();
-  else
-    taur = rayleigh->optical_depth_each_layer(wn, spec_index);
+  // Rayleigh optical depth is a wavenumber independent factor times
+  // the cross section, so we fill this in directly rather than
+  // creating a new ArrayAd each time.
+  ArrayAd<double, 1> taur_f = 
+    rayleigh->optical_depth_per_cross_section(spec_index);
+  double rayleigh_cs = rayleigh->cross_section_wn(wn);
+  taur.value() = taur_f.value() * rayleigh_cs;
+  if(!taur.is_constant()) {
+    if(taur_f.is_constant())
+      taur.jacobian() = 0;
+    else
+      taur.jacobian() = taur_f.jacobian() * rayleigh_cs;
+  }
   ArrayAd<double, 2> taug_i =
     absorber->optical_depth_each_layer(wn, spec_index);
 
+  // The absorber may tell us which columns of the Jacobian are
+  // nonzero, in which case we only need to sum those.
+  boost::shared_ptr<const JacobianColumnGroup> gas_group = 
+    taug_i.column_group();
   totaltaug.resize(taug_i.cols(), taug_i.number_variable());
   totaltaug.value() = sum(taug_i.value()(i2, i1), i2);
-  if(!taug_i.is_constant())
-    totaltaug.jacobian() = sum(taug_i.jacobian()(i3, i1, i2), i3);
-  else
+  if(taug_i.is_constant())
+    totaltaug.jacobian() = 0;
+  else if(gas_group) {
+    Array<double, 3> tjac(taug_i.jacobian());
     totaltaug.jacobian() = 0;
+    for(int k = 0; k < taug_i.cols(); ++k)
+      BOOST_FOREACH(const Range& r, gas_group->group(k))
+	totaltaug.jacobian()(k, r) = sum(tjac(ra, k, r)(i2, i1), i2);
+  } else
+    totaltaug.jacobian() = sum(taug_i.jacobian()(i3, i1, i2), i3);
 
   // If cache exists, then store the computed value
   if(totaltaug_cache)
     totaltaug_cache->insert(wn, totaltaug);
 
   taug.value() = sum(taug_i.value()(i1, i2), i2);
-  if(!taug.is_constant() && !taug_i.is_constant())
-    taug.jacobian() = sum(taug_i.jacobian()(i1, i3, i2), i3);
-  else
+  if(taug.is_constant() || taug_i.is_constant())
     taug.jacobian() = 0;
+  else if(gas_group) {
+    Array<double, 3> tjac(taug_i.jacobian());
+    taug.jacobian() = 0;
+    for(int k = 0; k < taug_i.cols(); ++k)
+      BOOST_FOREACH(const Range& r, gas_group->group(k))
+	taug.jacobian()(ra, r) += tjac(ra, k, r);
+  } else
+    taug.jacobian() = sum(taug_i.jacobian()(i1, i3, i2), i3);
 
 //-----------------------------------------------------------------------
 /// Add in aerosol, if we have any.
 //-----------------------------------------------------------------------
 
+  ArrayAd<double, 2> taua_f;
   if(aerosol) {
+    taua_f.reference(aerosol->optical_depth_each_layer(wn));
     if(taua_i.is_constant())
-      taua_i.value() = aerosol->optical_depth_each_layer(wn).value();
+      taua_i.value() = taua_f.value();
     else
-      taua_i = aerosol->optical_depth_each_layer(wn);
+      taua_i = taua_f;
   }
+  set_intermediate_variable_column_group(taug_i, taur_f, taua_f);
+}
+
+//-----------------------------------------------------------------------
+/// Most of the state vector only affects one of the intermediate
+/// variables (e.g., the aerosol parameters only affect taua_i). If
+/// the absorber, rayleigh and aerosol tell us which columns of their
+/// Jacobians are nonzero, combine these to give the column group for
+/// intermediate_v. This lets the RadiativeTransfer skip the rest of
+/// the state vector when it applies the chain rule. 
+///
+/// The column group only changes when the state vector changes, so
+/// we reuse the last one if the parts are the same.
+//-----------------------------------------------------------------------
+
+void AtmosphereOco::set_intermediate_variable_column_group
+(const ArrayAd<double, 2>& Taug_i, const ArrayAd<double, 1>& Taur_f,
+ const ArrayAd<double, 2>& Taua) const
+{
+  int nvar = intermediate_v.number_variable();
+  // A constant part has no nonzero columns, so we leave its group as
+  // a null pointer. Otherwise we need the group to be supplied, with
+  // a matching number of variables.
+  bool know_group = !intermediate_v.is_constant();
+  boost::shared_ptr<const JacobianColumnGroup> ggas, gray, gaer;
+  if(!Taug_i.is_constant()) {
+    ggas = Taug_i.column_group();
+    know_group = know_group && ggas && ggas->number_variable() == nvar;
+  }
+  if(!Taur_f.is_constant()) {
+    gray = Taur_f.column_group();
+    know_group = know_group && gray && gray->number_variable() == nvar;
+  }
+  if(aerosol && !Taua.is_constant()) {
+    gaer = Taua.column_group();
+    know_group = know_group && gaer && gaer->number_variable() == nvar;
+  }
+  if(!know_group) {
+    intermediate_v.clear_column_group();
+    return;
+  }
+  if(!iv_column_group || 
+     iv_column_group->number_slot() != intermediate_v.cols() ||
+     iv_column_group->number_variable() != nvar ||
+     ggas != iv_group_gas || gray != iv_group_ray || gaer != iv_group_aer) {
+    boost::shared_ptr<JacobianColumnGroup> 
+      g(new JacobianColumnGroup(intermediate_v.cols(), nvar));
+    if(ggas)
+      g->add_all_slot(taug_index, *ggas);
+    if(gray)
+      g->add_all_slot(taur_index, *gray);
+    if(gaer)
+      for(int i = 0; i < gaer->number_slot(); ++i)
+	g->add(taua_0_index + i, *gaer, i);
+    iv_column_group = g;
+    iv_group_gas = ggas;
+    iv_group_ray = gray;
+    iv_group_aer = gaer;
+  }
+  intermediate_v.column_group(iv_column_group);
 }
 
 //-----------------------------------------------------------------------
@@ -461,6 +595,11 @@ void AtmosphereOco::calc_rt_parameters
   omega.resize(tau.shape(), tau.number_variable());
   frac_ray.resize(tau.shape(), tau.number_variable());
 
+  // This gets called for every wavenumber, so rather than going to
+  // the heap we get the memory for our temporaries from arena. This
+  // is all returned when we leave this function.
+  ScratchArena::Scope scope(arena);
+
   ArrayAd<double, 1> taug(iv(ra, taug_index));
   ArrayAd<double, 1> taur(iv(ra, taur_index));
   tau.value() = taur.value() + taug.value();
@@ -469,11 +608,10 @@ void AtmosphereOco::calc_rt_parameters
 
   // We need taur with derivatives with respect to the intermediate
   // variables in a few different places, so store here
-  Array<double, 2> scratch(taur.rows(), iv.cols());
-  scratch = 0;
-  scratch(ra, taur_index) = 1;
-  ArrayAd<double, 1> taur_wrt_iv(taur.value(), scratch.copy());
-  scratch(ra, taur_index) = 0;
+  Array<double, 2> taur_jac(arena.array<double>(taur.rows(), iv.cols()));
+  taur_jac = 0;
+  taur_jac(ra, taur_index) = 1;
+  ArrayAd<double, 1> taur_wrt_iv(taur.value(), taur_jac);
 
 //-----------------------------------------------------------------------
 /// Add in aerosol, if we have any, and use to finish up tau, omega,
@@ -485,15 +623,21 @@ void AtmosphereOco::calc_rt_parameters
 		 (aerosol ? aerosol->number_particle() - 1 : 0));
     ArrayAd<double, 2> taua_i(iv(ra, taua_r));
     tau.value() += sum(taua_i.value(), i2);
-    ArrayAd<double, 2> aersc(taua_i.shape(), iv.cols());
-    for(int i = 0; i < taua_i.cols(); ++i) {
-      scratch(ra, taua_0_index + i) = 1;
-      ArrayAd<double, 1> t(taua_i.value()(Range::all(), i), scratch);
-      aersc(ra, i) = aerosol->ssa_each_layer(wn, i, t);
-      scratch(ra, taua_0_index + i) = 0;
-    }
+    ArrayAd<double, 2> aersc(arena.array_ad<double>(taua_i.shape(),
+						    iv.cols()));
+    // The scattering optical depth of each particle is taua_i times
+    // the single scatter albedo, so the Jacobian is the single scatter
+    // albedo in the taua_i column. This comes from the aerosol table,
+    // if the aerosol uses one.
+    Array<double, 2> aer_ssa(aerosol->particle_ssa_each_layer(wn));
+    aersc.value() = taua_i.value() * aer_ssa;
+    aersc.jacobian() = 0;
+    for(int i = 0; i < taua_i.cols(); ++i)
+      aersc.jacobian()(ra, i, taua_0_index + i) = aer_ssa(ra, i);
     frac_aer.resize(aersc.shape(), iv.cols());
-    ArrayAd<double, 1> ssasum(taur_wrt_iv.copy());
+    ArrayAd<double, 1> ssasum(arena.array_ad<double>(taur_wrt_iv.rows(),
+						     iv.cols()));
+    ssasum = taur_wrt_iv;
 
     // Because this is a bottle neck, we have explicit expressions for
     // the Jacobians here. This is just the simple chain rule 
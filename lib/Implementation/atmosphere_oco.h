@@ -10,6 +10,7 @@
 #include "rayleigh.h"
 #include "rayleigh_greek_moment.h"
 #include "array_ad_cache.h"
+#include "scratch_arena.h"
 
 namespace FullPhysics {
 /****************************************************************//**
@@ -79,7 +80,7 @@ public:
   column_optical_depth(double wn, int spec_index, const std::string& Gas_name) const
   {
     if (totaltaug_cache) {
-      if (not totaltaug_cache->is_valid(wn))
+      if (cache_is_stale() || not totaltaug_cache->is_valid(wn))
         fill_cache(wn, spec_index);
 
       return (*totaltaug_cache)[wn](absorber->gas_index(Gas_name));
@@ -216,6 +217,18 @@ private:
   mutable ArrayAd<double, 1> totaltaug;
   mutable ArrayAd<double, 2> frac_aer;
   mutable ArrayAd<double, 2> intermediate_v;
+  // The state vector size and the update_version() of the objects we
+  // depend on that intermediate_v was calculated for.
+  mutable int sv_size_version, absorber_version, pressure_version,
+    temperature_version, aerosol_version, rh_version;
+  mutable std::vector<int> alt_version;
+  // Memory for the temporaries in calc_rt_parameters.
+  mutable ScratchArena arena;
+  // Columns of the Jacobian of intermediate_v that might be nonzero,
+  // along with the column groups of the gas, Rayleigh and aerosol
+  // optical depths that we used to create it.
+  mutable boost::shared_ptr<const JacobianColumnGroup> iv_column_group, 
+    iv_group_gas, iv_group_ray, iv_group_aer;
   mutable int nlay;
 
   // Items that might need to be cached for access
@@ -226,6 +239,10 @@ private:
   void initialize();
   void calc_rt_parameters(double wn, const ArrayAd<double, 2>& iv) const;
   void calc_intermediate_variable(double wn, int spec_index) const;
+  void set_intermediate_variable_column_group
+  (const ArrayAd<double, 2>& Taug_i, const ArrayAd<double, 1>& Taur_f,
+   const ArrayAd<double, 2>& Taua) const;
+  bool cache_is_stale() const;
   bool fill_cache(double wn, int spec_index) const;
   ArrayAd<double, 3> scattering_moment_common(double wn,
     int nummom, int numscat) const;
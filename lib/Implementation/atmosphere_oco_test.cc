@@ -61,6 +61,30 @@ BOOST_AUTO_TEST_CASE(basic)
   BOOST_CHECK_EQUAL(count(statev->used_flag()), 109 - 5);
 }
 
+BOOST_AUTO_TEST_CASE(update_version)
+{
+  // Updating the StateVector with the same values shouldn't change
+  // anything the cache depends on. Changing the state should update
+  // the cache.
+  StateVector& sv = *statev;
+  Array<double, 1> sv0(sv.state().copy());
+  Array<double, 1> tau0 = 
+    atm->optical_depth_wrt_iv(12929.94, 0).value().copy();
+  int absv = atm->absorber_ptr()->update_version();
+  int aerv = atm->aerosol_ptr()->update_version();
+  sv.update_state(sv0);
+  BOOST_CHECK_EQUAL(atm->absorber_ptr()->update_version(), absv);
+  BOOST_CHECK_EQUAL(atm->aerosol_ptr()->update_version(), aerv);
+  Array<double, 1> sv1(sv0.copy());
+  sv1 *= 1.01;
+  sv.update_state(sv1);
+  BOOST_CHECK(max(abs(atm->optical_depth_wrt_iv(12929.94, 0).value() - 
+		      tau0)) > 0);
+  sv.update_state(sv0);
+  BOOST_CHECK_MATRIX_CLOSE(atm->optical_depth_wrt_iv(12929.94, 0).value(), 
+			   tau0);
+}
+
 BOOST_AUTO_TEST_CASE(rayleigh_atmosphere)
 {
   // We check that leaving out the aerosol gives the same results as
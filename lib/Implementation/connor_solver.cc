@@ -2,6 +2,7 @@
 #include "linear_algebra.h"
 #include "fp_exception.h"
 #include "logger.h"
+#include "profiler.h"
 #include "ifstream_cs.h"
 #include <fstream>
 
@@ -152,6 +153,7 @@ bool ConnorSolver::solve(const blitz::Array<double, 1>& Initial_guess,
 			 const blitz::Array<double, 2>& Apriori_cov)
 
 {
+  FP_PROFILE_SCOPE("ConnorSolver solve");
   using namespace blitz;
   firstIndex i1; secondIndex i2;
   
@@ -293,6 +295,7 @@ void ConnorSolver::test_do_inversion(const std::string& Fname,
 
 void ConnorSolver::do_inversion()
 {
+  FP_PROFILE_SCOPE("ConnorSolver do_inversion");
   using namespace blitz;
   firstIndex i1; secondIndex i2; thirdIndex i3;
 
@@ -8,6 +8,7 @@
 %base_import(observer)
 %import "cost_function.i"
 %import "convergence_check.i"
+%python_release_gil(FullPhysics::ConnorSolver::solve);
 %fp_shared_ptr(FullPhysics::ConnorSolver);
 %fp_shared_ptr(FullPhysics::ConnorSolverState);
 
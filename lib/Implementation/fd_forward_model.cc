@@ -1,4 +1,6 @@
 #include "fd_forward_model.h"
+#include "oco_forward_model.h"
+#include <boost/foreach.hpp>
 using namespace FullPhysics;
 using namespace blitz;
 
@@ -11,10 +13,32 @@ using namespace blitz;
 FdForwardModel::FdForwardModel(const boost::shared_ptr<ForwardModel>& Real_forward_model,
 			       const boost::shared_ptr<StateVector>& Sv,
 			       const blitz::Array<double, 1>& Perturbation)
-  : real_fm(Real_forward_model), statev(Sv), perturb(Perturbation)
+  : real_fm(Real_forward_model), statev(Sv), perturb(Perturbation),
+    number_rt_skipped_(0)
 {
 }
 
+//-----------------------------------------------------------------------
+/// Return the update_version of the Instrument and each of the
+/// SpectrumEffect for the given band. These are the parts of a
+/// OcoForwardModel that are applied after the radiative transfer. If
+/// the forward model isn't a OcoForwardModel we return an empty list.
+//-----------------------------------------------------------------------
+
+std::vector<int> FdForwardModel::post_rt_version(int Spec_index) const
+{
+  std::vector<int> res;
+  boost::shared_ptr<OcoForwardModel> ofm = 
+    boost::dynamic_pointer_cast<OcoForwardModel>(real_fm);
+  if(!ofm)
+    return res;
+  res.push_back(ofm->instrument()->update_version());
+  BOOST_FOREACH(const boost::shared_ptr<SpectrumEffect>& se, 
+		ofm->spectrum_effect()[Spec_index])
+    res.push_back(se->update_version());
+  return res;
+}
+
 // See base class for description.
 
 Spectrum FdForwardModel::radiance(int Spec_index, bool Skip_jacobian) const
@@ -23,26 +47,48 @@ Spectrum FdForwardModel::radiance(int Spec_index, bool Skip_jacobian) const
     return real_fm->radiance(Spec_index, Skip_jacobian);
 
   // Save initial state of statevector to set back at end of jacobian looping
-  Array<double, 1> initial_sv( statev->state() );
+  Array<double, 1> initial_sv( statev->state().copy() );
+
+  // Make sure statevector size is same as perturbation array
+  if( initial_sv.extent(firstDim) != perturb.extent(firstDim) ) {
+    Exception err;
+    err << "Statevector size does not match size of perturbation array, can not do FD jacobian calculations";
+    throw(err);
+  }
 
-  // Retrieve unperturbed radiance value
+  // Retrieve unperturbed radiance value. For a OcoForwardModel we
+  // keep the high resolution radiance so we can reuse it for
+  // perturbations that don't change the radiative transfer.
   Logger::info() << "Finite Difference FM: Unperturbed radiances\n";
-  Spectrum rad(real_fm->radiance(Spec_index, true));
+  boost::shared_ptr<OcoForwardModel> ofm = 
+    boost::dynamic_pointer_cast<OcoForwardModel>(real_fm);
+  Spectrum highres_spec;
+  Spectrum rad;
+  if(ofm) {
+    highres_spec = ofm->high_resolution_radiance(Spec_index, true);
+    // Spectrum effects are applied in place, and may share data with
+    // the high resolution spectrum, so pass a copy.
+    rad = ofm->apply_spectrum_corrections(highres_spec.clone(), Spec_index);
+  } else
+    rad = real_fm->radiance(Spec_index, true);
 
   // Set up result ArrayAD class
   ArrayAd<double, 1> res(rad.spectral_range().data().rows(), 
 			 statev->state_with_derivative().number_variable());
   res.value() = rad.spectral_range().data();
 
-  // Make sure statevector size is same as perturbation array
-  if( initial_sv.extent(firstDim) != perturb.extent(firstDim) ) {
-    Exception err;
-    err << "Statevector size does not match size of perturbation array, can not do FD jacobian calculations";
-    throw(err);
-  }
+  // An object that updates even when the state vector doesn't change
+  // can't tell us anything, so we only use the ones that stay the same.
+  std::vector<int> initial_version = post_rt_version(Spec_index);
+  statev->update_state(initial_sv);
+  std::vector<int> ver = post_rt_version(Spec_index);
+  std::vector<bool> reliable(ver.size());
+  for(int i = 0; i < (int) ver.size(); ++i)
+    reliable[i] = (ver[i] == initial_version[i]);
 
   // Loop over statevector perturbing each item in turn, saving value into jacobian array
   Array<double, 1> current_sv(initial_sv.extent(firstDim));
+  number_rt_skipped_ = 0;
   for( int sv_idx = 0; sv_idx < initial_sv.extent(firstDim); sv_idx++) {
     Logger::info() << "Finite Difference FM: Perturbation of state vector element #" << sv_idx+1 << "\n";
     if( perturb(sv_idx) > 0.0 ) {
@@ -50,23 +96,41 @@ Spectrum FdForwardModel::radiance(int Spec_index, bool Skip_jacobian) const
       current_sv = initial_sv;
       current_sv(sv_idx) += perturb(sv_idx);
     
-      // Update statevector so calculations are done w/ perturbed values
+      // Update statevector so calculations are done w/ perturbed
+      // values, and check if this only changes things applied after
+      // the radiative transfer.
+      std::vector<int> ver_before = post_rt_version(Spec_index);
       statev->update_state(current_sv);
+      std::vector<int> ver_after = post_rt_version(Spec_index);
+      bool post_rt_only = false;
+      for(int i = 0; i < (int) ver_after.size(); ++i)
+	if(reliable[i] && ver_after[i] != ver_before[i])
+	  post_rt_only = true;
 
-      // Calculate FD jacobian value      
+      // Calculate FD jacobian value
+      Spectrum rad_pert = 
+	(post_rt_only ? 
+	 ofm->apply_spectrum_corrections(highres_spec.clone(), Spec_index) :
+	 real_fm->radiance(Spec_index, true));
+      if(post_rt_only)
+	++number_rt_skipped_;
       res.jacobian()(Range::all(), sv_idx) = 
-	(real_fm->radiance(Spec_index, true).spectral_range().data() - 
-	 rad.spectral_range().data()) / perturb(sv_idx);;
+	(rad_pert.spectral_range().data() - 
+	 rad.spectral_range().data()) / perturb(sv_idx);
 
+      // Go back to the initial state, so the next perturbation is
+      // compared against it.
+      statev->update_state(initial_sv);
     } else {
       // Set to all zeros if perturbation is 0.0 since 
       // the perturbation would have no effect
       res.jacobian()(Range::all(), sv_idx) = 0.0;
     }
   }
-
-  // Set statevector object back to initial state
-  statev->update_state(initial_sv);
+  if(ofm)
+    Logger::info() << "Finite Difference FM: Reused unperturbed radiative "
+		   << "transfer for " << number_rt_skipped_ 
+		   << " state vector elements\n";
 
   return Spectrum(rad.spectral_domain(), 
 		  SpectralRange(res, rad.spectral_range().units()));
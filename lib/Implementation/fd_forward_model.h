@@ -1,6 +1,7 @@
 #ifndef FD_FORWARD_MODEL_H
 #define FD_FORWARD_MODEL_H
 #include "forward_model.h"
+#include <vector>
 
 namespace FullPhysics {
 /****************************************************************//**
@@ -9,9 +10,17 @@ namespace FullPhysics {
   much slower and is meant for testing analytic jacobains and
   for models that do not include analytic jacobians.
 
-  Additionally this way of doing finitie difference is wasteful
-  because some state vector elements might not require a full
-  radiative transfer call.
+  If the underlying forward model is a OcoForwardModel, we avoid
+  rerunning the radiative transfer for state vector elements that
+  only affect the stages after it (e.g., dispersion, instrument
+  corrections, fluorescence, EOFs). We determine this by perturbing
+  the element and checking which of the Instrument and SpectrumEffect
+  objects report an update (see Observable::update_version). Since
+  each element is owned by a single object, an element that updates
+  one of these doesn't affect the atmosphere or ground, and we just
+  apply OcoForwardModel::apply_spectrum_corrections to the unperturbed
+  OcoForwardModel::high_resolution_radiance. Everything else gets a
+  full call to radiance.
 *******************************************************************/
 
 class FdForwardModel : public ForwardModel {
@@ -33,10 +42,20 @@ public:
   {return real_fm->hdf_band_name(Spec_index);}
   virtual SpectralDomain spectral_domain(int Spec_index) const
   {return real_fm->spectral_domain(Spec_index);}
+
+//-----------------------------------------------------------------------
+/// Number of state vector elements in the last call to radiance where
+/// we reused the unperturbed radiative transfer rather than running
+/// it again. This is mostly useful for testing.
+//-----------------------------------------------------------------------
+
+  int number_rt_skipped() const { return number_rt_skipped_; }
 private:
+  std::vector<int> post_rt_version(int Spec_index) const;
   boost::shared_ptr<ForwardModel> real_fm;
   boost::shared_ptr<StateVector> statev;
   blitz::Array<double, 1> perturb;
+  mutable int number_rt_skipped_;
 };
 }
 #endif
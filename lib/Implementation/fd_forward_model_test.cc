@@ -0,0 +1,64 @@
+#include "unit_test_support.h"
+#include "configuration_fixture.h"
+#include "fd_forward_model.h"
+
+using namespace FullPhysics;
+using namespace blitz;
+
+BOOST_FIXTURE_TEST_SUITE(fd_forward_model, ConfigurationFixture)
+
+BOOST_AUTO_TEST_CASE(jacobian)
+{
+  is_long_test();		// Skip unless we are running long tests.
+  StateVector& sv = *config_state_vector;
+  Array<double, 1> sv0(sv.state().copy());
+
+  // Running the radiative transfer for every state vector element
+  // takes a long time, so only perturb a few atmosphere elements plus
+  // the instrument dispersion, which is the part we can skip the
+  // radiative transfer for.
+  Array<double, 1> perturb(sv0.rows());
+  perturb = 0;
+  perturb(0) = epsilon(0);	// CO2 VMR
+  perturb(21) = epsilon(21);	// Surface Pressure
+  Array<std::string, 1> sv_name = sv.state_vector_name();
+  int ndisp = 0;
+  for(int i = 0; i < sv0.rows(); ++i)
+    if(sv_name(i).find("Instrument Dispersion") == 0) {
+      perturb(i) = 1e-6;
+      ++ndisp;
+    }
+  BOOST_CHECK(ndisp > 0);
+
+  FdForwardModel fd(config_forward_model, config_state_vector, perturb);
+  Spectrum s = fd.radiance(0);
+  BOOST_CHECK_EQUAL(fd.number_rt_skipped(), ndisp);
+  BOOST_CHECK_MATRIX_CLOSE(sv.state(), sv0);
+
+  // Compare against the full finite difference Jacobian, running the
+  // forward model for each element. The reused radiative transfer is
+  // exactly what a full run would calculate, so these should agree
+  // to round off.
+  Array<double, 1> rad0 = 
+    config_forward_model->radiance(0, true).spectral_range().data();
+  BOOST_CHECK_MATRIX_CLOSE_TOL(s.spectral_range().data(), rad0, 
+			       1e-10 * max(abs(rad0)));
+  Array<double, 2> jac = s.spectral_range().data_ad().jacobian();
+  for(int i = 0; i < sv0.rows(); ++i) {
+    if(perturb(i) == 0.0) {
+      BOOST_CHECK(all(jac(Range::all(), i) == 0.0));
+      continue;
+    }
+    Array<double, 1> svp(sv0.copy());
+    svp(i) += perturb(i);
+    sv.update_state(svp);
+    Array<double, 1> jac_expect(rad0.shape());
+    jac_expect = (config_forward_model->radiance(0, true).
+		  spectral_range().data() - rad0) / perturb(i);
+    sv.update_state(sv0);
+    BOOST_CHECK_MATRIX_CLOSE_TOL(jac(Range::all(), i), jac_expect,
+				 1e-8 * max(abs(jac_expect)) + 1e-20);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
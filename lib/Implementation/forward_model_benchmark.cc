@@ -0,0 +1,210 @@
+#include "benchmark_support.h"
+#include "configuration_fixture.h"
+#include "lidort_fixture.h"
+#include "absco_hdf.h"
+#include "hdf_file.h"
+#include "dispersion_polynomial.h"
+#include "ils_table.h"
+#include "ils_convolution.h"
+#include "connor_solver.h"
+#include "chisq_convergence.h"
+#include "ifstream_cs.h"
+#include <boost/bind.hpp>
+
+using namespace FullPhysics;
+using namespace blitz;
+
+// Benchmarks for the most expensive pieces of the forward model and
+// the solver. These use the same fixtures and test data as the unit
+// tests, so the timings are reproducible from one run to the next.
+// See Benchmark for a description of the environment variables used
+// to write out the results and compare against a baseline.
+
+/// @cond
+// Number of wavenumbers we loop over in the benchmarks. The spacing
+// is the same as the high resolution grid for the A-band.
+const int benchmark_number_wn = 1000;
+const double benchmark_wn_start = 12929.94;
+const double benchmark_wn_step = 0.01;
+
+class BenchmarkAbsco {
+public:
+  BenchmarkAbsco(const std::string& Absco_dir)
+  {
+    boost::shared_ptr<Absco>
+      a(new AbscoHdf(Absco_dir + "/o2_v3.3.0-lowres.hdf"));
+    ArrayWithUnit<double, 1> p;
+    p.value.resize(3);
+    p.value = 11459.857421875, 12250.0, 13516.7548828125;
+    p.units = units::Pa;
+    Array<double, 1> tv(3), bv(3);
+    tv = 183.2799987792969, 190.0, 193.2799987792969;
+    bv = 0, 0, 0;
+    Array<double, 2> tjac(3, 2), bjac(3, 2);
+    tjac = 0;
+    bjac = 0;
+    tjac(Range::all(), 0) = 1;
+    bjac(Range::all(), 1) = 1;
+    ArrayAdWithUnit<double, 1> t(ArrayAd<double, 1>(tv, tjac), units::K);
+    ArrayAdWithUnit<double, 1> b(ArrayAd<double, 1>(bv, bjac),
+				 units::dimensionless);
+    interp.reset(new AbscoInterpolator(a, p, t, b));
+  }
+  void run() const
+  {
+    for(int i = 0; i < benchmark_number_wn; ++i)
+      interp->absorption_cross_section_deriv(benchmark_wn_start +
+					     i * benchmark_wn_step);
+  }
+  boost::shared_ptr<AbscoInterpolator> interp;
+};
+
+class BenchmarkSolverCostFunction : public CostFunction {
+public:
+  virtual void cost_function(const blitz::Array<double, 1>& x,
+			     blitz::Array<double, 1>& Residual,
+			     blitz::Array<double, 1>& Se,
+			     blitz::Array<double, 2>& Jacobian) const
+  {
+    // Not actually called, test_do_inversion reads everything from
+    // a file.
+    throw Exception("Not implemented");
+  }
+  virtual void print(std::ostream& Os) const
+  { Os << "BenchmarkSolverCostFunction"; }
+};
+
+// The atmosphere caches its results until the state vector changes,
+// so we alternate between two state vectors. Otherwise everything
+// after the warm up run would just be a cache hit.
+class BenchmarkAtmosphere {
+public:
+  BenchmarkAtmosphere(const RtAtmosphere& Atm, StateVector& Sv,
+		      const Array<double, 1>& X0,
+		      const Array<double, 1>& X1)
+    : atm(Atm), sv(Sv), x0(X0.copy()), x1(X1.copy()), use_x1(false) {}
+  void run()
+  {
+    use_x1 = !use_x1;
+    sv.update_state(use_x1 ? x1 : x0);
+    for(int i = 0; i < benchmark_number_wn; ++i)
+      atm.optical_depth_wrt_iv(benchmark_wn_start + i * benchmark_wn_step, 0);
+  }
+private:
+  const RtAtmosphere& atm;
+  StateVector& sv;
+  Array<double, 1> x0, x1;
+  bool use_x1;
+};
+
+void run_lidort(const LidortRt& Rt, const Array<double, 1>& Wn)
+{
+  Rt.reflectance(Wn, 0);
+}
+
+void run_ils(const IlsConvolution& Ils, const Array<double, 1>& Wn,
+	     const ArrayAd<double, 1>& Rad, const std::vector<int>& Plist)
+{
+  Ils.apply_ils(Wn, Rad, Plist);
+}
+
+void run_solver(ConnorSolver& Cs, const std::string& Fname)
+{
+  blitz::Array<double, 1> dx;
+  blitz::Array<double, 2> kt_se_m1_k;
+  Cs.test_do_inversion(Fname, dx, kt_se_m1_k);
+}
+
+void run_forward_model(const ForwardModel& Fm)
+{
+  Fm.radiance_all();
+}
+/// @endcond
+
+BOOST_FIXTURE_TEST_SUITE(benchmark_absco, GlobalFixture)
+BOOST_AUTO_TEST_CASE(absco_interpolator)
+{
+  BenchmarkAbsco b(absco_data_dir());
+  benchmark("absco_interpolator", boost::bind(&BenchmarkAbsco::run, &b));
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(benchmark_atmosphere, ConfigurationFixture)
+BOOST_AUTO_TEST_CASE(optical_depth_wrt_iv)
+{
+  Array<double, 1> x0(config_state_vector->state().copy());
+  Array<double, 1> x1(x0 + epsilon);
+  BenchmarkAtmosphere b(*config_atmosphere, *config_state_vector, x0, x1);
+  benchmark("atmosphere_optical_depth_wrt_iv",
+	    boost::bind(&BenchmarkAtmosphere::run, &b));
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(benchmark_lidort, LidortLambertianFixture)
+BOOST_AUTO_TEST_CASE(calculate_rt)
+{
+  benchmark("lidort_calculate_rt",
+	    boost::bind(&run_lidort, boost::cref(*lidort_rt),
+			boost::cref(wn_arr)));
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(benchmark_ils, GlobalFixture)
+BOOST_AUTO_TEST_CASE(apply_ils)
+{
+  Array<bool, 1> flag(2);
+  flag = true, false;
+  Array<double, 1> coeff(2);
+  coeff = 1.28695614e+04, 1.99492886e-01;
+  boost::shared_ptr<DispersionPolynomial>
+    d(new DispersionPolynomial(coeff, flag, units::inv_cm, "Test band", 1805,
+			       true));
+  HdfFile hf(test_data_dir() + "l2_fixed_level_static_input.h5");
+  boost::shared_ptr<IlsTableLinear>
+    ils_func(new IlsTableLinear(hf, 0, "A-Band", "o2"));
+  IlsConvolution ils(d, ils_func);
+  StateVector sv;
+  sv.add_observer(ils);
+  Array<double,1> x(2);
+  x(0) = coeff(0);
+  x(1) = 0;
+  sv.update_state(x);
+  std::vector<int> plist;
+  for(int i = 403; i <= 414; ++i)
+    plist.push_back(i);
+  IfstreamCs expected(test_data_dir() + "expected/ils_convolution/basic");
+  Array<double, 1> wn_in, rad_hres_in;
+  expected >> wn_in >> rad_hres_in;
+  Array<double, 2> jac(rad_hres_in.rows(), 2);
+  jac = 0;
+  jac(Range::all(), 1) = rad_hres_in;
+  ArrayAd<double, 1> rad(rad_hres_in, jac);
+  benchmark("ils_apply_ils",
+	    boost::bind(&run_ils, boost::cref(ils), boost::cref(wn_in),
+			boost::cref(rad), boost::cref(plist)));
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(benchmark_solver, GlobalFixture)
+BOOST_AUTO_TEST_CASE(do_inversion)
+{
+  ConnorSolver cs(boost::shared_ptr<CostFunction>
+		  (new BenchmarkSolverCostFunction),
+		  boost::shared_ptr<ConvergenceCheck>(new ChisqConvergence));
+  benchmark("connor_do_inversion",
+	    boost::bind(&run_solver, boost::ref(cs),
+			test_data_dir() +
+			"expected/connor_solver/connor_save.txt"));
+}
+BOOST_AUTO_TEST_SUITE_END()
+
+BOOST_FIXTURE_TEST_SUITE(benchmark_forward_model, ConfigurationFixture)
+BOOST_AUTO_TEST_CASE(radiance_all)
+{
+  // This is much slower than the other benchmarks, so we don't repeat
+  // it as often.
+  benchmark("forward_model_radiance_all",
+	    boost::bind(&run_forward_model,
+			boost::cref(*config_forward_model)), 2);
+}
+BOOST_AUTO_TEST_SUITE_END()
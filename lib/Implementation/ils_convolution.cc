@@ -24,7 +24,6 @@ blitz::Array<double, 1> IlsConvolution::apply_ils
   if(Hres_wn.rows() != Hres_rad.rows())
     throw Exception("wave_number and radiance need to be the same size");
   Array<double, 1> disp_wn(disp->pixel_grid().data());
-  ArrayAd<double, 1> response;
   Array<double,1> res((int) Pixel_list.size());
   for(int i = 0; i < res.rows(); ++i) {
     // Find the range of Hres_wn that lie within
@@ -41,10 +40,16 @@ blitz::Array<double, 1> IlsConvolution::apply_ils
     int jmax = (itmax == Hres_wn.end() ? Hres_wn.rows() - 1 : itmax.position()(0));
     Range r(jmin, jmax);
 
-    // Convolve with response
+    // Convolve with response. The temporaries here are created for
+    // every pixel, so get the memory from arena rather than the
+    // heap. The ils function resizes response, which doesn't
+    // reallocate if we guessed the size correctly.
 
+    ScratchArena::Scope scope(arena);
+    ArrayAd<double, 1> response(arena.array_ad<double>(r.length(), 0));
     ils_func->ils(wn_center, Hres_wn(r), response);
-    Array<double, 1> conv(response.value() * Hres_rad(r));
+    Array<double, 1> conv(arena.array<double>(response.rows()));
+    conv = response.value() * Hres_rad(r);
 
     // And integrate to get pixel value.
 
@@ -103,11 +108,9 @@ ArrayAd<double, 1> IlsConvolution::apply_ils
   ArrayAd<double,1> res((int) Pixel_list.size(), 
 			std::max(disp_wn.number_variable(), 
 				 Hres_rad.number_variable()));
-  // A few scratch variables, defined outside of loop so we don't keep
-  // recreating them.
+  // A scratch variable, defined outside of loop so we don't keep
+  // recreating it.
   Array<double, 1> normfact_grad(disp_wn.number_variable());
-  ArrayAd<double, 1> conv(1, res.number_variable());
-  ArrayAd<double, 1> response;
   for(int i = 0; i < res.rows(); ++i) {
     // Find the range of Hres_wn that lie within
     // wn_center +- ils_half_width
@@ -127,7 +130,11 @@ ArrayAd<double, 1> IlsConvolution::apply_ils
     // For speed, we just calculate dresponse/d[wn_center, coeff]. This along
     // with the chain rule is enough to calculate the Jacobian, and is
     // faster. 
+    // As in the other apply_ils, the temporaries we create for each
+    // pixel get their memory from arena.
+    ScratchArena::Scope scope(arena);
     AutoDerivative<double> wn_center2(wn_center.value(), 0, 2);
+    ArrayAd<double, 1> response(arena.array_ad<double>(r.length(), 2));
     ils_func->ils(wn_center2, Hres_wn(r), response, true);
 
     // Note that this is currently hardcoded to assume at most one
@@ -149,7 +156,8 @@ ArrayAd<double, 1> IlsConvolution::apply_ils
     AutoDerivative<double> normfact(normfact_dwn.value(), normfact_grad);
 
     
-    conv.resize(response.rows(), res.number_variable());
+    ArrayAd<double, 1> conv(arena.array_ad<double>(response.rows(), 
+						   res.number_variable()));
     conv.value() = response.value() * Hres_rad(r).value();
 
     if (!Hres_rad.is_constant() && !wn_center.is_constant()) {
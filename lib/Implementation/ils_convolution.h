@@ -3,6 +3,7 @@
 #include "ils.h"
 #include "ils_function.h"
 #include "dispersion.h"
+#include "scratch_arena.h"
 
 namespace FullPhysics {
   class HdfFile;
@@ -85,6 +86,8 @@ private:
   boost::shared_ptr<Dispersion> disp;
   boost::shared_ptr<IlsFunction> ils_func;
   DoubleWithUnit ils_half_width_;
+  // Memory for the temporaries we create for each pixel.
+  mutable ScratchArena arena;
   double integrate(const blitz::Array<double, 1>& x, 
 		   const blitz::Array<double, 1>& y) const;
   AutoDerivative<double> integrate(const blitz::Array<double, 1>& x, 
@@ -1,6 +1,7 @@
 #include "ils_fts.h"
-#include "linear_algebra.h"
 #include "ostream_pad.h"
+#include <algorithm>
+#include <cmath>
 using namespace FullPhysics;
 using namespace blitz;
 
@@ -28,24 +29,107 @@ REGISTER_LUA_DERIVED_CLASS(IlsFts, Ils)
 REGISTER_LUA_END()
 #endif
 
-extern "C" {
-
-  void iof_model_instrument_fts(
-    const double *ils_1,
-    const double *ils_2,
-    const double *ils_3,
-    const double *dispersion_2,
-    const double* disp_wn, 
-    const int* disp_wn_size, 
-    const double* wn, 
-    const int* wn_size,
-    const double* rad_calc, 
-    const int *num_rad,
-    const double *start,
-    const double  *end,
-    const double* rad_conv);
+/// @cond
+namespace {
+// These are fixed in the old Fortran code, and must match the values
+// used by jetspe.
+const int fts_interpol = 50;
+const int fts_ils_cycle = 25;
+
+//-----------------------------------------------------------------------
+/// The index (1 based) of the last value of X that is <= V. Like the
+/// old Fortran code, the comparison is done in single precision.
+//-----------------------------------------------------------------------
+
+int fts_hunt(const Array<double, 1>& X, double V)
+{
+  int lo = 0, hi = X.rows();
+  while(lo < hi) {
+    int mid = (lo + hi) / 2;
+    if((float) X(mid) <= (float) V)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
 }
 
+//-----------------------------------------------------------------------
+/// The index (0 based) of the start of the spline interval that V
+/// falls in.
+//-----------------------------------------------------------------------
+
+int fts_bracket(const Array<double, 1>& X, double V)
+{
+  int i = (int) (std::upper_bound(X.dataFirst(), X.dataFirst() + X.rows(), V) -
+		 X.dataFirst()) - 1;
+  return std::max(0, std::min(i, X.rows() - 2));
+}
+
+//-----------------------------------------------------------------------
+/// Calculate the ILS kernel, a sinc convolved with a box-car, with Ns
+/// points. This is the Fortran routine profzl with the apodization
+/// 1, followed by normalization. The kernel is calculated in single
+/// precision like the Fortran, so we get the same values.
+//-----------------------------------------------------------------------
+
+Array<double, 1> fts_kernel(int Ns, double Resnog, double Rectog)
+{
+  const double pi = 3.14159265;
+  const double c0 = 0.5480f, c1 = -0.0833f, c2 = 0.5353f;
+  double hwid = 0.5 * (Ns - 1);
+  double off = 0;
+  if(Resnog > hwid)
+    off = fabs(hwid - Resnog);
+  // Number of (equally weighted) points used to represent the box-car,
+  // with a spacing chosen to match the first three moments.
+  int np = 2 + int(4 * Rectog / Resnog);
+  double del = Rectog / sqrt(np * double(np) - 1.0);
+  if(Rectog < 0.0001)
+    np = 1;
+  double can = pi / Resnog;
+  std::vector<float> a(Ns);
+  float tot = 0;
+  for(int k = 0; k < Ns; ++k) {
+    a[k] = 0;
+    double xx = k - hwid;
+    for(int jp = -np + 1; jp <= np - 1; jp += 2) {
+      double t = can * (xx - off + jp * del / 2);
+      double t2 = t * t;
+      double t4 = t2 * t2;
+      double q0, q1, q2;
+      if(t2 >= 1.2) {
+	q0 = sin(t) / t;
+	double p = cos(t);
+	q1 = 3 * (q0 - p) / t2;
+	q2 = -15 * ((1 - 3 / t2) * q0 + 3 * p / t2) / t2;
+      } else {
+	double t6 = t2 * t4;
+	double t8 = t2 * t6;
+	q0 = 1 - t2 / 6 + t4 / 120 - t6 / 5040 + t8 / 362880;
+	q1 = 1 - t2 / 10 + t4 / 280 - t6 / 15120 + t8 / 1330560;
+	q2 = 1 - t2 / 14 + t4 / 504 - t6 / 33264 + t8 / 3459456;
+      }
+      a[k] = a[k] + (float) (c0 * q0 + c1 * q1 + c2 * q2);
+    }
+    // Apodize weakly
+    double ap = 1.0 - (xx / hwid) * (xx / hwid);
+    a[k] = a[k] * (float) (ap * ap);
+    tot += a[k];
+  }
+  Array<double, 1> res(Ns);
+  for(int k = 0; k < Ns; ++k)
+    res(k) = a[k] / tot;
+  return res;
+}
+
+bool same_array(const Array<double, 1>& A, const Array<double, 1>& B)
+{
+  return A.rows() == B.rows() && (A.rows() == 0 || all(A == B));
+}
+}
+/// @endcond
+
 //-----------------------------------------------------------------------
 /// Constructor.
 //-----------------------------------------------------------------------
@@ -60,97 +144,268 @@ IlsFts::IlsFts
  const DoubleWithUnit& Ils_half_width)
   : band_name_(Band_name), hdf_band_name_(Hdf_band_name),
     disp(Disp), level_1b(Level_1b), 
-    spec_index(Spec_index), ils_half_width_(Ils_half_width)
+    spec_index(Spec_index), ils_half_width_(Ils_half_width),
+    op_first_node(0), op_number_node(0)
 { 
-  disp_perturb.reference(Dispersion_perturb.copy());
   disp->add_observer(*this); 
 }
 
-// See base class for description
-blitz::Array<double, 1> IlsFts::apply_ils
+//-----------------------------------------------------------------------
+/// Calculate the banded operator that takes the high resolution
+/// radiance to the convolved radiance at each pixel in the
+/// Pixel_list. We skip this if we already have the operator for the
+/// same grids.
+///
+/// This follows the old Fortran code: we use a natural cubic spline
+/// through the high resolution radiance to interpolate to a fine
+/// grid (fts_interpol points per pixel), and take the dot product of
+/// this with the ILS kernel centered at the nearest fine grid point
+/// to each pixel. The spline value at each fine grid point is a
+/// linear combination of the radiance and its second derivative at
+/// the two surrounding nodes, so we can sum the kernel weights for
+/// each node. op_rad and op_rad2 are the weights for the radiance and
+/// second derivative, op_drad and op_drad2 are the same thing for
+/// the derivative of the interpolated radiance with respect to
+/// wavenumber.
+//-----------------------------------------------------------------------
+
+void IlsFts::calc_operator
 (const blitz::Array<double, 1>& High_resolution_wave_number,
- const blitz::Array<double, 1>& High_resolution_radiance,
  const std::vector<int>& Pixel_list) const
 {
-  if(High_resolution_wave_number.rows() != High_resolution_radiance.rows())
-    throw Exception("High_resolution_wave_number and High_resolution_radiance need to be the same size");
- 
-  // Apply convolution
-
-  // wave_number might not be contiguous. Since the Fortran code
-  // requires that it is, we make a copy if needed.
-  Array<double, 1> wave_number_contiguous = 
-    to_fortran_const(High_resolution_wave_number);
-  int number_wavelength = wave_number_contiguous.rows();
-
-  Array<double, 1> radiance_contiguous = 
-    to_fortran_const(High_resolution_radiance);
-  int nrad=radiance_contiguous.rows();
-
   Array<double, 1> disp_wn(pixel_grid().wavenumber());
-  int dwn_size = disp_wn.rows();
-
-  // Result array
-  Array<double,1> res_full(dwn_size);
-
+  if(op_pixel_list == Pixel_list && 
+     same_array(op_hres_wn, High_resolution_wave_number) &&
+     same_array(op_pixel_wn, disp_wn))
+    return;
+  int nwn = High_resolution_wave_number.rows();
+  int ndisp = disp_wn.rows();
+  if(nwn < 9 || ndisp < 2)
+    throw Exception("Not enough points in the wavenumber grids for IlsFts");
   double spacing = disp_wn(1) - disp_wn(0);
   double opd = level_1b->run_log(spec_index).optical_path_difference;
   double fov = level_1b->run_log(spec_index).internal_fov;
   double ang_misalignment = level_1b->run_log(spec_index).angular_misalignment;
-  
   double start = level_1b->frequency_start(spec_index);
   double end   = level_1b->frequency_end(spec_index);
 
-  iof_model_instrument_fts(&opd,&fov,&ang_misalignment,&spacing,
-                           disp_wn.data(),&dwn_size,
-                           wave_number_contiguous.data(),
-                           &number_wavelength,radiance_contiguous.data(),
-                           &nrad,&start,&end,res_full.dataFirst());
+  double resnog = 0.5 / opd / spacing;
+  double width = fts_ils_cycle * resnog;
+  double wn_first = disp_wn(0) - (int(1.1 * width) + 1) * spacing;
+  double wn_last = disp_wn(ndisp - 1) + (int(1.1 * width) + 1) * spacing;
+  double interpol_grid = spacing / fts_interpol;
+
+//-----------------------------------------------------------------------
+// Range of the high resolution grid that we use for the spline, with
+// a few extra points on each side.
+//-----------------------------------------------------------------------
 
-  Array<double,1> res(Pixel_list.size());
-  for (int i=0; i< (int) Pixel_list.size(); ++i) {
-     res(i) = res_full(Pixel_list[i]);
+  if(!(wn_first > High_resolution_wave_number(3))) {
+    Exception e;
+    e << "Start of wavenumber range of RT calculation too small. Convolution "
+      << "start wn = " << wn_first << ", high res start wn = " 
+      << High_resolution_wave_number(3);
+    throw e;
   }
-  
+  if(!(wn_last < High_resolution_wave_number(nwn - 5))) {
+    Exception e;
+    e << "End of wavenumber range of RT calculation too small. Convolution "
+      << "end wn = " << wn_last << ", high res end wn = " 
+      << High_resolution_wave_number(nwn - 5);
+    throw e;
+  }
+  op_first_node = fts_hunt(High_resolution_wave_number, wn_first) - 4;
+  op_number_node = fts_hunt(High_resolution_wave_number, wn_last) + 3 -
+    op_first_node + 1;
+  Array<double, 1> x(High_resolution_wave_number
+		     (Range(op_first_node, op_first_node + op_number_node - 1)).
+		     copy());
+
+//-----------------------------------------------------------------------
+// ILS kernel, on the fine grid.
+//-----------------------------------------------------------------------
+
+  double rect = (end + start) / 2 * 
+    (fov * fov + ang_misalignment * ang_misalignment) / 8;
+  int nii = 2 * fts_interpol * int(width) + 1;
+  int hw = (nii - 1) / 2;
+  Array<double, 1> ils = fts_kernel(nii, fts_interpol * resnog, 
+				    fts_interpol * rect / spacing);
+
+//-----------------------------------------------------------------------
+// Find the nodes each pixel depends on. We use the same band size
+// for each pixel, which may include a few zeros at the edges.
+//-----------------------------------------------------------------------
+
+  int npix = (int) Pixel_list.size();
+  std::vector<int> fine_start(npix);
+  op_start.resize(npix);
+  int nband = 2;
+  for(int i = 0; i < npix; ++i) {
+    range_check(Pixel_list[i], 0, ndisp);
+    fine_start[i] = (int) floor((disp_wn(Pixel_list[i]) - wn_first) / 
+				interpol_grid + 0.5) - hw;
+    op_start(i) = fts_bracket(x, wn_first + fine_start[i] * interpol_grid);
+    int jend = 
+      fts_bracket(x, wn_first + (fine_start[i] + nii - 1) * interpol_grid) + 1;
+    nband = std::max(nband, jend - op_start(i) + 1);
+  }
+  nband = std::min(nband, op_number_node);
+  op_rad.resize(npix, nband);
+  op_rad2.resize(npix, nband);
+  op_drad.resize(npix, nband);
+  op_drad2.resize(npix, nband);
+  op_rad = 0;
+  op_rad2 = 0;
+  op_drad = 0;
+  op_drad2 = 0;
+  for(int i = 0; i < npix; ++i) {
+    op_start(i) = std::min(op_start(i), op_number_node - nband);
+    int klo = fts_bracket(x, wn_first + fine_start[i] * interpol_grid);
+    for(int k = 0; k < nii; ++k) {
+      double xf = wn_first + (fine_start[i] + k) * interpol_grid;
+      while(klo < op_number_node - 2 && x(klo + 1) <= xf)
+	++klo;
+      double h = x(klo + 1) - x(klo);
+      double a = (x(klo + 1) - xf) / h;
+      double b = (xf - x(klo)) / h;
+      double w = ils(k);
+      int j = klo - op_start(i);
+      op_rad(i, j) += w * a;
+      op_rad(i, j + 1) += w * b;
+      op_rad2(i, j) += w * (a * a * a - a) * h * h / 6;
+      op_rad2(i, j + 1) += w * (b * b * b - b) * h * h / 6;
+      op_drad(i, j) -= w / h;
+      op_drad(i, j + 1) += w / h;
+      op_drad2(i, j) -= w * (3 * a * a - 1) * h / 6;
+      op_drad2(i, j + 1) += w * (3 * b * b - 1) * h / 6;
+    }
+  }
+  op_hres_wn.reference(High_resolution_wave_number.copy());
+  op_pixel_wn.reference(disp_wn.copy());
+  op_pixel_list = Pixel_list;
+}
+
+//-----------------------------------------------------------------------
+/// Apply the ILS to each column of High_resolution_radiance. We also
+/// return the derivative of the convolved first column with respect
+/// to the pixel wavenumber.
+//-----------------------------------------------------------------------
+
+blitz::Array<double, 2> IlsFts::convolve
+(const blitz::Array<double, 1>& High_resolution_wave_number,
+ const blitz::Array<double, 2>& High_resolution_radiance,
+ const std::vector<int>& Pixel_list,
+ blitz::Array<double, 1>& Drad_dwn) const
+{
+  if(High_resolution_wave_number.rows() != High_resolution_radiance.rows())
+    throw Exception("High_resolution_wave_number and High_resolution_radiance need to be the same size");
+  calc_operator(High_resolution_wave_number, Pixel_list);
+  int n = op_number_node;
+  int ncol = High_resolution_radiance.cols();
+  Array<double, 1> x(op_hres_wn(Range(op_first_node, op_first_node + n - 1)));
+  Array<double, 2> y(High_resolution_radiance(Range(op_first_node, 
+						    op_first_node + n - 1),
+					      Range::all()));
+
+//-----------------------------------------------------------------------
+// Second derivatives of the natural cubic spline through each
+// column. The tridiagonal factors only depend on x, so these are
+// shared by all the columns.
+//-----------------------------------------------------------------------
+
+  Array<double, 1> fac(n);
+  Array<double, 2> y2(n, ncol);
+  fac(0) = 0;
+  y2(0, Range::all()) = 0;
+  for(int i = 1; i < n - 1; ++i) {
+    double dx0 = x(i) - x(i - 1);
+    double dx1 = x(i + 1) - x(i);
+    double dx2 = x(i + 1) - x(i - 1);
+    double sig = dx0 / dx2;
+    double p = sig * fac(i - 1) + 2.0;
+    fac(i) = (sig - 1.0) / p;
+    for(int c = 0; c < ncol; ++c)
+      y2(i, c) = (6.0 * ((y(i + 1, c) - y(i, c)) / dx1 - 
+			 (y(i, c) - y(i - 1, c)) / dx0) / dx2 - 
+		  sig * y2(i - 1, c)) / p;
+  }
+  y2(n - 1, Range::all()) = 0;
+  for(int i = n - 2; i >= 0; --i)
+    for(int c = 0; c < ncol; ++c)
+      y2(i, c) += fac(i) * y2(i + 1, c);
+
+//-----------------------------------------------------------------------
+// Apply the banded operator.
+//-----------------------------------------------------------------------
+
+  int npix = (int) Pixel_list.size();
+  Array<double, 2> res(npix, ncol);
+  res = 0;
+  Drad_dwn.resize(npix);
+  Drad_dwn = 0;
+  for(int i = 0; i < npix; ++i)
+    for(int j = 0; j < op_rad.cols(); ++j) {
+      int k = op_start(i) + j;
+      double wr = op_rad(i, j);
+      double wr2 = op_rad2(i, j);
+      for(int c = 0; c < ncol; ++c)
+	res(i, c) += wr * y(k, c) + wr2 * y2(k, c);
+      Drad_dwn(i) += op_drad(i, j) * y(k, 0) + op_drad2(i, j) * y2(k, 0);
+    }
   return res;
 }
 
+// See base class for description
+blitz::Array<double, 1> IlsFts::apply_ils
+(const blitz::Array<double, 1>& High_resolution_wave_number,
+ const blitz::Array<double, 1>& High_resolution_radiance,
+ const std::vector<int>& Pixel_list) const
+{
+  Array<double, 2> rad(High_resolution_radiance.rows(), 1);
+  rad(Range::all(), 0) = High_resolution_radiance;
+  Array<double, 1> drad_dwn;
+  Array<double, 2> res = convolve(High_resolution_wave_number, rad, 
+				  Pixel_list, drad_dwn);
+  return res(Range::all(), 0);
+}
+
 // See base class for description
 ArrayAd<double, 1> IlsFts::apply_ils
 (const blitz::Array<double, 1>& High_resolution_wave_number,
  const ArrayAd<double, 1>& High_resolution_radiance,
  const std::vector<int>& Pixel_list) const
 {
-  ArrayAd<double, 1> res((int) Pixel_list.size(), 
-                         High_resolution_radiance.number_variable());
-  res.value() = apply_ils(High_resolution_wave_number, 
-                          High_resolution_radiance.value(), 
-                          Pixel_list);
-  // Apply instrument model to jacobians
-  for(int i = 0; i < res.number_variable(); ++i)
-    res.jacobian()(Range::all(), i) = 
-      apply_ils(High_resolution_wave_number, 
-                High_resolution_radiance.jacobian()(Range::all(),i), 
-                Pixel_list);
-
-  // This will go away shortly.
-  // svi = -1 in FM only mode
-  int svi = disp->state_vector_start_index();
-  if (svi > 0) {
-    Array<double, 1> coeff(disp->coefficient().value());
-    for(int i = 0; i < disp->used_flag_value().rows(); ++i)
-      if(disp->used_flag_value()(i)) {
-        double old_disp = coeff(i);
-        coeff(i) += disp_perturb(spec_index, i);
-        res.jacobian()(Range::all(), svi) +=
-            (apply_ils(High_resolution_wave_number, 
-                       High_resolution_radiance.value(), 
-                       Pixel_list) -
-             res.value()) / disp_perturb(spec_index, i);
-        coeff(i) = old_disp;
-        ++svi;
-      }
-  }
+  // Value and Jacobian are convolved as one block.
+  int nvar = High_resolution_radiance.number_variable();
+  Array<double, 2> rad(High_resolution_radiance.rows(), 1 + nvar);
+  rad(Range::all(), 0) = High_resolution_radiance.value();
+  if(nvar > 0)
+    rad(Range::all(), Range(1, nvar)) = High_resolution_radiance.jacobian();
+  Array<double, 1> drad_dwn;
+  Array<double, 2> r = convolve(High_resolution_wave_number, rad, 
+				Pixel_list, drad_dwn);
+  ArrayAd<double, 1> res((int) Pixel_list.size(), nvar);
+  res.value() = r(Range::all(), 0);
+  if(nvar > 0)
+    res.jacobian() = r(Range::all(), Range(1, nvar));
+
+  // Add in the dependence on the dispersion. This is zero if we
+  // aren't retrieving the dispersion (e.g., FM only mode).
+  SpectralDomain pgrid = pixel_grid();
+  const ArrayAd<double, 1>& pwn = pgrid.data_ad();
+  if(pwn.is_constant())
+    return res;
+  if(!pgrid.units().is_commensurate(units::inv_cm))
+    throw Exception("IlsFts requires the dispersion to be in wavenumbers");
+  double cfac = conversion(pgrid.units(), units::inv_cm);
+  if(res.is_constant())
+    res.resize_number_variable(pwn.number_variable());
+  if(res.number_variable() != pwn.number_variable())
+    throw Exception("Radiance and dispersion Jacobians need to be the same size");
+  for(int i = 0; i < res.rows(); ++i)
+    res.jacobian()(i, Range::all()) += 
+      (drad_dwn(i) * cfac) * pwn.jacobian()(Pixel_list[i], Range::all());
   return res;
 }
 
@@ -160,8 +415,8 @@ boost::shared_ptr<Ils> IlsFts::clone() const
   return boost::shared_ptr<Ils>
     (new IlsFts
      (boost::dynamic_pointer_cast<DispersionPolynomial>(disp->clone()),
-      disp_perturb, level_1b, spec_index, band_name_, hdf_band_name_, 
-      ils_half_width_));
+      blitz::Array<double, 2>(), level_1b, spec_index, band_name_, 
+      hdf_band_name_, ils_half_width_));
 }
 
 // See base class for description
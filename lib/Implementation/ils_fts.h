@@ -8,9 +8,26 @@
 namespace FullPhysics {
 
 /****************************************************************//**
-  This does an ILS convolution for FTS data. This wraps some old
-  Fortran code that models and sinc + box-car. We may replace this
-  at some point.
+  This does an ILS convolution for FTS data. This models the ILS as a
+  sinc + box-car, following the old GFIT Fortran code: the high
+  resolution radiance is spline interpolated to a fine grid and then
+  convolved with the ILS kernel.
+
+  Since the spline interpolation and the convolution are both linear
+  in the radiance, we combine them into a banded operator that maps
+  the high resolution radiance (and its spline second derivatives)
+  directly to each pixel. The operator depends only on the high
+  resolution and pixel grids, so we cache it between calls. The
+  radiance and each column of its Jacobian are then applied as one
+  block, rather than doing a full convolution for each column.
+
+  The derivative with respect to the dispersion is calculated
+  analytically, by convolving the derivative of the spline
+  interpolated radiance with the kernel centered at each pixel and
+  applying the chain rule with the Jacobian of the pixel grid. The
+  Dispersion_perturb values used by the older finite difference
+  calculation are no longer needed. The argument is ignored, we just
+  keep it for existing configurations.
 *******************************************************************/
 
 class IlsFts : public Ils, public Observer<Dispersion> {
@@ -55,10 +72,27 @@ private:
   std::string band_name_;
   std::string hdf_band_name_;
   boost::shared_ptr<DispersionPolynomial> disp;
-  blitz::Array<double, 2> disp_perturb;
   boost::shared_ptr<Level1bFts> level_1b;
   int spec_index;
   DoubleWithUnit ils_half_width_;
+
+  // Cached banded operator, see calc_operator. The band for pixel
+  // Pixel_list[i] starts at the spline node op_start(i), relative to
+  // op_first_node.
+  mutable blitz::Array<double, 2> op_rad, op_rad2, op_drad, op_drad2;
+  mutable blitz::Array<int, 1> op_start;
+  mutable int op_first_node, op_number_node;
+  // Values the operator depends on, so we know when to recalculate.
+  mutable blitz::Array<double, 1> op_hres_wn, op_pixel_wn;
+  mutable std::vector<int> op_pixel_list;
+  void calc_operator
+  (const blitz::Array<double, 1>& High_resolution_wave_number,
+   const std::vector<int>& Pixel_list) const;
+  blitz::Array<double, 2> convolve
+  (const blitz::Array<double, 1>& High_resolution_wave_number,
+   const blitz::Array<double, 2>& High_resolution_radiance,
+   const std::vector<int>& Pixel_list,
+   blitz::Array<double, 1>& Drad_dwn) const;
 };
 }
 #endif
@@ -87,4 +87,60 @@ BOOST_AUTO_TEST_CASE(basic)
   
 }
 
+BOOST_AUTO_TEST_CASE(jacobian)
+{
+  std::vector<std::string> spectra;
+  spectra.push_back(test_data_dir() + 
+		    "in/l1b/spec/pa20091103saaaaa_100223160344.008");
+  ArrayWithUnit<double, 2> spec_range;
+  spec_range.value.resize(1, 2);
+  spec_range.units = units::inv_cm;
+  spec_range.value = 6173.0, 6275.0;
+  boost::shared_ptr<Level1bFts> l1b_fts(new Level1bFts(test_data_dir() + "in/pa20091103_100223163011.grl", spectra, spec_range));
+  blitz::Array<double, 1> disp_coeff(2);
+  disp_coeff = 6173.0156278633530746, 0.0075330826756407334374; 
+  Array<bool, 1> flag_disp(2);
+  flag_disp = true, false;
+  boost::shared_ptr<DispersionPolynomial> 
+    disp(new DispersionPolynomial(disp_coeff, flag_disp, "cm^-1", "Band 1", 
+				   l1b_fts->radiance(0).data().rows(), false));
+  // Dispersion perturbation isn't used
+  IlsFts ils_fts(disp, Array<double, 2>(), l1b_fts, 0, "Band 1", "band_1");
+  StateVector sv;
+  sv.add_observer(ils_fts);
+  Array<double,1> x(2);
+  x(0) = disp_coeff(0);
+  x(1) = 0;
+  sv.update_state(x);
+
+  IfstreamCs indata(test_data_dir() + "/expected/ils_fts/ils_fts");
+  Array<double, 1> wn_in, rad_hres_in, ils_out_expect;
+  indata >> wn_in >> rad_hres_in >> ils_out_expect;
+  std::vector<int> pixel_list;
+  for(int i = 10; i <= 100; ++i)
+    pixel_list.push_back(i);
+
+  // Value and Jacobian are done as one block, check that this gives
+  // the same results as doing each separately.
+  Array<double, 2> jac_rad_fake(rad_hres_in.rows(), 2);
+  jac_rad_fake = 0;
+  jac_rad_fake(Range::all(), 1) = rad_hres_in;
+  ArrayAd<double, 1> rad_hres_in2(rad_hres_in, jac_rad_fake);
+  ArrayAd<double, 1> res = ils_fts.apply_ils(wn_in, rad_hres_in2, pixel_list);
+  Array<double, 1> v0 = ils_fts.apply_ils(wn_in, rad_hres_in, pixel_list);
+  BOOST_CHECK_MATRIX_CLOSE_TOL(ils_out_expect, res.value(), 2e-5);
+  BOOST_CHECK_MATRIX_CLOSE(res.value(), v0);
+  BOOST_CHECK_MATRIX_CLOSE(res.jacobian()(Range::all(), 1), v0);
+
+  // Compare the analytic dispersion derivative with finite
+  // differences.
+  double epsilon = 1e-6;
+  x(0) += epsilon;
+  sv.update_state(x);
+  Array<double, 1> v1 = ils_fts.apply_ils(wn_in, rad_hres_in, pixel_list);
+  Array<double, 1> jacd(v1.shape());
+  jacd = (v1 - v0) / epsilon;
+  BOOST_CHECK_MATRIX_CLOSE_TOL(res.jacobian()(Range::all(), 0), jacd, 1e-3);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -1,5 +1,6 @@
 #include "ils_instrument.h"
 #include "ostream_pad.h"
+#include "profiler.h"
 #include <boost/foreach.hpp>
 
 using namespace FullPhysics;
@@ -84,6 +85,7 @@ Spectrum IlsInstrument::apply_instrument_model(
     const std::vector<int>& Pixel_list,
     int Spec_index) const 
 {
+  FP_PROFILE_SCOPE("IlsInstrument apply_instrument_model");
   range_check(Spec_index, 0, number_spectrometer());
 
   SpectralDomain full = pixel_spectral_domain(Spec_index);
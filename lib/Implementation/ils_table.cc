@@ -21,6 +21,7 @@ REGISTER_LUA_DERIVED_CLASS(IlsTableLinear, IlsFunction)
                           const std::string&, const std::string&,
                           bool>())
 .def("band_name", &IlsTableLinear::band_name)
+.def("clone", &IlsTableLinear::clone)
 REGISTER_LUA_END()
 
 REGISTER_LUA_DERIVED_CLASS(IlsTableLog, IlsFunction)
@@ -39,6 +40,7 @@ REGISTER_LUA_DERIVED_CLASS(IlsTableLog, IlsFunction)
                           const std::string&, const std::string&,
                           bool>())
 .def("band_name", &IlsTableLog::band_name)
+.def("clone", &IlsTableLog::clone)
 REGISTER_LUA_END()
 
 #endif
@@ -2,9 +2,54 @@
 #include "hdf_file_generating.h"
 #include "output_hdf.h"
 #include "output_hdf_iteration.h"
+#include "output_manifest.h"
 #include "register_output_base.h"
+#include "fe_disable_exception.h"
+#include <cstdlib>
 using namespace FullPhysics;
 
+//-----------------------------------------------------------------------
+/// This is used when processing a number of soundings in one process
+/// (e.g., "l2_fp -b"). We run the configuration file Fname again in
+/// the existing LuaState Ls, with the environment variable
+/// "sounding_id" set to Sounding_id. 
+///
+/// The configuration modules read things like the sounding id when
+/// they are first loaded by "require", so we unload any module that
+/// was loaded after the first call to this function before running
+/// the file again. Static inputs like the ABSCO tables are created
+/// through StaticInputRegistry, which keeps them resident from one
+/// sounding to the next.
+///
+/// The LuaState should have been created with the directory that
+/// Fname is in, as LuaState::load_file does.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<L2FpConfigurationLua> 
+L2FpConfigurationLua::load_sounding
+(const boost::shared_ptr<LuaState>& Ls,
+ const std::string& Fname, const std::string& Sounding_id,
+ const std::string& Out_file)
+{
+  // See LuaState::load_file for why we do this.
+  FeDisableException disable_fp;
+  if(setenv("sounding_id", Sounding_id.c_str(), 1) != 0)
+    throw Exception("Call to setenv failed");
+  Ls->run(
+"if(batch_module_snapshot == nil) then\n"
+"   batch_module_snapshot = {}\n"
+"   for k in pairs(package.loaded) do batch_module_snapshot[k] = true end\n"
+"else\n"
+"   for k in pairs(package.loaded) do\n"
+"      if(not batch_module_snapshot[k]) then package.loaded[k] = nil end\n"
+"   end\n"
+"end\n");
+  size_t t = Fname.find_last_of("/");
+  Ls->do_file(t == std::string::npos ? Fname : Fname.substr(t + 1));
+  return boost::shared_ptr<L2FpConfigurationLua>
+    (new L2FpConfigurationLua(Ls, Out_file));
+}
+
 // See base class for description.
 void L2FpConfigurationLua::output(boost::shared_ptr<Output>& Regular_output,
 				  boost::shared_ptr<Output>& Error_output) const
@@ -29,6 +74,16 @@ void L2FpConfigurationLua::output(boost::shared_ptr<Output>& Regular_output,
     (new OutputHdf(output_name_ + ".error", npres, 
 		   forward_model()->state_vector()->observer_claimed_size(), 
 		   num_aer_part + 1, nband));
+  // Set the manifest before registering anything, so disabled
+  // datasets never get registered.
+  if(!ls->globals()["output_manifest"].is_nil()) {
+    boost::shared_ptr<OutputManifest> m = 
+      ls->globals()["output_manifest"].value_ptr<OutputManifest>();
+    Regular_output->manifest(m);
+    Error_output->manifest(m);
+    if(out_iteration)
+      out_iteration->manifest(m);
+  }
   std::vector<boost::shared_ptr<RegisterOutputBase> > out_reg
     = ls->globals()["register_output"].value<std::vector<boost::shared_ptr<RegisterOutputBase> > >();
   BOOST_FOREACH(const boost::shared_ptr<RegisterOutputBase>& r, out_reg) {
@@ -40,6 +40,12 @@ namespace FullPhysics {
        list of output that should be generated. This list can empty if
        no output is desired. The Lua type for this is called 
        VectorRegisterOutput (since Lua doesn't have templates).
+
+   There is also an optional variable:
+
+   \li output_manifest - A OutputManifest used to select which
+       datasets get written. If this isn't defined (or is nil) then
+       all the datasets are written.
 *******************************************************************/
 
 class L2FpConfigurationLua : public L2FpConfiguration {
@@ -73,6 +79,10 @@ public:
       output_name_(Argc > 1 ? Argv[1] : "out.h5")
   {
   }
+  static boost::shared_ptr<L2FpConfigurationLua>
+  load_sounding(const boost::shared_ptr<LuaState>& Ls,
+		const std::string& Fname, const std::string& Sounding_id,
+		const std::string& Out_file);
   virtual ~L2FpConfigurationLua() {}
   virtual boost::shared_ptr<LogImp> logger() const
   {
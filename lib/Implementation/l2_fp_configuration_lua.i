@@ -18,6 +18,10 @@ public:
   L2FpConfigurationLua(const boost::shared_ptr<LuaState>& Ls, 
 		       const std::string& Out_file = "out.h5");
   L2FpConfigurationLua(int Argc, char** Argv);
+  static boost::shared_ptr<L2FpConfigurationLua>
+  load_sounding(const boost::shared_ptr<LuaState>& Ls,
+		const std::string& Fname, const std::string& Sounding_id,
+		const std::string& Out_file);
   %python_attribute_nonconst(lua_state, LuaState)
   %python_attribute_with_set(output_name, std::string);
   virtual void output(boost::shared_ptr<Output>& OUTPUT,
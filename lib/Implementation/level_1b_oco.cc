@@ -16,6 +16,8 @@ REGISTER_LUA_DERIVED_CLASS(Level1bOco, Level1b)
                           const boost::shared_ptr<HdfSoundingId>&>())
 .def(luabind::constructor<const boost::shared_ptr<HdfFile>&, 
                           const boost::shared_ptr<HdfSoundingId>&>())
+.def(luabind::constructor<const boost::shared_ptr<Level1bOcoPreload>&, 
+                          const boost::shared_ptr<HdfSoundingId>&>())
 .property("noise_model", 
           &level_1b_oco_noise_model_get,
           &level_1b_oco_noise_model_set)
@@ -53,6 +55,104 @@ Level1bOco::Level1bOco(const boost::shared_ptr<HdfFile>& Hfile,
   }
 }
 
+//-----------------------------------------------------------------------
+/// Constructor that takes the per sounding data from a
+/// Level1bOcoPreload when the sounding is in the preloaded range.
+//-----------------------------------------------------------------------
+
+Level1bOco::Level1bOco(const boost::shared_ptr<Level1bOcoPreload>& Preload, 
+                       const boost::shared_ptr<HdfSoundingId>& Sounding_id)
+: Level1bHdf(Preload->hdf_file(), Sounding_id), preload_(Preload)
+{
+  try {
+    initialize();
+  } catch(Exception& E) {
+    E << " in the file " << file_name;
+    throw E;
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Read a field with dimensions frame x sounding x n for our
+/// sounding, either from the Level1bOcoPreload or the file.
+//-----------------------------------------------------------------------
+
+ArrayWithUnit<double, 1> Level1bOco::read_sounding_array
+(const std::string& Field, const Unit& Default_unit) const
+{
+  int frame_index = hdf_sounding_id_->frame_number();
+  int sounding_index = hdf_sounding_id_->sounding_number();
+  if(use_preload())
+    return preload_->sounding_array(Field, Default_unit, frame_index, 
+				    sounding_index);
+  TinyVector<int, 3> shape = hfile->read_shape<3>(Field);
+  TinyVector<int, 3> start, size;
+  start = frame_index, sounding_index, 0;
+  size = 1, 1, shape(2);
+  ArrayWithUnit<double, 3> f = 
+    hfile->read_field_with_unit<double, 3>(Field, Default_unit, start, size);
+  return ArrayWithUnit<double, 1>(f.value(0, 0, Range::all()), f.units);
+}
+
+//-----------------------------------------------------------------------
+/// Read a field without units with dimensions frame x sounding x n
+/// for our sounding, either from the Level1bOcoPreload or the file.
+//-----------------------------------------------------------------------
+
+blitz::Array<double, 1> Level1bOco::read_sounding_array
+(const std::string& Field) const
+{
+  int frame_index = hdf_sounding_id_->frame_number();
+  int sounding_index = hdf_sounding_id_->sounding_number();
+  if(use_preload())
+    return preload_->sounding_array(Field, frame_index, sounding_index);
+  TinyVector<int, 3> shape = hfile->read_shape<3>(Field);
+  TinyVector<int, 3> start, size;
+  start = frame_index, sounding_index, 0;
+  size = 1, 1, shape(2);
+  Array<double, 3> f = hfile->read_field<double, 3>(Field, start, size);
+  return f(0, 0, Range::all());
+}
+
+//-----------------------------------------------------------------------
+/// Read a field with dimensions frame x sounding for our sounding,
+/// either from the Level1bOcoPreload or the file.
+//-----------------------------------------------------------------------
+
+DoubleWithUnit Level1bOco::read_sounding_value
+(const std::string& Field, const Unit& Default_unit) const
+{
+  int frame_index = hdf_sounding_id_->frame_number();
+  int sounding_index = hdf_sounding_id_->sounding_number();
+  if(use_preload())
+    return preload_->sounding_value(Field, Default_unit, frame_index, 
+				    sounding_index);
+  TinyVector<int, 2> start, size;
+  start = frame_index, sounding_index;
+  size = 1, 1;
+  ArrayWithUnit<double, 2> f = 
+    hfile->read_field_with_unit<double, 2>(Field, Default_unit, start, size);
+  return f(0, 0);
+}
+
+//-----------------------------------------------------------------------
+/// Read a field without units with dimensions frame x sounding for
+/// our sounding, either from the Level1bOcoPreload or the file.
+//-----------------------------------------------------------------------
+
+double Level1bOco::read_sounding_value(const std::string& Field) const
+{
+  int frame_index = hdf_sounding_id_->frame_number();
+  int sounding_index = hdf_sounding_id_->sounding_number();
+  if(use_preload())
+    return preload_->sounding_value(Field, frame_index, sounding_index);
+  TinyVector<int, 2> start, size;
+  start = frame_index, sounding_index;
+  size = 1, 1;
+  Array<double, 2> f = hfile->read_field<double, 2>(Field, start, size);
+  return f(0, 0);
+}
+
 void Level1bOco::initialize()
 {
   firstIndex i1; secondIndex i2; thirdIndex i3;
@@ -65,41 +165,36 @@ void Level1bOco::initialize()
   int frame_index = hdf_sounding_id_->frame_number();
   int sounding_index = hdf_sounding_id_->sounding_number();
 
-  TinyVector<int, 3> alt_shape = hfile->read_shape<3>("FootprintGeometry/footprint_altitude");
-  TinyVector<int, 3> fg_start, fg_size;
-  fg_start = 
-    frame_index, sounding_index, 0;
-  fg_size = 1, 1, alt_shape(2);
-
-  ArrayWithUnit<double, 3> alt = 
-    hfile->read_field_with_unit<double, 3>("FootprintGeometry/footprint_altitude", units::m, fg_start, fg_size);
-  ArrayWithUnit<double, 3> lat = 
-    hfile->read_field_with_unit<double, 3>("FootprintGeometry/footprint_latitude", units::deg, fg_start, fg_size);
-  ArrayWithUnit<double, 3> lon = 
-    hfile->read_field_with_unit<double, 3>("FootprintGeometry/footprint_longitude", units::deg, fg_start, fg_size);
-  ArrayWithUnit<double, 3> saz = 
-    hfile->read_field_with_unit<double, 3>("FootprintGeometry/footprint_solar_azimuth", units::deg, fg_start, fg_size);
-  ArrayWithUnit<double, 3> szn = 
-    hfile->read_field_with_unit<double, 3>("FootprintGeometry/footprint_solar_zenith", units::deg, fg_start, fg_size);
-  ArrayWithUnit<double, 3> azm = 
-    hfile->read_field_with_unit<double, 3>("FootprintGeometry/footprint_azimuth", units::deg, fg_start, fg_size);
-  ArrayWithUnit<double, 3> zen = 
-    hfile->read_field_with_unit<double, 3>("FootprintGeometry/footprint_zenith", units::deg, fg_start, fg_size);
-
-  Array<double, 3> tm =
-    hfile->read_field<double, 3>("FootprintGeometry/footprint_time_tai93", fg_start, fg_size);
-
-  TinyVector<int, 1> relv_start, relv_size;
-  relv_start = frame_index;
-  relv_size = 1;
+  ArrayWithUnit<double, 1> alt = 
+    read_sounding_array("FootprintGeometry/footprint_altitude", units::m);
+  ArrayWithUnit<double, 1> lat = 
+    read_sounding_array("FootprintGeometry/footprint_latitude", units::deg);
+  ArrayWithUnit<double, 1> lon = 
+    read_sounding_array("FootprintGeometry/footprint_longitude", units::deg);
+  ArrayWithUnit<double, 1> saz = 
+    read_sounding_array("FootprintGeometry/footprint_solar_azimuth", units::deg);
+  ArrayWithUnit<double, 1> szn = 
+    read_sounding_array("FootprintGeometry/footprint_solar_zenith", units::deg);
+  ArrayWithUnit<double, 1> azm = 
+    read_sounding_array("FootprintGeometry/footprint_azimuth", units::deg);
+  ArrayWithUnit<double, 1> zen = 
+    read_sounding_array("FootprintGeometry/footprint_zenith", units::deg);
+
+  Array<double, 1> tm =
+    read_sounding_array("FootprintGeometry/footprint_time_tai93");
 
   if (hfile->has_object("SoundingGeometry/sounding_relative_velocity")) {
-    TinyVector<int,2> vstart, vsize;
-    vstart = frame_index, sounding_index;
-    vsize = 1, 1;
-    ArrayWithUnit<double, 2> relv = hfile->read_field_with_unit<double, 2>("SoundingGeometry/sounding_relative_velocity", units::m / units::s, vstart, vsize);
-    relative_velocity_ = relv(0, 0);
+    relative_velocity_ = 
+      read_sounding_value("SoundingGeometry/sounding_relative_velocity", 
+			  units::m / units::s);
+  } else if(use_preload()) {
+    relative_velocity_ = 
+      preload_->frame_value("FrameGeometry/relative_velocity", 
+			    units::m / units::s, frame_index);
   } else {
+    TinyVector<int, 1> relv_start, relv_size;
+    relv_start = frame_index;
+    relv_size = 1;
     ArrayWithUnit<double, 1> relv = hfile->read_field_with_unit<double, 1>("FrameGeometry/relative_velocity", units::m / units::s, relv_start, relv_size);
     relative_velocity_ = relv(0);
   }
@@ -128,7 +223,7 @@ void Level1bOco::initialize()
   sounding_azimuth_.units = azm.units;
   spectral_coefficient_.units = wl_coeffs.units;
 
-  altitude_.value.resize(alt.value.depth());
+  altitude_.value.resize(alt.value.rows());
   latitude_.value.resize(altitude_.value.shape());
   longitude_.value.resize(altitude_.value.shape());
   solar_azimuth_.value.resize(altitude_.value.shape());
@@ -137,16 +232,17 @@ void Level1bOco::initialize()
   sounding_azimuth_.value.resize(altitude_.value.shape());
   spectral_coefficient_.value.resize(wl_coeffs.value.extent(0), wl_coeffs.value.extent(2));
 
-  // We hyperslabed into the dataset above, so we should have arrays
-  // with shape 1 x 1 x 3
-  altitude_.value = alt.value(0, 0, ra);
-  latitude_.value = lat.value(0, 0, ra);
-  longitude_.value = lon.value(0, 0, ra);
-  solar_azimuth_.value = saz.value(0, 0, ra);
-  solar_zenith_.value = szn.value(0, 0, ra);
-  sounding_zenith_.value = zen.value(0, 0, ra);
-  sounding_azimuth_.value = azm.value(0, 0, ra);
-  time_ = Time::time_pgs(tm(0,0,0)); // Use time of first band, 
+  // Copy the data for our sounding. Note that with a preload these
+  // are views into the preloaded data, so we need a copy rather
+  // than a reference.
+  altitude_.value = alt.value;
+  latitude_.value = lat.value;
+  longitude_.value = lon.value;
+  solar_azimuth_.value = saz.value;
+  solar_zenith_.value = szn.value;
+  sounding_zenith_.value = zen.value;
+  sounding_azimuth_.value = azm.value;
+  time_ = Time::time_pgs(tm(0)); // Use time of first band, 
 
   spectral_coefficient_.value = wl_coeffs.value(ra, sounding_index, ra);
 
@@ -159,29 +255,33 @@ void Level1bOco::initialize()
 
   // Determine if we can read from the stokes dataset
   if (hfile->has_object(stokes_dataset)) {
-    TinyVector<int,4> stokes_shape = hfile->read_shape<4>(stokes_dataset);
-    TinyVector<int,4> stokes_start, stokes_size;
-    stokes_start = frame_index, sounding_index, 0, 0;
-    stokes_size = 1, 1, stokes_shape(2), stokes_shape(3);
-
-    Array<double, 4> st =
-      hfile->read_field<double, 4>(stokes_dataset, stokes_start, stokes_size);
-    stokes_coef_ = st(0, 0, ra, ra);
+    if(use_preload())
+      stokes_coef_ = preload_->sounding_array_2d(stokes_dataset, frame_index,
+						 sounding_index);
+    else {
+      TinyVector<int,4> stokes_shape = hfile->read_shape<4>(stokes_dataset);
+      TinyVector<int,4> stokes_start, stokes_size;
+      stokes_start = frame_index, sounding_index, 0, 0;
+      stokes_size = 1, 1, stokes_shape(2), stokes_shape(3);
+
+      Array<double, 4> st =
+	hfile->read_field<double, 4>(stokes_dataset, stokes_start, stokes_size);
+      stokes_coef_ = st(0, 0, ra, ra);
+    }
 
   } else if(hfile->has_object(pol_ang_dataset)) {
     // OCO1 did not supply stokes coefficients, instead had
     // polarization angle which can be converted to
     // stokes coefficients
 
-    Array<double, 3> pol_ang =
-      hfile->read_field<double, 3>(pol_ang_dataset);
+    Array<double, 1> pol_ang = read_sounding_array(pol_ang_dataset);
     
     // Note that the 1/2 here is due to the fact OCO does not have a polarization
     // filter
     stokes_coef_(ra, 0) = 0.5;
     for(int bidx = 0; bidx < stokes_coef_.extent(firstDim); bidx++) {
-      stokes_coef_(bidx,1) = 0.5*cos(2.0*pol_ang(frame_index, sounding_index, bidx)*FullPhysics::conversion(units::deg, units::rad));
-      stokes_coef_(bidx,2) = 0.5*sin(2.0*pol_ang(frame_index, sounding_index, bidx)*FullPhysics::conversion(units::deg, units::rad));
+      stokes_coef_(bidx,1) = 0.5*cos(2.0*pol_ang(bidx)*FullPhysics::conversion(units::deg, units::rad));
+      stokes_coef_(bidx,2) = 0.5*sin(2.0*pol_ang(bidx)*FullPhysics::conversion(units::deg, units::rad));
     }
     stokes_coef_(ra, 3) = 0.0;
 
@@ -193,19 +293,13 @@ void Level1bOco::initialize()
     stokes_coef_(ra, Range(2, toEnd)) = 0.0;
   }
   if(hfile->has_object("SoundingGeometry/sounding_land_fraction")) {
-    TinyVector<int,2> land_start, land_size;
-    land_start = frame_index, sounding_index;
-    land_size = 1, 1;
-    Array<double, 2> lf = hfile->read_field<double, 2>("SoundingGeometry/sounding_land_fraction", land_start, land_size);
-    land_fraction_ = lf(0,0);
+    land_fraction_ = 
+      read_sounding_value("SoundingGeometry/sounding_land_fraction");
   } else {
     // For backward compatibility, if we don't have the land fraction field
     // use the land_water_indicator and translate to an fraction
-    TinyVector<int,2> land_start, land_size;
-    land_start = frame_index, sounding_index;
-    land_size = 1, 1;
-    Array<int, 2> lind = hfile->read_field<int, 2>("SoundingGeometry/sounding_land_water_indicator", land_start, land_size);
-    int lin = lind(0,0);
+    int lin = (int) 
+      read_sounding_value("SoundingGeometry/sounding_land_water_indicator");
     switch(lin) {
     case 0:
     case 3:
@@ -221,15 +315,12 @@ void Level1bOco::initialize()
   }
   if(hfile->has_object("/SoundingGeometry/sounding_solar_relative_velocity")) {
     has_solar_relative_velocity_ = true;
-    TinyVector<int,2> solar_start, solar_size;
-    solar_start = frame_index, sounding_index;
-    solar_size = 1, 1;
-    ArrayWithUnit<double, 2> sdist =
-      hfile->read_field_with_unit<double, 2>("/SoundingGeometry/sounding_solar_distance", units::m, solar_start, solar_size);
-    ArrayWithUnit<double, 2> svel =
-      hfile->read_field_with_unit<double, 2>("/SoundingGeometry/sounding_solar_relative_velocity", units::m / units::s, solar_start, solar_size);
-    solar_distance_ = sdist(0,0);
-    solar_velocity_ = svel(0,0);
+    solar_distance_ = 
+      read_sounding_value("/SoundingGeometry/sounding_solar_distance", 
+			  units::m);
+    solar_velocity_ = 
+      read_sounding_value("/SoundingGeometry/sounding_solar_relative_velocity",
+			  units::m / units::s);
   } else {
     has_solar_relative_velocity_ = false;
     solar_distance_ = 0.0;
@@ -272,20 +363,12 @@ SpectralRange Level1bOco::radiance_no_uncertainty(int Spec_index) const
     throw Exception("Unrecognized Spec_Index");
   }
 
-  // Use start and size to keep from having to read entire radiance
-  // array each time, OCO datasets get rather large
-  TinyVector<int, 3> rad_shape = hfile->read_shape<3>(field);
-  TinyVector<int, 3> rad_start, rad_size;
-  rad_start = 
-    hdf_sounding_id_->frame_number(), hdf_sounding_id_->sounding_number(), 0;
-  rad_size = 1, 1, rad_shape(2);
-
-  ArrayWithUnit<double, 3> rad = 
-    hfile->read_field_with_unit<double, 3>(field, 
-                                           Unit("Ph sec^{-1} m^{-2} sr^{-1} um^{-1}"),
-                                           rad_start, rad_size);
-  
-  return SpectralRange(rad.value(0, 0, Range::all()), rad.units);
+  // Read just our sounding, OCO datasets get rather large. With a
+  // preload this is a view into the preloaded data, so copy it to
+  // keep callers from changing the shared buffer.
+  ArrayWithUnit<double, 1> rad = 
+    read_sounding_array(field, Unit("Ph sec^{-1} m^{-2} sr^{-1} um^{-1}"));
+  return SpectralRange(rad.value.copy(), rad.units);
 }
 
 //-----------------------------------------------------------------------
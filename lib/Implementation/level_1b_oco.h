@@ -4,11 +4,16 @@
 #include "hdf_sounding_id.h"
 #include "fp_exception.h"
 #include "hdf_file.h"
+#include "level_1b_oco_preload.h"
 #include <blitz/array.h>
 
 namespace FullPhysics {
 /****************************************************************//**
   This reads a Level 1B file that is in the HDF format.
+
+  If a Level1bOcoPreload is passed to the constructor, the per
+  sounding data is taken from that rather than read from the file
+  directly (see Level1bOcoPreload for details).
 *******************************************************************/
 class Level1bOco: public Level1bHdf {
 public:
@@ -17,6 +22,16 @@ public:
 	     const boost::shared_ptr<HdfSoundingId>& Sounding_id);
   Level1bOco(const boost::shared_ptr<HdfFile>& Hfile, 
 	     const boost::shared_ptr<HdfSoundingId>& Sounding_id);
+  Level1bOco(const boost::shared_ptr<Level1bOcoPreload>& Preload, 
+	     const boost::shared_ptr<HdfSoundingId>& Sounding_id);
+
+//-----------------------------------------------------------------------
+/// The Level1bOcoPreload we are using. This may be null, if we are
+/// reading directly from the file.
+//-----------------------------------------------------------------------
+
+  const boost::shared_ptr<Level1bOcoPreload>& preload() const
+  { return preload_; }
 
 //-----------------------------------------------------------------------
 /// The acquisition mode. The data we process will be "Nadir", "Glint"
@@ -87,7 +102,16 @@ protected:
   double land_fraction_;
   bool has_solar_relative_velocity_;
   std::string acquisition_mode_;
-
+  boost::shared_ptr<Level1bOcoPreload> preload_;
+
+  bool use_preload() const
+  { return preload_ && preload_->contains(hdf_sounding_id_->frame_number()); }
+  ArrayWithUnit<double, 1> read_sounding_array(const std::string& Field,
+					       const Unit& Default_unit) const;
+  blitz::Array<double, 1> read_sounding_array(const std::string& Field) const;
+  DoubleWithUnit read_sounding_value(const std::string& Field,
+				     const Unit& Default_unit) const;
+  double read_sounding_value(const std::string& Field) const;
 private:
   void initialize();
 };
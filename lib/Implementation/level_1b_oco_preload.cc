@@ -0,0 +1,220 @@
+#include "level_1b_oco_preload.h"
+#include "fp_exception.h"
+#include <algorithm>
+using namespace FullPhysics;
+using namespace blitz;
+
+#ifdef HAVE_LUA
+#include "register_lua.h"
+typedef bool (Level1bOcoPreload::*contains_func)(const std::string&, const HdfSoundingId&) const;
+REGISTER_LUA_CLASS(Level1bOcoPreload)
+.def(luabind::constructor<const boost::shared_ptr<HdfFile>&, int, int>())
+.def(luabind::constructor<const boost::shared_ptr<HdfFile>&,
+                          const boost::shared_ptr<HdfSoundingId>&, int>())
+.def("contains", ((contains_func) &Level1bOcoPreload::contains))
+.def("frame_start", &Level1bOcoPreload::frame_start)
+.def("number_frame", &Level1bOcoPreload::number_frame)
+REGISTER_LUA_END()
+#endif
+
+//-----------------------------------------------------------------------
+/// Constructor. We preload the frames Frame_start through
+/// Frame_start + Number_frame - 1. Nothing is actually read until a
+/// field is requested.
+//-----------------------------------------------------------------------
+
+Level1bOcoPreload::Level1bOcoPreload
+(const boost::shared_ptr<HdfFile>& Hfile, int Frame_start, int Number_frame)
+  : hfile(Hfile), frame_start_(Frame_start), number_frame_(Number_frame)
+{
+  range_min_check(Frame_start, 0);
+  range_min_check(Number_frame, 1);
+}
+
+//-----------------------------------------------------------------------
+/// Constructor, starting with the frame of the given sounding.
+//-----------------------------------------------------------------------
+
+Level1bOcoPreload::Level1bOcoPreload
+(const boost::shared_ptr<HdfFile>& Hfile,
+ const boost::shared_ptr<HdfSoundingId>& Sounding_id,
+ int Number_frame)
+  : hfile(Hfile), frame_start_(Sounding_id->frame_number()),
+    number_frame_(Number_frame)
+{
+  range_min_check(frame_start_, 0);
+  range_min_check(Number_frame, 1);
+}
+
+//-----------------------------------------------------------------------
+/// True if the given sounding is from the file we read, and in the
+/// range we preload.
+//-----------------------------------------------------------------------
+
+bool Level1bOcoPreload::contains
+(const std::string& Fname, const HdfSoundingId& Sid) const
+{
+  return Fname == hfile->file_name() && contains(Sid.frame_number());
+}
+
+//-----------------------------------------------------------------------
+/// Index into our buffers for the given frame. Nframe_read is the
+/// number of frames actually read for the field, which is smaller
+/// than number_frame() if the preloaded range runs past the end of
+/// the file.
+//-----------------------------------------------------------------------
+
+int Level1bOcoPreload::frame_index(int Frame, int Nframe_read) const
+{
+  if(!contains(Frame)) {
+    Exception e;
+    e << "Frame " << Frame << " is not in the preloaded range "
+      << frame_start_ << " to " << frame_start_ + number_frame_ - 1;
+    throw e;
+  }
+  if(Frame - frame_start_ >= Nframe_read) {
+    Exception e;
+    e << "Frame " << Frame << " is past the end of the file, the last "
+      << "frame read is " << frame_start_ + Nframe_read - 1;
+    throw e;
+  }
+  return Frame - frame_start_;
+}
+
+//-----------------------------------------------------------------------
+/// Return the given field, reading it if this is the first time it
+/// is requested. The first dimension of the field is the frame, we
+/// read all of the other dimensions. If Default_unit is null, we
+/// don't read units at all (for fields like the time that don't have
+/// any).
+//-----------------------------------------------------------------------
+
+template<int D> const ArrayWithUnit<double, D>&
+Level1bOcoPreload::read
+(std::map<std::string, ArrayWithUnit<double, D> >& M,
+ const std::string& Field, const Unit* Default_unit) const
+{
+  typename std::map<std::string, ArrayWithUnit<double, D> >::iterator i =
+    M.find(Field);
+  if(i != M.end())
+    return i->second;
+  TinyVector<int, D> shape = hfile->read_shape<D>(Field);
+  TinyVector<int, D> start, size;
+  start = 0;
+  size = shape;
+  start(0) = frame_start_;
+  size(0) = std::min(number_frame_, shape(0) - frame_start_);
+  if(size(0) <= 0) {
+    Exception e;
+    e << "Preloaded frame range starting at " << frame_start_
+      << " is past the end of the field " << Field;
+    throw e;
+  }
+  ArrayWithUnit<double, D>& res = M[Field];
+  if(Default_unit) {
+    ArrayWithUnit<double, D> t = 
+      hfile->read_field_with_unit<double, D>(Field, *Default_unit, start, size);
+    res.value.reference(t.value);
+    res.units = t.units;
+  } else {
+    res.value.reference(hfile->read_field<double, D>(Field, start, size));
+    res.units = units::dimensionless;
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Return the field (with dimensions frame x sounding x n) for the
+/// given sounding. This is a view into the preloaded data.
+//-----------------------------------------------------------------------
+
+ArrayWithUnit<double, 1> Level1bOcoPreload::sounding_array
+(const std::string& Field, const Unit& Default_unit, int Frame,
+ int Sounding) const
+{
+  const ArrayWithUnit<double, 3>& f = read(field_3d, Field, &Default_unit);
+  int fi = frame_index(Frame, f.value.extent(0));
+  range_check(Sounding, 0, f.value.extent(1));
+  return ArrayWithUnit<double, 1>(f.value(fi, Sounding, Range::all()),
+				  f.units);
+}
+
+//-----------------------------------------------------------------------
+/// Return the field (with dimensions frame x sounding x n) for the
+/// given sounding, for a field without units. This is a view into the
+/// preloaded data.
+//-----------------------------------------------------------------------
+
+blitz::Array<double, 1> Level1bOcoPreload::sounding_array
+(const std::string& Field, int Frame, int Sounding) const
+{
+  const ArrayWithUnit<double, 3>& f = read(field_3d, Field, 0);
+  int fi = frame_index(Frame, f.value.extent(0));
+  range_check(Sounding, 0, f.value.extent(1));
+  return f.value(fi, Sounding, Range::all());
+}
+
+//-----------------------------------------------------------------------
+/// Return the field (with dimensions frame x sounding x n x m) for
+/// the given sounding. This is a view into the preloaded data.
+//-----------------------------------------------------------------------
+
+blitz::Array<double, 2> Level1bOcoPreload::sounding_array_2d
+(const std::string& Field, int Frame, int Sounding) const
+{
+  const ArrayWithUnit<double, 4>& f = read(field_4d, Field, 0);
+  int fi = frame_index(Frame, f.value.extent(0));
+  range_check(Sounding, 0, f.value.extent(1));
+  return f.value(fi, Sounding, Range::all(), Range::all());
+}
+
+//-----------------------------------------------------------------------
+/// Return the field (with dimensions frame x sounding) for the given
+/// sounding.
+//-----------------------------------------------------------------------
+
+DoubleWithUnit Level1bOcoPreload::sounding_value
+(const std::string& Field, const Unit& Default_unit, int Frame,
+ int Sounding) const
+{
+  const ArrayWithUnit<double, 2>& f = read(field_2d, Field, &Default_unit);
+  int fi = frame_index(Frame, f.value.extent(0));
+  range_check(Sounding, 0, f.value.extent(1));
+  return f(fi, Sounding);
+}
+
+//-----------------------------------------------------------------------
+/// Return the field (with dimensions frame x sounding) for the given
+/// sounding, for a field without units.
+//-----------------------------------------------------------------------
+
+double Level1bOcoPreload::sounding_value
+(const std::string& Field, int Frame, int Sounding) const
+{
+  const ArrayWithUnit<double, 2>& f = read(field_2d, Field, 0);
+  int fi = frame_index(Frame, f.value.extent(0));
+  range_check(Sounding, 0, f.value.extent(1));
+  return f.value(fi, Sounding);
+}
+
+//-----------------------------------------------------------------------
+/// Return the field (with dimensions frame) for the given frame.
+//-----------------------------------------------------------------------
+
+DoubleWithUnit Level1bOcoPreload::frame_value
+(const std::string& Field, const Unit& Default_unit, int Frame) const
+{
+  const ArrayWithUnit<double, 1>& f = read(field_1d, Field, &Default_unit);
+  return f(frame_index(Frame, f.value.extent(0)));
+}
+
+void Level1bOcoPreload::print(std::ostream& Os) const
+{
+  Os << "Level1bOcoPreload:\n"
+     << "  File name:   " << hfile->file_name() << "\n"
+     << "  Frame start: " << frame_start_ << "\n"
+     << "  Frame count: " << number_frame_ << "\n"
+     << "  Fields read: "
+     << field_1d.size() + field_2d.size() + field_3d.size() + field_4d.size()
+     << "\n";
+}
@@ -0,0 +1,98 @@
+#ifndef LEVEL_1B_OCO_PRELOAD_H
+#define LEVEL_1B_OCO_PRELOAD_H
+#include "printable.h"
+#include "hdf_file.h"
+#include "hdf_sounding_id.h"
+#include "array_with_unit.h"
+#include "double_with_unit.h"
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <string>
+
+namespace FullPhysics {
+/****************************************************************//**
+  Level1bOco reads each of the fields it needs with a small
+  hyperslab read for the one sounding it is processing. When we
+  process a number of soundings from the same file in one process
+  (e.g., "l2_fp -b"), this adds up to a lot of small reads.
+
+  This class reads a contiguous range of frames (all the soundings
+  in each frame) for a field the first time it is requested, with
+  one read for each field. The data for a particular sounding is then
+  returned as a view into that buffer, so there is no copying. The
+  buffer is shared by every Level1bOco using this object, so callers
+  should treat these views as read only and copy the data if they
+  hand it on (Level1bOco does this). A
+  Level1bOco created with a Level1bOcoPreload gets all of its
+  per-sounding data from here if the sounding is in the preloaded
+  range, and reads from the file otherwise.
+
+  Fields are stored in the units found in the file, using the given
+  default units if the file doesn't have a units attribute. Datasets
+  that are integers in the file (e.g., the land/water indicator) are
+  converted to double when read.
+*******************************************************************/
+class Level1bOcoPreload : public Printable<Level1bOcoPreload> {
+public:
+  Level1bOcoPreload(const boost::shared_ptr<HdfFile>& Hfile,
+		    int Frame_start, int Number_frame);
+  Level1bOcoPreload(const boost::shared_ptr<HdfFile>& Hfile,
+		    const boost::shared_ptr<HdfSoundingId>& Sounding_id,
+		    int Number_frame);
+  virtual ~Level1bOcoPreload() {}
+
+//-----------------------------------------------------------------------
+/// File we are reading.
+//-----------------------------------------------------------------------
+
+  const boost::shared_ptr<HdfFile>& hdf_file() const { return hfile; }
+
+//-----------------------------------------------------------------------
+/// First frame that we preload.
+//-----------------------------------------------------------------------
+
+  int frame_start() const { return frame_start_; }
+
+//-----------------------------------------------------------------------
+/// Number of frames we preload. Note that the range may run past the
+/// end of the file, in which case we only read to the end.
+//-----------------------------------------------------------------------
+
+  int number_frame() const { return number_frame_; }
+
+//-----------------------------------------------------------------------
+/// True if the given frame is in the range we preload.
+//-----------------------------------------------------------------------
+
+  bool contains(int Frame) const
+  { return Frame >= frame_start_ && Frame < frame_start_ + number_frame_; }
+  bool contains(const std::string& Fname, const HdfSoundingId& Sid) const;
+  ArrayWithUnit<double, 1>
+  sounding_array(const std::string& Field, const Unit& Default_unit,
+		 int Frame, int Sounding) const;
+  blitz::Array<double, 1>
+  sounding_array(const std::string& Field, int Frame, int Sounding) const;
+  blitz::Array<double, 2>
+  sounding_array_2d(const std::string& Field, int Frame, int Sounding) const;
+  DoubleWithUnit sounding_value(const std::string& Field,
+				const Unit& Default_unit,
+				int Frame, int Sounding) const;
+  double sounding_value(const std::string& Field, int Frame,
+			int Sounding) const;
+  DoubleWithUnit frame_value(const std::string& Field,
+			     const Unit& Default_unit, int Frame) const;
+  virtual void print(std::ostream& Os) const;
+private:
+  boost::shared_ptr<HdfFile> hfile;
+  int frame_start_, number_frame_;
+  mutable std::map<std::string, ArrayWithUnit<double, 1> > field_1d;
+  mutable std::map<std::string, ArrayWithUnit<double, 2> > field_2d;
+  mutable std::map<std::string, ArrayWithUnit<double, 3> > field_3d;
+  mutable std::map<std::string, ArrayWithUnit<double, 4> > field_4d;
+  template<int D> const ArrayWithUnit<double, D>&
+  read(std::map<std::string, ArrayWithUnit<double, D> >& M,
+       const std::string& Field, const Unit* Default_unit) const;
+  int frame_index(int Frame, int Nframe_read) const;
+};
+}
+#endif
@@ -110,6 +110,56 @@ BOOST_AUTO_TEST_CASE(downlooking_file)
   BOOST_CHECK_MATRIX_CLOSE_TOL(l1b_oco.spectral_coefficient(2).value, expt_coeff, 1e-5);
 }
 
+BOOST_AUTO_TEST_CASE(preload)
+{
+  boost::shared_ptr<HdfFile> hfile(new HdfFile(test_data_dir() + "/oco2_L1bScND_80008a_111017225030d_spliced.h5"));
+  boost::shared_ptr<HdfSoundingId> sid(new OcoSoundingId(*hfile, "2010090900133834"));
+  Level1bOco l1b_expect(hfile, sid);
+  boost::shared_ptr<Level1bOcoPreload> 
+    preload(new Level1bOcoPreload(hfile, 0, 10));
+  BOOST_CHECK(preload->contains(hfile->file_name(), *sid));
+  Level1bOco l1b_oco(preload, sid);
+  BOOST_CHECK(l1b_oco.preload());
+  BOOST_CHECK_CLOSE(l1b_oco.land_fraction(), l1b_expect.land_fraction(), 1e-8);
+  BOOST_CHECK_CLOSE(l1b_oco.relative_velocity(0).value, 
+		    l1b_expect.relative_velocity(0).value, 1e-8);
+  BOOST_CHECK_CLOSE(l1b_oco.time(0).pgs_time(), l1b_expect.time(0).pgs_time(),
+		    1e-8);
+  for(int i = 0; i < 3; ++i) {
+    BOOST_CHECK_CLOSE(l1b_oco.latitude(i).value, 
+		      l1b_expect.latitude(i).value, 1e-8);
+    BOOST_CHECK_CLOSE(l1b_oco.solar_zenith(i).value, 
+		      l1b_expect.solar_zenith(i).value, 1e-8);
+    BOOST_CHECK_CLOSE(l1b_oco.sounding_azimuth(i).value, 
+		      l1b_expect.sounding_azimuth(i).value, 1e-8);
+    BOOST_CHECK_MATRIX_CLOSE(l1b_oco.stokes_coefficient(i), 
+			     l1b_expect.stokes_coefficient(i));
+    BOOST_CHECK_MATRIX_CLOSE(l1b_oco.radiance(i).data(), 
+			     l1b_expect.radiance(i).data());
+  }
+  // Changing the radiance we get back shouldn't change the preloaded
+  // data.
+  Array<double, 1> rad = l1b_oco.radiance(0).data();
+  rad = 0;
+  BOOST_CHECK_MATRIX_CLOSE(l1b_oco.radiance(0).data(), 
+			   l1b_expect.radiance(0).data());
+}
+
+BOOST_AUTO_TEST_CASE(preload_range)
+{
+  boost::shared_ptr<HdfFile> hfile(new HdfFile(test_data_dir() + "/oco2_L1bScND_80008a_111017225030d_spliced.h5"));
+  std::string field = "FootprintGeometry/footprint_altitude";
+  TinyVector<int, 3> shape = hfile->read_shape<3>(field);
+  // Range runs past the end of the file.
+  Level1bOcoPreload preload(hfile, 0, shape(0) + 10);
+  BOOST_CHECK(preload.contains(shape(0)));
+  BOOST_CHECK_NO_THROW(preload.sounding_array(field, shape(0) - 1, 0));
+  BOOST_CHECK_THROW(preload.sounding_array(field, shape(0), 0), Exception);
+  BOOST_CHECK_THROW(preload.sounding_array(field, 0, shape(1)), Exception);
+  BOOST_CHECK_THROW(preload.sounding_array(field, 0, -1), Exception);
+  BOOST_CHECK_THROW(Level1bOcoPreload(hfile, -1, 10), Exception);
+}
+
 BOOST_AUTO_TEST_CASE(solar_velocity)
 {
   return; // Normally skip this test since it is just a quick and
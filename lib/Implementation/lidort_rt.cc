@@ -6,6 +6,7 @@ using namespace blitz;
 
 #ifdef HAVE_LUA
 #include "register_lua.h"
+typedef void (LidortRt::*fo_cache_set)(const boost::shared_ptr<FirstOrderRtCache>&);
 REGISTER_LUA_DERIVED_CLASS(LidortRt, RadiativeTransfer)
 .def(luabind::constructor<const boost::shared_ptr<RtAtmosphere>&,
                           const boost::shared_ptr<StokesCoefficient>&,
@@ -13,6 +14,7 @@ REGISTER_LUA_DERIVED_CLASS(LidortRt, RadiativeTransfer)
                           const blitz::Array<double, 1>&, 
                           const blitz::Array<double, 1>&, 
                           bool, int, int, bool>())
+.def("first_order_cache", ((fo_cache_set) &LidortRt::first_order_cache))
 .enum_("constants")
 [
  luabind::value("maxmoments_input", Lidort_Pars::instance().maxmoments_input)
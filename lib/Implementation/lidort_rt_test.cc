@@ -379,3 +379,47 @@ BOOST_AUTO_TEST_CASE(compare_sphericity)
 BOOST_AUTO_TEST_SUITE_END()
 
 
+
+///////////////////////////////////////////////////////////////////////////////////////
+
+BOOST_FIXTURE_TEST_SUITE(lidort_rt_first_order_cache, LidortLambertianFixture)
+
+BOOST_AUTO_TEST_CASE(compare_full)
+{
+  // No checks against the full calculation, so we know how many
+  // wavenumbers get predicted.
+  boost::shared_ptr<FirstOrderRtCache> cache(new FirstOrderRtCache(1e-3, 1e-4, 0));
+  lidort_rt->first_order_cache(cache);
+  StateVector& sv = *config_state_vector;
+  Array<double, 1> sv0(sv.state().copy());
+  lidort_rt->stokes_and_jacobian(wn_arr, 0);
+  BOOST_CHECK_EQUAL(cache->number_full(), wn_arr.rows());
+  BOOST_CHECK_EQUAL(cache->number_predicted(), 0);
+
+  // Small relative change in the surface albedo, less than the
+  // threshold.
+  Array<std::string, 1> sv_name = sv.state_vector_name();
+  Array<double, 1> sv1(sv0.copy());
+  int nchange = 0;
+  for(int i = 0; i < sv1.rows(); ++i)
+    if(sv_name(i).find("Ground Lambertian") == 0) {
+      sv1(i) *= 1 + 5e-4;
+      ++nchange;
+    }
+  BOOST_CHECK(nchange > 0);
+  sv.update_state(sv1);
+  ArrayAd<double, 2> stk_cache = lidort_rt->stokes_and_jacobian(wn_arr, 0);
+  BOOST_CHECK(cache->number_predicted() > 0);
+  lidort_rt->first_order_cache(boost::shared_ptr<FirstOrderRtCache>());
+  ArrayAd<double, 2> stk_full = lidort_rt->stokes_and_jacobian(wn_arr, 0);
+
+  // The radiance is a first order prediction, so the error is second
+  // order in the change. The Jacobian is the one saved at the
+  // unperturbed state, so the error is first order in the change.
+  BOOST_CHECK_MATRIX_CLOSE_TOL(stk_cache.value(), stk_full.value(),
+			       1e-6 * max(abs(stk_full.value())));
+  BOOST_CHECK_MATRIX_CLOSE_TOL(stk_cache.jacobian(), stk_full.jacobian(),
+			       1e-3 * max(abs(stk_full.jacobian())));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 #include "ifstream_cs.h"
 #include "bin_map.h"
 #include "ostream_pad.h"
+#include "twostream_rt.h"
 #include <boost/lexical_cast.hpp>
 #include <boost/bind.hpp>
 
@@ -272,6 +273,12 @@ void LsiRt::calc_correction(const SpectralDomain& Spec_domain,
   boost::shared_ptr<boost::progress_display> disp = progress_display(wn);
   const RtAtmosphere& atm = *low_stream_rt->atmosphere_ptr();
   const std::vector<double>& odb = optical_depth_boundary[Spec_index];
+  // Only a TwostreamRt using its batch driver does a block of
+  // wavenumbers at a time, everything else goes one wavenumber at a
+  // time anyways so we do that as we calculate the atmosphere.
+  boost::shared_ptr<TwostreamRt> ts_low =
+    boost::dynamic_pointer_cast<TwostreamRt>(low_stream_rt);
+  bool batch_low = ts_low && ts_low->batch_driver();
 
 //-----------------------------------------------------------------------
 // Go through all the wave numbers and collect the atmosphere
@@ -370,7 +377,7 @@ void LsiRt::calc_correction(const SpectralDomain& Spec_domain,
 
     // Since we are already calculating the atmosphere parameters, go
     // ahead and collect low streams data if requested.
-    if(!Skip_stokes_calc) {
+    if(!Skip_stokes_calc && !batch_low) {
       if(Calc_jacobian)
 	stokes_and_jac(i, ra) = low_stream_rt->stokes_and_jacobian_single_wn
 	  (wn(i), Spec_index);
@@ -384,6 +391,22 @@ void LsiRt::calc_correction(const SpectralDomain& Spec_domain,
       *disp += 1;
   }
 
+//-----------------------------------------------------------------------
+// If the low stream RT does a block of wavenumbers at a time, then
+// collect the low streams data for all the wavenumbers in one call
+// instead.
+//-----------------------------------------------------------------------
+
+  if(!Skip_stokes_calc && batch_low) {
+    if(Calc_jacobian) {
+      ArrayAd<double, 2> t =
+	low_stream_rt->stokes_and_jacobian(Spec_domain, Spec_index);
+      for(int i = 0; i < wn.rows(); ++i)
+	stokes_and_jac(i, ra) = t(i, ra);
+    } else
+      stokes_only = low_stream_rt->stokes(Spec_domain, Spec_index);
+  }
+
 //-----------------------------------------------------------------------
 // Now average them, and use to calculate the high and low stream
 // values using these averaged values. We then use this to create
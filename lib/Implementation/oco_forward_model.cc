@@ -41,6 +41,21 @@ OcoForwardModel::OcoForwardModel(
 // See bass class for description.
 Spectrum OcoForwardModel::radiance
 (int Spec_index, bool Skip_jacobian) const
+{
+  return apply_spectrum_corrections(high_resolution_radiance(Spec_index, 
+							     Skip_jacobian),
+				    Spec_index);
+}
+
+//-----------------------------------------------------------------------
+/// Run the radiative transfer on the high resolution grid. This is the
+/// first stage of radiance, before apply_spectrum_corrections. This is
+/// available separately so things like FdForwardModel can reuse the
+/// radiative transfer results.
+//-----------------------------------------------------------------------
+
+Spectrum OcoForwardModel::high_resolution_radiance
+(int Spec_index, bool Skip_jacobian) const
 {
   if(!g)
     throw Exception ("setup_grid needs to be called before calling radiance");
@@ -49,8 +64,7 @@ Spectrum OcoForwardModel::radiance
     rt->reflectance(g->high_resolution_grid(Spec_index), Spec_index, 
 		    Skip_jacobian);
   notify_spectrum_update(highres_spec, "high_res_rt", Spec_index);
-
-  return apply_spectrum_corrections(highres_spec, Spec_index);
+  return highres_spec;
 }
 
 //-----------------------------------------------------------------------
@@ -87,18 +101,26 @@ Spectrum OcoForwardModel::measured_radiance
   Spectrum full(inst->pixel_spectral_domain(Spec_index),
 		l1b->radiance(Spec_index));
   const std::vector<int>& plist = g->pixel_list(Spec_index);
+  const ArrayAd<double, 1>& full_r = full.spectral_range().data_ad();
+  // Get these once outside of the loop, rather than creating new
+  // arrays for each pixel.
+  Array<double, 1> full_d(full.spectral_domain().data());
+  Array<double, 1> full_uncer(full.spectral_range().uncertainty());
   Array<double, 1> res_d((int) plist.size());
-  ArrayAd<double, 1> res_r((int) plist.size(), 
-			   full.spectral_range().data_ad().number_variable());
+  ArrayAd<double, 1> res_r((int) plist.size(), full_r.number_variable());
   Array<double, 1> uncer;
-  if(full.spectral_range().uncertainty().rows() > 0)
+  if(full_uncer.rows() > 0)
     uncer.resize(res_r.rows());
+  if(full_r.is_constant())
+    res_r.jacobian() = 0;
   for(int i = 0; i < res_d.rows(); ++i) {
-    res_d(i) = full.spectral_domain().data()(plist[i]);
-    AutoDerivative<double> t = full.spectral_range().data_ad()(plist[i]);
-    res_r(i) = t;
+    res_d(i) = full_d(plist[i]);
+    res_r.value()(i) = full_r.value()(plist[i]);
+    if(!full_r.is_constant())
+      res_r.jacobian()(i, Range::all()) = 
+	full_r.jacobian()(plist[i], Range::all());
     if(uncer.rows() > 0)
-      uncer(i) = full.spectral_range().uncertainty()(plist[i]);
+      uncer(i) = full_uncer(plist[i]);
   }
   return Spectrum(SpectralDomain(res_d, full.spectral_domain().units()),
 		  SpectralRange(res_r, full.spectral_range().units(),
@@ -80,6 +80,8 @@ public:
   void spectrum_sampling(const boost::shared_ptr<SpectrumSampling>& V)
   { spectrum_sampling_ = V; }
   
+  Spectrum high_resolution_radiance(int Spec_index, 
+				    bool Skip_jacobian = false) const;
   Spectrum apply_spectrum_corrections(const Spectrum& highres_spec, int Spec_index) const;
   const boost::shared_ptr<ForwardModelSpectralGrid>& spectral_grid() const
   { return g; }
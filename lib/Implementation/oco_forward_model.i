@@ -44,6 +44,8 @@ public:
   %python_attribute_with_set(radiative_transfer, boost::shared_ptr<RadiativeTransfer>)
   %python_attribute(spectrum_sampling, boost::shared_ptr<SpectrumSampling>)
   %python_attribute(spectral_grid, boost::shared_ptr<ForwardModelSpectralGrid>)
+  Spectrum high_resolution_radiance(int Spec_index, 
+				    bool Skip_jacobian = false) const;
   Spectrum apply_spectrum_corrections(const Spectrum& highres_spec, int Spec_index) const;
 
   virtual void add_observer(Observer<boost::shared_ptr<FullPhysics::NamedSpectrum> >& Obs); 
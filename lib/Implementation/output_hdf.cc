@@ -7,34 +7,13 @@ using namespace FullPhysics;
 using namespace blitz;
 
 //-----------------------------------------------------------------------
-/// Constructor. This takes the file name to write.
+/// Constructor.
 //-----------------------------------------------------------------------
 
-OutputHdf::OutputHdf(const std::string& Fname, int Num_level, 
-		     int Statevector_size, int Num_aerosol, 
-		     int Num_band) 
+OutputHdfShape::OutputHdfShape(int Num_level, int Statevector_size, 
+			       int Num_aerosol, int Num_band)
 : num_level(Num_level), statevector_size(Statevector_size),
   num_aerosol(Num_aerosol), num_band(Num_band)
-{
-  h.reset(new HdfFileGenerating(Fname));
-  initialize();
-}
-
-//-----------------------------------------------------------------------
-/// Constructor. This takes the file to write to.
-//-----------------------------------------------------------------------
-
-OutputHdf::OutputHdf(const boost::shared_ptr<HdfFileGenerating>& H, 
-		     int Num_level, 
-		     int Statevector_size, int Num_aerosol, 
-		     int Num_band) 
-: num_level(Num_level), statevector_size(Statevector_size),
-  num_aerosol(Num_aerosol), num_band(Num_band), h(H)
-{
-  initialize();
-}
-
-void OutputHdf::initialize()
 {
   range_min_check(num_level, 1);
   range_min_check(num_aerosol, 1);
@@ -56,21 +35,59 @@ void OutputHdf::initialize()
   }
 }
 
-// See base class for descriptions of all these functions.
+//-----------------------------------------------------------------------
+/// Shape of a scalar field. Metadata fields are scalars, all others
+/// are indexed by Retrieval.
+//-----------------------------------------------------------------------
 
-void OutputHdf::start_write()
+std::string OutputHdfShape::shape(const std::string& Dataset_name) const
 {
-  write_dimension_metadata();
-  write_shape_metadata();
+  if(Dataset_name.find("/Metadata/") == std::string::npos)
+    return "Retrieval_Array";
+  return "Scalar";
 }
 
-void OutputHdf::end_because_of_error()
+//-----------------------------------------------------------------------
+/// Shape of a 1d field of size N1. We return an empty string if we
+/// don't recognize the size. See discussion of this design decision
+/// in output_hdf.h.
+//-----------------------------------------------------------------------
+
+std::string OutputHdfShape::shape(const std::string& Dataset_name, 
+				  int N1) const
 {
-  h->abandon();
+  // We can't depend on num_aerosol and num_band being different, so
+  // we hardcode the few fields we have that depend on band. The
+  // regular expression is compiled once, the first time we need it.
+  static const boost::regex band_field(".*/num_colors_per_band|.*/Absco.*Scale");
+  if(N1 == statevector_size)
+    return "Retrieval_StateVectorElement_Array";
+  if(N1 == num_level)
+    return "Retrieval_Level_Array";
+  if(boost::regex_match(Dataset_name, band_field))
+    return "Retrieval_Band_Array";
+  if(N1 == num_aerosol)
+    return "Retrieval_Aerosol_Array";
+  return "";
 }
 
 //-----------------------------------------------------------------------
-/// Add the dimension metadata to the file.
+/// Shape of a 2d field of size N1 x N2. We return an empty string if we
+/// don't recognize the size.
+//-----------------------------------------------------------------------
+
+std::string OutputHdfShape::shape(const std::string& Dataset_name, 
+				  int N1, int N2) const
+{
+  if(N1 == statevector_size && N2 == statevector_size)
+    return "Retrieval_StateVectorElement_StateVectorElement_Array";
+  return "";
+}
+
+//-----------------------------------------------------------------------
+/// Add the dimension metadata to the file. Number_retrieval is the
+/// size of the Retrieval dimension, which is 1 unless we are writing
+/// a number of soundings to one file.
 ///
 /// Right now, there are only a handful of dimensions. We go ahead and
 /// hard code this, since this is the easiest implementation. If this
@@ -78,17 +95,18 @@ void OutputHdf::end_because_of_error()
 /// flexible (but also more complicated) implementation.
 //-----------------------------------------------------------------------
 
-void OutputHdf::write_dimension_metadata()
+void OutputHdfShape::write_dimension_metadata(HdfFile& H, 
+					      int Number_retrieval) const
 {
-  h->hdf_file().dimension_metadata("Retrieval", 
-       "Number retrievals reported.", 1);
-  h->hdf_file().dimension_metadata("StateVectorElement", 
+  H.dimension_metadata("Retrieval", 
+       "Number retrievals reported.", Number_retrieval);
+  H.dimension_metadata("StateVectorElement", 
        "Retrieved state vector elements.", statevector_size);
-  h->hdf_file().dimension_metadata("Level",
+  H.dimension_metadata("Level",
        "Atmospheric retrieval levels.", num_level);
-  h->hdf_file().dimension_metadata("Aerosol",
+  H.dimension_metadata("Aerosol",
        "Retrieved aerosol type.", num_aerosol);
-  h->hdf_file().dimension_metadata("Band",
+  H.dimension_metadata("Band",
        "Spectral band.", num_band);
 }
 
@@ -101,28 +119,72 @@ void OutputHdf::write_dimension_metadata()
 /// flexible (but also more complicated) implementation.
 //-----------------------------------------------------------------------
 
-void OutputHdf::write_shape_metadata()
+void OutputHdfShape::write_shape_metadata(HdfFile& H) const
 {
-  h->hdf_file().shape_metadata("Retrieval_Array", "Retrieval");
-  h->hdf_file().shape_metadata(
+  H.shape_metadata("Retrieval_Array", "Retrieval");
+  H.shape_metadata(
      "Retrieval_StateVectorElement_StateVectorElement_Array",
      "Retrieval", "StateVectorElement", "StateVectorElement");
-  h->hdf_file().shape_metadata("Retrieval_Level_Array", "Retrieval", "Level");
-  h->hdf_file().shape_metadata("Retrieval_StateVectorElement_Array",
-			   "Retrieval", "StateVectorElement");
-  h->hdf_file().shape_metadata("Retrieval_Aerosol_Array", "Retrieval", "Aerosol");
-  h->hdf_file().shape_metadata("Retrieval_Band_Array", "Retrieval", "Band");
+  H.shape_metadata("Retrieval_Level_Array", "Retrieval", "Level");
+  H.shape_metadata("Retrieval_StateVectorElement_Array",
+		   "Retrieval", "StateVectorElement");
+  H.shape_metadata("Retrieval_Aerosol_Array", "Retrieval", "Aerosol");
+  H.shape_metadata("Retrieval_Band_Array", "Retrieval", "Band");
+}
+
+//-----------------------------------------------------------------------
+/// Constructor. This takes the file name to write.
+//-----------------------------------------------------------------------
+
+OutputHdf::OutputHdf(const std::string& Fname, int Num_level, 
+		     int Statevector_size, int Num_aerosol, 
+		     int Num_band) 
+: shape(Num_level, Statevector_size, Num_aerosol, Num_band)
+{
+  h.reset(new HdfFileGenerating(Fname));
+}
+
+//-----------------------------------------------------------------------
+/// Constructor. This takes the file to write to.
+//-----------------------------------------------------------------------
+
+OutputHdf::OutputHdf(const boost::shared_ptr<HdfFileGenerating>& H, 
+		     int Num_level, 
+		     int Statevector_size, int Num_aerosol, 
+		     int Num_band) 
+: shape(Num_level, Statevector_size, Num_aerosol, Num_band), h(H)
+{
+}
+
+// See base class for descriptions of all these functions.
+
+void OutputHdf::start_write()
+{
+  shape.write_dimension_metadata(h->hdf_file());
+  shape.write_shape_metadata(h->hdf_file());
+}
+
+void OutputHdf::end_because_of_error()
+{
+  h->abandon();
+}
+
+//-----------------------------------------------------------------------
+/// Write the Shape metadata for a field, if we recognized the shape.
+//-----------------------------------------------------------------------
+
+void OutputHdf::write_shape(const std::string& Dataset_name, 
+			    const std::string& Shape)
+{
+  if(Shape != "")
+    h->hdf_file().write_attribute(Dataset_name + "/Shape", Shape);
 }
 
 template<class T> void OutputHdf::write_data_t(
     const std::string& Dataset_name, T Val)
 {
   h->hdf_file().write_field(Dataset_name, Val);
-  // Metadata fields are scalars, all others are indexed by Retrieval.
-  if(Dataset_name.find("/Metadata/") == std::string::npos)
-    h->hdf_file().write_attribute(Dataset_name + "/Shape", "Retrieval_Array");
-  else
-    h->hdf_file().write_attribute(Dataset_name + "/Shape", "Scalar");
+  write_shape(Dataset_name, shape.shape(Dataset_name));
 }
 
 template<class T> void OutputHdf::write_data_t(
@@ -139,23 +201,7 @@ template<class T> void OutputHdf::write_data_t(
   // Check size, and use this to fill in Shape metadata.  We silently
   // leave off Shape metadata if don't recognize the size. See discussion
   // of this design decision in output_hdf.h
-  
-  if(Val.rows() == statevector_size)
-    h->hdf_file().write_attribute(Dataset_name + "/Shape", 
-			      "Retrieval_StateVectorElement_Array");
-  else if(Val.rows() == num_level)
-    h->hdf_file().write_attribute(Dataset_name + "/Shape", 
-			      "Retrieval_Level_Array");
-  // We can't depend on num_aerosol and num_band being different, so
-  // we hardcode the few fields we have that depend on band.
-  else if(boost::regex_match(Dataset_name, 
-			     boost::regex(".*/num_colors_per_band")) ||
-	  boost::regex_match(Dataset_name, boost::regex(".*/Absco.*Scale")))
-    h->hdf_file().write_attribute(Dataset_name + "/Shape", 
-				  "Retrieval_Band_Array");
-  else if(Val.rows() == num_aerosol)
-    h->hdf_file().write_attribute(Dataset_name + "/Shape", 
-			      "Retrieval_Aerosol_Array");
+  write_shape(Dataset_name, shape.shape(Dataset_name, Val.rows()));
 }
 
 template<class T> void OutputHdf::write_data_t(
@@ -172,11 +218,8 @@ template<class T> void OutputHdf::write_data_t(
   // Check size, and use this to fill in Shape metadata.  We silently
   // leave off Shape metadata if don't recognize the size. See discussion
   // of this design decision in output_hdf.h
-  
-  if(Val.rows() == statevector_size &&
-     Val.cols() == statevector_size)
-    h->hdf_file().write_attribute(Dataset_name + "/Shape", 
-	      "Retrieval_StateVectorElement_StateVectorElement_Array");
+  write_shape(Dataset_name, shape.shape(Dataset_name, Val.rows(), 
+					Val.cols()));
 }
 
 template<class T> void OutputHdf::write_data_t(
@@ -4,6 +4,31 @@
 #include "hdf_file_generating.h"
 
 namespace FullPhysics {
+/****************************************************************//**
+  This handles the Shape and Dimension metadata used by OutputHdf and
+  OutputHdfStream. See OutputHdf for a discussion of how we determine
+  the shape of a field.
+
+  Fields are looked up by name and size. The few rules that depend on
+  the dataset name are compiled once, rather than each time we write
+  a field.
+*******************************************************************/
+
+class OutputHdfShape : public Printable<OutputHdfShape> {
+public:
+  OutputHdfShape(int Num_level, int Statevector_size, int Num_aerosol, 
+		 int Number_band);
+  virtual ~OutputHdfShape() {}
+  std::string shape(const std::string& Dataset_name) const;
+  std::string shape(const std::string& Dataset_name, int N1) const;
+  std::string shape(const std::string& Dataset_name, int N1, int N2) const;
+  void write_dimension_metadata(HdfFile& H, int Number_retrieval = 1) const;
+  void write_shape_metadata(HdfFile& H) const;
+  virtual void print(std::ostream& Os) const {Os << "OutputHdfShape";}
+private:
+  int num_level, statevector_size, num_aerosol, num_band;
+};
+
 /****************************************************************//**
   This write the output of the Level 2 Full physics. This particular
   implementation writes out a HDF5 file.
@@ -64,11 +89,10 @@ protected:
 				      const blitz::Array<T, 3>& Val);
   friend class OutputTemplate<OutputHdf>; 
 private:
-  int num_level, statevector_size, num_aerosol, num_band;
+  OutputHdfShape shape;
   boost::shared_ptr<HdfFileGenerating> h;
-  void write_dimension_metadata();
-  void write_shape_metadata();
-  void initialize();
+  void write_shape(const std::string& Dataset_name, 
+		   const std::string& Shape);
 };
 }
 #endif
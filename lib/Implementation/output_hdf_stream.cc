@@ -0,0 +1,335 @@
+#include "output_hdf_stream.h"
+#include "fp_exception.h"
+#include "logger.h"
+#include <boost/foreach.hpp>
+
+using namespace FullPhysics;
+using namespace blitz;
+
+// Helper class for OutputHdfStream
+// Don't have Doxygen document this class
+/// @cond
+namespace FullPhysics {
+template<class T, int D> class OutputHdfStreamHelper:
+    public OutputHdfStreamHelperBase {
+public:
+  // Row_shape is the shape of a single row, including the leading
+  // dimension of size 1.
+  OutputHdfStreamHelper(const std::string& Data_name,
+			const TinyVector<int, D>& Row_shape,
+			const std::string& Shape_name,
+			int Chunk_size, int Row_start)
+    : d(Data_name), shape_name(Shape_name), row_start(Row_start),
+      created(false), has_pending(false)
+  {
+    TinyVector<int, D> sz = Row_shape;
+    sz(0) = Chunk_size;
+    buf.resize(sz);
+    buf = T();
+  }
+  virtual ~OutputHdfStreamHelper() {}
+  void set_pending(const Array<T, D>& Row)
+  {
+    for(int i = 1; i < D; ++i)
+      if(Row.extent(i) != buf.extent(i)) {
+	Exception e;
+	e << "The field " << d << " changed size. OutputHdfStream requires"
+	  << " each field to be the same size for every sounding.";
+	throw e;
+      }
+    pending.reference(Row);
+    has_pending = true;
+  }
+  virtual void commit(int Row)
+  {
+    if(!has_pending)
+      return;
+    TinyVector<int, D> lb, ub;
+    lb = 0;
+    ub = buf.shape() - 1;
+    lb(0) = ub(0) = Row - row_start;
+    buf(RectDomain<D>(lb, ub)) = pending;
+    discard();
+  }
+  virtual void discard()
+  {
+    pending.free();
+    has_pending = false;
+  }
+  virtual void flush(HdfFile& H, int Row_end, int Deflate_level,
+		     bool Shuffle)
+  {
+    if(!created) {
+      H.create_extendible_field<T, D>(d, buf.shape(), Deflate_level, Shuffle);
+      if(shape_name != "")
+	H.write_attribute(d + "/Shape", shape_name);
+      created = true;
+    }
+    if(Row_end <= row_start)
+      return;
+    TinyVector<int, D> lb, ub;
+    lb = 0;
+    ub = buf.shape() - 1;
+    ub(0) = Row_end - row_start - 1;
+    H.write_field_rows(d, row_start, Array<T, D>(buf(RectDomain<D>(lb, ub))));
+    buf = T();
+    row_start = Row_end;
+  }
+private:
+  std::string d, shape_name;
+  int row_start;
+  bool created, has_pending;
+  Array<T, D> buf, pending;
+};
+}
+/// @endcond
+
+//-----------------------------------------------------------------------
+/// Constructor. This takes the file name to write.
+//-----------------------------------------------------------------------
+
+OutputHdfStream::OutputHdfStream
+(const std::string& Fname, int Num_level, int Statevector_size,
+ int Num_aerosol, int Num_band, int Chunk_size, int Deflate_level,
+ bool Shuffle)
+: shape(Num_level, Statevector_size, Num_aerosol, Num_band),
+  h(new HdfFileGenerating(Fname)),
+  chunk_size_(Chunk_size), deflate_level(Deflate_level), nsounding(0),
+  nflushed(0), shuffle(Shuffle), shape_metadata_written(false)
+{
+  range_min_check(chunk_size_, 1);
+  range_check(deflate_level, 0, 10);
+}
+
+//-----------------------------------------------------------------------
+/// Constructor. This takes the file to write to.
+//-----------------------------------------------------------------------
+
+OutputHdfStream::OutputHdfStream
+(const boost::shared_ptr<HdfFileGenerating>& H,
+ int Num_level, int Statevector_size, int Num_aerosol, int Num_band,
+ int Chunk_size, int Deflate_level, bool Shuffle)
+: shape(Num_level, Statevector_size, Num_aerosol, Num_band),
+  h(H),
+  chunk_size_(Chunk_size), deflate_level(Deflate_level), nsounding(0),
+  nflushed(0), shuffle(Shuffle), shape_metadata_written(false)
+{
+  range_min_check(chunk_size_, 1);
+  range_check(deflate_level, 0, 10);
+}
+
+//-----------------------------------------------------------------------
+/// Write out the soundings we have collected in memory. This is
+/// called automatically when we have collected chunk_size()
+/// soundings, and by close(). You can call this directly if you want
+/// the data to get written sooner (e.g., to limit what gets lost if
+/// the process is killed).
+//-----------------------------------------------------------------------
+
+void OutputHdfStream::flush()
+{
+  if(!h)
+    return;
+  typedef std::map<std::string,
+		   boost::shared_ptr<OutputHdfStreamHelperBase> >::value_type
+    vt;
+  BOOST_FOREACH(vt& p, data)
+    p.second->flush(h->hdf_file(), nsounding, deflate_level, shuffle);
+  nflushed = nsounding;
+}
+
+//-----------------------------------------------------------------------
+/// Write out any data we still have in memory, add the dimension
+/// metadata and close the file. This is automatically done by the
+/// destructor.
+//-----------------------------------------------------------------------
+
+void OutputHdfStream::close()
+{
+  if(!h)
+    return;
+  flush();
+  if(shape_metadata_written)
+    shape.write_dimension_metadata(h->hdf_file(), nsounding);
+  h->close();
+  h.reset();
+}
+
+//-----------------------------------------------------------------------
+/// Destructor. This closes the file if it is still open. We can't
+/// throw an exception from a destructor, so if something goes wrong
+/// we log the error instead. The file then doesn't get its final
+/// name. Call close() directly if you want to handle errors.
+//-----------------------------------------------------------------------
+
+OutputHdfStream::~OutputHdfStream()
+{
+  try {
+    close();
+  } catch(const H5::Exception& e) {
+    Logger::error() << "Error closing OutputHdfStream: " 
+		    << e.getDetailMsg() << "\n";
+  } catch(const std::exception& e) {
+    Logger::error() << "Error closing OutputHdfStream: " << e.what() << "\n";
+  } catch(...) {
+    Logger::error() << "Unknown error closing OutputHdfStream\n";
+  }
+}
+
+void OutputHdfStream::print(std::ostream& Os) const
+{
+  Os << "OutputHdfStream:\n"
+     << "  Chunk size:    " << chunk_size_ << "\n"
+     << "  Deflate level: " << deflate_level << "\n"
+     << "  Shuffle:       " << (shuffle ? "true" : "false") << "\n"
+     << "  Soundings:     " << nsounding << "\n";
+}
+
+// See base class for descriptions of all these functions.
+
+void OutputHdfStream::start_write()
+{
+  if(!h)
+    throw Exception("OutputHdfStream has already been closed");
+  if(!shape_metadata_written) {
+    shape.write_shape_metadata(h->hdf_file());
+    shape_metadata_written = true;
+  }
+}
+
+void OutputHdfStream::end_write()
+{
+  typedef std::map<std::string,
+		   boost::shared_ptr<OutputHdfStreamHelperBase> >::value_type
+    vt;
+  BOOST_FOREACH(vt& p, data)
+    p.second->commit(nsounding);
+  ++nsounding;
+  if(nsounding - nflushed >= chunk_size_)
+    flush();
+}
+
+void OutputHdfStream::end_because_of_error()
+{
+  typedef std::map<std::string,
+		   boost::shared_ptr<OutputHdfStreamHelperBase> >::value_type
+    vt;
+  BOOST_FOREACH(vt& p, data)
+    p.second->discard();
+}
+
+//-----------------------------------------------------------------------
+/// Add a row to the given field, creating the field if this is the
+/// first time we have seen it.
+//-----------------------------------------------------------------------
+
+template<class T, int D> void OutputHdfStream::add_row
+(const std::string& Dataset_name, const blitz::Array<T, D>& Row,
+ const std::string& Shape)
+{
+  if(data.count(Dataset_name) == 0)
+    data[Dataset_name] = boost::shared_ptr<OutputHdfStreamHelperBase>
+      (new OutputHdfStreamHelper<T, D>(Dataset_name, Row.shape(), Shape,
+				       chunk_size_, nflushed));
+  boost::shared_ptr<OutputHdfStreamHelper<T, D> >
+    hlp = boost::dynamic_pointer_cast<OutputHdfStreamHelper<T, D> >
+    (data[Dataset_name]);
+  if(!hlp) {
+    Exception e;
+    e << "The field " << Dataset_name << " changed type or rank";
+    throw e;
+  }
+  hlp->set_pending(Row);
+}
+
+template<class T> void OutputHdfStream::write_data_t
+(const std::string& Dataset_name, T Val)
+{
+  std::string s = shape.shape(Dataset_name);
+  if(s == "Scalar") {
+    if(metadata_written.count(Dataset_name) == 0) {
+      h->hdf_file().write_field(Dataset_name, Val);
+      h->hdf_file().write_attribute(Dataset_name + "/Shape", s);
+      metadata_written.insert(Dataset_name);
+    }
+    return;
+  }
+  Array<T, 1> row(1);
+  row(0) = Val;
+  add_row(Dataset_name, row, s);
+}
+
+void OutputHdfStream::write_data_t
+(const std::string& Dataset_name, const char* Val)
+{
+  write_data_t(Dataset_name, std::string(Val));
+}
+
+template<class T, int D> void OutputHdfStream::write_data_t
+(const std::string& Dataset_name, const blitz::Array<T, D>& Val)
+{
+  TinyVector<int, D + 1> sz;
+  sz(0) = 1;
+  for(int i = 0; i < D; ++i)
+    sz(i + 1) = Val.extent(i);
+  Array<T, D + 1> row(sz);
+  // Copy the data in, row has the same data ordering as Val with the
+  // leading dimension of size 1 added.
+  Array<T, D> t = to_c_order_const(Val);
+  std::copy(t.dataFirst(), t.dataFirst() + t.size(), row.dataFirst());
+  std::string s;
+  if(D == 1)
+    s = shape.shape(Dataset_name, Val.extent(0));
+  else if(D == 2)
+    s = shape.shape(Dataset_name, Val.extent(0), Val.extent(1));
+  add_row(Dataset_name, row, s);
+}
+
+template<int D> void OutputHdfStream::write_data_t
+(const std::string& Dataset_name, const blitz::Array<const char*, D>& Val)
+{
+  Array<std::string, D> v(Val.shape());
+  typename Array<const char*, D>::const_iterator i1 = Val.begin();
+  typename Array<std::string, D>::iterator i2 = v.begin();
+  for(; i1 != Val.end(); ++i1, ++i2)
+    *i2 = *i1;
+  write_data_t(Dataset_name, v);
+}
+
+// Instantiation of the templates for the various types.
+
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      int Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      int64_t Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      double Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      std::string Val);
+
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<int, 1>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<std::string, 1>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<const char*, 1>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<double, 1>& Val);
+
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<int, 2>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<std::string, 2>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<const char*, 2>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<double, 2>& Val);
+
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<int, 3>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<std::string, 3>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<const char*, 3>& Val);
+template void OutputHdfStream::write_data_t(const std::string& Dataset_name,
+				      const blitz::Array<double, 3>& Val);
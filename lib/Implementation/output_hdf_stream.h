@@ -0,0 +1,109 @@
+#ifndef OUTPUT_HDF_STREAM_H
+#define OUTPUT_HDF_STREAM_H
+#include "output_hdf.h"
+#include <set>
+
+namespace FullPhysics {
+// Helper class for OutputHdfStream
+// Don't have Doxygen document this class
+/// @cond
+class OutputHdfStreamHelperBase {
+public:
+  virtual ~OutputHdfStreamHelperBase() {}
+  virtual void commit(int Row) = 0;
+  virtual void discard() = 0;
+  virtual void flush(HdfFile& H, int Row_end, int Deflate_level,
+		     bool Shuffle) = 0;
+};
+/// @endcond
+
+/****************************************************************//**
+  This writes the output of the Level 2 Full physics to a HDF5 file,
+  like OutputHdf. The difference is that this class is set up to
+  write a number of soundings to the same file.
+
+  Each call to write() adds one row to every field, so the
+  "Retrieval" dimension is the number of soundings written (rather
+  than always being 1 as it is for OutputHdf). The data is collected
+  in memory, and written out Chunk_size soundings at a time. The
+  fields in the file are chunked with that number of rows, and can
+  optionally be compressed. This avoids the large number of small
+  datasets we get writing each sounding to its own file, and makes
+  appending a sounding cheap.
+
+  The Shape of each field is determined once, the first time we see
+  it, using the same rules as OutputHdf (see OutputHdfShape).
+
+  There are a few differences from OutputHdf:
+
+  1. A write is atomic for a sounding, rather than for the whole
+     file. If an error occurs, we throw away the data for that
+     sounding only, the soundings already written are left alone.
+     The file is only given its final name (see HdfFileGenerating)
+     when close() is called.
+
+  2. Each field needs to have the same size for each sounding. Fields
+     that aren't written for a particular sounding (e.g., a field that
+     only appears in some soundings) are left at the HDF fill value
+     (0, or an empty string) for that row.
+
+  3. Scalar fields in the "/Metadata/" group are written once, the
+     first time we see them, without a Retrieval dimension.
+
+  4. All strings are written as variable length strings, since the
+     length of fixed length strings can't change after we have
+     created the field.
+*******************************************************************/
+
+class OutputHdfStream : public OutputTemplate<OutputHdfStream> {
+public:
+  OutputHdfStream(const std::string& Fname, int Num_level,
+		  int Statevector_size, int Num_aerosol, int Number_band,
+		  int Chunk_size = 100, int Deflate_level = 0,
+		  bool Shuffle = false);
+  OutputHdfStream(const boost::shared_ptr<HdfFileGenerating>& H,
+		  int Num_level, int Statevector_size, int Num_aerosol,
+		  int Number_band, int Chunk_size = 100,
+		  int Deflate_level = 0, bool Shuffle = false);
+  virtual ~OutputHdfStream();
+  void flush();
+  void close();
+
+//-----------------------------------------------------------------------
+/// Number of soundings that have been written.
+//-----------------------------------------------------------------------
+
+  int number_sounding() const { return nsounding; }
+
+//-----------------------------------------------------------------------
+/// Number of soundings that we buffer in memory before writing.
+//-----------------------------------------------------------------------
+
+  int chunk_size() const { return chunk_size_; }
+  virtual void print(std::ostream& Os) const;
+protected:
+  virtual void start_write();
+  virtual void end_write();
+  virtual void end_because_of_error();
+  template<class T> void write_data_t(const std::string& Dataset_name,
+				      T Val);
+  void write_data_t(const std::string& Dataset_name, const char* Val);
+  template<class T, int D> void write_data_t(const std::string& Dataset_name,
+					     const blitz::Array<T, D>& Val);
+  template<int D> void write_data_t(const std::string& Dataset_name,
+			    const blitz::Array<const char*, D>& Val);
+  friend class OutputTemplate<OutputHdfStream>;
+private:
+  OutputHdfShape shape;
+  boost::shared_ptr<HdfFileGenerating> h;
+  int chunk_size_, deflate_level, nsounding, nflushed;
+  bool shuffle, shape_metadata_written;
+  std::map<std::string, boost::shared_ptr<OutputHdfStreamHelperBase> >
+  data;
+  std::set<std::string> metadata_written;
+  template<class T, int D> void
+  add_row(const std::string& Dataset_name, const blitz::Array<T, D>& Row,
+	  const std::string& Shape);
+};
+}
+#endif
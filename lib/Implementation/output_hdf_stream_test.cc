@@ -0,0 +1,98 @@
+#include "unit_test_support.h"
+#include "output_hdf_stream.h"
+#include <boost/lexical_cast.hpp>
+
+using namespace FullPhysics;
+using namespace blitz;
+
+class StreamCalcData {
+public:
+  StreamCalcData(int D) : d(D) {}
+  int d_val() const {return d;}
+  int d_val_fake_error() const {throw Exception("fake error");}
+  Array<double, 1> d_lev() const 
+  { Array<double, 1> res(20); res = d; return res; }
+  std::string d_str() const 
+  { return "Sounding " + boost::lexical_cast<std::string>(d); }
+  int d;
+};
+
+BOOST_FIXTURE_TEST_SUITE(output_hdf_stream, GlobalFixture)
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  boost::shared_ptr<HdfFileGenerating> 
+    hf(new HdfFileGenerating("output_hdf_stream.h5"));
+  add_file_to_cleanup("output_hdf_stream.h5");
+  // Use a chunk size that doesn't evenly divide the number of
+  // soundings, so we test a partial chunk at the end.
+  OutputHdfStream h(hf, 20, 112, 5, 3, 2, 6, true);
+  boost::shared_ptr<StreamCalcData> c(new StreamCalcData(1));
+  h.register_data_source("/Test/C1", &StreamCalcData::d_val, c);
+  h.register_data_source("/Test/dlev", &StreamCalcData::d_lev, c);
+  h.register_data_source("/Test/str", &StreamCalcData::d_str, c);
+  h.register_data_source("/Metadata/Version", std::string("1.0"));
+  Array<double, 2> darr2(112, 112);
+  darr2 = 2.0;
+  h.register_data_source("/Test/dstatestate", darr2);
+  for(int i = 1; i <= 5; ++i) {
+    c->d = i;
+    h.write();
+  }
+  BOOST_CHECK_EQUAL(h.number_sounding(), 5);
+  h.close();
+  HdfFile hread("output_hdf_stream.h5");
+  Array<int, 1> c1 = hread.read_field<int, 1>("/Test/C1");
+  BOOST_CHECK_EQUAL(c1.rows(), 5);
+  for(int i = 0; i < 5; ++i)
+    BOOST_CHECK_EQUAL(c1(i), i + 1);
+  Array<double, 2> dlev = hread.read_field<double, 2>("/Test/dlev");
+  BOOST_CHECK_EQUAL(dlev.rows(), 5);
+  BOOST_CHECK_EQUAL(dlev.cols(), 20);
+  BOOST_CHECK_CLOSE(dlev(3, 10), 4.0, 1e-8);
+  Array<std::string, 1> str = hread.read_field<std::string, 1>("/Test/str");
+  BOOST_CHECK_EQUAL(str(4), "Sounding 5");
+  BOOST_CHECK_EQUAL(hread.read_field<double, 3>("/Test/dstatestate").rows(),
+		    5);
+  BOOST_CHECK_EQUAL(hread.read_field<std::string>("/Metadata/Version"), 
+		    "1.0");
+  BOOST_CHECK_EQUAL(hread.read_attribute<std::string>("/Test/C1/Shape"),
+		    "Retrieval_Array");
+  BOOST_CHECK_EQUAL(hread.read_attribute<std::string>("/Test/dlev/Shape"),
+		    "Retrieval_Level_Array");
+  BOOST_CHECK_EQUAL(hread.read_attribute<std::string>("/Test/dstatestate/Shape"),
+		    "Retrieval_StateVectorElement_StateVectorElement_Array");
+  BOOST_CHECK_EQUAL(hread.read_attribute<int>("/Dimensions/Retrieval/Size"), 
+		    5);
+}
+
+BOOST_AUTO_TEST_CASE(test_error)
+{
+  boost::shared_ptr<HdfFileGenerating> 
+    hf(new HdfFileGenerating("output_hdf_stream.h5"));
+  add_file_to_cleanup("output_hdf_stream.h5");
+  OutputHdfStream h(hf, 20, 112, 5, 3);
+  boost::shared_ptr<StreamCalcData> c1(new StreamCalcData(1));
+  boost::shared_ptr<StreamCalcData> c2(new StreamCalcData(2));
+  h.register_data_source("/Test/C2", &StreamCalcData::d_val, c2);
+  h.write();
+  // A sounding that fails shouldn't add anything to the file.
+  h.register_data_source("/Test/C1", &StreamCalcData::d_val_fake_error, c1);
+  BOOST_CHECK_THROW(h.write(), Exception);
+  h.register_data_source("/Test/C1", &StreamCalcData::d_val, c1);
+  h.write();
+  BOOST_CHECK_EQUAL(h.number_sounding(), 2);
+  h.close();
+  HdfFile hread("output_hdf_stream.h5");
+  Array<int, 1> c2v = hread.read_field<int, 1>("/Test/C2");
+  BOOST_CHECK_EQUAL(c2v.rows(), 2);
+  BOOST_CHECK_EQUAL(c2v(1), 2);
+  // C1 wasn't written for the first sounding, so it gets the fill
+  // value. 
+  Array<int, 1> c1v = hread.read_field<int, 1>("/Test/C1");
+  BOOST_CHECK_EQUAL(c1v.rows(), 2);
+  BOOST_CHECK_EQUAL(c1v(0), 0);
+  BOOST_CHECK_EQUAL(c1v(1), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,475 @@
+#include "pca_rt.h"
+#include "linear_algebra.h"
+#include "ostream_pad.h"
+#include "twostream_rt.h"
+#include <boost/lexical_cast.hpp>
+#include <algorithm>
+
+using namespace FullPhysics;
+using namespace blitz;
+
+#ifdef HAVE_LUA
+#include "register_lua.h"
+boost::shared_ptr<RadiativeTransfer>
+pca_rt_create(const boost::shared_ptr<RadiativeTransfer>& Rt_low,
+	      const boost::shared_ptr<RadiativeTransfer>& Rt_high,
+	      const HdfFile& Config_file,
+	      const std::string& Lsi_group,
+	      int Number_eof)
+{
+  boost::shared_ptr<RadiativeTransferSingleWn> rt_lows =
+    boost::dynamic_pointer_cast<RadiativeTransferSingleWn>(Rt_low);
+  boost::shared_ptr<RadiativeTransferSingleWn> rt_highs =
+    boost::dynamic_pointer_cast<RadiativeTransferSingleWn>(Rt_high);
+  return boost::shared_ptr<RadiativeTransfer>
+  (new PcaRt(rt_lows, rt_highs, Config_file, Lsi_group, Number_eof));
+}
+
+boost::shared_ptr<RadiativeTransfer>
+pca_rt_create_default(const boost::shared_ptr<RadiativeTransfer>& Rt_low,
+		      const boost::shared_ptr<RadiativeTransfer>& Rt_high,
+		      const HdfFile& Config_file,
+		      const std::string& Lsi_group)
+{
+  return pca_rt_create(Rt_low, Rt_high, Config_file, Lsi_group, 4);
+}
+
+REGISTER_LUA_DERIVED_CLASS(PcaRt, RadiativeTransfer)
+.scope
+[
+ luabind::def("create", &pca_rt_create),
+ luabind::def("create", &pca_rt_create_default)
+]
+REGISTER_LUA_END()
+#endif
+
+// Small value added to the intermediate variables before taking the
+// log, so we can handle values that are 0 (e.g., an aerosol with no
+// optical depth in a layer).
+const double pca_log_floor = 1e-10;
+
+// We don't extrapolate the second order expansion past this many
+// standard deviations along an EOF.
+const double pca_score_max = 3.0;
+
+/// @cond
+//-----------------------------------------------------------------------
+// Bin that the optical depth falls into. This matches what BinMap
+// does for the LSI: we don't care what the lower edge of the first
+// bin is, and we extrapolate the last bin.
+//-----------------------------------------------------------------------
+
+static int pca_bin(const std::vector<double>& Odb, double Od)
+{
+  if(Odb.size() < 2)
+    return 0;
+  int b = (int) (std::lower_bound(Odb.begin() + 1, Odb.end(), Od) -
+		 (Odb.begin() + 1));
+  return std::min(b, (int) Odb.size() - 2);
+}
+/// @endcond
+
+//-----------------------------------------------------------------------
+/// Create a object that uses the low stream RT + PCA corrections
+/// based on the low and high stream RT.
+///
+/// As with LsiRt, you'll normally want the low and high stream
+/// RadiativeTransfer classes to use the same stokes coefficients,
+/// StateVector and Atmosphere. This class uses the same stokes
+/// coefficients, StateVector and Atmosphere as the High_stream_rt.
+///
+/// This reads the optical depth boundaries used for binning from the
+/// same fields LsiRt uses, "optical_depth_boundary_1",
+/// "optical_depth_boundary_2", etc. in the given group.
+///
+/// \param Low_stream_rt Low stream RadiativeTransfer object.
+/// \param High_stream_rt High stream RadiativeTransfer object.
+/// \param Config_file HDF file that contains configuration
+///    information
+/// \param Lsi_group The group that contains the optical depth
+///    boundaries to read.
+/// \param Number_eof Number of EOFs to use in each bin.
+//-----------------------------------------------------------------------
+
+PcaRt::PcaRt(const boost::shared_ptr<RadiativeTransferSingleWn>& Low_stream_rt,
+	     const boost::shared_ptr<RadiativeTransferSingleWn>& High_stream_rt,
+	     const HdfFile& Config_file,
+	     const std::string& Lsi_group,
+	     int Number_eof)
+: RadiativeTransferFixedStokesCoefficient(High_stream_rt->stokes_coefficient()),
+  low_stream_rt(Low_stream_rt), high_stream_rt(High_stream_rt),
+  neof(Number_eof), nhigh_call(0)
+{
+  check_stream();
+  for(int i = 0; i < number_spectrometer(); ++i) {
+    Array<double, 1> d = Config_file.read_field<double, 1>
+      (Lsi_group + "/optical_depth_boundary_" +
+       boost::lexical_cast<std::string>(i + 1));
+    optical_depth_boundary.push_back(std::vector<double>(d.begin(), d.end()));
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Create a object that uses the low stream RT + PCA corrections
+/// based on the low and high stream RT. This version uses the same
+/// optical depth boundaries for all the spectrometers. You can pass
+/// an empty array to use one bin for everything.
+///
+/// \param Low_stream_rt Low stream RadiativeTransfer object.
+/// \param High_stream_rt High stream RadiativeTransfer object.
+/// \param Optical_depth_boundary Boundaries of the optical depth bins.
+/// \param Number_eof Number of EOFs to use in each bin.
+//-----------------------------------------------------------------------
+
+PcaRt::PcaRt(const boost::shared_ptr<RadiativeTransferSingleWn>& Low_stream_rt,
+	     const boost::shared_ptr<RadiativeTransferSingleWn>& High_stream_rt,
+	     const blitz::Array<double, 1>& Optical_depth_boundary,
+	     int Number_eof)
+: RadiativeTransferFixedStokesCoefficient(High_stream_rt->stokes_coefficient()),
+  low_stream_rt(Low_stream_rt), high_stream_rt(High_stream_rt),
+  neof(Number_eof), nhigh_call(0)
+{
+  check_stream();
+  for(int i = 0; i < number_spectrometer(); ++i)
+    optical_depth_boundary.push_back
+      (std::vector<double>(Optical_depth_boundary.begin(),
+			   Optical_depth_boundary.end()));
+}
+
+//-----------------------------------------------------------------------
+/// Check the arguments passed to the constructor.
+//-----------------------------------------------------------------------
+
+void PcaRt::check_stream() const
+{
+  if(low_stream_rt->number_stokes() != high_stream_rt->number_stokes())
+    throw Exception("Low stream and high stream need to have the same number of stokes parameters");
+  range_min_check(neof, 0);
+}
+
+void PcaRt::print(std::ostream& Os, bool Short_form) const
+{
+  OstreamPad opad(Os, "    ");
+  Os << "PcaRt\n";
+  Os << "  ";
+  RadiativeTransferFixedStokesCoefficient::print(opad, Short_form);
+  opad.strict_sync();
+  Os << "\n  Number EOF: " << neof << "\n";
+  for(int i = 0; i < (int) optical_depth_boundary.size(); ++i) {
+    Os << "  Optical depth boundary[" << i << "]:\n";
+    Os << "   (";
+    for(int j = 0; j < (int) optical_depth_boundary[i].size(); ++j) {
+      Os << optical_depth_boundary[i][j];
+      if(j != (int) optical_depth_boundary[i].size() - 1)
+	Os << ", ";
+    }
+    Os << ")\n";
+  }
+  Os << "\n  High stream:\n";
+  high_stream_rt->print(opad, Short_form);
+  opad.strict_sync();
+  Os << "  Low stream:\n";
+  low_stream_rt->print(opad, true);
+  opad.strict_sync();
+}
+
+// See base class for description
+blitz::Array<double, 2> PcaRt::stokes(const SpectralDomain& Spec_domain,
+				      int Spec_index) const
+{
+  FunctionTimer ft(timer.function_timer(true));
+  Logger::info() << "RT for band " << Spec_index + 1 << "\n";
+  calc_correction(Spec_domain, Spec_index, false);
+  Logger::info() << low_stream_rt->atmosphere_ptr()->timer_info();
+  return stokes_only;
+}
+
+// See base class for description
+ArrayAd<double, 2> PcaRt::stokes_and_jacobian
+(const SpectralDomain& Spec_domain, int Spec_index) const
+{
+  FunctionTimer ft(timer.function_timer(true));
+  Logger::info() << "RT + Jac for band " << Spec_index + 1 << "\n";
+  calc_correction(Spec_domain, Spec_index, true);
+  Logger::info() << low_stream_rt->atmosphere_ptr()->timer_info();
+  return stokes_and_jac;
+}
+
+//-----------------------------------------------------------------------
+/// Run the low and high stream RT on the intermediate variables
+/// exp(Xlog) - pca_log_floor, returning the correction. The
+/// intensity correction is log(high / low), the others are high -
+/// low. If Calc_jacobian is true, Dlog is the Jacobian of Xlog with
+/// the state vector, and we include the Jacobian in the correction.
+//-----------------------------------------------------------------------
+
+Array<AutoDerivative<double>, 1> PcaRt::correction
+(double Wn, int Spec_index, const blitz::Array<double, 2>& Xlog,
+ const blitz::Array<double, 3>& Dlog, bool Calc_jacobian) const
+{
+  Range ra(Range::all());
+  Array<double, 2> v(Xlog.shape());
+  v = exp(Xlog) - pca_log_floor;
+  v = where(v < 0, 0, v);
+  Array<AutoDerivative<double>, 1> low, high;
+  if(Calc_jacobian) {
+    Array<double, 3> jac(Dlog.shape());
+    for(int l = 0; l < v.rows(); ++l)
+      for(int k = 0; k < v.cols(); ++k)
+	jac(l, k, ra) = (v(l, k) + pca_log_floor) * Dlog(l, k, ra);
+    ArrayAd<double, 2> iv(v, jac);
+    low.reference(low_stream_rt->stokes_and_jacobian_single_wn
+		  (Wn, Spec_index, iv).to_array());
+    high.reference(high_stream_rt->stokes_and_jacobian_single_wn
+		   (Wn, Spec_index, iv).to_array());
+  } else {
+    ArrayAd<double, 2> iv(v);
+    Array<double, 1> l = low_stream_rt->stokes_single_wn(Wn, Spec_index, iv);
+    Array<double, 1> h = high_stream_rt->stokes_single_wn(Wn, Spec_index, iv);
+    low.resize(l.rows());
+    high.resize(h.rows());
+    for(int j = 0; j < l.rows(); ++j) {
+      low(j) = l(j);
+      high(j) = h(j);
+    }
+  }
+  ++nhigh_call;
+  // As with the LSI, we don't want to do a scaled correction for Q
+  // and U since these can be negative.
+  Array<AutoDerivative<double>, 1> c(low.rows());
+  if(low(0).value() > 1e-15 && high(0).value() > 1e-15)
+    c(0) = log(high(0) / low(0));
+  else
+    c(0) = 0.0;
+  for(int j = 1; j < c.rows(); ++j)
+    c(j) = high(j) - low(j);
+  return c;
+}
+
+//-----------------------------------------------------------------------
+/// Calculate the low stream stokes at each wavenumber, and apply the
+/// PCA correction to it. This fills in stokes_and_jac if
+/// Calc_jacobian is true, stokes_only otherwise.
+//-----------------------------------------------------------------------
+
+void PcaRt::calc_correction(const SpectralDomain& Spec_domain,
+			    int Spec_index, bool Calc_jacobian) const
+{
+  firstIndex i1; secondIndex i2;
+  Range ra(Range::all());
+  Array<double, 1> wn(Spec_domain.wavenumber());
+  boost::shared_ptr<boost::progress_display> disp = progress_display(wn);
+  const RtAtmosphere& atm = *low_stream_rt->atmosphere_ptr();
+  const std::vector<double>& odb = optical_depth_boundary[Spec_index];
+  int nbin = std::max((int) odb.size() - 1, 1);
+  int nwn = wn.rows();
+  nhigh_call = 0;
+  // As in LsiRt, only a TwostreamRt using its batch driver does a
+  // block of wavenumbers at a time.
+  boost::shared_ptr<TwostreamRt> ts_low =
+    boost::dynamic_pointer_cast<TwostreamRt>(low_stream_rt);
+  bool batch_low = ts_low && ts_low->batch_driver();
+
+//-----------------------------------------------------------------------
+// Go through all the wavenumbers and collect the log of the
+// intermediate variables in x (flattened to number_layer *
+// number intermediate variables), along with the bin each wavenumber
+// falls in. For the Jacobian, we also sum the Jacobian of the log of
+// the intermediate variables in each bin.
+//
+// Since we are already calculating the atmosphere properties, we also
+// run the low stream RT here, unless it does all the wavenumbers in
+// one call.
+//-----------------------------------------------------------------------
+
+  ArrayAd<double, 2> iv0(atm.intermediate_variable(wn(0), Spec_index).copy());
+  int nlay = iv0.rows();
+  int nvar_iv = iv0.cols();
+  int nfeat = nlay * nvar_iv;
+  // Need at least 1 or else FM only mode doesn't work
+  int numvar = std::max(iv0.number_variable(), 1);
+  Array<double, 2> x(nwn, nfeat);
+  Array<int, 1> bin_index(nwn);
+  std::vector<int> cnt(nbin, 0);
+  std::vector<Array<double, 3> > dlog_sum;
+  for(int b = 0; b < nbin; ++b) {
+    dlog_sum.push_back(Array<double, 3>(nlay, nvar_iv, numvar));
+    dlog_sum[b] = 0;
+  }
+  if(Calc_jacobian)
+    stokes_and_jac.resize(nwn, number_stokes(), numvar);
+  else
+    stokes_only.resize(nwn, number_stokes());
+  for(int i = 0; i < nwn; ++i) {
+    ArrayAd<double, 2> iv(atm.intermediate_variable(wn(i), Spec_index));
+    int b = pca_bin(odb,
+		    sum(atm.optical_depth_wrt_iv(wn(i), Spec_index).value()));
+    bin_index(i) = b;
+    ++cnt[b];
+    bool have_jac = Calc_jacobian && !iv.is_constant() &&
+      iv.number_variable() == numvar;
+    for(int l = 0; l < nlay; ++l)
+      for(int k = 0; k < nvar_iv; ++k) {
+	double v = std::max(iv.value()(l, k), 0.0) + pca_log_floor;
+	x(i, l * nvar_iv + k) = log(v);
+	if(have_jac)
+	  dlog_sum[b](l, k, ra) += iv.jacobian()(l, k, ra) / v;
+      }
+    if(!batch_low) {
+      if(Calc_jacobian)
+	stokes_and_jac(i, ra) = low_stream_rt->stokes_and_jacobian_single_wn
+	  (wn(i), Spec_index);
+      else
+	stokes_only(i, ra) = low_stream_rt->stokes_single_wn
+	  (wn(i), Spec_index);
+    }
+
+  // Update progress meter in log file, if we are using it.
+    if(disp)
+      *disp += 1;
+  }
+
+  if(batch_low) {
+    if(Calc_jacobian) {
+      ArrayAd<double, 2> t =
+	low_stream_rt->stokes_and_jacobian(Spec_domain, Spec_index);
+      for(int i = 0; i < nwn; ++i)
+	stokes_and_jac(i, ra) = t(i, ra);
+    } else
+      stokes_only = low_stream_rt->stokes(Spec_domain, Spec_index);
+  }
+
+//-----------------------------------------------------------------------
+// As with the LSI, we do the RT calculation for the correction at the
+// middle wavenumber.
+//-----------------------------------------------------------------------
+
+  double wn_mid = (max(wn) + min(wn)) / 2;
+  double wn_mid_closest = wn(0);
+  double wn_dist = fabs(wn_mid_closest - wn_mid);
+  for(int i = 0; i < nwn; ++i)
+    if(fabs(wn(i) - wn_mid) < wn_dist) {
+      wn_dist = fabs(wn(i) - wn_mid);
+      wn_mid_closest = wn(i);
+    }
+
+//-----------------------------------------------------------------------
+// Now, for each bin find the mean and EOFs of x. We run the RT at the
+// mean and at the mean +- one standard deviation along each EOF, and
+// use this to get the coefficients of a second order expansion of
+// the correction in the principal component scores. coef[b] has the
+// correction at the mean in the first row, followed by the first
+// order and then the second order coefficients for each EOF. We
+// save the scores (in units of the standard deviation) for each
+// wavenumber in score.
+//-----------------------------------------------------------------------
+
+  std::vector<Array<AutoDerivative<double>, 2> > coef(nbin);
+  std::vector<int> neof_bin(nbin, 0);
+  Array<double, 2> score(nwn, std::max(neof, 1));
+  score = 0;
+  Array<double, 1> xmean(nfeat), dx(nfeat);
+  Array<double, 2> cov(nfeat, nfeat);
+  for(int b = 0; b < nbin; ++b) {
+    if(cnt[b] == 0)
+      continue;
+    xmean = 0;
+    for(int i = 0; i < nwn; ++i)
+      if(bin_index(i) == b)
+	xmean += x(i, ra);
+    xmean /= cnt[b];
+    int ne = std::min(neof, cnt[b] - 1);
+    Array<double, 1> sd;
+    Array<double, 2> eof;
+    if(ne > 0) {
+      cov = 0;
+      for(int i = 0; i < nwn; ++i)
+	if(bin_index(i) == b) {
+	  dx = x(i, ra) - xmean;
+	  cov += dx(i1) * dx(i2);
+	}
+      cov /= cnt[b];
+      Array<double, 1> s;
+      Array<double, 2> u, vt;
+      svd(cov, s, u, vt);
+      // Drop any EOFs that don't have any variance.
+      int nuse = 0;
+      while(nuse < ne && s(nuse) > 0 && s(nuse) > s(0) * 1e-12)
+	++nuse;
+      ne = nuse;
+      if(ne > 0) {
+	sd.resize(ne);
+	sd = sqrt(s(Range(0, ne - 1)));
+	eof.reference(vt(Range(0, ne - 1), ra).copy());
+      }
+    }
+    neof_bin[b] = ne;
+    for(int i = 0; i < nwn; ++i)
+      if(bin_index(i) == b)
+	for(int k = 0; k < ne; ++k) {
+	  dx = x(i, ra) - xmean;
+	  double p = sum(eof(k, ra) * dx) / sd(k);
+	  score(i, k) = std::max(std::min(p, pca_score_max), -pca_score_max);
+	}
+
+    Array<double, 3> dlog;
+    if(Calc_jacobian) {
+      dlog.resize(dlog_sum[b].shape());
+      dlog = dlog_sum[b] / cnt[b];
+    }
+    Array<double, 2> xs(nlay, nvar_iv);
+    for(int l = 0; l < nlay; ++l)
+      for(int k = 0; k < nvar_iv; ++k)
+	xs(l, k) = xmean(l * nvar_iv + k);
+    Array<AutoDerivative<double>, 1> f0 =
+      correction(wn_mid_closest, Spec_index, xs, dlog, Calc_jacobian);
+    coef[b].resize(1 + 2 * ne, f0.rows());
+    coef[b](0, ra) = f0;
+    for(int k = 0; k < ne; ++k) {
+      for(int l = 0; l < nlay; ++l)
+	for(int m = 0; m < nvar_iv; ++m)
+	  xs(l, m) = xmean(l * nvar_iv + m) + sd(k) * eof(k, l * nvar_iv + m);
+      Array<AutoDerivative<double>, 1> fp =
+	correction(wn_mid_closest, Spec_index, xs, dlog, Calc_jacobian);
+      for(int l = 0; l < nlay; ++l)
+	for(int m = 0; m < nvar_iv; ++m)
+	  xs(l, m) = xmean(l * nvar_iv + m) - sd(k) * eof(k, l * nvar_iv + m);
+      Array<AutoDerivative<double>, 1> fm =
+	correction(wn_mid_closest, Spec_index, xs, dlog, Calc_jacobian);
+      for(int j = 0; j < f0.rows(); ++j) {
+	coef[b](1 + k, j) = (fp(j) - fm(j)) / 2.0;
+	coef[b](1 + ne + k, j) = (fp(j) - 2.0 * f0(j) + fm(j)) / 2.0;
+      }
+    }
+  }
+  Logger::info() << "PCA correction used " << nhigh_call
+		 << " high stream calls for " << nwn << " wavenumbers\n";
+
+//-----------------------------------------------------------------------
+// Finally, apply the correction to the low stream results. Intensity
+// is a scaled correction, the others are additive.
+//-----------------------------------------------------------------------
+
+  for(int i = 0; i < nwn; ++i) {
+    int b = bin_index(i);
+    int ne = neof_bin[b];
+    for(int j = 0; j < coef[b].cols(); ++j) {
+      AutoDerivative<double> c = coef[b](0, j);
+      for(int k = 0; k < ne; ++k) {
+	double p = score(i, k);
+	c = c + coef[b](1 + k, j) * p + coef[b](1 + ne + k, j) * (p * p);
+      }
+      if(Calc_jacobian) {
+	if(j == 0)
+	  stokes_and_jac(i, j) = stokes_and_jac(i, j) * exp(c);
+	else
+	  stokes_and_jac(i, j) = stokes_and_jac(i, j) + c;
+      } else {
+	if(j == 0)
+	  stokes_only(i, j) *= exp(c.value());
+	else
+	  stokes_only(i, j) += c.value();
+      }
+    }
+  }
+}
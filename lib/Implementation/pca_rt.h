@@ -0,0 +1,100 @@
+#ifndef PCA_RT_H
+#define PCA_RT_H
+#include "radiative_transfer_single_wn.h"
+#include "hdf_file.h"
+
+namespace FullPhysics {
+/****************************************************************//**
+  This does a principal component analysis (PCA) correction to a low
+  stream RadiativeTransfer object. This is an alternative to LsiRt,
+  and can be used in its place.
+
+  Like the LSI, we run the low stream RT at every wavenumber, and
+  correct it using the high stream RT run on a small number of
+  representative sets of optical properties. The difference is in
+  how we pick those, and how we map the correction back to each
+  wavenumber.
+
+  We first bin the wavenumbers by total column optical depth (using
+  the same optical depth boundaries as the LSI). Within each bin, we
+  take the log of the intermediate variables (e.g., taug, taur,
+  taua_i for each layer) at each wavenumber, and find the mean and
+  the leading empirical orthogonal functions (EOFs) of these
+  profiles. We then run both the low and high stream RT at the mean,
+  and at the mean plus and minus one standard deviation along each
+  EOF. For Number_eof EOFs, this is 2 * Number_eof + 1 high stream
+  calls per bin.
+
+  The correction for the intensity is log(high / low), and for the
+  other stokes parameters it is high - low (since these can be
+  negative). For each wavenumber, we project its profile onto the
+  EOFs, and use a second order expansion of the correction in those
+  principal component scores. The low stream intensity is multiplied
+  by exp(correction), and the correction is added to the other stokes
+  parameters.
+
+  For the Jacobian, the correction at the mean and perturbed states
+  is calculated with the high and low stream Jacobians, using the
+  average Jacobian of the log intermediate variables in the bin. We
+  treat the principal component scores as fixed, so the derivative of
+  the correction is the expansion of the derivatives at each of the
+  states we ran the RT on.
+
+  See Natraj et al., "Acceleration of radiative transfer computations
+  using principal component analysis" (JQSRT 2005) for a description
+  of the method.
+*******************************************************************/
+class PcaRt : public RadiativeTransferFixedStokesCoefficient {
+public:
+  PcaRt(const boost::shared_ptr<RadiativeTransferSingleWn>& Low_stream_rt,
+	const boost::shared_ptr<RadiativeTransferSingleWn>& High_stream_rt,
+	const HdfFile& Config_file,
+	const std::string& Lsi_group = "LSI",
+	int Number_eof = 4);
+  PcaRt(const boost::shared_ptr<RadiativeTransferSingleWn>& Low_stream_rt,
+	const boost::shared_ptr<RadiativeTransferSingleWn>& High_stream_rt,
+	const blitz::Array<double, 1>& Optical_depth_boundary,
+	int Number_eof = 4);
+  virtual ~PcaRt() {}
+  virtual int number_stokes() const
+  { return high_stream_rt->number_stokes(); }
+  virtual blitz::Array<double, 2> stokes(const SpectralDomain& Spec_domain,
+					 int Spec_index) const;
+  virtual ArrayAd<double, 2> stokes_and_jacobian
+  (const SpectralDomain& Spec_domain, int Spec_index) const;
+
+//-----------------------------------------------------------------------
+/// Number of EOFs we use in each bin. We may use fewer if a bin
+/// doesn't have enough wavenumbers in it.
+//-----------------------------------------------------------------------
+
+  int number_eof() const { return neof; }
+
+//-----------------------------------------------------------------------
+/// Number of high stream RT calls done in the last call to stokes or
+/// stokes_and_jacobian. This is useful for comparing the cost to
+/// LsiRt or running the high stream RT at every wavenumber.
+//-----------------------------------------------------------------------
+
+  int number_high_stream_call() const { return nhigh_call; }
+  virtual void print(std::ostream& Os, bool Short_form = false) const;
+  boost::shared_ptr<RadiativeTransfer>
+  low_stream_radiative_transfer() const { return low_stream_rt; }
+  boost::shared_ptr<RadiativeTransfer>
+  high_stream_radiative_transfer() const { return high_stream_rt; }
+private:
+  void calc_correction(const SpectralDomain& Spec_domain,
+		       int Spec_index, bool Calc_jacobian) const;
+  void check_stream() const;
+  blitz::Array<AutoDerivative<double>, 1> correction
+  (double Wn, int Spec_index, const blitz::Array<double, 2>& Xlog,
+   const blitz::Array<double, 3>& Dlog, bool Calc_jacobian) const;
+  boost::shared_ptr<RadiativeTransferSingleWn> low_stream_rt, high_stream_rt;
+  std::vector<std::vector<double> > optical_depth_boundary;
+  int neof;
+  mutable int nhigh_call;
+  mutable blitz::Array<double, 2> stokes_only;
+  mutable ArrayAd<double, 2> stokes_and_jac;
+};
+}
+#endif
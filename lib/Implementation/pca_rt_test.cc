@@ -0,0 +1,81 @@
+#include "pca_rt.h"
+#include "fp_logger.h"
+#include "lidort_fixture.h"
+#include "unit_test_support.h"
+#include "hdf_file.h"
+
+using namespace FullPhysics;
+using namespace blitz;
+BOOST_FIXTURE_TEST_SUITE(pca_rt, LidortLowHighLambertianFixture)
+
+BOOST_AUTO_TEST_CASE(stokes)
+{
+  is_long_test();		// Skip unless we are running long tests.
+  turn_on_logger();		// Have log output show up.
+
+  HdfFile config(test_data_dir() + "l2_fixed_level_static_input.h5");
+  PcaRt rt(low_rt, high_rt, config);
+  BOOST_CHECK_EQUAL(rt.number_eof(), 4);
+  // Small piece of the A-band, which has both continuum and strong
+  // O2 lines.
+  int wn_i = 0;
+  for(double wn = 13040.0; wn <= 13050.0; wn += 0.01)
+    wn_i += 1;
+  Array<double, 1> wn_arr(wn_i);
+  wn_i = 0;
+  for(double wn = 13040.0; wn <= 13050.0; wn += 0.01, ++wn_i)
+    wn_arr(wn_i) = wn;
+  Array<double, 2> stk = rt.stokes(wn_arr, 0);
+  BOOST_CHECK(rt.number_high_stream_call() < wn_arr.rows() / 5);
+  Array<double, 2> stk_high = high_rt->stokes(wn_arr, 0);
+  Array<double, 2> stk_low = low_rt->stokes(wn_arr, 0);
+  // The correction should move us much closer to the high stream
+  // result than the low stream result is.
+  double err_pca = max(abs(stk(Range::all(), 0) - stk_high(Range::all(), 0))
+		       / stk_high(Range::all(), 0));
+  double err_low = max(abs(stk_low(Range::all(), 0) - 
+			   stk_high(Range::all(), 0)) / 
+		       stk_high(Range::all(), 0));
+  BOOST_CHECK(err_pca < err_low / 5);
+  BOOST_CHECK(err_pca < 2e-3);
+}
+
+BOOST_AUTO_TEST_CASE(stokes_and_jacobian)
+{
+  is_long_test();		// Skip unless we are running long tests.
+  HdfFile config(test_data_dir() + "l2_fixed_level_static_input.h5");
+  PcaRt rt(low_rt, high_rt, config);
+  Array<double, 1> wn_arr(200);
+  for(int i = 0; i < wn_arr.rows(); ++i)
+    wn_arr(i) = 13040.0 + i * 0.01;
+  ArrayAd<double, 2> stk = rt.stokes_and_jacobian(wn_arr, 0);
+  Array<double, 2> stk_only = rt.stokes(wn_arr, 0);
+  // The value should be the same with or without the Jacobian.
+  BOOST_CHECK_MATRIX_CLOSE_TOL(stk.value(), stk_only, 1e-10);
+  BOOST_CHECK_EQUAL(stk.number_variable(), 
+		    config_state_vector->state().rows());
+
+  // Compare the Jacobian of the intensity with the high stream
+  // LIDORT. We treat the principal component scores as fixed when
+  // mapping the correction back, so the Jacobian is only approximate.
+  // We require each column to agree to 1% of the largest value in
+  // that column, and to be at least as close to the high stream
+  // Jacobian as the uncorrected low stream Jacobian is.
+  ArrayAd<double, 2> stk_high = high_rt->stokes_and_jacobian(wn_arr, 0);
+  ArrayAd<double, 2> stk_low = low_rt->stokes_and_jacobian(wn_arr, 0);
+  double err_pca = 0, err_low = 0;
+  for(int i = 0; i < stk.number_variable(); ++i) {
+    Array<double, 1> jhigh = stk_high.jacobian()(Range::all(), 0, i);
+    double scale = max(abs(jhigh));
+    if(scale == 0)
+      continue;
+    double e = max(abs(stk.jacobian()(Range::all(), 0, i) - jhigh)) / scale;
+    BOOST_CHECK_SMALL(e, 1e-2);
+    err_pca = std::max(err_pca, e);
+    err_low = std::max(err_low, 
+	       max(abs(stk_low.jacobian()(Range::all(), 0, i) - jhigh)) / scale);
+  }
+  BOOST_CHECK(err_pca <= err_low);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,16 +2,36 @@
 
 using namespace FullPhysics;
 using namespace blitz;
-extern "C" {
-  void rayleigh_wrap(const double* wn,
-		     const double* depolar_fact,
-		     const double* a,
-		     const double* b,
-		     double* rayleigh_cross_section);
-  /* depolar_fact depolarization factor for air is 0.02790 (young, 1980) */
-  /* a and b are wavelength dependence coefficients for the refractive index
-       (allen, 1964) (note: wavelengths must be in microns)
-       For Earth, a = 2.871e-04, b = 5.67e-03 */
+
+//-----------------------------------------------------------------------
+/// Rayleigh cross section in m^2. This was originally the Fortran
+/// function raylei in ray_tau.F90. We have this in C++ so the
+/// compiler can inline and vectorize this when we calculate a full
+/// band at once.
+///
+/// depolar_fact is the depolarization factor for air, 0.02790 (young,
+/// 1980).
+/// a and b are wavelength dependence coefficients for the refractive
+/// index (allen, 1964) (note: wavelengths must be in microns). For
+/// Earth, a = 2.871e-04, b = 5.67e-03
+//-----------------------------------------------------------------------
+
+static inline double rayleigh_cross_section(double wn, double depolar_fact, 
+					    double a, double b)
+{
+  // Constant multiplier, this is equal to 24*pi**3/(1.e-24*L**2),
+  // where L = loschmidt's number (mks units) , (L = 2.687e25
+  // molecules/m3) and the factor 1.e-24 is needed to convert wl**4
+  // from microns to meters.
+  const double cnst = 1.031e-24;
+  double wl = 1e4 / wn;		// Wavelength in microns
+  double wl2i = 1.0 / (wl * wl);
+  double r = 1.0 + a * (1.0 + b * wl2i);
+  double aniso = (6.0 + 3.0 * depolar_fact) / (6.0 - 7.0 * depolar_fact);
+  double r2 = r * r + 2.0;
+  double t = (r * r - 1.0) / r2;
+  double prod = aniso * (t * t);
+  return cnst * wl2i * wl2i * prod;
 }
 
 //-----------------------------------------------------------------------
@@ -20,7 +40,7 @@ extern "C" {
 Rayleigh::Rayleigh(const boost::shared_ptr<Pressure>& Pres, 
 		   const std::vector<boost::shared_ptr<Altitude> >& Alt,
 		   const Constant& C) 
-  : pres(Pres), alt(Alt), cache_is_stale(true),
+  : pres(Pres), alt(Alt), pres_version(-1),
     a(C.rayleigh_a().value), b(C.rayleigh_b().value), 
     depolar_fact(C.rayleigh_depolarization_factor()),
     molar_weight_dry_air(C.molar_weight_dry_air().convert(Unit("g / mol")).value)
@@ -39,13 +59,81 @@ Rayleigh::Rayleigh(const boost::shared_ptr<Pressure>& Pres,
 DoubleWithUnit Rayleigh::cross_section(const DoubleWithUnit& W,
 				       const Constant& C)
 {
-  double rayleigh_cross_section;
   double wn = W.convert_wave(units::inv_cm).value;
-  double a = C.rayleigh_a().value;
-  double b = C.rayleigh_b().value;
-  double depolar_fact = C.rayleigh_depolarization_factor();
-  rayleigh_wrap(&wn, &depolar_fact, &a, &b, &rayleigh_cross_section);
-  return DoubleWithUnit(rayleigh_cross_section, Unit("m^2"));
+  return DoubleWithUnit(rayleigh_cross_section(wn, 
+			       C.rayleigh_depolarization_factor(),
+			       C.rayleigh_a().value, C.rayleigh_b().value),
+			Unit("m^2"));
+}
+
+//-----------------------------------------------------------------------
+/// Rayleigh cross section in m^2 for the given wavenumber (in
+/// cm^-1), using the constants passed to the constructor.
+//-----------------------------------------------------------------------
+
+double Rayleigh::cross_section_wn(double Wn) const
+{
+  return rayleigh_cross_section(Wn, depolar_fact, a, b);
+}
+
+//-----------------------------------------------------------------------
+/// Rayleigh cross section in m^2 for each of the given wavenumbers
+/// (in cm^-1).
+//-----------------------------------------------------------------------
+
+Array<double, 1> Rayleigh::cross_section_wn(const Array<double, 1>& Wn) const
+{
+  Array<double, 1> res(Wn.shape());
+  for(int i = 0; i < Wn.rows(); ++i)
+    res(i) = rayleigh_cross_section(Wn(i), depolar_fact, a, b);
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// The optical depth of each layer divided by the Rayleigh cross
+/// section. This is independent of wavenumber, so the optical depth
+/// for any wavenumber is cross_section_wn(wn) times this value, and
+/// the Jacobian is cross_section_wn(wn) times this Jacobian.
+///
+/// This has size of pres->number_active_layer(). Note that this
+/// points to the data in our cache, so you should copy this if you
+/// need to hold onto it past the next update of the Pressure or
+/// Altitude.
+//-----------------------------------------------------------------------
+
+ArrayAd<double, 1> Rayleigh::optical_depth_per_cross_section(int spec_index) 
+const
+{
+  range_check(spec_index, 0, (int) alt.size());
+  fill_cache();
+  ArrayAd<double, 1> res(part_independent_wn(spec_index, Range::all()));
+  res.column_group(column_group[spec_index]);
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// This gives the optical depth for each layer, for all the given
+/// wavenumbers at once. The results are number wavenumber x number
+/// layer. 
+///
+/// This only returns the value, the Jacobian for each wavenumber is
+/// cross_section_wn(Wn(i)) * 
+/// optical_depth_per_cross_section(spec_index).jacobian(). Since this
+/// is the same Jacobian scaled by a different number for each
+/// wavenumber, it is much more efficient to combine this where it is
+/// used rather than generating the full (wn, layer, nvar) array.
+//-----------------------------------------------------------------------
+
+Array<double, 2> 
+Rayleigh::optical_depth_each_layer(const Array<double, 1>& Wn, int spec_index)
+const
+{
+  firstIndex i1; secondIndex i2;
+  Array<double, 1> f(optical_depth_per_cross_section(spec_index).value());
+  Array<double, 1> cs(cross_section_wn(Wn));
+  Array<double, 2> res(Wn.rows(), f.rows());
+  res = cs(i1) * f(i2);
+  return res;
 }
 
 //-----------------------------------------------------------------------
@@ -63,23 +151,41 @@ DoubleWithUnit Rayleigh::cross_section(const DoubleWithUnit& W,
 ArrayAd<double, 1> 
 Rayleigh::optical_depth_each_layer(double wn, int spec_index) const
 {
-  range_check(spec_index, 0, (int) alt.size());
-  fill_cache();
-  double rayleigh_cross_section;
-
-  rayleigh_wrap(&wn, &depolar_fact, &a, &b, &rayleigh_cross_section);
-  ArrayAd<double, 1> res(part_independent_wn(spec_index, Range::all()).copy());
-  res.value() *= rayleigh_cross_section;
-  res.jacobian() *= rayleigh_cross_section;
+  ArrayAd<double, 1> f = optical_depth_per_cross_section(spec_index);
+  double cs = cross_section_wn(wn);
+  ArrayAd<double, 1> res(f.rows(), f.number_variable());
+  res.value() = f.value() * cs;
+  if(!f.is_constant())
+    res.jacobian() = f.jacobian() * cs;
+  res.column_group(f.column_group());
   return res;
 }
 
 //-----------------------------------------------------------------------
-/// Fill in cache, if needed.
+/// Return true if the Pressure or Altitude has changed since we last
+/// filled in the cache.
+//-----------------------------------------------------------------------
+
+bool Rayleigh::cache_is_stale() const
+{
+  if(pres->update_version() != pres_version ||
+     alt_version.size() != alt.size())
+    return true;
+  for(int i = 0; i < (int) alt.size(); ++i)
+    if(alt[i]->update_version() != alt_version[i])
+      return true;
+  return false;
+}
+
+//-----------------------------------------------------------------------
+/// Fill in cache, if needed. Rather than using a flag set by
+/// notify_update, we compare the update_version() of the Pressure and
+/// Altitude to what we used when we last filled in the cache.
 //-----------------------------------------------------------------------
+
 void Rayleigh::fill_cache() const
 {
-  if(!cache_is_stale)
+  if(!cache_is_stale())
     return;
 
   // A comment in the old fortran code indicates this is Avogadro's
@@ -103,6 +209,19 @@ void Rayleigh::fill_cache() const
       part_independent_wn(j, i) = a0 * deltap.convert(units::Pa).value /
 	(molar_weight_dry_air * alt[j]->gravity(play).convert(Unit("m/s^2")).value);
     }
-  cache_is_stale = false;
+  // This is only calculated when the pressure or altitude changes,
+  // so it is worth finding which columns of the Jacobian are
+  // nonzero. Code applying the chain rule can then skip the others.
+  column_group.resize(alt.size());
+  for(int i = 0; i < (int) alt.size(); ++i)
+    if(part_independent_wn.is_constant())
+      column_group[i].reset();
+    else
+      column_group[i] = JacobianColumnGroup::find
+	(part_independent_wn.jacobian()(i, Range::all(), Range::all()));
+  pres_version = pres->update_version();
+  alt_version.resize(alt.size());
+  for(int i = 0; i < (int) alt.size(); ++i)
+    alt_version[i] = alt[i]->update_version();
 }
 
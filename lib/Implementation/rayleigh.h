@@ -9,6 +9,16 @@
 namespace FullPhysics {
 /****************************************************************//**
   This class calculates the Rayleigh portion of the optical depth
+
+  The optical depth is the product of the Rayleigh cross section,
+  which depends only on the wavenumber, and a factor for each layer
+  that depends only on the pressure and gravity (see
+  optical_depth_per_cross_section). This means that the Jacobian for
+  every wavenumber is just a scaled version of the same (layer, nvar)
+  array. When working on a full band at once you can use the
+  vectorized optical_depth_each_layer or cross_section_wn together
+  with optical_depth_per_cross_section to avoid creating a new
+  ArrayAd for each wavenumber.
 *******************************************************************/
 class Rayleigh: public Observer<Pressure>, public Observer<Altitude>,
 		  public Printable<Rayleigh> {
@@ -17,12 +27,19 @@ public:
 	   const std::vector<boost::shared_ptr<Altitude> >& Alt,
 	   const Constant& C);
   
-  virtual void notify_update(const Pressure& P)
-  { cache_is_stale = true;}
-  virtual void notify_update(const Altitude& A)
-  {cache_is_stale = true;}
+  // We check the update_version() of the Pressure and Altitude in
+  // fill_cache, so there is nothing we need to do here.
+  virtual void notify_update(const Pressure& P) {}
+  virtual void notify_update(const Altitude& A) {}
 
   ArrayAd<double, 1> optical_depth_each_layer(double wn, int spec_index) const;
+  blitz::Array<double, 2> 
+  optical_depth_each_layer(const blitz::Array<double, 1>& Wn, 
+			   int spec_index) const;
+  ArrayAd<double, 1> optical_depth_per_cross_section(int spec_index) const;
+  double cross_section_wn(double Wn) const;
+  blitz::Array<double, 1> 
+  cross_section_wn(const blitz::Array<double, 1>& Wn) const;
   static DoubleWithUnit cross_section(const DoubleWithUnit& W,
 				      const Constant& C = DefaultConstant());
   virtual void print(std::ostream& Os) const
@@ -30,8 +47,16 @@ public:
 private:
   boost::shared_ptr<Pressure> pres;
   std::vector<boost::shared_ptr<Altitude> > alt;
-  mutable bool cache_is_stale;
+  // Versions of pres and alt that part_independent_wn was calculated
+  // for.
+  mutable int pres_version;
+  mutable std::vector<int> alt_version;
   mutable ArrayAd<double, 2> part_independent_wn;
+  // Columns of the Jacobian of part_independent_wn that are nonzero,
+  // for each spectrometer.
+  mutable std::vector<boost::shared_ptr<const JacobianColumnGroup> > 
+  column_group;
+  bool cache_is_stale() const;
   void fill_cache() const;
   // Constants. We get this from the Constant class, but stash a copy
   // of them here.
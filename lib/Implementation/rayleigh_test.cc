@@ -59,9 +59,108 @@ BOOST_AUTO_TEST_CASE(basic)
 			       od_expect, 1e-6);
 }
 
+BOOST_AUTO_TEST_CASE(band)
+{
+  DefaultConstant constant;
+  std::vector<boost::shared_ptr<Altitude> > alt;
+  alt.push_back(boost::shared_ptr<Altitude>
+    (new AltitudeHydrostatic(config_pressure, config_temperature,
+			     DoubleWithUnit(77.1828918457, units::deg),
+			     DoubleWithUnit(416, units::m))));
+  Rayleigh r(config_pressure, alt, constant);
+  Array<double, 1> wn(3);
+  wn = 12929.94, 12930.30, 13100.0;
+  Array<double, 1> cs = r.cross_section_wn(wn);
+  Array<double, 2> od = r.optical_depth_each_layer(wn, 0);
+  ArrayAd<double, 1> f = r.optical_depth_per_cross_section(0);
+  BOOST_CHECK_EQUAL(od.rows(), wn.rows());
+  for(int i = 0; i < wn.rows(); ++i) {
+    BOOST_CHECK_CLOSE(cs(i), Rayleigh::cross_section(DoubleWithUnit(wn(i), units::inv_cm)).value, 1e-10);
+    ArrayAd<double, 1> od_expect = r.optical_depth_each_layer(wn(i), 0);
+    BOOST_CHECK_MATRIX_CLOSE_TOL(od(i, Range::all()), od_expect.value(), 
+				 1e-15);
+    Array<double, 2> jac(f.jacobian() * cs(i));
+    BOOST_CHECK_MATRIX_CLOSE_TOL(jac, od_expect.jacobian(), 1e-15);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(update_version)
+{
+  // Updating the StateVector with the same values shouldn't cause the
+  // Pressure to notify its observers, so the Rayleigh cache stays
+  // valid.
+  DefaultConstant constant;
+  std::vector<boost::shared_ptr<Altitude> > alt;
+  alt.push_back(boost::shared_ptr<Altitude>
+    (new AltitudeHydrostatic(config_pressure, config_temperature,
+			     DoubleWithUnit(77.1828918457, units::deg),
+			     DoubleWithUnit(416, units::m))));
+  Rayleigh r(config_pressure, alt, constant);
+  StateVector& sv = *config_state_vector;
+  Array<double, 1> sv0(sv.state().copy());
+  Array<double, 1> od0 = r.optical_depth_each_layer(12929.94, 0).value().copy();
+  int v0 = config_pressure->update_version();
+  sv.update_state(sv0);
+  BOOST_CHECK_EQUAL(config_pressure->update_version(), v0);
+  Array<double, 1> sv1(sv0.copy());
+  sv1 *= 1.01;
+  sv.update_state(sv1);
+  BOOST_CHECK(config_pressure->update_version() > v0);
+  sv.update_state(sv0);
+  BOOST_CHECK_MATRIX_CLOSE(r.optical_depth_each_layer(12929.94, 0).value(),
+			   od0);
+}
+
+BOOST_AUTO_TEST_CASE(temperature_update)
+{
+  // The gravity, and so the optical depth, depends on the
+  // temperature. Changing only the temperature needs to update the
+  // Rayleigh cache, even though the Pressure doesn't change.
+  DefaultConstant constant;
+  std::vector<boost::shared_ptr<Altitude> > alt;
+  alt.push_back(boost::shared_ptr<Altitude>
+    (new AltitudeHydrostatic(config_pressure, config_temperature,
+			     DoubleWithUnit(77.1828918457, units::deg),
+			     DoubleWithUnit(416, units::m))));
+  Rayleigh r(config_pressure, alt, constant);
+  StateVector& sv = *config_state_vector;
+  Array<double, 1> sv0(sv.state().copy());
+  Array<std::string, 1> svname(sv.state_vector_name());
+  int tind = -1;
+  for(int i = 0; i < svname.rows(); ++i)
+    if(svname(i).find("Temperature") == 0)
+      tind = i;
+  BOOST_REQUIRE(tind >= 0);
+  Array<double, 1> od0 = r.optical_depth_each_layer(12929.94, 0).value().copy();
+  int pv0 = config_pressure->update_version();
+  int av0 = alt[0]->update_version();
+  Array<double, 1> sv1(sv0.copy());
+  sv1(tind) += 5;
+  sv.update_state(sv1);
+  BOOST_CHECK_EQUAL(config_pressure->update_version(), pv0);
+  BOOST_CHECK(alt[0]->update_version() > av0);
+  std::vector<boost::shared_ptr<Altitude> > alt2;
+  alt2.push_back(boost::shared_ptr<Altitude>
+    (new AltitudeHydrostatic(config_pressure, config_temperature,
+			     DoubleWithUnit(77.1828918457, units::deg),
+			     DoubleWithUnit(416, units::m))));
+  Rayleigh r2(config_pressure, alt2, constant);
+  Array<double, 1> od1 = r.optical_depth_each_layer(12929.94, 0).value();
+  BOOST_CHECK(max(abs(od1 - od0)) > 0);
+  BOOST_CHECK_MATRIX_CLOSE_TOL(od1, 
+		       r2.optical_depth_each_layer(12929.94, 0).value(), 1e-14);
+  sv.update_state(sv0);
+}
+
 BOOST_AUTO_TEST_CASE(jacobian)
 {
-  Rayleigh& r = *(dynamic_cast<const AtmosphereOco&>(*config_atmosphere).rayleigh_ptr());
+  DefaultConstant constant;
+  std::vector<boost::shared_ptr<Altitude> > alt;
+  alt.push_back(boost::shared_ptr<Altitude>
+    (new AltitudeHydrostatic(config_pressure, config_temperature,
+			     DoubleWithUnit(77.1828918457, units::deg),
+			     DoubleWithUnit(416, units::m))));
+  Rayleigh r(config_pressure, alt, constant);
   StateVector& sv = *config_state_vector;
   Array<double, 1> sv0(sv.state().copy());
 
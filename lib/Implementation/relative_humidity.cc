@@ -58,6 +58,23 @@ void RelativeHumidity::print(std::ostream& Os)
   opad.strict_sync();
 }
 
+//-----------------------------------------------------------------------
+/// We aren't an Observable, but the relative humidity only changes
+/// when the H2O AbsorberVmr, Temperature or Pressure does. This
+/// returns the sum of their update_version(), so it increases
+/// whenever any of these change. A cache that depends on the relative
+/// humidity can record this when it is filled, and compare it later
+/// to determine if it is stale.
+//-----------------------------------------------------------------------
+
+int RelativeHumidity::update_version() const
+{
+  int res = temp->update_version() + press->update_version();
+  if(absorber->gas_index("H2O") >= 0)
+    res += absorber->absorber_vmr("H2O")->update_version();
+  return res;
+}
+
 //-----------------------------------------------------------------------
 /// Calculate specific humidity.
 //-----------------------------------------------------------------------
@@ -26,6 +26,7 @@ public:
   ArrayAd<double, 1> relative_humidity_grid() const;
   ArrayAd<double, 1> relative_humidity_layer() const;
   ArrayAd<double, 1> specific_humidity_grid() const;
+  int update_version() const;
 private:
   boost::shared_ptr<Absorber> absorber;
   boost::shared_ptr<Temperature> temp;
@@ -14,4 +14,28 @@ BOOST_AUTO_TEST_CASE(basic)
   BOOST_CHECK_CLOSE(h.relative_humidity_grid()(18).value(), 37.521953, 1e-2);
 }
 
+BOOST_AUTO_TEST_CASE(update_version)
+{
+  // The version should only change when the temperature, pressure or
+  // H2O does.
+  RelativeHumidity h(atm->absorber_ptr(), atm->temperature_ptr(),
+		     atm->pressure_ptr());
+  StateVector& sv = *statev;
+  Array<double, 1> sv0(sv.state().copy());
+  Array<std::string, 1> svname(sv.state_vector_name());
+  int tind = -1;
+  for(int i = 0; i < svname.rows(); ++i)
+    if(svname(i).find("Temperature") == 0)
+      tind = i;
+  BOOST_REQUIRE(tind >= 0);
+  int v0 = h.update_version();
+  sv.update_state(sv0);
+  BOOST_CHECK_EQUAL(h.update_version(), v0);
+  Array<double, 1> sv1(sv0.copy());
+  sv1(tind) += 5;
+  sv.update_state(sv1);
+  BOOST_CHECK(h.update_version() > v0);
+  sv.update_state(sv0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
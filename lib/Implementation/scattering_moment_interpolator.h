@@ -3,6 +3,8 @@
 #include <blitz/array.h>
 #include <boost/shared_ptr.hpp>
 #include "auto_derivative.h"
+#include <algorithm>
+#include <vector>
 
 namespace FullPhysics {
 /****************************************************************//**
@@ -69,39 +71,170 @@ private:
   blitz::Array<double, 2> delta_pf0;
 };
 
+/****************************************************************//**
+  This interpolates the phase function scattering matrix moments
+  given at a set of wavenumbers (e.g., the wavenumbers in an aerosol
+  property file). We extrapolate past the ends of the range.
+
+  All the moments are stored in a single contiguous number_segment x
+  number_moment x number_scattering array, along with the slope in
+  each segment, so the interpolation is just a multiply-add over a
+  contiguous block. You can either get a new array for each
+  wavenumber (operator()), fill in a buffer you supply so nothing
+  gets allocated (interpolate), or fill in a number_wavenumber x
+  number_moment x number_scattering array for a whole band at once.
+*******************************************************************/
+
 class ScatteringMomentInterpolate {
 public:
   template<class I1, class I2> ScatteringMomentInterpolate(I1 xstart, I1 xend,
 							   I2 ystart)
   {
-    while(xstart != xend) {
-      double x0 = *xstart++;
-      const blitz::Array<double, 2>& y0 = *ystart++;
-      if(xstart == xend)
-	return;
-      double x1 = *xstart;
-      const blitz::Array<double, 2>& y1 = *ystart;
-      if(x1 <= x0)
-	throw Exception("X needs to be sorted");
-      inter[x1] = boost::shared_ptr<ScatteringMomentInterpolate2Point>
-	(new ScatteringMomentInterpolate2Point(x0, y0, x1, y1));
+    std::vector<double> x;
+    std::vector<blitz::Array<double, 2> > y;
+    for(; xstart != xend; ++xstart, ++ystart) {
+      x.push_back(*xstart);
+      y.push_back(*ystart);
     }
+    init(x, y);
   }
+
+//-----------------------------------------------------------------------
+/// Interpolate the data to give the phase function scattering
+/// moments for the given wave number. You can optionally specify the
+/// number of moments and scattering matrix elements to return, the
+/// default is to return all of them. This returns a matrix that is 
+/// number_moment + 1 x number scattering elements in
+/// size. 
+//-----------------------------------------------------------------------
+
   blitz::Array<double, 2> 
   operator()(double x, int nummom = -1, int nscatt = -1) const
   { 
-    typedef
-      std::map<double, boost::shared_ptr<ScatteringMomentInterpolate2Point> >::const_iterator Itype;
-    Itype i = inter.lower_bound(x);
-    if(i == inter.end())	// If we are past the upper end, 
-				// then extrapolate
-      return (*inter.rbegin()->second)(x, nummom, nscatt);
-    else
-      return (*i->second)(x, nummom, nscatt);
+    blitz::Array<double, 2> res;
+    interpolate(x, res, nummom, nscatt);
+    return res;
+  }
+
+//-----------------------------------------------------------------------
+/// Same as operator(), but we fill in the supplied array. This is
+/// resized if needed, so if you reuse the same array for each call
+/// no memory is allocated.
+//-----------------------------------------------------------------------
+
+  void interpolate(double x, blitz::Array<double, 2>& Res, int nummom = -1,
+		   int nscatt = -1) const
+  {
+    int nm, s1, s2;
+    size(nummom, nscatt, nm, s1, s2);
+    Res.resize(s1, s2);
+    fill(segment(x), x, Res, nm, s1, s2);
   }
+
+//-----------------------------------------------------------------------
+/// Interpolate for all the given wavenumbers at once. Res is
+/// number_wavenumber x number_moment + 1 x number scattering
+/// elements, and is resized if needed. This is most efficient if the
+/// wavenumbers are sorted, but this isn't required.
+//-----------------------------------------------------------------------
+
+  void interpolate(const blitz::Array<double, 1>& X, 
+		   blitz::Array<double, 3>& Res, int nummom = -1,
+		   int nscatt = -1) const
+  {
+    using namespace blitz;
+    int nm, s1, s2;
+    size(nummom, nscatt, nm, s1, s2);
+    Res.resize(X.rows(), s1, s2);
+    int seg = -1;
+    for(int i = 0; i < X.rows(); ++i) {
+      // Nearby wavenumbers are almost always in the same segment, so
+      // check that before searching.
+      if(seg < 0 || X(i) > wn1[seg] || 
+	 (seg > 0 && X(i) <= wn1[seg - 1]))
+	seg = segment(X(i));
+      Array<double, 2> r(Res(i, Range::all(), Range::all()));
+      fill(seg, X(i), r, nm, s1, s2);
+    }
+  }
+
+//-----------------------------------------------------------------------
+/// Number of moments in the data we are interpolating.
+//-----------------------------------------------------------------------
+
+  int number_moment() const { return pf0.cols(); }
+
+//-----------------------------------------------------------------------
+/// Number of scattering elements in the data we are interpolating.
+//-----------------------------------------------------------------------
+
+  int number_scattering() const { return pf0.depth(); }
 private:
-  std::map<double, boost::shared_ptr<ScatteringMomentInterpolate2Point> > inter;
-};  
+  // Segment i goes from wn0(i) to wn1[i]. wn1 is a std::vector so we
+  // can use std::lower_bound to search it.
+  blitz::Array<double, 1> wn0;
+  std::vector<double> wn1;
+  // Value at the start of each segment, and the slope. These are
+  // number_segment x number_moment x number_scattering.
+  blitz::Array<double, 3> pf0, delta_pf0;
+
+  void init(const std::vector<double>& X, 
+	    const std::vector<blitz::Array<double, 2> >& Y)
+  {
+    using namespace blitz;
+    Range ra = Range::all();
+    if(X.size() < 2)
+      throw Exception("Need at least 2 points to interpolate");
+    int nseg = (int) X.size() - 1;
+    wn0.resize(nseg);
+    pf0.resize(nseg, Y[0].rows(), Y[0].cols());
+    delta_pf0.resize(pf0.shape());
+    for(int i = 0; i < nseg; ++i) {
+      if(X[i + 1] <= X[i])
+	throw Exception("X needs to be sorted");
+      if(Y[i].rows() != pf0.cols() || Y[i].cols() != pf0.depth() ||
+	 Y[i + 1].rows() != pf0.cols() || Y[i + 1].cols() != pf0.depth())
+	throw Exception("Phase function moments need to all be the same size");
+      wn0(i) = X[i];
+      wn1.push_back(X[i + 1]);
+      pf0(i, ra, ra) = Y[i];
+      delta_pf0(i, ra, ra) = (Y[i + 1] - Y[i]) / (X[i + 1] - X[i]);
+    }
+  }
+
+  // Segment to use for the given wavenumber. If we are past the
+  // upper end, then extrapolate using the last segment. Likewise,
+  // below the lower end we use the first segment.
+  int segment(double x) const
+  {
+    int i = (int) (std::lower_bound(wn1.begin(), wn1.end(), x) - 
+		   wn1.begin());
+    return std::min(i, (int) wn1.size() - 1);
+  }
+
+  // Determine the size of the results. nm is the number of moments
+  // we have data for, s1 the number of moments to return (we pad with
+  // zeros if this is larger than nm), and s2 the number of
+  // scattering elements.
+  void size(int nummom, int nscatt, int& nm, int& s1, int& s2) const
+  {
+    s1 = (nummom == -1 ? pf0.cols() : nummom + 1);
+    nm = std::min(s1, pf0.cols());
+    s2 = (nscatt == -1 || nscatt > pf0.depth() ? pf0.depth() : nscatt);
+  }
+
+  void fill(int seg, double x, blitz::Array<double, 2>& Res, int nm, int s1,
+	    int s2) const
+  {
+    double d = x - wn0(seg);
+    for(int i = 0; i < nm; ++i)
+      for(int j = 0; j < s2; ++j)
+	Res(i, j) = pf0(seg, i, j) + delta_pf0(seg, i, j) * d;
+    for(int i = nm; i < s1; ++i)
+      for(int j = 0; j < s2; ++j)
+	Res(i, j) = 0;
+  }
+};
 
 }
 #endif
@@ -0,0 +1,73 @@
+#include "scattering_moment_interpolator.h"
+#include "unit_test_support.h"
+
+using namespace FullPhysics;
+using namespace blitz;
+
+BOOST_FIXTURE_TEST_SUITE(scattering_moment_interpolator, GlobalFixture)
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  std::vector<double> wn;
+  std::vector<Array<double, 2> > pf;
+  wn.push_back(10000);
+  wn.push_back(11000);
+  wn.push_back(13000);
+  for(int i = 0; i < 3; ++i) {
+    Array<double, 2> t(4, 2);
+    t = (i + 1) * 1.0, (i + 1) * 2.0,
+      (i + 1) * 3.0, (i + 1) * 4.0,
+      (i + 1) * 5.0, (i + 1) * 6.0,
+      (i + 1) * 7.0, (i + 1) * 8.0;
+    pf.push_back(t);
+  }
+  ScatteringMomentInterpolate p(wn.begin(), wn.end(), pf.begin());
+  BOOST_CHECK_EQUAL(p.number_moment(), 4);
+  BOOST_CHECK_EQUAL(p.number_scattering(), 2);
+  Array<double, 2> expect(4, 2);
+  expect = pf[0] * 0.5 + pf[1] * 0.5;
+  BOOST_CHECK_MATRIX_CLOSE(p(10500), expect);
+  expect = pf[1] * 0.25 + pf[2] * 0.75;
+  BOOST_CHECK_MATRIX_CLOSE(p(12500), expect);
+  // Extrapolate at both ends
+  expect = pf[0] * 1.5 - pf[1] * 0.5;
+  BOOST_CHECK_MATRIX_CLOSE(p(9500), expect);
+  expect = pf[2] * 1.5 - pf[1] * 0.5;
+  BOOST_CHECK_MATRIX_CLOSE(p(14000), expect);
+
+  // Subset of moments and scattering elements, and padding with 0.
+  Array<double, 2> res = p(10500, 1, 1);
+  BOOST_CHECK_EQUAL(res.rows(), 2);
+  BOOST_CHECK_EQUAL(res.cols(), 1);
+  BOOST_CHECK_CLOSE(res(1, 0), 4.5, 1e-8);
+  res.reference(p(10500, 5));
+  BOOST_CHECK_EQUAL(res.rows(), 6);
+  BOOST_CHECK_CLOSE(res(3, 1), 12.0, 1e-8);
+  BOOST_CHECK_CLOSE(res(4, 1), 0.0, 1e-8);
+  BOOST_CHECK_CLOSE(res(5, 0), 0.0, 1e-8);
+}
+
+BOOST_AUTO_TEST_CASE(band)
+{
+  std::vector<double> wn;
+  std::vector<Array<double, 2> > pf;
+  for(int i = 0; i < 4; ++i) {
+    wn.push_back(10000 + 1000 * i);
+    Array<double, 2> t(3, 6);
+    t = 1.0 / (i + 1);
+    pf.push_back(t);
+  }
+  ScatteringMomentInterpolate p(wn.begin(), wn.end(), pf.begin());
+  Array<double, 1> wnband(7);
+  wnband = 9000, 10000, 10400, 11900, 12100, 12000, 14000;
+  Array<double, 3> res;
+  p.interpolate(wnband, res);
+  BOOST_CHECK_EQUAL(res.rows(), wnband.rows());
+  for(int i = 0; i < wnband.rows(); ++i)
+    BOOST_CHECK_MATRIX_CLOSE(res(i, Range::all(), Range::all()), p(wnband(i)));
+  Array<double, 2> buf;
+  p.interpolate(wnband(2), buf, 1, 2);
+  BOOST_CHECK_MATRIX_CLOSE(buf, p(wnband(2), 1, 2));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,261 @@
+#include "static_input_registry.h"
+#include <boost/foreach.hpp>
+#include <iomanip>
+#include <sstream>
+using namespace FullPhysics;
+
+#ifdef HAVE_LUA
+#include "register_lua.h"
+// Luabind can't handle overloaded static functions, or return types
+// other than the holder type, so wrap these.
+boost::shared_ptr<HdfFile> sir_hdf_file(const std::string& Fname)
+{ return StaticInputRegistry::hdf_file(Fname); }
+boost::shared_ptr<GasAbsorption> sir_absco_hdf(const std::string& Fname)
+{ return StaticInputRegistry::absco_hdf(Fname); }
+boost::shared_ptr<GasAbsorption> sir_absco_hdf2(const std::string& Fname,
+						double Table_scale)
+{ return StaticInputRegistry::absco_hdf(Fname, Table_scale); }
+boost::shared_ptr<GasAbsorption> sir_absco_hdf3
+(const std::string& Fname, const SpectralBound& Spectral_bound,
+ const std::vector<double>& Table_scale)
+{ return StaticInputRegistry::absco_hdf(Fname, Spectral_bound, Table_scale); }
+boost::shared_ptr<SolarAbsorptionSpectrum> sir_solar_absorption_table
+(const HdfFile& Hdf_static_input, const std::string& Hdf_group)
+{ return StaticInputRegistry::solar_absorption_table(Hdf_static_input,
+						     Hdf_group); }
+boost::shared_ptr<IlsFunction> sir_ils_table_linear
+(const HdfFile& Hdf_static_input, int Spec_index,
+ const std::string& Band_name, const std::string& Hdf_band_name)
+{ return StaticInputRegistry::ils_table_linear(Hdf_static_input, Spec_index,
+					       Band_name, Hdf_band_name); }
+boost::shared_ptr<IlsFunction> sir_ils_table_linear2
+(const HdfFile& Hdf_static_input, int Spec_index,
+ const std::string& Band_name, const std::string& Hdf_band_name,
+ const std::string& Hdf_group)
+{ return StaticInputRegistry::ils_table_linear(Hdf_static_input, Spec_index,
+					       Band_name, Hdf_band_name,
+					       Hdf_group); }
+
+REGISTER_LUA_CLASS(StaticInputRegistry)
+.scope
+[
+ luabind::def("hdf_file", &sir_hdf_file),
+ luabind::def("absco_hdf", &sir_absco_hdf),
+ luabind::def("absco_hdf", &sir_absco_hdf2),
+ luabind::def("absco_hdf", &sir_absco_hdf3),
+ luabind::def("solar_absorption_table", &sir_solar_absorption_table),
+ luabind::def("ils_table_linear", &sir_ils_table_linear),
+ luabind::def("ils_table_linear", &sir_ils_table_linear2),
+ luabind::def("aerosol_property_hdf",
+	      &StaticInputRegistry::aerosol_property_hdf),
+ luabind::def("number_entry", &StaticInputRegistry::number_entry),
+ luabind::def("purge_unused", &StaticInputRegistry::purge_unused),
+ luabind::def("clear", &StaticInputRegistry::clear)
+]
+REGISTER_LUA_END()
+#endif
+
+//-----------------------------------------------------------------------
+/// The registry. We use a function static rather than a class static
+/// so we don't need to worry about the order of static
+/// initialization (the Lua registration runs during static
+/// initialization).
+//-----------------------------------------------------------------------
+
+StaticInputRegistry::map_type& StaticInputRegistry::registry()
+{
+  static map_type reg;
+  return reg;
+}
+
+//-----------------------------------------------------------------------
+/// Return the registered object for the given key, or a null pointer
+/// if we don't have one yet.
+//-----------------------------------------------------------------------
+
+template<class T> boost::shared_ptr<T>
+StaticInputRegistry::find(const std::string& Key)
+{
+  map_type::const_iterator i = registry().find(Key);
+  if(i == registry().end())
+    return boost::shared_ptr<T>();
+  return boost::static_pointer_cast<T>(i->second);
+}
+
+//-----------------------------------------------------------------------
+/// Return a shared HdfFile opened read only.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<HdfFile>
+StaticInputRegistry::hdf_file(const std::string& Fname)
+{
+  std::string key = "HdfFile:" + Fname;
+  boost::shared_ptr<HdfFile> res = find<HdfFile>(key);
+  if(!res) {
+    res.reset(new HdfFile(Fname));
+    registry()[key] = res;
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Return a shared AbscoHdf. Note that AbscoHdf has a cache of the
+/// lines it has read, so sharing the object also shares that cache.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<AbscoHdf>
+StaticInputRegistry::absco_hdf(const std::string& Fname, double Table_scale,
+			       int Cache_nline)
+{
+  std::ostringstream key;
+  key << std::setprecision(17)
+      << "AbscoHdf:" << Fname << ":" << Table_scale << ":" << Cache_nline;
+  boost::shared_ptr<AbscoHdf> res = find<AbscoHdf>(key.str());
+  if(!res) {
+    res.reset(new AbscoHdf(Fname, Table_scale, Cache_nline));
+    registry()[key.str()] = res;
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Return a shared AbscoHdf, using a different table scale for each
+/// spectral band.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<AbscoHdf>
+StaticInputRegistry::absco_hdf(const std::string& Fname,
+			       const SpectralBound& Spectral_bound,
+			       const std::vector<double>& Table_scale,
+			       int Cache_nline)
+{
+  std::ostringstream key;
+  key << std::setprecision(17) << "AbscoHdf:" << Fname << ":" << Cache_nline;
+  for(int i = 0; i < Spectral_bound.number_spectrometer(); ++i)
+    key << ":" << Spectral_bound.lower_bound(i, units::inv_cm).value
+	<< "-" << Spectral_bound.upper_bound(i, units::inv_cm).value;
+  BOOST_FOREACH(double s, Table_scale)
+    key << ":" << s;
+  boost::shared_ptr<AbscoHdf> res = find<AbscoHdf>(key.str());
+  if(!res) {
+    res.reset(new AbscoHdf(Fname, Spectral_bound, Table_scale, Cache_nline));
+    registry()[key.str()] = res;
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Return a shared SolarAbsorptionTable.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<SolarAbsorptionTable>
+StaticInputRegistry::solar_absorption_table(const HdfFile& Hdf_static_input,
+					    const std::string& Hdf_group)
+{
+  std::string key = "SolarAbsorptionTable:" + Hdf_static_input.file_name() +
+    ":" + Hdf_group;
+  boost::shared_ptr<SolarAbsorptionTable> res =
+    find<SolarAbsorptionTable>(key);
+  if(!res) {
+    res.reset(new SolarAbsorptionTable(Hdf_static_input, Hdf_group));
+    registry()[key] = res;
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Return a IlsTableLinear. The table gets attached to the
+/// StateVector, so we can't share it directly. Instead we read the
+/// table once, and return a new clone of it each time.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<IlsFunction>
+StaticInputRegistry::ils_table_linear(const HdfFile& Hdf_static_input,
+				      int Spec_index,
+				      const std::string& Band_name,
+				      const std::string& Hdf_band_name,
+				      const std::string& Hdf_group)
+{
+  std::ostringstream key;
+  key << "IlsTableLinear:" << Hdf_static_input.file_name() << ":"
+      << Hdf_group << ":" << Spec_index << ":" << Band_name << ":"
+      << Hdf_band_name;
+  boost::shared_ptr<IlsTableLinear> res = find<IlsTableLinear>(key.str());
+  if(!res) {
+    res.reset(new IlsTableLinear(Hdf_static_input, Spec_index, Band_name,
+				 Hdf_band_name, Hdf_group));
+    registry()[key.str()] = res;
+  }
+  return res->clone();
+}
+
+//-----------------------------------------------------------------------
+/// Return a AerosolPropertyHdf for the given Pressure. We read the
+/// HDF group once into a AerosolPropertyHdfTable, which doesn't
+/// depend on the Pressure. Each request then gets a new
+/// AerosolPropertyHdf for its Pressure that shares that table, so we
+/// don't hold onto the Pressure (and everything connected to it) of
+/// the first sounding.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<AerosolProperty>
+StaticInputRegistry::aerosol_property_hdf
+(const HdfFile& F, const std::string& Group_name,
+ const boost::shared_ptr<Pressure>& Press)
+{
+  std::string key = "AerosolPropertyHdfTable:" + F.file_name() + ":" +
+    Group_name;
+  boost::shared_ptr<AerosolPropertyHdfTable> t =
+    find<AerosolPropertyHdfTable>(key);
+  if(!t) {
+    t.reset(new AerosolPropertyHdfTable(F, Group_name));
+    registry()[key] = t;
+  }
+  return boost::shared_ptr<AerosolProperty>(new AerosolPropertyHdf(t, Press));
+}
+
+//-----------------------------------------------------------------------
+/// Number of objects currently in the registry.
+//-----------------------------------------------------------------------
+
+int StaticInputRegistry::number_entry()
+{
+  return (int) registry().size();
+}
+
+//-----------------------------------------------------------------------
+/// Remove all the objects that aren't being used by anything other
+/// than the registry. Returns the number of entries removed.
+//-----------------------------------------------------------------------
+
+int StaticInputRegistry::purge_unused()
+{
+  int res = 0;
+  map_type::iterator i = registry().begin();
+  while(i != registry().end()) {
+    if(i->second.unique()) {
+      registry().erase(i++);
+      ++res;
+    } else
+      ++i;
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Remove all objects from the registry. Objects that are still being
+/// used elsewhere stay valid, they just won't be shared with later
+/// requests.
+//-----------------------------------------------------------------------
+
+void StaticInputRegistry::clear()
+{
+  registry().clear();
+}
+
+void StaticInputRegistry::print(std::ostream& Os) const
+{
+  Os << "StaticInputRegistry:\n";
+  BOOST_FOREACH(const map_type::value_type& v, registry())
+    Os << "  " << v.first << "\n";
+}
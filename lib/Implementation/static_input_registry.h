@@ -0,0 +1,81 @@
+#ifndef STATIC_INPUT_REGISTRY_H
+#define STATIC_INPUT_REGISTRY_H
+#include "printable.h"
+#include "hdf_file.h"
+#include "absco_hdf.h"
+#include "aerosol_property_hdf.h"
+#include "ils_table.h"
+#include "solar_absorption_table.h"
+#include <boost/shared_ptr.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace FullPhysics {
+/****************************************************************//**
+  The Lua configuration creates objects like AbscoHdf,
+  AerosolPropertyHdf, IlsTableLinear and SolarAbsorptionTable
+  directly from file names. Without something to coordinate this,
+  the same table gets opened and read again for every band or gas
+  that refers to it, and again for every configuration created in
+  the same process (e.g., the soundings in a "l2_fp -b" batch run,
+  or a python script that creates several configurations).
+
+  This class is a process wide registry of these objects, keyed by
+  the type, file name, HDF group and whatever other parameters are
+  used to create the object. The first request creates the object,
+  later requests get the same instance back. The objects are
+  treated as immutable once they have been read in.
+
+  Objects that depend on the sounding can't be shared directly, but
+  the tables they read can be:
+
+  \li IlsTableLinear gets attached to the StateVector, so each
+      request returns a new clone of the registered table.
+  \li AerosolPropertyHdf depends on the Pressure, so we register
+      the AerosolPropertyHdfTable read from the file, and each
+      request returns a new AerosolPropertyHdf for the given Pressure
+      that shares that table.
+
+  The registry holds a reference to each object, so by default they
+  stay in memory until the process ends. If you want to free up
+  memory, purge_unused removes the entries that nothing else holds a
+  reference to anymore.
+
+  This is not thread safe. The objects are created by the
+  configuration, which is done in a single thread.
+*******************************************************************/
+class StaticInputRegistry : public Printable<StaticInputRegistry> {
+public:
+  virtual ~StaticInputRegistry() {}
+  static boost::shared_ptr<HdfFile> hdf_file(const std::string& Fname);
+  static boost::shared_ptr<AbscoHdf>
+  absco_hdf(const std::string& Fname, double Table_scale = 1.0,
+	    int Cache_nline = 5000);
+  static boost::shared_ptr<AbscoHdf>
+  absco_hdf(const std::string& Fname, const SpectralBound& Spectral_bound,
+	    const std::vector<double>& Table_scale, int Cache_nline = 5000);
+  static boost::shared_ptr<SolarAbsorptionTable>
+  solar_absorption_table(const HdfFile& Hdf_static_input,
+			 const std::string& Hdf_group);
+  static boost::shared_ptr<IlsFunction>
+  ils_table_linear(const HdfFile& Hdf_static_input, int Spec_index,
+		   const std::string& Band_name,
+		   const std::string& Hdf_band_name,
+		   const std::string& Hdf_group = "Instrument/ILS");
+  static boost::shared_ptr<AerosolProperty>
+  aerosol_property_hdf(const HdfFile& F, const std::string& Group_name,
+		       const boost::shared_ptr<Pressure>& Press);
+  static int number_entry();
+  static int purge_unused();
+  static void clear();
+  virtual void print(std::ostream& Os) const;
+private:
+  typedef std::map<std::string, boost::shared_ptr<void> > map_type;
+  static map_type& registry();
+  template<class T> static boost::shared_ptr<T>
+  find(const std::string& Key);
+  StaticInputRegistry() {}
+};
+}
+#endif
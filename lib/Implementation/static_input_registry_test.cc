@@ -0,0 +1,87 @@
+#include "static_input_registry.h"
+#include "pressure_sigma.h"
+#include "unit_test_support.h"
+#include <boost/weak_ptr.hpp>
+
+using namespace FullPhysics;
+using namespace blitz;
+
+BOOST_FIXTURE_TEST_SUITE(static_input_registry, GlobalFixture)
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  StaticInputRegistry::clear();
+  std::string fname = test_data_dir() + "l2_fixed_level_static_input.h5";
+  boost::shared_ptr<HdfFile> h = StaticInputRegistry::hdf_file(fname);
+  BOOST_CHECK(StaticInputRegistry::hdf_file(fname) == h);
+  boost::shared_ptr<SolarAbsorptionTable> s1 =
+    StaticInputRegistry::solar_absorption_table(*h, 
+					"/Solar/Absorption/Absorption_1");
+  BOOST_CHECK(StaticInputRegistry::solar_absorption_table(*h, 
+		      "/Solar/Absorption/Absorption_1") == s1);
+  BOOST_CHECK(StaticInputRegistry::solar_absorption_table(*h, 
+		      "/Solar/Absorption/Absorption_2") != s1);
+  boost::shared_ptr<AbscoHdf> a1 = 
+    StaticInputRegistry::absco_hdf(absco_data_dir() + "/o2_v3.3.0-lowres.hdf");
+  BOOST_CHECK(StaticInputRegistry::absco_hdf(absco_data_dir() + 
+				    "/o2_v3.3.0-lowres.hdf") == a1);
+  BOOST_CHECK(StaticInputRegistry::absco_hdf(absco_data_dir() + 
+				    "/o2_v3.3.0-lowres.hdf", 1.1) != a1);
+  BOOST_CHECK_EQUAL(StaticInputRegistry::number_entry(), 5);
+  s1.reset();
+  a1.reset();
+  // The Absorption_2 and table scaled absco are only held by the
+  // registry, as are Absorption_1 and the unscaled absco now.
+  BOOST_CHECK_EQUAL(StaticInputRegistry::purge_unused(), 4);
+  BOOST_CHECK_EQUAL(StaticInputRegistry::number_entry(), 1);
+  StaticInputRegistry::clear();
+  BOOST_CHECK_EQUAL(StaticInputRegistry::number_entry(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(aerosol)
+{
+  StaticInputRegistry::clear();
+  HdfFile h(test_data_dir() + "l2_fixed_level_static_input.h5");
+  Array<double, 1> a1(3), b(3), a2(4), b2(4);
+  a1 = 0; b = 0.3, 0.6, 1.0;
+  a2 = 0; b2 = 0.2, 0.4, 0.6, 1.0;
+  boost::shared_ptr<Pressure> p1(new PressureSigma(a1,b, 10, true));
+  boost::shared_ptr<Pressure> p2(new PressureSigma(a2,b2, 20, true));
+  boost::shared_ptr<AerosolProperty> ap1 = 
+    StaticInputRegistry::aerosol_property_hdf(h, "Aerosol/Kahn_2b/Properties",
+					      p1);
+  boost::shared_ptr<AerosolProperty> ap2 = 
+    StaticInputRegistry::aerosol_property_hdf(h, "Aerosol/Kahn_2b/Properties",
+					      p2);
+  BOOST_CHECK(ap1 != ap2);
+  BOOST_CHECK_EQUAL(StaticInputRegistry::number_entry(), 1);
+  BOOST_CHECK_CLOSE(ap1->extinction_coefficient_each_layer(13000).value()(0), 
+		    0.9321898305, 1e-8);
+  BOOST_CHECK_CLOSE(ap2->extinction_coefficient_each_layer(13000).value()(0), 
+		    0.9321898305, 1e-8);
+  // Each AerosolProperty uses its own Pressure
+  BOOST_CHECK_EQUAL(ap1->extinction_coefficient_each_layer(13000).rows(), 2);
+  BOOST_CHECK_EQUAL(ap2->extinction_coefficient_each_layer(13000).rows(), 3);
+  // The registry shouldn't hold onto the Pressure of the first request
+  boost::weak_ptr<Pressure> p1_weak(p1);
+  ap1.reset();
+  p1.reset();
+  BOOST_CHECK(p1_weak.expired());
+  StaticInputRegistry::clear();
+}
+
+BOOST_AUTO_TEST_CASE(ils_table)
+{
+  StaticInputRegistry::clear();
+  HdfFile h(test_data_dir() + "l2_fixed_level_static_input.h5");
+  boost::shared_ptr<IlsFunction> i1 = 
+    StaticInputRegistry::ils_table_linear(h, 0, "A-Band", "o2");
+  boost::shared_ptr<IlsFunction> i2 = 
+    StaticInputRegistry::ils_table_linear(h, 0, "A-Band", "o2");
+  BOOST_CHECK(i1 != i2);
+  BOOST_CHECK_EQUAL(StaticInputRegistry::number_entry(), 1);
+  BOOST_CHECK_EQUAL(i1->band_name(), i2->band_name());
+  StaticInputRegistry::clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,849 @@
+#include "twostream_batch_driver.h"
+#include "old_constant.h"
+#include "wgs84_constant.h"
+#include "fp_exception.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace FullPhysics;
+using namespace blitz;
+
+/// @cond
+// Values used by the Fortran 2stream code. Transmittances along a
+// path with more than max_tau_path optical depth are set to zero.
+const double max_tau_path = 88.0;
+const double omega_max = 0.999999999;
+const double omega_min = 1e-9;
+const double asymm_max = 0.999999999;
+const double asymm_min = 1e-9;
+const double small_pivot = 1e-20;
+
+namespace {
+inline void zero(std::vector<double>& V)
+{
+  std::fill(V.begin(), V.end(), 0.0);
+}
+
+// The quantities we calculate for one Fourier term, kept around so
+// we can run the adjoint. Everything is stored layer (or row) major
+// with the lane as the fastest index.
+struct FourierTerm {
+  void resize(int Nlayer, int Nlane)
+  {
+    int s = Nlayer * Nlane;
+    kval.resize(s); et.resize(s); xp1.resize(s); xp2.resize(s);
+    norm.resize(s); uxp.resize(s); uxn.resize(s); hm1.resize(s);
+    hm2.resize(s); gp.resize(s); gm.resize(s); cf.resize(s); df.resize(s);
+    aterm.resize(s); bterm.resize(s); gdn.resize(s); gup.resize(s);
+    sd.resize(s); su.resize(s);
+    // Band matrix, with 5 diagonals for each of 2 * Nlayer rows
+    band.resize(2 * s * 5);
+    x.resize(2 * s);
+    cum.resize((Nlayer + 1) * Nlane);
+  }
+  std::vector<double> kval, et, xp1, xp2, norm, uxp, uxn, hm1, hm2, gp, gm,
+    cf, df, aterm, bterm, gdn, gup, sd, su, band, x, cum;
+};
+}
+/// @endcond
+
+const int TwostreamBatchDriver::nlane;
+
+struct TwostreamBatchDriver::Workspace {
+  Workspace(int Nlayer)
+  {
+    int s = Nlayer * nlane;
+    od.resize(s); ssa.resize(s); asymm.resize(s); d2s.resize(s);
+    albedo.resize(nlane);
+    dtau.resize(s); omega.resize(s); g.resize(s); omfac.resize(s);
+    m1fac.resize(s);
+    ts.resize(s); avsec.resize(s); itrans.resize(s); tdm.resize(s);
+    tdu.resize(s); emu.resize(s); ncut.resize(nlane); tsb.resize(nlane);
+    inten.resize(nlane);
+    fterm[0].resize(Nlayer, nlane);
+    fterm[1].resize(Nlayer, nlane);
+    od_b.resize(s); ssa_b.resize(s); asymm_b.resize(s); d2s_b.resize(s);
+    albedo_b.resize(nlane);
+    dtau_b.resize(s); omega_b.resize(s); g_b.resize(s);
+    ts_b.resize(s); avsec_b.resize(s); itrans_b.resize(s); tdm_b.resize(s);
+    tdu_b.resize(s); emu_b.resize(s); tsb_b.resize(nlane);
+  }
+  // Inputs
+  std::vector<double> od, ssa, asymm, d2s, albedo;
+  // Optical properties after delta 2-stream scaling
+  std::vector<double> dtau, omega, g, omfac, m1fac;
+  // Solar beam attenuation
+  std::vector<double> ts, avsec, itrans, tdm, tdu, emu, tsb;
+  std::vector<int> ncut;
+  FourierTerm fterm[2];
+  std::vector<double> inten;
+  // Adjoint values
+  std::vector<double> od_b, ssa_b, asymm_b, d2s_b, albedo_b;
+  std::vector<double> dtau_b, omega_b, g_b, ts_b, avsec_b, itrans_b,
+    tdm_b, tdu_b, emu_b, tsb_b;
+};
+
+//-----------------------------------------------------------------------
+/// Constructor.
+///
+/// \param Nlayer Number of layers
+/// \param Do_fullquadrature If true, use the full quadrature stream
+///    value of sqrt(1/3), otherwise use 0.5. As for TwostreamRtDriver,
+///    false is really only useful for comparing against LIDORT.
+//-----------------------------------------------------------------------
+
+TwostreamBatchDriver::TwostreamBatchDriver(int Nlayer, bool Do_fullquadrature)
+  : nlayer(Nlayer),
+    stream_value_(Do_fullquadrature ? sqrt(1.0 / 3.0) : 0.5),
+    do_d2s_scaling_(true), do_plane_parallel_(false),
+    sza(0), azm(0), zen(0),
+    height_grid(Nlayer + 1), chapman(Nlayer, Nlayer),
+    ws(new Workspace(Nlayer))
+{
+  range_min_check(Nlayer, 1);
+  height_grid = 0;
+  chapman = 0;
+}
+
+//-----------------------------------------------------------------------
+/// Set the plane-parallel flag.
+//-----------------------------------------------------------------------
+
+void TwostreamBatchDriver::do_plane_parallel(bool V)
+{
+  if(V != do_plane_parallel_) {
+    do_plane_parallel_ = V;
+    calc_chapman();
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Set up the height grid, in km. This is number_layer() + 1 in size,
+/// going from the top of the atmosphere to the surface.
+//-----------------------------------------------------------------------
+
+void TwostreamBatchDriver::setup_height_grid
+(const blitz::Array<double, 1>& Height_grid)
+{
+  if(Height_grid.rows() != nlayer + 1) {
+    Exception e;
+    e << "Height grid has " << Height_grid.rows()
+      << " levels, but we were set up for " << nlayer << " layers";
+    throw e;
+  }
+  if(all(Height_grid == height_grid))
+    return;
+  height_grid = Height_grid;
+  calc_chapman();
+}
+
+//-----------------------------------------------------------------------
+/// Set up the geometry. All angles are in degrees.
+//-----------------------------------------------------------------------
+
+void TwostreamBatchDriver::setup_geometry(double Sza, double Azm, double Zen)
+{
+  bool sza_changed = (Sza != sza);
+  sza = Sza;
+  azm = Azm;
+  zen = Zen;
+  if(sza_changed)
+    calc_chapman();
+}
+
+//-----------------------------------------------------------------------
+/// Calculate the chapman factors, which give the slant path through
+/// each layer for the solar beam. This is the same straight line
+/// geometry as twostream_beam_geometry_prepare.
+//-----------------------------------------------------------------------
+
+void TwostreamBatchDriver::calc_chapman()
+{
+  chapman = 0;
+  double mu_toa = cos(sza * OldConstant::pi / 180.0);
+  if(do_plane_parallel_) {
+    for(int n = 0; n < nlayer; ++n)
+      for(int k = 0; k <= n; ++k)
+	chapman(n, k) = 1.0 / mu_toa;
+    return;
+  }
+  double rearth = OldConstant::wgs84_a.convert(units::km).value;
+  double gm_toa = sqrt(1.0 - mu_toa * mu_toa);
+  double h0 = height_grid(0) + rearth;
+  for(int n = 0; n < nlayer; ++n) {
+    double sinth1 = gm_toa * (height_grid(n + 1) + rearth) / h0;
+    double sth1 = asin(sinth1);
+    double re_upper = h0;
+    for(int k = 0; k <= n; ++k) {
+      double delz = height_grid(k) - height_grid(k + 1);
+      double re_lower = re_upper - delz;
+      double sinth2 = re_upper * sinth1 / re_lower;
+      double sth2 = asin(sinth2);
+      // Limit as we go to nadir, the Fortran code divides by zero here.
+      if(sinth2 == 0)
+	chapman(n, k) = 1.0;
+      else
+	chapman(n, k) = re_upper * sin(sth2 - sth1) / sinth2 / delz;
+      re_upper = re_lower;
+      sinth1 = sinth2;
+      sth1 = sth2;
+    }
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Set up the optical properties for the given lane. This takes the
+/// same arguments as TwostreamRtDriver::setup_optical_inputs, along
+/// with the Lambertian albedo.
+///
+/// \param Lane Lane to fill in, 0 to number_lane() - 1
+/// \param Od Optical depth for each layer
+/// \param Ssa Single scattering albedo for each layer
+/// \param Pf Phase function moments. This is number moment x
+///   number_layer(), and must have at least 3 moments.
+/// \param Albedo Lambertian albedo
+//-----------------------------------------------------------------------
+
+void TwostreamBatchDriver::setup_optical_inputs
+(int Lane, const blitz::Array<double, 1>& Od,
+ const blitz::Array<double, 1>& Ssa, const blitz::Array<double, 2>& Pf,
+ double Albedo) const
+{
+  range_check(Lane, 0, nlane);
+  if(Od.rows() != nlayer || Ssa.rows() != nlayer || Pf.cols() != nlayer ||
+     Pf.rows() < 3)
+    throw Exception("Optical inputs don't match the number of layers");
+  Workspace& w = *ws;
+  for(int n = 0; n < nlayer; ++n) {
+    int i = n * nlane + Lane;
+    w.od[i] = Od(n);
+    w.ssa[i] = (Ssa(n) > 0.999 ? 0.999999 : Ssa(n));
+    w.asymm[i] = Pf(1, n) / 3.0;
+    w.d2s[i] = Pf(2, n) / 5.0;
+  }
+  w.albedo[Lane] = Albedo;
+}
+
+//-----------------------------------------------------------------------
+/// Run the radiative transfer for the first Number_lane_used lanes,
+/// optionally calculating the Jacobian. Any unused lanes are filled
+/// with a copy of lane 0, so they are harmless to calculate.
+//-----------------------------------------------------------------------
+
+void TwostreamBatchDriver::calculate_rt(int Number_lane_used,
+					bool Calc_jacobian) const
+{
+  range_check(Number_lane_used, 1, nlane + 1);
+  Workspace& w = *ws;
+  const int nl = nlane;
+  const int L = nlayer;
+  for(int lane = Number_lane_used; lane < nl; ++lane) {
+    for(int n = 0; n < L; ++n) {
+      w.od[n * nl + lane] = w.od[n * nl];
+      w.ssa[n * nl + lane] = w.ssa[n * nl];
+      w.asymm[n * nl + lane] = w.asymm[n * nl];
+      w.d2s[n * nl + lane] = w.d2s[n * nl];
+    }
+    w.albedo[lane] = w.albedo[0];
+  }
+  const double deg_to_rad = OldConstant::pi / 180.0;
+  const double x0 = cos(sza * deg_to_rad);
+  const double mu = cos(zen * deg_to_rad);
+  const double usec = 1.0 / mu;
+  const double s = stream_value_;
+  const double xinv = 1.0 / s;
+  const double f1 = 1.0 / (4.0 * OldConstant::pi);
+  const int nfourier = (sza < 1e-8 ? 1 : 2);
+  const double azmfac = cos(azm * deg_to_rad);
+
+//-----------------------------------------------------------------------
+// Delta 2-stream scaling of the optical properties.
+//-----------------------------------------------------------------------
+
+  for(int i = 0; i < L * nl; ++i) {
+    double f = (do_d2s_scaling_ ? w.d2s[i] : 0.0);
+    w.omfac[i] = 1.0 - w.ssa[i] * f;
+    w.m1fac[i] = 1.0 - f;
+    w.dtau[i] = w.omfac[i] * w.od[i];
+    double om = w.m1fac[i] * w.ssa[i] / w.omfac[i];
+    om = (om > omega_max ? omega_max : (om < omega_min ? omega_min : om));
+    w.omega[i] = om;
+    double g = (w.asymm[i] - f) / w.m1fac[i];
+    g = (g > asymm_max ? asymm_max :
+	 (g < -asymm_max ? -asymm_max :
+	  (g >= 0 && g < asymm_min ? asymm_min :
+	   (g < 0 && g > -asymm_min ? -asymm_min : g))));
+    w.g[i] = g;
+  }
+
+//-----------------------------------------------------------------------
+// Solar beam attenuation, and the transmittances we need in each
+// layer (twostream_qsprep, twostream_preptrans and
+// twostream_emultmaster).
+//-----------------------------------------------------------------------
+
+  for(int n = 0; n < L; ++n) {
+    for(int l = 0; l < nl; ++l)
+      w.ts[n * nl + l] = 0;
+    for(int k = 0; k <= n; ++k) {
+      double c = chapman(n, k);
+      for(int l = 0; l < nl; ++l)
+	w.ts[n * nl + l] += c * w.dtau[k * nl + l];
+    }
+  }
+  for(int l = 0; l < nl; ++l) {
+    w.ncut[l] = L;
+    for(int n = 0; n < L; ++n)
+      if(w.ts[n * nl + l] > max_tau_path) {
+	w.ncut[l] = n + 1;
+	break;
+      }
+    double tau_solar = w.ts[(L - 1) * nl + l];
+    w.tsb[l] = (tau_solar > max_tau_path ? 0.0 : exp(-tau_solar));
+  }
+  for(int n = 0; n < L; ++n)
+    for(int l = 0; l < nl; ++l) {
+      int i = n * nl + l;
+      bool active = (n < w.ncut[l]);
+      double tsprev = (n == 0 ? 0.0 : w.ts[i - nl]);
+      double avsec = (do_plane_parallel_ ? 1.0 / x0 :
+		      (w.ts[i] - tsprev) / w.dtau[i]);
+      w.avsec[i] = (active ? avsec : 0.0);
+      w.itrans[i] = (active ? exp(-tsprev) : 0.0);
+      double spher = w.dtau[i] * w.avsec[i];
+      w.tdm[i] = (active && spher <= max_tau_path ? exp(-spher) : 0.0);
+      double sp = w.dtau[i] * usec;
+      w.tdu[i] = (sp <= max_tau_path ? exp(-sp) : 0.0);
+      w.emu[i] = (active ? w.itrans[i] * usec * (1 - w.tdm[i] * w.tdu[i]) /
+		  (w.avsec[i] + usec) : 0.0);
+    }
+
+//-----------------------------------------------------------------------
+// Fourier terms.
+//-----------------------------------------------------------------------
+
+  for(int l = 0; l < nl; ++l)
+    w.inten[l] = 0;
+  for(int m = 0; m < nfourier; ++m) {
+    FourierTerm& ft = w.fterm[m];
+    bool m0 = (m == 0);
+    double pxsq = (m0 ? s * s : 0.5 * (1 - s * s));
+    double px11 = sqrt(0.5 * (1 - s * s));
+    double px0x = (m0 ? x0 * s : sqrt(0.5 * (1 - x0 * x0)) * px11);
+    double ulp = -sqrt(0.5 * (1 - mu * mu));
+    double sf = (m0 ? 2.0 : 1.0);
+    double fluxmult = (m0 ? 1.0 : 2.0);
+
+    // Homogeneous solution, user stream solution and multipliers,
+    // and the particular solution for the solar beam.
+    for(int i = 0; i < L * nl; ++i) {
+      double om = w.omega[i];
+      double oa3 = 3.0 * om * w.g[i];
+      double sab = (m0 ? xinv * (om - 1) : xinv * (pxsq * oa3 - 1));
+      double dab = (m0 ? xinv * (pxsq * oa3 - 1) : -xinv);
+      double k = sqrt(sab * dab);
+      double kd = k * w.dtau[i];
+      double et = (kd > max_tau_path ? 0.0 : exp(-kd));
+      double difvec = -sab / k;
+      double xp1 = 0.5 * (1 + difvec);
+      double xp2 = 0.5 * (1 - difvec);
+      ft.kval[i] = k;
+      ft.et[i] = et;
+      ft.xp1[i] = xp1;
+      ft.xp2[i] = xp2;
+      ft.norm[i] = s * (xp1 * xp1 - xp2 * xp2);
+      if(m0) {
+	double uhp0 = 0.5 * (xp1 + xp2);
+	double uhp1 = 0.5 * (xp2 - xp1) * s;
+	ft.uxp[i] = uhp0 * om + uhp1 * oa3 * mu;
+	ft.uxn[i] = uhp0 * om - uhp1 * oa3 * mu;
+      } else {
+	double uhp1 = -0.5 * (xp1 + xp2) * px11;
+	ft.uxp[i] = ft.uxn[i] = uhp1 * oa3 * ulp;
+      }
+      double tdu = w.tdu[i];
+      ft.hm2[i] = usec * (1 - et * tdu) / (usec + k);
+      ft.hm1[i] = usec * (et - tdu) / (usec - k);
+      double avsec = w.avsec[i];
+      double tdm = w.tdm[i];
+      ft.gp[i] = avsec + k;
+      ft.gm[i] = avsec - k;
+      ft.cf[i] = (et - tdm) / ft.gm[i];
+      ft.df[i] = (1 - et * tdm) / ft.gp[i];
+      double tp = (m0 ? om + px0x * oa3 : px0x * oa3);
+      double tm = (m0 ? om - px0x * oa3 : px0x * oa3);
+      double dpi = tp * f1;
+      double dmi = tm * f1;
+      ft.aterm[i] = (dpi * xp1 + dmi * xp2) / ft.norm[i];
+      ft.bterm[i] = (dmi * xp1 + dpi * xp2) / ft.norm[i];
+      // For layers past the cutoff itrans is 0, so this is 0 also.
+      ft.gdn[i] = ft.cf[i] * ft.aterm[i] * w.itrans[i];
+      ft.gup[i] = ft.df[i] * ft.bterm[i] * w.itrans[i];
+    }
+
+    // Set up the boundary value problem, and solve it.
+    std::vector<double>& a = ft.band;
+    std::vector<double>& x = ft.x;
+    zero(a);
+    const int nt = 2 * L;
+    // Band element for row r, column c, lane l.
+#define BAND(r, c, l) a[((r) * 5 + (c) - (r) + 2) * nl + (l)]
+    for(int l = 0; l < nl; ++l) {
+      double fac = (m0 ? sf * w.albedo[l] : 0.0);
+      double db = (m0 ? x0 / OldConstant::pi * w.tsb[l] * w.albedo[l] : 0.0);
+      BAND(0, 0, l) = ft.xp1[l];
+      BAND(0, 1, l) = ft.xp2[l] * ft.et[l];
+      x[l] = -ft.gup[l] * ft.xp2[l];
+      for(int j = 1; j < L; ++j) {
+	int ip = (j - 1) * nl + l;
+	int ij = j * nl + l;
+	int r = 2 * j - 1;
+	BAND(r, 2 * j - 2, l) = ft.xp1[ip] * ft.et[ip];
+	BAND(r, 2 * j - 1, l) = ft.xp2[ip];
+	BAND(r, 2 * j, l) = -ft.xp1[ij];
+	BAND(r, 2 * j + 1, l) = -ft.xp2[ij] * ft.et[ij];
+	x[r * nl + l] = ft.gup[ij] * ft.xp2[ij] - ft.gdn[ip] * ft.xp1[ip];
+	r = 2 * j;
+	BAND(r, 2 * j - 2, l) = ft.xp2[ip] * ft.et[ip];
+	BAND(r, 2 * j - 1, l) = ft.xp1[ip];
+	BAND(r, 2 * j, l) = -ft.xp2[ij];
+	BAND(r, 2 * j + 1, l) = -ft.xp1[ij] * ft.et[ij];
+	x[r * nl + l] = ft.gup[ij] * ft.xp1[ij] - ft.gdn[ip] * ft.xp2[ip];
+      }
+      int il = (L - 1) * nl + l;
+      int r = nt - 1;
+      double xpnet = ft.xp2[il] - fac * s * ft.xp1[il];
+      double xmnet = ft.xp1[il] - fac * s * ft.xp2[il];
+      BAND(r, nt - 2, l) = xpnet * ft.et[il];
+      BAND(r, nt - 1, l) = xmnet;
+      x[r * nl + l] = -ft.gdn[il] * ft.xp2[il] +
+	fac * s * ft.gdn[il] * ft.xp1[il] + db;
+    }
+    // LU decomposition, without pivoting. This is what the Fortran
+    // pentadiagonal solver does. We store the multipliers in place of
+    // the eliminated elements.
+    for(int c = 0; c < nt; ++c) {
+      for(int l = 0; l < nl; ++l)
+	if(fabs(BAND(c, c, l)) < small_pivot) {
+	  Exception e;
+	  e << "Singularity in pentadiagonal matrix, row " << c + 1;
+	  throw e;
+	}
+      for(int r = c + 1; r < std::min(c + 3, nt); ++r)
+	for(int l = 0; l < nl; ++l) {
+	  double lm = BAND(r, c, l) / BAND(c, c, l);
+	  BAND(r, c, l) = lm;
+	  for(int cc = c + 1; cc < std::min(c + 3, nt); ++cc)
+	    BAND(r, cc, l) -= lm * BAND(c, cc, l);
+	}
+    }
+    for(int r = 1; r < nt; ++r)
+      for(int c = std::max(r - 2, 0); c < r; ++c)
+	for(int l = 0; l < nl; ++l)
+	  x[r * nl + l] -= BAND(r, c, l) * x[c * nl + l];
+    for(int r = nt - 1; r >= 0; --r) {
+      for(int c = r + 1; c < std::min(r + 3, nt); ++c)
+	for(int l = 0; l < nl; ++l)
+	  x[r * nl + l] -= BAND(r, c, l) * x[c * nl + l];
+      for(int l = 0; l < nl; ++l)
+	x[r * nl + l] /= BAND(r, r, l);
+    }
+#undef BAND
+
+    // Upwelling intensity at the top of the atmosphere.
+    // (twostream_upuser_intensity)
+    for(int l = 0; l < nl; ++l) {
+      int il = (L - 1) * nl + l;
+      double fac = (m0 ? sf * w.albedo[l] : 0.0);
+      ft.cum[L * nl + l] = fac * s *
+	(ft.gdn[il] * ft.xp1[il] + x[(nt - 2) * nl + l] * ft.xp1[il] *
+	 ft.et[il] + x[(nt - 1) * nl + l] * ft.xp2[il]);
+    }
+    for(int n = L - 1; n >= 0; --n)
+      for(int l = 0; l < nl; ++l) {
+	int i = n * nl + l;
+	double lcon = x[2 * n * nl + l];
+	double mcon = x[(2 * n + 1) * nl + l];
+	double shom = lcon * ft.uxp[i] * ft.hm2[i] +
+	  mcon * ft.uxn[i] * ft.hm1[i];
+	ft.sd[i] = (w.itrans[i] * ft.hm2[i] - w.emu[i]) / ft.gm[i];
+	ft.su[i] = (-w.itrans[i] * w.tdm[i] * ft.hm1[i] + w.emu[i]) / ft.gp[i];
+	double spar = ft.uxp[i] * ft.sd[i] * ft.aterm[i] +
+	  ft.uxn[i] * ft.su[i] * ft.bterm[i];
+	ft.cum[i] = shom + spar + w.tdu[i] * ft.cum[i + nl];
+      }
+    for(int l = 0; l < nl; ++l)
+      w.inten[l] += (m0 ? 1.0 : azmfac) * fluxmult * ft.cum[l];
+  }
+  if(!Calc_jacobian)
+    return;
+
+//-----------------------------------------------------------------------
+// Now go backwards through the calculation to get the Jacobian. We
+// follow the same order as above, but in reverse.
+//-----------------------------------------------------------------------
+
+  zero(w.dtau_b); zero(w.omega_b); zero(w.g_b); zero(w.ts_b);
+  zero(w.avsec_b); zero(w.itrans_b); zero(w.tdm_b); zero(w.tdu_b);
+  zero(w.emu_b); zero(w.tsb_b); zero(w.albedo_b);
+  std::vector<double> xb(2 * L * nl), lam(2 * L * nl), fac_b(nl);
+  std::vector<double> k_b(L * nl), et_b(L * nl), xp1_b(L * nl),
+    xp2_b(L * nl), norm_b(L * nl), uxp_b(L * nl), uxn_b(L * nl),
+    hm1_b(L * nl), hm2_b(L * nl), aterm_b(L * nl), bterm_b(L * nl),
+    gdn_b(L * nl), gup_b(L * nl);
+  for(int m = 0; m < nfourier; ++m) {
+    const FourierTerm& ft = w.fterm[m];
+    bool m0 = (m == 0);
+    double pxsq = (m0 ? s * s : 0.5 * (1 - s * s));
+    double px11 = sqrt(0.5 * (1 - s * s));
+    double px0x = (m0 ? x0 * s : sqrt(0.5 * (1 - x0 * x0)) * px11);
+    double ulp = -sqrt(0.5 * (1 - mu * mu));
+    double sf = (m0 ? 2.0 : 1.0);
+    double fluxmult = (m0 ? 1.0 : 2.0);
+    const int nt = 2 * L;
+    const std::vector<double>& x = ft.x;
+    zero(xb); zero(fac_b); zero(k_b); zero(et_b); zero(xp1_b);
+    zero(xp2_b); zero(norm_b); zero(uxp_b); zero(uxn_b); zero(hm1_b);
+    zero(hm2_b); zero(aterm_b); zero(bterm_b); zero(gdn_b); zero(gup_b);
+
+    // Intensity
+    std::vector<double> cumb(nl, (m0 ? 1.0 : azmfac) * fluxmult);
+    for(int n = 0; n < L; ++n)
+      for(int l = 0; l < nl; ++l) {
+	int i = n * nl + l;
+	double cb = cumb[l];
+	double lcon = x[2 * n * nl + l];
+	double mcon = x[(2 * n + 1) * nl + l];
+	w.tdu_b[i] += cb * ft.cum[i + nl];
+	xb[2 * n * nl + l] += cb * ft.uxp[i] * ft.hm2[i];
+	xb[(2 * n + 1) * nl + l] += cb * ft.uxn[i] * ft.hm1[i];
+	uxp_b[i] += cb * (lcon * ft.hm2[i] + ft.sd[i] * ft.aterm[i]);
+	uxn_b[i] += cb * (mcon * ft.hm1[i] + ft.su[i] * ft.bterm[i]);
+	hm2_b[i] += cb * lcon * ft.uxp[i];
+	hm1_b[i] += cb * mcon * ft.uxn[i];
+	aterm_b[i] += cb * ft.uxp[i] * ft.sd[i];
+	bterm_b[i] += cb * ft.uxn[i] * ft.su[i];
+	double sdb = cb * ft.uxp[i] * ft.aterm[i];
+	double sub = cb * ft.uxn[i] * ft.bterm[i];
+	w.itrans_b[i] += (sdb * ft.hm2[i] / ft.gm[i] -
+			  sub * w.tdm[i] * ft.hm1[i] / ft.gp[i]);
+	hm2_b[i] += sdb * w.itrans[i] / ft.gm[i];
+	hm1_b[i] -= sub * w.itrans[i] * w.tdm[i] / ft.gp[i];
+	w.tdm_b[i] -= sub * w.itrans[i] * ft.hm1[i] / ft.gp[i];
+	w.emu_b[i] += sub / ft.gp[i] - sdb / ft.gm[i];
+	// gm and gp only appear in sd, su, cf and df, so we fold their
+	// adjoint right into k and avsec.
+	double gmb = -sdb * ft.sd[i] / ft.gm[i];
+	double gpb = -sub * ft.su[i] / ft.gp[i];
+	w.avsec_b[i] += gmb + gpb;
+	k_b[i] += gpb - gmb;
+	cumb[l] = cb * w.tdu[i];
+      }
+    for(int l = 0; l < nl; ++l) {
+      int il = (L - 1) * nl + l;
+      double fac = (m0 ? sf * w.albedo[l] : 0.0);
+      double t = cumb[l] * fac * s;
+      double lcon = x[(nt - 2) * nl + l];
+      double mcon = x[(nt - 1) * nl + l];
+      gdn_b[il] += t * ft.xp1[il];
+      xb[(nt - 2) * nl + l] += t * ft.xp1[il] * ft.et[il];
+      xb[(nt - 1) * nl + l] += t * ft.xp2[il];
+      xp1_b[il] += t * (ft.gdn[il] + lcon * ft.et[il]);
+      xp2_b[il] += t * mcon;
+      et_b[il] += t * lcon * ft.xp1[il];
+      fac_b[l] += cumb[l] * s * (ft.gdn[il] * ft.xp1[il] +
+				 lcon * ft.xp1[il] * ft.et[il] +
+				 mcon * ft.xp2[il]);
+    }
+
+    // Boundary value problem. Solve A^T lam = xb using the LU
+    // decomposition, first U^T then L^T.
+    const std::vector<double>& a = ft.band;
+#define BAND(r, c, l) a[((r) * 5 + (c) - (r) + 2) * nl + (l)]
+    for(int r = 0; r < nt; ++r) {
+      for(int l = 0; l < nl; ++l)
+	lam[r * nl + l] = xb[r * nl + l];
+      for(int c = std::max(r - 2, 0); c < r; ++c)
+	for(int l = 0; l < nl; ++l)
+	  lam[r * nl + l] -= BAND(c, r, l) * lam[c * nl + l];
+      for(int l = 0; l < nl; ++l)
+	lam[r * nl + l] /= BAND(r, r, l);
+    }
+    for(int r = nt - 2; r >= 0; --r)
+      for(int c = r + 1; c < std::min(r + 3, nt); ++c)
+	for(int l = 0; l < nl; ++l)
+	  lam[r * nl + l] -= BAND(c, r, l) * lam[c * nl + l];
+#undef BAND
+    // The adjoint of the right hand side is lam, and for the matrix
+    // element (r,c) it is -lam(r) * x(c).
+    for(int l = 0; l < nl; ++l) {
+      double fac = (m0 ? sf * w.albedo[l] : 0.0);
+      double lm = lam[l];
+      gup_b[l] -= lm * ft.xp2[l];
+      xp2_b[l] -= lm * ft.gup[l];
+      xp1_b[l] -= lm * x[l];
+      xp2_b[l] -= lm * x[nl + l] * ft.et[l];
+      et_b[l] -= lm * x[nl + l] * ft.xp2[l];
+      for(int j = 1; j < L; ++j) {
+	int ip = (j - 1) * nl + l;
+	int ij = j * nl + l;
+	double xa = x[(2 * j - 2) * nl + l];
+	double xb1 = x[(2 * j - 1) * nl + l];
+	double xc = x[2 * j * nl + l];
+	double xd = x[(2 * j + 1) * nl + l];
+	// Row 2j - 1
+	lm = lam[(2 * j - 1) * nl + l];
+	gup_b[ij] += lm * ft.xp2[ij];
+	xp2_b[ij] += lm * ft.gup[ij];
+	gdn_b[ip] -= lm * ft.xp1[ip];
+	xp1_b[ip] -= lm * ft.gdn[ip];
+	xp1_b[ip] -= lm * xa * ft.et[ip];
+	et_b[ip] -= lm * xa * ft.xp1[ip];
+	xp2_b[ip] -= lm * xb1;
+	xp1_b[ij] += lm * xc;
+	xp2_b[ij] += lm * xd * ft.et[ij];
+	et_b[ij] += lm * xd * ft.xp2[ij];
+	// Row 2j
+	lm = lam[2 * j * nl + l];
+	gup_b[ij] += lm * ft.xp1[ij];
+	xp1_b[ij] += lm * ft.gup[ij];
+	gdn_b[ip] -= lm * ft.xp2[ip];
+	xp2_b[ip] -= lm * ft.gdn[ip];
+	xp2_b[ip] -= lm * xa * ft.et[ip];
+	et_b[ip] -= lm * xa * ft.xp2[ip];
+	xp1_b[ip] -= lm * xb1;
+	xp2_b[ij] += lm * xc;
+	xp1_b[ij] += lm * xd * ft.et[ij];
+	et_b[ij] += lm * xd * ft.xp1[ij];
+      }
+      int il = (L - 1) * nl + l;
+      lm = lam[(nt - 1) * nl + l];
+      double xpnet = ft.xp2[il] - fac * s * ft.xp1[il];
+      gdn_b[il] += lm * (fac * s * ft.xp1[il] - ft.xp2[il]);
+      xp2_b[il] -= lm * ft.gdn[il];
+      xp1_b[il] += lm * fac * s * ft.gdn[il];
+      fac_b[l] += lm * s * ft.gdn[il] * ft.xp1[il];
+      if(m0) {
+	double db_b = lm;
+	w.albedo_b[l] += db_b * x0 / OldConstant::pi * w.tsb[l];
+	w.tsb_b[l] += db_b * x0 / OldConstant::pi * w.albedo[l];
+      }
+      double xpnet_b = -lm * x[(nt - 2) * nl + l] * ft.et[il];
+      double xmnet_b = -lm * x[(nt - 1) * nl + l];
+      et_b[il] -= lm * x[(nt - 2) * nl + l] * xpnet;
+      xp2_b[il] += xpnet_b - xmnet_b * fac * s;
+      xp1_b[il] += xmnet_b - xpnet_b * fac * s;
+      fac_b[l] -= (xpnet_b * ft.xp1[il] + xmnet_b * ft.xp2[il]) * s;
+      if(m0)
+	w.albedo_b[l] += fac_b[l] * sf;
+    }
+
+    // Particular solution, user stream solution, multipliers and
+    // homogeneous solution.
+    for(int i = 0; i < L * nl; ++i) {
+      double om = w.omega[i];
+      double oa3 = 3.0 * om * w.g[i];
+      double k = ft.kval[i];
+      double xp1 = ft.xp1[i];
+      double xp2 = ft.xp2[i];
+      double om_b = 0, oa3_b = 0;
+      double kb = k_b[i], etb = et_b[i], xp1b = xp1_b[i], xp2b = xp2_b[i];
+      double normb = norm_b[i];
+      // wu and wl are folded into gup and gdn above
+      double cf_b = gdn_b[i] * ft.aterm[i] * w.itrans[i];
+      double df_b = gup_b[i] * ft.bterm[i] * w.itrans[i];
+      double atb = aterm_b[i] + gdn_b[i] * ft.cf[i] * w.itrans[i];
+      double btb = bterm_b[i] + gup_b[i] * ft.df[i] * w.itrans[i];
+      w.itrans_b[i] += gdn_b[i] * ft.cf[i] * ft.aterm[i] +
+	gup_b[i] * ft.df[i] * ft.bterm[i];
+      double norm = ft.norm[i];
+      double tp = (m0 ? om + px0x * oa3 : px0x * oa3);
+      double tm = (m0 ? om - px0x * oa3 : px0x * oa3);
+      double dpi = tp * f1;
+      double dmi = tm * f1;
+      double dpi_b = (atb * xp1 + btb * xp2) / norm;
+      double dmi_b = (atb * xp2 + btb * xp1) / norm;
+      xp1b += (atb * dpi + btb * dmi) / norm;
+      xp2b += (atb * dmi + btb * dpi) / norm;
+      normb -= (atb * ft.aterm[i] + btb * ft.bterm[i]) / norm;
+      double tp_b = dpi_b * f1;
+      double tm_b = dmi_b * f1;
+      if(m0) {
+	om_b += tp_b + tm_b;
+	oa3_b += px0x * (tp_b - tm_b);
+      } else
+	oa3_b += px0x * (tp_b + tm_b);
+      double tdm = w.tdm[i];
+      double gm = ft.gm[i], gp = ft.gp[i];
+      etb += cf_b / gm - df_b * tdm / gp;
+      w.tdm_b[i] += -cf_b / gm - df_b * ft.et[i] / gp;
+      double gm_b = -cf_b * ft.cf[i] / gm;
+      double gp_b = -df_b * ft.df[i] / gp;
+      w.avsec_b[i] += gm_b + gp_b;
+      kb += gp_b - gm_b;
+      // Multipliers
+      double et = ft.et[i];
+      double tdu = w.tdu[i];
+      etb += -hm2_b[i] * usec * tdu / (usec + k) + hm1_b[i] * usec / (usec - k);
+      w.tdu_b[i] += -hm2_b[i] * usec * et / (usec + k) -
+	hm1_b[i] * usec / (usec - k);
+      kb += -hm2_b[i] * ft.hm2[i] / (usec + k) +
+	hm1_b[i] * ft.hm1[i] / (usec - k);
+      // User stream solution
+      if(m0) {
+	double uhp0 = 0.5 * (xp1 + xp2);
+	double uhp1 = 0.5 * (xp2 - xp1) * s;
+	double uhp0_b = (uxp_b[i] + uxn_b[i]) * om;
+	double uhp1_b = (uxp_b[i] - uxn_b[i]) * oa3 * mu;
+	om_b += (uxp_b[i] + uxn_b[i]) * uhp0;
+	oa3_b += (uxp_b[i] - uxn_b[i]) * uhp1 * mu;
+	xp1b += 0.5 * uhp0_b - 0.5 * s * uhp1_b;
+	xp2b += 0.5 * uhp0_b + 0.5 * s * uhp1_b;
+      } else {
+	double uhp1 = -0.5 * (xp1 + xp2) * px11;
+	double t = uxp_b[i] + uxn_b[i];
+	double uhp1_b = t * oa3 * ulp;
+	oa3_b += t * uhp1 * ulp;
+	xp1b -= 0.5 * px11 * uhp1_b;
+	xp2b -= 0.5 * px11 * uhp1_b;
+      }
+      // Homogeneous solution
+      xp1b += normb * 2 * s * xp1;
+      xp2b -= normb * 2 * s * xp2;
+      double difvec_b = 0.5 * (xp1b - xp2b);
+      double sab = (m0 ? xinv * (om - 1) : xinv * (pxsq * oa3 - 1));
+      double dab = (m0 ? xinv * (pxsq * oa3 - 1) : -xinv);
+      double sab_b = -difvec_b / k;
+      kb += difvec_b * sab / (k * k);
+      kb -= etb * et * w.dtau[i];
+      w.dtau_b[i] -= etb * et * k;
+      sab_b += kb * dab / (2 * k);
+      double dab_b = kb * sab / (2 * k);
+      if(m0) {
+	om_b += sab_b * xinv;
+	oa3_b += dab_b * xinv * pxsq;
+      } else
+	oa3_b += sab_b * xinv * pxsq;
+      om_b += oa3_b * 3.0 * w.g[i];
+      w.g_b[i] += oa3_b * 3.0 * om;
+      w.omega_b[i] += om_b;
+    }
+  }
+
+//-----------------------------------------------------------------------
+// Adjoint of the solar beam attenuation.
+//-----------------------------------------------------------------------
+
+  for(int n = 0; n < L; ++n)
+    for(int l = 0; l < nl; ++l) {
+      int i = n * nl + l;
+      bool active = (n < w.ncut[l]);
+      double avsec = w.avsec[i];
+      if(active) {
+	double sp = avsec + usec;
+	double eb = w.emu_b[i];
+	w.itrans_b[i] += eb * usec * (1 - w.tdm[i] * w.tdu[i]) / sp;
+	w.tdm_b[i] -= eb * w.itrans[i] * usec * w.tdu[i] / sp;
+	w.tdu_b[i] -= eb * w.itrans[i] * usec * w.tdm[i] / sp;
+	w.avsec_b[i] -= eb * w.emu[i] / sp;
+      }
+      w.dtau_b[i] -= w.tdu_b[i] * w.tdu[i] * usec;
+      w.dtau_b[i] -= w.tdm_b[i] * w.tdm[i] * avsec;
+      w.avsec_b[i] -= w.tdm_b[i] * w.tdm[i] * w.dtau[i];
+      if(active && n > 0)
+	w.ts_b[i - nl] -= w.itrans_b[i] * w.itrans[i];
+      if(active && !do_plane_parallel_) {
+	double ab = w.avsec_b[i] / w.dtau[i];
+	w.ts_b[i] += ab;
+	if(n > 0)
+	  w.ts_b[i - nl] -= ab;
+	w.dtau_b[i] -= ab * avsec;
+      }
+    }
+  for(int l = 0; l < nl; ++l)
+    w.ts_b[(L - 1) * nl + l] -= w.tsb_b[l] * w.tsb[l];
+  for(int n = 0; n < L; ++n)
+    for(int k = 0; k <= n; ++k) {
+      double c = chapman(n, k);
+      for(int l = 0; l < nl; ++l)
+	w.dtau_b[k * nl + l] += c * w.ts_b[n * nl + l];
+    }
+
+//-----------------------------------------------------------------------
+// And finally the delta 2-stream scaling. Like the Fortran, we
+// ignore the clamping of omega and g when calculating the derivative.
+//-----------------------------------------------------------------------
+
+  for(int i = 0; i < L * nl; ++i) {
+    if(do_d2s_scaling_) {
+      double f = w.d2s[i];
+      w.od_b[i] = w.dtau_b[i] * w.omfac[i];
+      w.ssa_b[i] = -w.dtau_b[i] * f * w.od[i] +
+	w.omega_b[i] * (1 - f * (1 - w.omega[i])) / w.omfac[i];
+      w.d2s_b[i] = -w.dtau_b[i] * w.ssa[i] * w.od[i] -
+	w.omega_b[i] * w.ssa[i] * (1 - w.omega[i]) / w.omfac[i] -
+	w.g_b[i] * (1 - w.g[i]) / w.m1fac[i];
+      w.asymm_b[i] = w.g_b[i] / w.m1fac[i];
+    } else {
+      w.od_b[i] = w.dtau_b[i];
+      w.ssa_b[i] = w.omega_b[i];
+      w.d2s_b[i] = 0;
+      w.asymm_b[i] = w.g_b[i];
+    }
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Intensity calculated by the last call to calculate_rt, for the
+/// given lane.
+//-----------------------------------------------------------------------
+
+double TwostreamBatchDriver::intensity(int Lane) const
+{
+  range_check(Lane, 0, nlane);
+  return ws->inten[Lane];
+}
+
+//-----------------------------------------------------------------------
+/// Jacobian calculated by the last call to calculate_rt (which needs
+/// to have had Calc_jacobian true). Jac_layer is 4 x number_layer(),
+/// and is the derivative of the intensity with respect to the
+/// optical depth, single scattering albedo and phase function moments
+/// 1 and 2 (i.e., the arguments to setup_optical_inputs). Jac_albedo
+/// is the derivative with respect to the albedo.
+///
+/// As with the TwostreamRtDriver, the derivative for the single
+/// scattering albedo ignores the cap we put on it.
+//-----------------------------------------------------------------------
+
+void TwostreamBatchDriver::copy_jacobians
+(int Lane, blitz::Array<double, 2>& Jac_layer, double& Jac_albedo) const
+{
+  range_check(Lane, 0, nlane);
+  const Workspace& w = *ws;
+  Jac_layer.resize(4, nlayer);
+  for(int n = 0; n < nlayer; ++n) {
+    int i = n * nlane + Lane;
+    Jac_layer(0, n) = w.od_b[i];
+    Jac_layer(1, n) = w.ssa_b[i];
+    Jac_layer(2, n) = w.asymm_b[i] / 3.0;
+    Jac_layer(3, n) = w.d2s_b[i] / 5.0;
+  }
+  Jac_albedo = w.albedo_b[Lane];
+}
+
+//-----------------------------------------------------------------------
+/// Print to a stream.
+//-----------------------------------------------------------------------
+
+void TwostreamBatchDriver::print(std::ostream& Os) const
+{
+  Os << "TwostreamBatchDriver:\n"
+     << "  Number layer:      " << nlayer << "\n"
+     << "  Number lane:       " << nlane << "\n"
+     << "  Stream value:      " << stream_value_ << "\n"
+     << "  Do d2s scaling:    " << (do_d2s_scaling_ ? "true" : "false") << "\n"
+     << "  Do plane parallel: " << (do_plane_parallel_ ? "true" : "false")
+     << "\n";
+}
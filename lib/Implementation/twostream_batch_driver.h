@@ -0,0 +1,108 @@
+#ifndef TWOSTREAM_BATCH_DRIVER_H
+#define TWOSTREAM_BATCH_DRIVER_H
+
+#include "printable.h"
+#include <blitz/array.h>
+#include <boost/shared_ptr.hpp>
+
+namespace FullPhysics {
+
+/****************************************************************//**
+  This is a C++ implementation of the 2stream radiative transfer
+  code, for a Lambertian surface, that works on a block of
+  number_lane() wavenumbers at once.
+
+  TwostreamRtDriver calls the Fortran 2stream code (the
+  twostream_lps_master) once per wavenumber. The two stream problem
+  is small enough that the overhead of each call, and the scalar
+  code in the Fortran, dominate the run time. Here we store each
+  quantity with the wavenumber as the fastest varying index, so every
+  step of the calculation (the homogeneous and particular solutions,
+  the pentadiagonal boundary value problem, and the source function
+  integration) is an inner loop over the wavenumbers in the block
+  that the compiler can vectorize.
+
+  We follow the Fortran code exactly for the options the Fortran
+  driver uses: upwelling TOA intensity for one solar and viewing
+  geometry, a pseudo-spherical (or optionally plane-parallel) solar
+  beam, optional delta 2-stream scaling, and Fourier terms 0 and 1.
+  Only the Lambertian surface is supported. For other surfaces we
+  need the BRDF supplement, so TwostreamRt falls back to the
+  TwostreamRtDriver.
+
+  Rather than carrying the linearized solution through each step
+  like the Fortran does (once for each atmospheric weighting
+  function), we calculate the Jacobian by running the calculation
+  backwards (i.e., the adjoint). This gives the derivative of the
+  intensity with respect to the optical depth, single scattering
+  albedo, asymmetry factor and delta 2-stream scaling of every layer
+  plus the albedo in one pass, at a cost similar to the intensity
+  calculation itself. The caller then applies the chain rule to get
+  the Jacobian with respect to the state vector.
+*******************************************************************/
+class TwostreamBatchDriver : public Printable<TwostreamBatchDriver> {
+public:
+  TwostreamBatchDriver(int Nlayer, bool Do_fullquadrature = true);
+  virtual ~TwostreamBatchDriver() {}
+
+//-----------------------------------------------------------------------
+/// Number of wavenumbers we process together.
+//-----------------------------------------------------------------------
+
+  static int number_lane() { return nlane; }
+
+//-----------------------------------------------------------------------
+/// Number of layers.
+//-----------------------------------------------------------------------
+
+  int number_layer() const { return nlayer; }
+
+//-----------------------------------------------------------------------
+/// Cosine of the quadrature angle.
+//-----------------------------------------------------------------------
+
+  double stream_value() const { return stream_value_; }
+  void stream_value(double V) { stream_value_ = V; }
+
+//-----------------------------------------------------------------------
+/// If true, we apply the delta 2-stream scaling to the optical
+/// properties (the default).
+//-----------------------------------------------------------------------
+
+  bool do_d2s_scaling() const { return do_d2s_scaling_; }
+  void do_d2s_scaling(bool V) { do_d2s_scaling_ = V; }
+
+//-----------------------------------------------------------------------
+/// If true we use a plane-parallel rather than a pseudo-spherical
+/// solar beam. The default is false.
+//-----------------------------------------------------------------------
+
+  bool do_plane_parallel() const { return do_plane_parallel_; }
+  void do_plane_parallel(bool V);
+
+  void setup_height_grid(const blitz::Array<double, 1>& Height_grid);
+  void setup_geometry(double Sza, double Azm, double Zen);
+  void setup_optical_inputs(int Lane, const blitz::Array<double, 1>& Od,
+			    const blitz::Array<double, 1>& Ssa,
+			    const blitz::Array<double, 2>& Pf,
+			    double Albedo) const;
+  void calculate_rt(int Number_lane_used, bool Calc_jacobian) const;
+  double intensity(int Lane) const;
+  void copy_jacobians(int Lane, blitz::Array<double, 2>& Jac_layer,
+		      double& Jac_albedo) const;
+  virtual void print(std::ostream& Os) const;
+private:
+  struct Workspace;
+  static const int nlane = 8;
+  int nlayer;
+  double stream_value_;
+  bool do_d2s_scaling_, do_plane_parallel_;
+  double sza, azm, zen;
+  blitz::Array<double, 1> height_grid;
+  // Chapman factors, number_layer() x number_layer().
+  blitz::Array<double, 2> chapman;
+  void calc_chapman();
+  boost::shared_ptr<Workspace> ws;
+};
+}
+#endif
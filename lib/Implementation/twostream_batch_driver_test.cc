@@ -0,0 +1,105 @@
+#include "twostream_batch_driver.h"
+#include "twostream_driver.h"
+#include "spurr_brdf_types.h"
+#include "unit_test_support.h"
+
+using namespace FullPhysics;
+using namespace blitz;
+
+BOOST_FIXTURE_TEST_SUITE(twostream_batch_driver, GlobalFixture)
+
+//-----------------------------------------------------------------------
+/// Compare the batch driver against the Fortran code called through
+/// TwostreamRtDriver, one lane at a time.
+//-----------------------------------------------------------------------
+
+void compare_batch_fortran(bool do_plane_parallel, bool do_d2s_scaling,
+			   int nlane_used)
+{
+  int nlayer = 10;
+  Range all = Range::all();
+  Array<double, 1> hgrid(nlayer + 1);
+  for(int i = 0; i <= nlayer; ++i)
+    hgrid(i) = 60.0 * (nlayer - i) / nlayer;
+  double sza = 52.3, azm = 118.0, zen = 17.4;
+
+  TwostreamBatchDriver bdriver(nlayer);
+  bdriver.do_plane_parallel(do_plane_parallel);
+  bdriver.do_d2s_scaling(do_d2s_scaling);
+  bdriver.setup_height_grid(hgrid);
+  bdriver.setup_geometry(sza, azm, zen);
+
+  TwostreamRtDriver tdriver(nlayer, LAMBERTIAN);
+  tdriver.twostream_interface()->do_plane_parallel(do_plane_parallel);
+  tdriver.twostream_interface()->do_d2s_scaling(do_d2s_scaling);
+  tdriver.setup_height_grid(hgrid);
+  tdriver.brdf_driver()->setup_geometry(sza, azm, zen);
+  tdriver.setup_geometry(sza, azm, zen);
+
+  // Derivatives with respect to the od, ssa, and the phase function
+  // moments 1 and 2 of each layer.
+  std::vector<ArrayAd<double, 1> > od, ssa;
+  std::vector<ArrayAd<double, 2> > pf;
+  std::vector<double> albedo;
+  for(int j = 0; j < nlane_used; ++j) {
+    od.push_back(ArrayAd<double, 1>(nlayer, 4));
+    ssa.push_back(ArrayAd<double, 1>(nlayer, 4));
+    pf.push_back(ArrayAd<double, 2>(3, nlayer, 4));
+    od[j].jacobian() = 0;
+    ssa[j].jacobian() = 0;
+    pf[j].jacobian() = 0;
+    for(int i = 0; i < nlayer; ++i) {
+      od[j].value()(i) = 0.02 * (i + 1) * (j + 1) + (i == 7 ? 0.5 * j : 0);
+      ssa[j].value()(i) = 0.95 - 0.08 * i + 0.01 * j;
+      double g = 0.7 - 0.06 * i - 0.02 * j;
+      pf[j].value()(0, i) = 1;
+      pf[j].value()(1, i) = 3 * g;
+      pf[j].value()(2, i) = 5 * 0.6 * g * g;
+      od[j].jacobian()(i, 0) = 1;
+      ssa[j].jacobian()(i, 1) = 1;
+      pf[j].jacobian()(1, i, 2) = 1;
+      pf[j].jacobian()(2, i, 3) = 1;
+    }
+    albedo.push_back(0.05 + 0.04 * j);
+    bdriver.setup_optical_inputs(j, od[j].value(), ssa[j].value(),
+				 pf[j].value(), albedo[j]);
+  }
+  bdriver.calculate_rt(nlane_used, true);
+
+  for(int j = 0; j < nlane_used; ++j) {
+    ArrayAd<double, 1> surface_param(1, 1);
+    surface_param(0) = AutoDerivative<double>(albedo[j], 0, 1);
+    tdriver.brdf_driver()->setup_brdf_inputs(LAMBERTIAN, surface_param);
+    tdriver.setup_optical_inputs(od[j].value(), ssa[j].value(),
+				 pf[j].value());
+    tdriver.setup_linear_inputs(od[j], ssa[j], pf[j], true);
+    tdriver.calculate_rt();
+    Array<double, 2> jac_atm;
+    Array<double, 1> jac_surf;
+    tdriver.copy_jacobians(jac_atm, jac_surf);
+    Array<double, 2> jac_layer;
+    double jac_albedo;
+    bdriver.copy_jacobians(j, jac_layer, jac_albedo);
+    BOOST_CHECK_CLOSE(bdriver.intensity(j), tdriver.get_intensity(), 1e-8);
+    // The Fortran doesn't set the d2s derivative if we aren't
+    // doing the scaling.
+    int njac = (do_d2s_scaling ? 4 : 3);
+    Range rjac(0, njac - 1);
+    double jac_scale = max(abs(jac_atm(rjac, all)));
+    BOOST_CHECK_MATRIX_CLOSE_TOL(jac_layer(rjac, all) / jac_scale,
+				 jac_atm(rjac, all) / jac_scale, 1e-9);
+    BOOST_CHECK_CLOSE(jac_albedo, jac_surf(0), 1e-8);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(pseudo_spherical)
+{
+  compare_batch_fortran(false, true, TwostreamBatchDriver::number_lane());
+}
+
+BOOST_AUTO_TEST_CASE(plane_parallel)
+{
+  compare_batch_fortran(true, false, 5);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
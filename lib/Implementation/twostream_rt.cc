@@ -1,5 +1,8 @@
 #include "twostream_rt.h"
+#include "spurr_brdf_types.h"
 #include "ostream_pad.h"
+#include "profiler.h"
+#include <boost/foreach.hpp>
 
 using namespace FullPhysics;
 using namespace blitz;
@@ -18,6 +21,12 @@ REGISTER_LUA_DERIVED_CLASS(TwostreamRt, RadiativeTransfer)
                           const blitz::Array<double, 1>&, 
                           const blitz::Array<double, 1>&,
                           bool>())
+.def(luabind::constructor<const boost::shared_ptr<RtAtmosphere>&,
+                          const boost::shared_ptr<StokesCoefficient>&,
+                          const blitz::Array<double, 1>&,
+                          const blitz::Array<double, 1>&, 
+                          const blitz::Array<double, 1>&,
+                          bool, bool>())
 REGISTER_LUA_END()
 #endif
 
@@ -38,6 +47,8 @@ const bool dump_data = false;
 /// \param Azm Azimuth angle (degrees), in range 0 to 360, and have size
 ///      number_spectrometer()
 /// \param do_fullquadrature false only for comparison against LIDORT 
+/// \param Use_batch_driver If true, and the surface is Lambertian, use
+///      the TwostreamBatchDriver in stokes and stokes_and_jacobian.
 //-----------------------------------------------------------------------
 
 TwostreamRt::TwostreamRt(const boost::shared_ptr<RtAtmosphere>& Atm,
@@ -45,16 +56,170 @@ TwostreamRt::TwostreamRt(const boost::shared_ptr<RtAtmosphere>& Atm,
                          const blitz::Array<double, 1>& Sza,
                          const blitz::Array<double, 1>& Zen,
                          const blitz::Array<double, 1>& Azm, 
-                         bool do_fullquadrature)
+                         bool do_fullquadrature,
+                         bool Use_batch_driver)
 : SpurrRt(Atm, Stokes_coef, Sza, Zen, Azm)
 {   
   rt_driver_.reset(new TwostreamRtDriver(atm->number_layer(), surface_type(), do_fullquadrature));
+  if(Use_batch_driver && surface_type() == LAMBERTIAN)
+    batch_driver_.reset(new TwostreamBatchDriver(atm->number_layer(),
+                                                 do_fullquadrature));
   if(dump_data)
     std::cout << "# Nlayer:\n" << atm->number_layer() << "\n"
               << "# Surface type:\n" << surface_type() << "\n"
               << "# do_fullquadrature:\n" << do_fullquadrature << "\n";
 }
 
+//-----------------------------------------------------------------------
+/// Set up the batch driver for the given spectrometer. We take the
+/// height grid, geometry and options from the Fortran interface, so
+/// the two always agree.
+//-----------------------------------------------------------------------
+
+void TwostreamRt::setup_batch_driver(int Spec_index) const
+{
+  update_altitude(Spec_index);
+  update_geometry(Spec_index);
+  const Twostream_Lps_Master& ts = *rt_driver()->twostream_interface();
+  batch_driver_->stream_value(ts.stream_value());
+  batch_driver_->do_d2s_scaling(ts.do_d2s_scaling());
+  batch_driver_->do_plane_parallel(ts.do_plane_parallel());
+  batch_driver_->setup_height_grid
+    (ts.height_grid()(Range(0, batch_driver_->number_layer())));
+  batch_driver_->setup_geometry(ts.beam_szas()(0), ts.user_relazms()(0),
+                                ts.user_angles()(0));
+}
+
+// See base class for description of this
+Array<double, 2> TwostreamRt::stokes(const SpectralDomain& Spec_domain,
+                                     int Spec_index) const
+{
+  if(!batch_driver_)
+    return SpurrRt::stokes(Spec_domain, Spec_index);
+  FP_PROFILE_SCOPE("TwostreamRt stokes");
+  Array<double, 1> wn(Spec_domain.wavenumber());
+  boost::shared_ptr<boost::progress_display> disp = progress_display(wn);
+  Array<double, 2> res(wn.rows(), number_stokes());
+  res = 0;
+  setup_batch_driver(Spec_index);
+  Range ra(Range::all());
+  int nlane = TwostreamBatchDriver::number_lane();
+  for(int i = 0; i < wn.rows(); i += nlane) {
+    int nused = std::min(nlane, wn.rows() - i);
+    for(int j = 0; j < nused; ++j) {
+      double w = wn(i + j);
+      batch_driver_->setup_optical_inputs
+        (j, atm->optical_depth_wrt_iv(w, Spec_index).value(),
+         atm->single_scattering_albedo_wrt_iv(w, Spec_index).value(),
+         atm->scattering_moment_wrt_iv(w, Spec_index, number_moment(), 1)
+         (ra, ra, 0).value(),
+         atm->ground()->surface_parameter(w, Spec_index)(0).value());
+    }
+    batch_driver_->calculate_rt(nused, false);
+    for(int j = 0; j < nused; ++j) {
+      res(i + j, 0) = batch_driver_->intensity(j);
+      if(std::isnan(res(i + j, 0)))
+        throw Exception("TwostreamRt encountered a NaN in the radiance");
+    }
+    if(disp)
+      *disp += nused;
+  }
+  return res;
+}
+
+// See base class for description of this
+ArrayAd<double, 2> TwostreamRt::stokes_and_jacobian
+(const SpectralDomain& Spec_domain, int Spec_index) const
+{
+  if(!batch_driver_)
+    return SpurrRt::stokes_and_jacobian(Spec_domain, Spec_index);
+  FP_PROFILE_SCOPE("TwostreamRt stokes_and_jacobian");
+  Array<double, 1> wn(Spec_domain.wavenumber());
+  if(wn.rows() < 1)		// Handle degenerate case.
+    return ArrayAd<double, 2>(0, number_stokes(), 0);
+  boost::shared_ptr<boost::progress_display> disp = progress_display(wn);
+  setup_batch_driver(Spec_index);
+  Range ra(Range::all());
+  int nlane = TwostreamBatchDriver::number_lane();
+  std::vector<ArrayAd<double, 1> > od(nlane), ssa(nlane), surf(nlane);
+  std::vector<ArrayAd<double, 2> > pf(nlane);
+  std::vector<Array<double, 3> > jac_iv(nlane);
+  std::vector<boost::shared_ptr<const JacobianColumnGroup> > jac_iv_group(nlane);
+  Array<double, 2> jac_layer;
+  double jac_albedo;
+  ArrayAd<double, 2> res;
+  for(int i = 0; i < wn.rows(); i += nlane) {
+    int nused = std::min(nlane, wn.rows() - i);
+    for(int j = 0; j < nused; ++j) {
+      double w = wn(i + j);
+      od[j].reference(atm->optical_depth_wrt_iv(w, Spec_index));
+      ssa[j].reference(atm->single_scattering_albedo_wrt_iv(w, Spec_index));
+      pf[j].reference(atm->scattering_moment_wrt_iv(w, Spec_index,
+                                                    number_moment(), 1)
+                      (ra, ra, 0));
+      ArrayAd<double, 2> inter_var(atm->intermediate_variable(w, Spec_index));
+      jac_iv_group[j] = inter_var.column_group();
+      if(!inter_var.is_constant())
+        jac_iv[j].reference(inter_var.jacobian());
+      else
+        jac_iv[j].resize(0, 0, 0);
+      surf[j].reference(atm->ground()->surface_parameter(w, Spec_index));
+      batch_driver_->setup_optical_inputs(j, od[j].value(), ssa[j].value(),
+                                          pf[j].value(),
+                                          surf[j](0).value());
+    }
+    batch_driver_->calculate_rt(nused, true);
+
+//-----------------------------------------------------------------------
+// As in SpurrRt, the atmosphere Jacobian is relative to the
+// RtAtmosphere intermediate variables, and the surface Jacobian
+// relative to the albedo. Convert both to be relative to the state
+// vector. If we know which columns of the intermediate variable
+// Jacobian might be nonzero, we only add those in.
+//-----------------------------------------------------------------------
+
+    for(int j = 0; j < nused; ++j) {
+      double rad = batch_driver_->intensity(j);
+      batch_driver_->copy_jacobians(j, jac_layer, jac_albedo);
+      Array<double, 1> jac(jac_iv[j].depth());
+      jac = 0;
+      for(int m = 0; m < jac_iv[j].rows(); ++m)
+        for(int n = 0; n < jac_iv[j].cols(); ++n) {
+          double d = 0;
+          if(!od[j].is_constant())
+            d += jac_layer(0, m) * od[j].jacobian()(m, n);
+          if(!ssa[j].is_constant())
+            d += jac_layer(1, m) * ssa[j].jacobian()(m, n);
+          if(!pf[j].is_constant())
+            d += jac_layer(2, m) * pf[j].jacobian()(1, m, n) +
+              jac_layer(3, m) * pf[j].jacobian()(2, m, n);
+          if(d != 0) {
+            if(jac_iv_group[j])
+              BOOST_FOREACH(const Range& r, jac_iv_group[j]->group(n))
+                jac(r) += d * jac_iv[j](m, n, r);
+            else
+              jac += d * jac_iv[j](m, n, ra);
+          }
+        }
+      if(!surf[j].is_constant() && surf[j].number_variable() == jac.rows())
+        jac += jac_albedo * surf[j].jacobian()(0, ra);
+      if(std::isnan(rad))
+        throw Exception("TwostreamRt encountered a NaN in the radiance");
+      if(any(blitz_isnan(jac)))
+        throw Exception("TwostreamRt encountered a NaN in the jacobian");
+      ArrayAd<double, 1> rad_jac(number_stokes(), jac.rows());
+      rad_jac = 0;
+      rad_jac(0) = AutoDerivative<double>(rad, jac);
+      if(i == 0 && j == 0)
+        res.resize(wn.rows(), number_stokes(), jac.rows());
+      res(i + j, ra) = rad_jac;
+    }
+    if(disp)
+      *disp += nused;
+  }
+  return res;
+}
+
 //-----------------------------------------------------------------------
 /// Print to a stream.
 //-----------------------------------------------------------------------
@@ -66,5 +231,6 @@ void TwostreamRt::print(std::ostream& Os, bool Short_form) const
   SpurrRt::print(opad1, Short_form);
   opad1.strict_sync();
   Os << "do_full_quadrature = " << (rt_driver()->do_full_quadrature() ? "true" : "false") << "\n";
+  Os << "use_batch_driver = " << (batch_driver_ ? "true" : "false") << "\n";
   opad1.strict_sync();
 }
@@ -2,6 +2,7 @@
 #define TWOSTREAM_RT_H
 
 #include "twostream_driver.h"
+#include "twostream_batch_driver.h"
 #include "spurr_rt.h"
 
 namespace FullPhysics {
@@ -9,6 +10,15 @@ namespace FullPhysics {
 /****************************************************************//**
   Uses the Spurr interfaces to construct a radiative transfer
   class connecting L2 FP and TwoStream
+
+  For a Lambertian surface, stokes and stokes_and_jacobian can
+  optionally use a TwostreamBatchDriver to do a block of wavenumbers
+  at a time rather than calling the Fortran code for each
+  wavenumber. This is turned on with Use_batch_driver. The settings of the Fortran
+  interface (e.g., do_d2s_scaling, do_plane_parallel) are used by
+  both, so changing them through rt_driver() affects either path.
+  stokes_single_wn and stokes_and_jacobian_single_wn always use the
+  Fortran code.
  *******************************************************************/
 class TwostreamRt : public SpurrRt {
 public:
@@ -17,7 +27,8 @@ public:
               const blitz::Array<double, 1>& Sza, 
               const blitz::Array<double, 1>& Zen, 
               const blitz::Array<double, 1>& Azm,
-              bool do_fullquadrature = true);
+              bool do_fullquadrature = true,
+              bool Use_batch_driver = false);
 
   /// Number of quadtature streams in the cosine half space
   virtual int number_stream() const { return 1; }
@@ -33,7 +44,19 @@ public:
   const boost::shared_ptr<TwostreamRtDriver> rt_driver() const 
   { return boost::shared_ptr<TwostreamRtDriver>(boost::dynamic_pointer_cast<TwostreamRtDriver>(rt_driver_)); }
 
+  /// Batch driver object. This is null if we aren't using it (e.g.,
+  /// the surface isn't Lambertian).
+  const boost::shared_ptr<TwostreamBatchDriver>& batch_driver() const
+  { return batch_driver_; }
+
+  virtual blitz::Array<double, 2> stokes(const SpectralDomain& Spec_domain,
+                                         int Spec_index) const;
+  virtual ArrayAd<double, 2> stokes_and_jacobian
+  (const SpectralDomain& Spec_domain, int Spec_index) const;
   virtual void print(std::ostream& Os, bool Short_form = false) const;
+private:
+  boost::shared_ptr<TwostreamBatchDriver> batch_driver_;
+  void setup_batch_driver(int Spec_index) const;
 };
 }
 #endif
@@ -71,6 +71,22 @@ BOOST_AUTO_TEST_CASE(comparison)
   compare_lidort_2stream(config_atmosphere, stokes_coefs, sza, zen, azm, wn_arr, false);
 }
 
+BOOST_AUTO_TEST_CASE(batch_driver)
+{
+  // Default settings (pseudo-spherical, d2s scaling), with and
+  // without the batch driver.
+  TwostreamRt rt_batch(config_atmosphere, stokes_coefs, sza, zen, azm,
+                       true, true);
+  TwostreamRt rt_fortran(config_atmosphere, stokes_coefs, sza, zen, azm);
+  BOOST_CHECK(rt_batch.batch_driver());
+  BOOST_CHECK(!rt_fortran.batch_driver());
+  ArrayAd<double, 2> batch_rad_jac = rt_batch.stokes_and_jacobian(wn_arr, 0);
+  ArrayAd<double, 2> ts_rad_jac = rt_fortran.stokes_and_jacobian(wn_arr, 0);
+  BOOST_CHECK_MATRIX_CLOSE_TOL(batch_rad_jac.value(), ts_rad_jac.value(), 1e-10);
+  BOOST_CHECK_MATRIX_CLOSE_TOL(batch_rad_jac.jacobian(), ts_rad_jac.jacobian(), 1e-8);
+  BOOST_CHECK_MATRIX_CLOSE_TOL(rt_batch.stokes(wn_arr, 0), ts_rad_jac.value(), 1e-10);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
 
@@ -91,6 +91,19 @@ public:
   virtual ArrayAd<double, 1> 
   ssa_each_layer(double wn, int particle_index,
 		 const ArrayAd<double, 1>& Od) const = 0;
+
+//-----------------------------------------------------------------------
+/// This gives the single scatter albedo of each particle for each
+/// layer, for the given wave number. This is the value ssa_each_layer
+/// multiplies Od by, without any derivatives. AtmosphereOco uses this
+/// when it takes the derivatives with respect to the intermediate
+/// variables, since these don't depend on the single scatter albedo.
+///
+/// This has size of number_active_layer() x number_particle().
+//-----------------------------------------------------------------------
+
+  virtual blitz::Array<double, 2> particle_ssa_each_layer(double wn) 
+    const = 0;
 };
 }
 #endif
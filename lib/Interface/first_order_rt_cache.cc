@@ -0,0 +1,217 @@
+#include "first_order_rt_cache.h"
+#include "fp_exception.h"
+#include <cmath>
+#include <algorithm>
+using namespace FullPhysics;
+using namespace blitz;
+
+#ifdef HAVE_LUA
+#include "register_lua.h"
+REGISTER_LUA_CLASS(FirstOrderRtCache)
+.def(luabind::constructor<>())
+.def(luabind::constructor<double>())
+.def(luabind::constructor<double, double>())
+.def(luabind::constructor<double, double, int>())
+.def(luabind::constructor<double, double, int, double>())
+.def("clear", &FirstOrderRtCache::clear)
+REGISTER_LUA_END()
+#endif
+
+//-----------------------------------------------------------------------
+/// Constructor.
+///
+/// \param Threshold Largest relative change in the inputs for which
+///   we predict the radiance.
+/// \param Error_tolerance Largest relative error we accept when
+///   checking a prediction against the full calculation. If a check
+///   fails, we cut the threshold in half.
+/// \param Check_interval Number of predicted wavenumbers between
+///   checks against the full calculation. 0 turns the check off.
+/// \param Floor Added to the absolute value of each input when
+///   calculating the relative change.
+//-----------------------------------------------------------------------
+
+FirstOrderRtCache::FirstOrderRtCache(double Threshold, double Error_tolerance,
+				     int Check_interval, double Floor)
+: threshold_(Threshold), error_tolerance_(Error_tolerance), floor_(Floor),
+  check_interval_(Check_interval),
+  nfull(0), npredict(0), ncheck(0), ncheck_fail(0), since_check(0),
+  max_check_err(0), check_pending(false)
+{
+  if(Threshold < 0 || Error_tolerance < 0 || Check_interval < 0 ||
+     Floor <= 0)
+    throw Exception("Threshold, Error_tolerance and Check_interval need to be >= 0, and Floor > 0");
+}
+
+//-----------------------------------------------------------------------
+/// Remove all the saved values. This should be called before using
+/// the RadiativeTransfer for a new sounding. The statistics are kept.
+//-----------------------------------------------------------------------
+
+void FirstOrderRtCache::clear()
+{
+  entry.clear();
+  check_pending = false;
+}
+
+//-----------------------------------------------------------------------
+/// Largest relative change between X and X_old.
+//-----------------------------------------------------------------------
+
+double FirstOrderRtCache::relative_change(const Array<double, 2>& X,
+					  const Array<double, 2>& X_old) const
+{
+  double res = 0;
+  for(int i = 0; i < X.rows(); ++i)
+    for(int j = 0; j < X.cols(); ++j)
+      res = std::max(res, fabs(X(i, j) - X_old(i, j)) /
+		     (fabs(X_old(i, j)) + floor_));
+  return res;
+}
+
+double FirstOrderRtCache::relative_change(const Array<double, 1>& X,
+					  const Array<double, 1>& X_old) const
+{
+  double res = 0;
+  for(int i = 0; i < X.rows(); ++i)
+    res = std::max(res, fabs(X(i) - X_old(i)) / (fabs(X_old(i)) + floor_));
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Try to predict the radiance for the given wavenumber.
+///
+/// \param Spec_index The spectrometer index
+/// \param Wn The wavenumber
+/// \param Iv The intermediate variables, number_layer() x number
+///   intermediate variables.
+/// \param Surface The surface inputs to the radiative transfer.
+/// \param Key Other inputs to the radiative transfer that we don't
+///   have the Jacobian for (e.g., the layer altitudes and the
+///   viewing geometry). These need to be within threshold() of the
+///   saved values, and the prediction ignores any change in them.
+/// \param Rad Return the predicted radiance.
+/// \param Jac_atm Return the Jacobian of the radiance with respect to
+///   the intermediate variables. Note that like the Jacobian returned
+///   by SpurrRtDriver::copy_jacobians this is number intermediate
+///   variables x number_layer(). This shares memory with our saved
+///   values, so it shouldn't be modified.
+/// \param Jac_surf Return the Jacobian of the radiance with respect to
+///   the surface inputs. This also shares memory with our saved
+///   values.
+/// \return true if we predicted the radiance. If this is false, then
+///   you should run the full radiative transfer and then call store.
+//-----------------------------------------------------------------------
+
+bool FirstOrderRtCache::predict
+(int Spec_index, double Wn, const Array<double, 2>& Iv,
+ const Array<double, 1>& Surface, const Array<double, 1>& Key,
+ double& Rad, Array<double, 2>& Jac_atm, Array<double, 1>& Jac_surf)
+{
+  check_pending = false;
+  if(Spec_index < 0 || Spec_index >= (int) entry.size())
+    return false;
+  std::map<double, Entry>::const_iterator i = entry[Spec_index].find(Wn);
+  if(i == entry[Spec_index].end())
+    return false;
+  const Entry& e = i->second;
+  if(e.iv.rows() != Iv.rows() || e.iv.cols() != Iv.cols() ||
+     e.surface.rows() != Surface.rows() || e.key.rows() != Key.rows())
+    return false;
+  if(relative_change(Iv, e.iv) > threshold_ ||
+     relative_change(Surface, e.surface) > threshold_ ||
+     relative_change(Key, e.key) > threshold_)
+    return false;
+  // We can't predict a change in a surface input we don't have the
+  // Jacobian for.
+  int nsurf = std::min(e.jac_surf.rows(), Surface.rows());
+  for(int k = nsurf; k < Surface.rows(); ++k)
+    if(Surface(k) != e.surface(k))
+      return false;
+
+  double r = e.rad;
+  for(int n = 0; n < Iv.cols(); ++n)
+    for(int m = 0; m < Iv.rows(); ++m)
+      r += e.jac_atm(n, m) * (Iv(m, n) - e.iv(m, n));
+  for(int k = 0; k < nsurf; ++k)
+    r += e.jac_surf(k) * (Surface(k) - e.surface(k));
+
+  // Every so often, check the prediction against the full
+  // calculation. store does the actual comparison.
+  if(check_interval_ > 0 && ++since_check >= check_interval_) {
+    since_check = 0;
+    check_pending = true;
+    check_spec_index = Spec_index;
+    check_wn = Wn;
+    check_rad = r;
+    return false;
+  }
+  Rad = r;
+  Jac_atm.reference(e.jac_atm);
+  Jac_surf.reference(e.jac_surf);
+  ++npredict;
+  return true;
+}
+
+//-----------------------------------------------------------------------
+/// Save the results of a full radiative transfer calculation. The
+/// arguments are the same as predict. If predict asked for a check
+/// of this wavenumber, we also compare the full calculation with
+/// the prediction here.
+//-----------------------------------------------------------------------
+
+void FirstOrderRtCache::store
+(int Spec_index, double Wn, const Array<double, 2>& Iv,
+ const Array<double, 1>& Surface, const Array<double, 1>& Key,
+ double Rad, const Array<double, 2>& Jac_atm, const Array<double, 1>& Jac_surf)
+{
+  range_min_check(Spec_index, 0);
+  ++nfull;
+  if(check_pending && Spec_index == check_spec_index && Wn == check_wn) {
+    ++ncheck;
+    double err = (Rad == 0 ? fabs(check_rad) :
+		  fabs(check_rad - Rad) / fabs(Rad));
+    max_check_err = std::max(max_check_err, err);
+    if(err > error_tolerance_) {
+      ++ncheck_fail;
+      threshold_ /= 2;
+    }
+  }
+  check_pending = false;
+  // Can't use this for predicting if we don't have the full
+  // Jacobian (e.g., the intermediate variables were constant).
+  if(Jac_atm.rows() < Iv.cols() || Jac_atm.cols() < Iv.rows())
+    return;
+  if(Spec_index >= (int) entry.size())
+    entry.resize(Spec_index + 1);
+  Entry& e = entry[Spec_index][Wn];
+  e.iv.resize(Iv.shape());
+  e.iv = Iv;
+  e.surface.resize(Surface.shape());
+  e.surface = Surface;
+  e.key.resize(Key.shape());
+  e.key = Key;
+  e.rad = Rad;
+  e.jac_atm.resize(Jac_atm.shape());
+  e.jac_atm = Jac_atm;
+  e.jac_surf.resize(Jac_surf.shape());
+  e.jac_surf = Jac_surf;
+}
+
+//-----------------------------------------------------------------------
+/// Print to a stream.
+//-----------------------------------------------------------------------
+
+void FirstOrderRtCache::print(std::ostream& Os) const
+{
+  Os << "FirstOrderRtCache:\n"
+     << "  Threshold:           " << threshold() << "\n"
+     << "  Error tolerance:     " << error_tolerance() << "\n"
+     << "  Check interval:      " << check_interval() << "\n"
+     << "  Floor:               " << floor() << "\n"
+     << "  Number full:         " << number_full() << "\n"
+     << "  Number predicted:    " << number_predicted() << "\n"
+     << "  Number checked:      " << number_checked() << "\n"
+     << "  Number check failed: " << number_check_failed() << "\n"
+     << "  Max check error:     " << max_check_error() << "\n";
+}
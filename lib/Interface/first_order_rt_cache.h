@@ -0,0 +1,161 @@
+#ifndef FIRST_ORDER_RT_CACHE_H
+#define FIRST_ORDER_RT_CACHE_H
+#include "printable.h"
+#include <blitz/array.h>
+#include <map>
+#include <vector>
+
+namespace FullPhysics {
+/****************************************************************//**
+  In the last few iterations of a retrieval the state vector barely
+  changes, but we still run the full radiative transfer for every
+  wavenumber each time.
+
+  This class saves the inputs and results of the radiative transfer
+  for each wavenumber: the intermediate variables (e.g., taug, taur,
+  taua_i), the surface inputs, the radiance, and the Jacobian of
+  the radiance with respect to the intermediate variables and the
+  surface inputs. When the inputs for a wavenumber are close to the
+  saved ones, we predict the radiance from the first order Taylor
+  expansion about the saved values instead of running the radiative
+  transfer. The saved Jacobians are used as the Jacobian at the new
+  inputs. The RadiativeTransfer then applies the chain rule with the
+  current Jacobian of the inputs, just like for a full calculation.
+
+  We only predict if the relative change of every input is less
+  than threshold(). The change is relative to the absolute value of
+  the saved input plus floor(), so tiny inputs (e.g., the optical
+  depth in the upper layers) need a change of more than threshold()
+  * floor() before we run the full radiative transfer. We never
+  update the saved values when we predict, so the change builds up
+  over the iterations until it is large enough to force a full
+  calculation.
+
+  As a check, every check_interval() wavenumbers that we could have
+  predicted we run the full calculation anyway and compare it with
+  the prediction. If the relative error is larger than
+  error_tolerance(), we cut threshold() in half. The statistics are
+  available for logging (see print).
+
+  The radiative transfer also depends on inputs we don't have the
+  Jacobian for, the layer altitudes and the viewing geometry. These
+  are passed as a "key", which also needs to be within threshold()
+  of the saved key before we predict. The prediction ignores the
+  change in the key. For a retrieval the altitudes change only a
+  little with the surface pressure and temperature in the last
+  iterations, and the geometry doesn't change at all, so this is
+  a small error that the check described below guards against.
+
+  You should still call clear() if you reuse the RadiativeTransfer
+  for a new sounding, since there is no reason to keep the old
+  values around. The memory used is a few times number_layer() x
+  number intermediate variables doubles per wavenumber.
+
+  The RadiativeTransfer drives this by calling predict, and if that
+  returns false running the full calculation and calling store.
+*******************************************************************/
+class FirstOrderRtCache : public Printable<FirstOrderRtCache> {
+public:
+  FirstOrderRtCache(double Threshold = 1e-3, double Error_tolerance = 1e-4,
+		    int Check_interval = 100, double Floor = 1e-4);
+  virtual ~FirstOrderRtCache() {}
+
+//-----------------------------------------------------------------------
+/// Largest relative change in the inputs for which we predict the
+/// radiance rather than running the full radiative transfer.
+//-----------------------------------------------------------------------
+
+  double threshold() const { return threshold_; }
+  void threshold(double V) { threshold_ = V; }
+
+//-----------------------------------------------------------------------
+/// Largest relative error between the prediction and the full
+/// calculation we accept when we check the prediction.
+//-----------------------------------------------------------------------
+
+  double error_tolerance() const { return error_tolerance_; }
+
+//-----------------------------------------------------------------------
+/// Number of predicted wavenumbers between checks against the full
+/// calculation.
+//-----------------------------------------------------------------------
+
+  int check_interval() const { return check_interval_; }
+
+//-----------------------------------------------------------------------
+/// Floor added to the absolute value of an input when calculating
+/// the relative change.
+//-----------------------------------------------------------------------
+
+  double floor() const { return floor_; }
+
+//-----------------------------------------------------------------------
+/// Number of wavenumbers where we ran the full radiative transfer.
+//-----------------------------------------------------------------------
+
+  int number_full() const { return nfull; }
+
+//-----------------------------------------------------------------------
+/// Number of wavenumbers where we used the prediction.
+//-----------------------------------------------------------------------
+
+  int number_predicted() const { return npredict; }
+
+//-----------------------------------------------------------------------
+/// Number of times we compared the prediction with the full
+/// calculation.
+//-----------------------------------------------------------------------
+
+  int number_checked() const { return ncheck; }
+
+//-----------------------------------------------------------------------
+/// Number of checks that failed (i.e., the error was larger than
+/// error_tolerance()).
+//-----------------------------------------------------------------------
+
+  int number_check_failed() const { return ncheck_fail; }
+
+//-----------------------------------------------------------------------
+/// Largest relative error we found when checking the predictions.
+//-----------------------------------------------------------------------
+
+  double max_check_error() const { return max_check_err; }
+
+  void clear();
+  bool predict(int Spec_index, double Wn, const blitz::Array<double, 2>& Iv,
+	       const blitz::Array<double, 1>& Surface,
+	       const blitz::Array<double, 1>& Key, double& Rad,
+	       blitz::Array<double, 2>& Jac_atm,
+	       blitz::Array<double, 1>& Jac_surf);
+  void store(int Spec_index, double Wn, const blitz::Array<double, 2>& Iv,
+	     const blitz::Array<double, 1>& Surface,
+	     const blitz::Array<double, 1>& Key, double Rad,
+	     const blitz::Array<double, 2>& Jac_atm,
+	     const blitz::Array<double, 1>& Jac_surf);
+  virtual void print(std::ostream& Os) const;
+private:
+  struct Entry {
+    blitz::Array<double, 2> iv;
+    blitz::Array<double, 1> surface;
+    blitz::Array<double, 1> key;
+    double rad;
+    blitz::Array<double, 2> jac_atm;
+    blitz::Array<double, 1> jac_surf;
+  };
+  // Saved values, indexed by spectrometer and then wavenumber.
+  std::vector<std::map<double, Entry> > entry;
+  double threshold_, error_tolerance_, floor_;
+  int check_interval_;
+  int nfull, npredict, ncheck, ncheck_fail, since_check;
+  double max_check_err;
+  // Prediction we are checking against the full calculation.
+  bool check_pending;
+  int check_spec_index;
+  double check_wn, check_rad;
+  double relative_change(const blitz::Array<double, 2>& X,
+			 const blitz::Array<double, 2>& X_old) const;
+  double relative_change(const blitz::Array<double, 1>& X,
+			 const blitz::Array<double, 1>& X_old) const;
+};
+}
+#endif
@@ -0,0 +1,133 @@
+#include "first_order_rt_cache.h"
+#include "unit_test_support.h"
+
+using namespace FullPhysics;
+using namespace blitz;
+
+/// @cond
+// Simple stand in for the radiative transfer, R = S * exp(-sum(Iv)).
+class FirstOrderRtCacheFixture : public GlobalFixture {
+public:
+  FirstOrderRtCacheFixture() : iv(3, 2), surf(1), key(2), jac_atm(2, 3), 
+    jac_surf(1)
+  {
+    iv = 0.1, 0.2,
+      0.3, 0.4,
+      0.5, 0.6;
+    surf = 0.3;
+    key = 1.0, 2.0;
+  }
+  void full(const Array<double, 2>& Iv, const Array<double, 1>& S)
+  {
+    rad = S(0) * std::exp(-sum(Iv));
+    jac_atm = -rad;
+    jac_surf = rad / S(0);
+  }
+  Array<double, 2> iv;
+  Array<double, 1> surf;
+  Array<double, 1> key;
+  double rad;
+  Array<double, 2> jac_atm;
+  Array<double, 1> jac_surf;
+};
+/// @endcond
+
+BOOST_FIXTURE_TEST_SUITE(first_order_rt_cache, FirstOrderRtCacheFixture)
+
+BOOST_AUTO_TEST_CASE(predict)
+{
+  FirstOrderRtCache c(1e-3, 1e-4, 0);
+  double r;
+  Array<double, 2> ja;
+  Array<double, 1> js;
+  // Nothing saved yet
+  BOOST_CHECK(!c.predict(0, 13000.0, iv, surf, key, r, ja, js));
+  full(iv, surf);
+  c.store(0, 13000.0, iv, surf, key, rad, jac_atm, jac_surf);
+  BOOST_CHECK_EQUAL(c.number_full(), 1);
+
+  // Small change, we should predict
+  Array<double, 2> iv2(iv.copy());
+  iv2(1, 0) *= 1 + 5e-4;
+  Array<double, 1> surf2(surf.copy());
+  surf2(0) *= 1 - 5e-4;
+  BOOST_CHECK(c.predict(0, 13000.0, iv2, surf2, key, r, ja, js));
+  BOOST_CHECK_EQUAL(c.number_predicted(), 1);
+  full(iv2, surf2);
+  BOOST_CHECK_CLOSE(r, rad, 1e-4);
+  BOOST_CHECK_EQUAL(ja.rows(), 2);
+  BOOST_CHECK_EQUAL(ja.cols(), 3);
+  BOOST_CHECK_EQUAL(js.rows(), 1);
+
+  // Nothing saved for a different wavenumber or spectrometer
+  BOOST_CHECK(!c.predict(0, 13000.01, iv2, surf2, key, r, ja, js));
+  BOOST_CHECK(!c.predict(1, 13000.0, iv2, surf2, key, r, ja, js));
+
+  // Key (e.g., the layer altitudes) changed too much, or changed size
+  Array<double, 1> key2(key.copy());
+  key2(1) *= 1.01;
+  BOOST_CHECK(!c.predict(0, 13000.0, iv2, surf2, key2, r, ja, js));
+  key2(1) = key(1) * (1 + 5e-4);
+  BOOST_CHECK(c.predict(0, 13000.0, iv2, surf2, key2, r, ja, js));
+  BOOST_CHECK(!c.predict(0, 13000.0, iv2, surf2, Array<double, 1>(3), r, 
+			 ja, js));
+
+  // Large change, need full calculation
+  iv2(1, 0) *= 1.01;
+  BOOST_CHECK(!c.predict(0, 13000.0, iv2, surf2, key, r, ja, js));
+
+  // Different number of layers
+  Array<double, 2> iv3(4, 2);
+  iv3 = 0.1;
+  BOOST_CHECK(!c.predict(0, 13000.0, iv3, surf, key, r, ja, js));
+
+  c.clear();
+  BOOST_CHECK(!c.predict(0, 13000.0, iv, surf, key, r, ja, js));
+  BOOST_CHECK_EQUAL(c.number_predicted(), 2);
+}
+
+BOOST_AUTO_TEST_CASE(constant_iv)
+{
+  // If we don't have the Jacobian, we can't save the results.
+  FirstOrderRtCache c;
+  double r;
+  Array<double, 2> ja;
+  Array<double, 1> js;
+  full(iv, surf);
+  c.store(0, 13000.0, iv, surf, key, rad, Array<double, 2>(), jac_surf);
+  BOOST_CHECK(!c.predict(0, 13000.0, iv, surf, key, r, ja, js));
+}
+
+BOOST_AUTO_TEST_CASE(check)
+{
+  FirstOrderRtCache c(1e-2, 1e-8, 2);
+  double r;
+  Array<double, 2> ja;
+  Array<double, 1> js;
+  full(iv, surf);
+  c.store(0, 13000.0, iv, surf, key, rad, jac_atm, jac_surf);
+  Array<double, 2> iv2(iv.copy());
+  iv2(0, 0) *= 1 + 5e-3;
+  BOOST_CHECK(c.predict(0, 13000.0, iv2, surf, key, r, ja, js));
+  // Second prediction gets checked against the full calculation
+  BOOST_CHECK(!c.predict(0, 13000.0, iv2, surf, key, r, ja, js));
+  full(iv2, surf);
+  c.store(0, 13000.0, iv2, surf, key, rad, jac_atm, jac_surf);
+  BOOST_CHECK_EQUAL(c.number_checked(), 1);
+  BOOST_CHECK_EQUAL(c.number_check_failed(), 1);
+  BOOST_CHECK(c.max_check_error() > 1e-8);
+  BOOST_CHECK_CLOSE(c.threshold(), 5e-3, 1e-8);
+
+  // Tolerance loose enough to pass
+  FirstOrderRtCache c2(1e-2, 1e-4, 1);
+  full(iv, surf);
+  c2.store(0, 13000.0, iv, surf, key, rad, jac_atm, jac_surf);
+  BOOST_CHECK(!c2.predict(0, 13000.0, iv2, surf, key, r, ja, js));
+  full(iv2, surf);
+  c2.store(0, 13000.0, iv2, surf, key, rad, jac_atm, jac_surf);
+  BOOST_CHECK_EQUAL(c2.number_checked(), 1);
+  BOOST_CHECK_EQUAL(c2.number_check_failed(), 0);
+  BOOST_CHECK_CLOSE(c2.threshold(), 1e-2, 1e-8);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -12,6 +12,8 @@
 %import "state_vector.i"
 %import "spectrum.i"
 
+%python_release_gil(FullPhysics::ForwardModel::radiance);
+%python_release_gil(FullPhysics::ForwardModel::radiance_all);
 %fp_shared_ptr(FullPhysics::ForwardModel)
 
 namespace FullPhysics {
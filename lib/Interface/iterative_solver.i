@@ -6,6 +6,7 @@
 %}
 
 %base_import(generic_object)
+%python_release_gil(FullPhysics::IterativeSolver::solve);
 %fp_shared_ptr(FullPhysics::IterativeSolver);
 
 namespace FullPhysics {
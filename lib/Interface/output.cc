@@ -1,5 +1,11 @@
 #include "output.h"
+#include "output_manifest.h"
+#include "profiler.h"
 #include <boost/foreach.hpp>
+#include <boost/chrono.hpp>
+#include <algorithm>
+#include <iomanip>
+#include <vector>
 
 using namespace FullPhysics;
 using namespace blitz;
@@ -9,12 +15,19 @@ using namespace blitz;
 //-----------------------------------------------------------------------
 
 template<class T> 
-void Output::pass_to_write_t(const std::string& Dataset_name, boost::any* D)
+void Output::pass_to_write_t(const std::string& Dataset_name, 
+			     const boost::any* D)
 {
   typedef typename boost::function<T ()> T2;
   if(boost::any_cast<T2>(D)) {
-    T2* t = boost::any_cast<T2>(D);
-    write_data(Dataset_name, (*t)());
+    const T2* t = boost::any_cast<T2>(D);
+    boost::chrono::steady_clock::time_point 
+      tstart = boost::chrono::steady_clock::now();
+    T v = (*t)();
+    boost::chrono::duration<double> tm = 
+      boost::chrono::steady_clock::now() - tstart;
+    add_evaluation_time(Dataset_name, tm.count());
+    write_data(Dataset_name, v);
   }
 }
 
@@ -22,7 +35,8 @@ void Output::pass_to_write_t(const std::string& Dataset_name, boost::any* D)
 /// Go through the various supported types, and write out the data.
 //-----------------------------------------------------------------------
 
-void Output::pass_to_write(const std::string& Dataset_name, boost::any* D)
+void Output::pass_to_write(const std::string& Dataset_name, 
+			   const boost::any* D)
 {
 //-----------------------------------------------------------------------
 /// Go through each type. Only one of these will actually write and
@@ -61,11 +75,13 @@ void Output::pass_to_write(const std::string& Dataset_name, boost::any* D)
 
 void Output::write()
 {
+  FP_PROFILE_SCOPE("Output write");
   try {
     start_write();
     typedef std::map<std::string, boost::any>::value_type vtype;
-    BOOST_FOREACH(vtype& p, func)
-      pass_to_write(p.first, &p.second);
+    BOOST_FOREACH(const vtype& p, func)
+      if(dataset_enabled(p.first))
+	pass_to_write(p.first, &p.second);
     end_write();
   } catch(...) {
     try {
@@ -85,15 +101,111 @@ void Output::write()
 
 void Output::write_best_attempt()
 {
+  FP_PROFILE_SCOPE("Output write");
   try {
     start_write();
     typedef std::map<std::string, boost::any>::value_type vtype;
-    BOOST_FOREACH(vtype& p, func)
+    BOOST_FOREACH(const vtype& p, func)
       try {
-	pass_to_write(p.first, &p.second);
+	if(dataset_enabled(p.first))
+	  pass_to_write(p.first, &p.second);
       } catch(...) {		// Ignore all errors
       }
     end_write();
   } catch(...) {		// Ignore all errors.
   }
 }
+
+//-----------------------------------------------------------------------
+/// Set the OutputManifest used to select the datasets we produce. Any
+/// data sources already registered for datasets that are disabled
+/// are removed. You can pass a null pointer to produce all datasets.
+//-----------------------------------------------------------------------
+
+void Output::manifest(const boost::shared_ptr<OutputManifest>& M)
+{
+  manifest_ = M;
+  std::map<std::string, boost::any>::iterator i = func.begin();
+  while(i != func.end())
+    if(!dataset_enabled(i->first))
+      func.erase(i++);
+    else
+      ++i;
+}
+
+//-----------------------------------------------------------------------
+/// Return true if we produce the given dataset.
+//-----------------------------------------------------------------------
+
+bool Output::dataset_enabled(const std::string& Dataset_name) const
+{
+  return !manifest_ || manifest_->enabled(Dataset_name);
+}
+
+void Output::add_evaluation_time(const std::string& Dataset_name, 
+				 double Elapsed)
+{
+  std::pair<double, int>& t = eval_time[Dataset_name];
+  t.first += Elapsed;
+  t.second += 1;
+}
+
+//-----------------------------------------------------------------------
+/// Total wall clock time in seconds spent evaluating the data source
+/// for the given dataset, since this object was created or
+/// reset_evaluation_time was last called. 
+///
+/// This is recorded by write and write_best_attempt.
+//-----------------------------------------------------------------------
+
+double Output::evaluation_time(const std::string& Dataset_name) const
+{
+  std::map<std::string, std::pair<double, int> >::const_iterator i =
+    eval_time.find(Dataset_name);
+  if(i == eval_time.end())
+    return 0.0;
+  return i->second.first;
+}
+
+//-----------------------------------------------------------------------
+/// Reset the evaluation times to 0.
+//-----------------------------------------------------------------------
+
+void Output::reset_evaluation_time()
+{
+  eval_time.clear();
+}
+
+// Don't have Doxygen document this function.
+/// @cond
+static bool greater_eval_time
+(const std::pair<std::string, std::pair<double, int> >& A,
+ const std::pair<std::string, std::pair<double, int> >& B)
+{
+  return A.second.first > B.second.first;
+}
+/// @endcond
+
+//-----------------------------------------------------------------------
+/// Print a report of the time spent evaluating each data source,
+/// most expensive first. This can be used to find output that is
+/// expensive to produce, which might then be turned off with an
+/// OutputManifest.
+//-----------------------------------------------------------------------
+
+void Output::print_evaluation_time(std::ostream& Os) const
+{
+  std::vector<std::pair<std::string, std::pair<double, int> > > 
+    t(eval_time.begin(), eval_time.end());
+  std::stable_sort(t.begin(), t.end(), greater_eval_time);
+  double total = 0;
+  for(int i = 0; i < (int) t.size(); ++i)
+    total += t[i].second.first;
+  Os << "Output evaluation time (seconds, number of evaluations, dataset):\n";
+  for(int i = 0; i < (int) t.size(); ++i)
+    Os << "  " << std::fixed << std::setprecision(4) << std::setw(10) 
+       << t[i].second.first << " " << std::setw(5) << t[i].second.second
+       << " " << t[i].first << "\n";
+  Os << "  " << std::fixed << std::setprecision(4) << std::setw(10)
+     << total << " Total\n";
+}
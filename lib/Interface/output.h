@@ -12,6 +12,8 @@
 #include <stdint.h>
 
 namespace FullPhysics {
+class OutputManifest;
+
 // Helper class to handle level padding.
 // Don't have Doxygen document this class.
 /// @cond
@@ -97,6 +99,17 @@ private:
   out whatever we can, ignoring all errors. This can results in
   partial files, but in the case of a diagnostic file whatever we can
   get is better than nothing.
+
+  You can supply an OutputManifest to turn off datasets that aren't
+  wanted. Data sources for disabled datasets are dropped when they
+  are registered, so they are never evaluated. Note that the manifest
+  should be set before the data sources are registered. A data source
+  registered before that is still skipped when writing, but anything
+  calculated at registration time has already been done.
+
+  We keep track of the time spent evaluating each data source, see
+  print_evaluation_time. This can be used to find the output that is
+  expensive to produce.
 *******************************************************************/
 
 class Output : public Printable<Output> {
@@ -199,7 +212,29 @@ public:
   template<class T> 
   void register_data_source(const std::string& Dataset_name,
 			    boost::function<T> f)
-  { func[Dataset_name] = f;}
+  { 
+    if(dataset_enabled(Dataset_name))
+      func[Dataset_name] = f;
+  }
+
+//-----------------------------------------------------------------------
+/// OutputManifest used to select the datasets we produce. This may be
+/// a null pointer, in which case all datasets are produced.
+//-----------------------------------------------------------------------
+
+  const boost::shared_ptr<OutputManifest>& manifest() const 
+  { return manifest_; }
+  void manifest(const boost::shared_ptr<OutputManifest>& M);
+  bool dataset_enabled(const std::string& Dataset_name) const;
+
+//-----------------------------------------------------------------------
+/// Number of data sources registered.
+//-----------------------------------------------------------------------
+
+  int number_data_source() const { return (int) func.size(); }
+  double evaluation_time(const std::string& Dataset_name) const;
+  void print_evaluation_time(std::ostream& Os) const;
+  void reset_evaluation_time();
   void write();
   void write_best_attempt();
 protected:
@@ -261,9 +296,14 @@ protected:
 		  const blitz::Array<double, 3>& Val) = 0;
 private:
   template<class T> 
-  void pass_to_write_t(const std::string& Dataset_name, boost::any* D);
-  void pass_to_write(const std::string& Dataset_name, boost::any* D);
+  void pass_to_write_t(const std::string& Dataset_name, const boost::any* D);
+  void pass_to_write(const std::string& Dataset_name, const boost::any* D);
+  void add_evaluation_time(const std::string& Dataset_name, double Elapsed);
   std::map<std::string, boost::any> func;
+  boost::shared_ptr<OutputManifest> manifest_;
+  // Total time spent evaluating each data source, and the number of
+  // times it was evaluated.
+  std::map<std::string, std::pair<double, int> > eval_time;
 };
 
 /****************************************************************//**
@@ -0,0 +1,79 @@
+#include "output_manifest.h"
+#include "fp_exception.h"
+
+using namespace FullPhysics;
+
+#ifdef HAVE_LUA
+#include "register_lua.h"
+REGISTER_LUA_CLASS(OutputManifest)
+.def(luabind::constructor<>())
+.def(luabind::constructor<bool>())
+.def("enable", &OutputManifest::enable)
+.def("disable", &OutputManifest::disable)
+.def("enabled", &OutputManifest::enabled)
+.def("number_rule", &OutputManifest::number_rule)
+REGISTER_LUA_END()
+#endif
+
+//-----------------------------------------------------------------------
+/// Add a rule enabling all datasets that match the given regular
+/// expression.
+//-----------------------------------------------------------------------
+
+void OutputManifest::enable(const std::string& Pattern)
+{
+  add_rule(Pattern, true);
+}
+
+//-----------------------------------------------------------------------
+/// Add a rule disabling all datasets that match the given regular
+/// expression.
+//-----------------------------------------------------------------------
+
+void OutputManifest::disable(const std::string& Pattern)
+{
+  add_rule(Pattern, false);
+}
+
+void OutputManifest::add_rule(const std::string& Pattern, bool Enable)
+{
+  try {
+    re.push_back(boost::regex(Pattern));
+  } catch(const boost::regex_error& err) {
+    Exception e;
+    e << "Bad regular expression \"" << Pattern << "\" in OutputManifest: "
+      << err.what();
+    throw e;
+  }
+  pattern.push_back(Pattern);
+  enable_flag.push_back(Enable);
+  cache.clear();
+}
+
+//-----------------------------------------------------------------------
+/// Return true if the given dataset should be produced.
+//-----------------------------------------------------------------------
+
+bool OutputManifest::enabled(const std::string& Dataset_name) const
+{
+  std::map<std::string, bool>::const_iterator i = cache.find(Dataset_name);
+  if(i != cache.end())
+    return i->second;
+  bool res = default_enabled_;
+  for(int j = (int) re.size() - 1; j >= 0; --j)
+    if(boost::regex_search(Dataset_name, re[j])) {
+      res = enable_flag[j];
+      break;
+    }
+  cache[Dataset_name] = res;
+  return res;
+}
+
+void OutputManifest::print(std::ostream& Os) const
+{
+  Os << "OutputManifest:\n"
+     << "  Default: " << (default_enabled_ ? "enabled" : "disabled") << "\n";
+  for(int i = 0; i < number_rule(); ++i)
+    Os << "  " << (enable_flag[i] ? "enable  " : "disable ") << pattern[i]
+       << "\n";
+}
@@ -0,0 +1,75 @@
+#ifndef OUTPUT_MANIFEST_H
+#define OUTPUT_MANIFEST_H
+#include "printable.h"
+#include <boost/regex.hpp>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace FullPhysics {
+/****************************************************************//**
+  This is a list of rules saying which datasets an Output should
+  produce.
+
+  Each rule is a regular expression and a flag saying if datasets
+  matching it are enabled or disabled. The rules are checked in the
+  order they were added, and the last rule that matches a dataset
+  name wins. A dataset that doesn't match any rule gets the default
+  given in the constructor. The regular expression only needs to
+  match part of the name (e.g., "xco2_gain_vector" matches
+  "/RetrievalResults/xco2_gain_vector"), use "^" and "$" if you want
+  to match the full name.
+
+  So for example to turn off everything in "/RetrievalResults" except
+  for the xco2 fields you would do:
+
+  \code
+    m.disable("^/RetrievalResults/");
+    m.enable("^/RetrievalResults/xco2");
+  \endcode
+
+  A dataset that is disabled is never registered with the Output
+  (see Output::register_data_source), so the function that calculates
+  it is never called. This allows us to skip expensive products
+  (e.g., averaging kernels) that aren't needed.
+
+  This is not thread safe, enabled() caches its results.
+*******************************************************************/
+
+class OutputManifest : public Printable<OutputManifest> {
+public:
+//-----------------------------------------------------------------------
+/// Constructor. Default_enabled is used for datasets that don't match
+/// any of the rules.
+//-----------------------------------------------------------------------
+
+  OutputManifest(bool Default_enabled = true)
+    : default_enabled_(Default_enabled) {}
+  virtual ~OutputManifest() {}
+  void enable(const std::string& Pattern);
+  void disable(const std::string& Pattern);
+  bool enabled(const std::string& Dataset_name) const;
+
+//-----------------------------------------------------------------------
+/// Value used for datasets that don't match any rule.
+//-----------------------------------------------------------------------
+
+  bool default_enabled() const { return default_enabled_; }
+
+//-----------------------------------------------------------------------
+/// Number of rules we have.
+//-----------------------------------------------------------------------
+
+  int number_rule() const { return (int) pattern.size(); }
+  virtual void print(std::ostream& Os) const;
+private:
+  bool default_enabled_;
+  std::vector<std::string> pattern;
+  std::vector<boost::regex> re;
+  std::vector<bool> enable_flag;
+  // Results of enabled, so we only match a dataset name once.
+  mutable std::map<std::string, bool> cache;
+  void add_rule(const std::string& Pattern, bool Enable);
+};
+}
+#endif
@@ -0,0 +1,40 @@
+#include "unit_test_support.h"
+#include "output_manifest.h"
+
+using namespace FullPhysics;
+
+BOOST_FIXTURE_TEST_SUITE(output_manifest, GlobalFixture)
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  OutputManifest m;
+  BOOST_CHECK(m.enabled("/RetrievalResults/xco2_gain_vector"));
+  m.disable("^/RetrievalResults/");
+  m.enable("^/RetrievalResults/xco2");
+  m.disable("gain_vector$");
+  BOOST_CHECK_EQUAL(m.number_rule(), 3);
+  BOOST_CHECK(m.enabled("/SpectralParameters/modeled_radiance"));
+  BOOST_CHECK(!m.enabled("/RetrievalResults/averaging_kernel_matrix"));
+  BOOST_CHECK(m.enabled("/RetrievalResults/xco2_uncert"));
+  BOOST_CHECK(!m.enabled("/RetrievalResults/xco2_gain_vector"));
+  // Adding a rule should throw away any cached results.
+  m.enable("xco2_gain_vector");
+  BOOST_CHECK(m.enabled("/RetrievalResults/xco2_gain_vector"));
+}
+
+BOOST_AUTO_TEST_CASE(default_disabled)
+{
+  OutputManifest m(false);
+  m.enable("^/Metadata/");
+  BOOST_CHECK(m.enabled("/Metadata/SoundingId"));
+  BOOST_CHECK(!m.enabled("/RetrievalResults/xco2"));
+}
+
+BOOST_AUTO_TEST_CASE(bad_pattern)
+{
+  OutputManifest m;
+  BOOST_CHECK_THROW(m.disable("[unclosed"), Exception);
+  BOOST_CHECK_EQUAL(m.number_rule(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
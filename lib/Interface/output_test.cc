@@ -1,5 +1,6 @@
 #include "unit_test_support.h"
 #include "output.h"
+#include "output_manifest.h"
 
 using namespace FullPhysics;
 
@@ -81,4 +82,29 @@ BOOST_AUTO_TEST_CASE(read)
   BOOST_CHECK_EQUAL(ot.val["C2"], 2);
 }
 
+BOOST_AUTO_TEST_CASE(manifest)
+{
+  OutputTest ot;
+  boost::shared_ptr<CalcData> c1(new CalcData(1));
+  boost::shared_ptr<CalcData> c2(new CalcData(2));
+  boost::shared_ptr<OutputManifest> m(new OutputManifest);
+  m->disable("C2");
+  ot.register_data_source("C2", &CalcData::d_val, c2);
+  ot.manifest(m);
+  ot.register_data_source("C1", &CalcData::d_val, c1);
+  ot.register_data_source("C2", &CalcData::d_val, c2);
+  BOOST_CHECK_EQUAL(ot.number_data_source(), 1);
+  ot.write();
+  BOOST_CHECK_EQUAL(ot.val["C1"], 1);
+  BOOST_CHECK(ot.val.count("C2") == 0);
+  BOOST_CHECK(ot.evaluation_time("C1") >= 0.0);
+  BOOST_CHECK_EQUAL(ot.evaluation_time("C2"), 0.0);
+  std::ostringstream os;
+  ot.print_evaluation_time(os);
+  BOOST_CHECK(os.str().find(" C1\n") != std::string::npos);
+  BOOST_CHECK(os.str().find(" C2\n") == std::string::npos);
+  ot.reset_evaluation_time();
+  BOOST_CHECK_EQUAL(ot.evaluation_time("C1"), 0.0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,9 @@
 #include "radiative_transfer.h"
 %}
 %base_import(generic_object)
+%python_release_gil(FullPhysics::RadiativeTransfer::reflectance);
+%python_release_gil(FullPhysics::RadiativeTransfer::stokes);
+%python_release_gil(FullPhysics::RadiativeTransfer::stokes_and_jacobian);
 %fp_shared_ptr(FullPhysics::RadiativeTransfer);
 %import "spectrum.i"
 %import "spectral_domain.i"
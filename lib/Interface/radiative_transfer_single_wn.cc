@@ -1,5 +1,6 @@
 #include "radiative_transfer_single_wn.h"
 #include "ostream_pad.h"
+#include "profiler.h"
 using namespace FullPhysics;
 using namespace blitz;
 
@@ -7,6 +8,7 @@ Array<double, 2>
 RadiativeTransferSingleWn::stokes(const SpectralDomain& Spec_domain,
 				  int Spec_index) const
 {
+  FP_PROFILE_SCOPE("RadiativeTransferSingleWn stokes");
   Array<double, 1> wn(Spec_domain.wavenumber());
   boost::shared_ptr<boost::progress_display> disp = progress_display(wn);
   Array<double, 2> res(wn.rows(), number_stokes());
@@ -22,6 +24,7 @@ ArrayAd<double, 2>
 RadiativeTransferSingleWn::stokes_and_jacobian(const SpectralDomain& Spec_domain,
 					       int Spec_index) const
 {
+  FP_PROFILE_SCOPE("RadiativeTransferSingleWn stokes_and_jacobian");
   Array<double, 1> wn(Spec_domain.wavenumber());
   if(wn.rows() < 1)		// Handle degenerate case.
     return ArrayAd<double, 2>(0,number_stokes(),0);
@@ -2,6 +2,7 @@
 #define RADIATIVE_TRANSFER_SINGLE_WN_H
 #include "radiative_transfer_fixed_stokes_coefficient.h"
 #include "rt_atmosphere.h"
+#include "first_order_rt_cache.h"
 
 namespace FullPhysics {
 /****************************************************************//**
@@ -76,6 +77,20 @@ public:
 
   const boost::shared_ptr<RtAtmosphere>& atmosphere() const
   { return atm; }
+
+//-----------------------------------------------------------------------
+/// Optional FirstOrderRtCache used to skip the full radiative
+/// transfer for wavenumbers where the inputs have barely changed
+/// since the last full calculation. This is null (i.e., not used) by
+/// default. Only radiative transfer that calculates the Jacobian
+/// relative to the intermediate variables (i.e., SpurrRt) makes use
+/// of this, others ignore it.
+//-----------------------------------------------------------------------
+
+  const boost::shared_ptr<FirstOrderRtCache>& first_order_cache() const
+  { return fo_cache; }
+  void first_order_cache(const boost::shared_ptr<FirstOrderRtCache>& C)
+  { fo_cache = C; }
 protected:
 //-----------------------------------------------------------------------
 /// Constructor.
@@ -96,6 +111,7 @@ protected:
   RadiativeTransferSingleWn() {}
 
   boost::shared_ptr<RtAtmosphere> atm;
+  boost::shared_ptr<FirstOrderRtCache> fo_cache;
 };
 }
 #endif
@@ -1,4 +1,5 @@
 #include "rt_atmosphere.h"
+#include <boost/foreach.hpp>
 
 using namespace FullPhysics;
 using namespace blitz;
@@ -45,12 +46,21 @@ RtAtmosphere::optical_depth_wrt_state_vector(double wn, int spec_index) const
   firstIndex i1; secondIndex i2; thirdIndex i3;
   Range ra(Range::all());
   ArrayAd<double, 1> od(optical_depth_wrt_iv(wn, spec_index));
-  Array<double, 3> ivjac(intermediate_variable(wn, spec_index).jacobian());
+  ArrayAd<double, 2> iv(intermediate_variable(wn, spec_index));
+  Array<double, 3> ivjac(iv.jacobian());
   ArrayAd<double, 1> res(od.rows(), ivjac.depth());
   res.value() = od.value();
-  for(int i = 0; i < res.rows(); ++i)
-    res.jacobian()(i, ra) = 
-      sum(od.jacobian()(i, ra)(i2) * ivjac(i, ra, ra)(i2,i1),i2);
+  if(iv.column_group()) {
+    // Only loop over the columns that might be nonzero.
+    res.jacobian() = 0;
+    BOOST_FOREACH(const Range& r, iv.column_group()->group_union())
+      for(int i = 0; i < res.rows(); ++i)
+	res.jacobian()(i, r) = 
+	  sum(od.jacobian()(i, ra)(i2) * ivjac(i, ra, r)(i2,i1),i2);
+  } else
+    for(int i = 0; i < res.rows(); ++i)
+      res.jacobian()(i, ra) = 
+	sum(od.jacobian()(i, ra)(i2) * ivjac(i, ra, ra)(i2,i1),i2);
   return res;
 }
 
@@ -75,12 +85,21 @@ RtAtmosphere::single_scattering_albedo_wrt_state_vector
   firstIndex i1; secondIndex i2; thirdIndex i3;
   Range ra(Range::all());
   ArrayAd<double, 1> ss(single_scattering_albedo_wrt_iv(wn, spec_index));
-  Array<double, 3> ivjac(intermediate_variable(wn, spec_index).jacobian());
+  ArrayAd<double, 2> iv(intermediate_variable(wn, spec_index));
+  Array<double, 3> ivjac(iv.jacobian());
   ArrayAd<double, 1> res(ss.rows(), ivjac.depth());
   res.value() = ss.value();
-  for(int i = 0; i < res.rows(); ++i)
-    res.jacobian()(i, ra) = 
-      sum(ss.jacobian()(i, ra)(i2) * ivjac(i, ra, ra)(i2,i1),i2);
+  if(iv.column_group()) {
+    // Only loop over the columns that might be nonzero.
+    res.jacobian() = 0;
+    BOOST_FOREACH(const Range& r, iv.column_group()->group_union())
+      for(int i = 0; i < res.rows(); ++i)
+	res.jacobian()(i, r) = 
+	  sum(ss.jacobian()(i, ra)(i2) * ivjac(i, ra, r)(i2,i1),i2);
+  } else
+    for(int i = 0; i < res.rows(); ++i)
+      res.jacobian()(i, ra) = 
+	sum(ss.jacobian()(i, ra)(i2) * ivjac(i, ra, ra)(i2,i1),i2);
   return res;
 }
 
@@ -116,10 +135,20 @@ RtAtmosphere::scattering_moment_wrt_state_vector
   firstIndex i1; secondIndex i2; thirdIndex i3; fourthIndex i4; fifthIndex i5;
   ArrayAd<double, 3> 
     pf(scattering_moment_wrt_iv(wn, spec_index, nummom, numscat));
-  Array<double, 3> ivjac(intermediate_variable(wn, spec_index).jacobian());
+  ArrayAd<double, 2> iv(intermediate_variable(wn, spec_index));
+  Array<double, 3> ivjac(iv.jacobian());
   ArrayAd<double, 3> res(pf.rows(), pf.cols(), pf.depth(), ivjac.depth());
   res.value() = pf.value();
-  res.jacobian() = sum(pf.jacobian()(i1, i2, i3, i5) * ivjac(i2,i5, i4), i5);
+  if(iv.column_group()) {
+    // Only loop over the columns that might be nonzero.
+    Range ra(Range::all());
+    res.jacobian() = 0;
+    BOOST_FOREACH(const Range& r, iv.column_group()->group_union())
+      res.jacobian()(ra, ra, ra, r) = 
+	sum(pf.jacobian()(i1, i2, i3, i5) * ivjac(ra, ra, r)(i2,i5, i4), i5);
+  } else
+    res.jacobian() = 
+      sum(pf.jacobian()(i1, i2, i3, i5) * ivjac(i2,i5, i4), i5);
   return res;
 }
 
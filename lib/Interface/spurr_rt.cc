@@ -1,6 +1,7 @@
 #include "spurr_rt.h"
 #include "ostream_pad.h"
 #include <cmath>
+#include <boost/foreach.hpp>
 
 #include "spurr_brdf_types.h"
 #include "ground_lambertian.h"
@@ -88,6 +89,7 @@ void SpurrRt::update_altitude(int spec_index) const
 
   // Set layers into LIDORT inputs
   Array<double, 1> atm_alt(atm->altitude(spec_index).convert(units::km).value.value());
+  alt_cache.reference(atm_alt);
 
   rt_driver_->setup_height_grid(atm_alt);
   if(dump_data)
@@ -165,24 +167,16 @@ ArrayAd<double, 1> SpurrRt::stokes_and_jacobian_single_wn(double Wn, int Spec_in
 
   // Obtain Wn and Spec_index dependent inputs
   Range ra(Range::all());
-  ArrayAd<double, 1> od, ssa;
-  ArrayAd<double, 2> pf;
+  ArrayAd<double, 2> iv;
+  if(Iv.rows() != 0)
+    iv.reference(Iv);
+  else
+    iv.reference(atm->intermediate_variable(Wn, Spec_index));
   Array<double, 3> jac_iv(0,0,0);
-  if(Iv.rows() != 0) {
-    od.reference(atm->optical_depth_wrt_iv(Wn, Spec_index, Iv));
-    ssa.reference(atm->single_scattering_albedo_wrt_iv(Wn, Spec_index, Iv));
-    if (number_moment() > 0)
-      pf.reference(atm->scattering_moment_wrt_iv(Wn, Spec_index, Iv, number_moment(), 1)(ra, ra, 0));
-    if(!Iv.is_constant())
-      jac_iv.reference(Iv.jacobian());
-  } else {
-    od.reference(atm->optical_depth_wrt_iv(Wn, Spec_index));
-    ssa.reference(atm->single_scattering_albedo_wrt_iv(Wn, Spec_index));
-    if (number_moment() > 0)
-      pf.reference(atm->scattering_moment_wrt_iv(Wn, Spec_index, number_moment(), 1)(ra, ra, 0));
-    ArrayAd<double, 2> inter_var(atm->intermediate_variable(Wn, Spec_index));
-    if(!inter_var.is_constant())
-      jac_iv.reference(inter_var.jacobian());
+  boost::shared_ptr<const JacobianColumnGroup> jac_iv_group;
+  if(!iv.is_constant()) {
+    jac_iv.reference(iv.jacobian());
+    jac_iv_group = iv.column_group();
   }
 
   // Update user levels if necessary
@@ -194,29 +188,70 @@ ArrayAd<double, 1> SpurrRt::stokes_and_jacobian_single_wn(double Wn, int Spec_in
   // Setup surface
   ArrayAd<double, 1> surface_parameters(atm->ground()->surface_parameter(Wn, Spec_index));
   ArrayAd<double, 1> lidort_surface = rt_driver_->brdf_driver()->setup_brdf_inputs(surface_type(), surface_parameters);
-
-  // Set up LIDORT inputs and run
-  rt_driver_->setup_optical_inputs(od.value(), ssa.value(), pf.value());
-
   bool do_surface_pd = !surface_parameters.is_constant();
-  if(dump_data &&
-    fabs(Wn - 13050.47) < 0.005)
-    std::cout << "# Surface type:\n " << surface_type() << "\n"
-	      << "# Surface paramters:\n" << surface_parameters << "\n"
-	      << "# Od:\n" << od << "\n"
-	      << "# SSA:\n" << ssa << "\n"
-	      << "# PF:\n" << pf << "\n"
-	      << "# Do surface pd:\n" << do_surface_pd << "\n";
-
-  rt_driver_->setup_linear_inputs(od, ssa, pf, do_surface_pd);
-  rt_driver_->calculate_rt();
 
-  // Copy values from LIDORT
-  double rad = rt_driver_->get_intensity();
+  //-----------------------------------------------------------------------
+  /// If we have a FirstOrderRtCache, and the intermediate variables,
+  /// surface inputs, altitudes and geometry are close to the ones
+  /// from the last full calculation for this wavenumber, it gives us
+  /// the radiance and the Jacobians relative to the intermediate
+  /// variables and surface inputs without running LIDORT. Otherwise
+  /// we do the full calculation, and save the results for next time.
+  //-----------------------------------------------------------------------
 
+  double rad;
   Array<double, 2> jac_atm;
   Array<double, 1> jac_surf;
-  rt_driver_->copy_jacobians(jac_atm, jac_surf);
+  Array<double, 1> fo_key;
+  if(fo_cache) {
+    // The layer altitudes and geometry also go into LIDORT, but we
+    // don't have the Jacobian for them.
+    int nalt = alt_cache.rows();
+    fo_key.resize(nalt + 3);
+    fo_key(Range(0, nalt - 1)) = alt_cache;
+    fo_key(nalt) = sza(Spec_index);
+    fo_key(nalt + 1) = zen(Spec_index);
+    fo_key(nalt + 2) = azm(Spec_index);
+  }
+  if(!fo_cache ||
+     !fo_cache->predict(Spec_index, Wn, iv.value(), lidort_surface.value(),
+			fo_key, rad, jac_atm, jac_surf)) {
+    ArrayAd<double, 1> od, ssa;
+    ArrayAd<double, 2> pf;
+    if(Iv.rows() != 0) {
+      od.reference(atm->optical_depth_wrt_iv(Wn, Spec_index, Iv));
+      ssa.reference(atm->single_scattering_albedo_wrt_iv(Wn, Spec_index, Iv));
+      if (number_moment() > 0)
+	pf.reference(atm->scattering_moment_wrt_iv(Wn, Spec_index, Iv, number_moment(), 1)(ra, ra, 0));
+    } else {
+      od.reference(atm->optical_depth_wrt_iv(Wn, Spec_index));
+      ssa.reference(atm->single_scattering_albedo_wrt_iv(Wn, Spec_index));
+      if (number_moment() > 0)
+	pf.reference(atm->scattering_moment_wrt_iv(Wn, Spec_index, number_moment(), 1)(ra, ra, 0));
+    }
+
+    // Set up LIDORT inputs and run
+    rt_driver_->setup_optical_inputs(od.value(), ssa.value(), pf.value());
+
+    if(dump_data &&
+       fabs(Wn - 13050.47) < 0.005)
+      std::cout << "# Surface type:\n " << surface_type() << "\n"
+		<< "# Surface paramters:\n" << surface_parameters << "\n"
+		<< "# Od:\n" << od << "\n"
+		<< "# SSA:\n" << ssa << "\n"
+		<< "# PF:\n" << pf << "\n"
+		<< "# Do surface pd:\n" << do_surface_pd << "\n";
+
+    rt_driver_->setup_linear_inputs(od, ssa, pf, do_surface_pd);
+    rt_driver_->calculate_rt();
+
+    // Copy values from LIDORT
+    rad = rt_driver_->get_intensity();
+    rt_driver_->copy_jacobians(jac_atm, jac_surf);
+    if(fo_cache)
+      fo_cache->store(Spec_index, Wn, iv.value(), lidort_surface.value(),
+		      fo_key, rad, jac_atm, jac_surf);
+  }
 
   //-----------------------------------------------------------------------
   /// To speed up the calculation, the Atmosphere Jacobian was
@@ -226,17 +261,36 @@ ArrayAd<double, 1> SpurrRt::stokes_and_jacobian_single_wn(double Wn, int Spec_in
   /// the state vector variables. Then sum the Atmosphere Jacobian over
   /// the layers and add in the surface Jacobian to give us the total
   /// Jacobian to the reflectance with respect to the state vector.
+  //
+  /// Most intermediate variables only depend on a small part of the
+  /// state vector. If the atmosphere tells us which columns of the
+  /// Jacobian of the intermediate variables can be nonzero, we only
+  /// loop over those.
   //-----------------------------------------------------------------------
-  Array<double, 1> jac(jac_iv.depth());
-
+  ScratchArena::Scope scope(arena);
+  Array<double, 1> jac(arena.array<double>(jac_iv.depth()));
+
+  if(jac_iv_group) {
+    jac = 0;
+    for(int n = 0; n < jac_iv.cols(); ++n)
+      BOOST_FOREACH(const Range& r, jac_iv_group->group(n))
+	for(int m = 0; m < jac_iv.rows(); ++m) {
+	  double ja = jac_atm(n, m);
+	  for(int i = r.first(); i <= r.last(); ++i)
+	    jac(i) += ja * jac_iv(m, n, i);
+	}
+  }
   for(int i = 0; i < jac.rows(); ++i) {
     double val = 0;
     // dimensions swapped on jac_iv and jac_atm
     // jac_atm is njac x nlayer 
     // jac_iv  is nlayer x njac
-    for(int m = 0; m < jac_iv.rows(); ++m)
-      for(int n = 0; n < jac_iv.cols(); ++n)
-        val += jac_atm(n,m) * jac_iv(m, n, i); 
+    if(jac_iv_group)
+      val = jac(i);
+    else
+      for(int m = 0; m < jac_iv.rows(); ++m)
+	for(int n = 0; n < jac_iv.cols(); ++n)
+	  val += jac_atm(n,m) * jac_iv(m, n, i); 
     if(do_surface_pd)
       // The min() here ensures that we only loop over the number of parameters that
       // either the RT or source parameters both have
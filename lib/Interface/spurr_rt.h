@@ -4,6 +4,7 @@
 #include "spurr_driver.h"
 #include "radiative_transfer_single_wn.h"
 #include "rt_atmosphere.h"
+#include "scratch_arena.h"
 #include <boost/noncopyable.hpp>
 
 namespace FullPhysics {
@@ -59,6 +60,10 @@ protected:
 
   // Last index we updates the altitude/geometry for.
   mutable int alt_spec_index_cache, geo_spec_index_cache;
+  // Altitude (in km) we last gave to the driver.
+  mutable blitz::Array<double, 1> alt_cache;
+  // Memory for the temporaries in stokes_and_jacobian_single_wn.
+  mutable ScratchArena arena;
   virtual void update_altitude(int spec_index) const;
   virtual void update_geometry(int spec_index) const;
 };
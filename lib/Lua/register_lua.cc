@@ -170,6 +170,7 @@ void RegisterLua::register_lua(lua_State* ls)
   REGISTER_LUA_LIST(VectorGasAbsorption);
   REGISTER_LUA_LIST(Absco);
   REGISTER_LUA_LIST(RadiativeTransfer);
+  REGISTER_LUA_LIST(FirstOrderRtCache);
   REGISTER_LUA_LIST(SpectralBound);
   REGISTER_LUA_LIST(SpectralWindow);
   REGISTER_LUA_LIST(NoiseModel);
@@ -213,6 +214,7 @@ void RegisterLua::register_lua(lua_State* ls)
   REGISTER_LUA_LIST(CostFunction);
   REGISTER_LUA_LIST(RegisterOutputBase);
   REGISTER_LUA_LIST(VectorRegisterOutput);
+  REGISTER_LUA_LIST(OutputManifest);
   REGISTER_LUA_LIST(SpectralRange);
   REGISTER_LUA_LIST(SpectralDomain);
   REGISTER_LUA_LIST(Spectrum);
@@ -236,6 +238,7 @@ void RegisterLua::register_lua(lua_State* ls)
   REGISTER_LUA_LIST(FtsRunLogOutput);
   REGISTER_LUA_LIST(Level1bFts);
   REGISTER_LUA_LIST(Level1bOco);
+  REGISTER_LUA_LIST(Level1bOcoPreload);
   REGISTER_LUA_LIST(Level1bUq);
   REGISTER_LUA_LIST(Meteorology);
   REGISTER_LUA_LIST(AcosMetFile);
@@ -243,6 +246,7 @@ void RegisterLua::register_lua(lua_State* ls)
   REGISTER_LUA_LIST(UqEcmwf);
   REGISTER_LUA_LIST(OcoSimMetEcmwf);
   REGISTER_LUA_LIST(HdfFile);
+  REGISTER_LUA_LIST(StaticInputRegistry);
   REGISTER_LUA_LIST(HdfConstant);
   REGISTER_LUA_LIST(PressureLevelInput);
   REGISTER_LUA_LIST(PressureFixedLevel);
@@ -303,6 +307,7 @@ void RegisterLua::register_lua(lua_State* ls)
   REGISTER_LUA_LIST(SpectralWindowRange);
   REGISTER_LUA_LIST(LRadRt);
   REGISTER_LUA_LIST(LsiRt);
+  REGISTER_LUA_LIST(PcaRt);
   REGISTER_LUA_LIST(TwostreamRt);
   REGISTER_LUA_LIST(HresWrapper);
   REGISTER_LUA_LIST(UplookingRaytracing);
@@ -338,6 +343,7 @@ void RegisterLua::register_lua(lua_State* ls)
   REGISTER_LUA_LIST(RadianceScalingSvFit);
   REGISTER_LUA_LIST(RadianceScalingLinearFit);
   REGISTER_LUA_LIST(NonuniformSpectrumSampling);
+  REGISTER_LUA_LIST(AdaptiveSpectrumSampling);
   REGISTER_LUA_LIST(TcconApriori);
   REGISTER_LUA_LIST(CO2ProfilePrior);
   REGISTER_LUA_LIST(GasVmrApriori);
@@ -130,3 +130,22 @@ def test_passing_numpy_array():
     assert_almost_equal(t.value, [[1,2],[5,6]])
     t = ArrayWithUnit_double_1(a[0:2,1], "m")
     assert_almost_equal(t.value, [2,4])
+
+def test_numpy_array_view():
+    '''Test that arrays returned from C++ are read only views of the C++
+    memory, and that they can be passed back to C++.'''
+    if(not have_full_physics_swig):
+        raise SkipTest
+    t = ArrayWithUnit_double_1(np.array([1.0, 2.0, 3.0]), "m")
+    v = t.value
+    assert not v.flags.writeable
+    assert_raises(ValueError, v.__setitem__, 1, 20.0)
+    assert_almost_equal(t.value, [1, 2, 3])
+    t2 = ArrayWithUnit_double_1(v, "m")
+    assert_almost_equal(t2.value, [1, 2, 3])
+    # A copy can be modified, and doesn't change the C++ object
+    w = v.copy()
+    w[1] = 20.0
+    t3 = ArrayWithUnit_double_1(w, "m")
+    assert_almost_equal(t3.value, [1, 20, 3])
+    assert_almost_equal(t.value, [1, 2, 3])
@@ -2,6 +2,7 @@
 #define ACCUMULATED_TIMER_H
 #include "printable.h"
 #include "logger.h"
+#include "profiler.h"
 #include <boost/shared_ptr.hpp>
 #include <boost/noncopyable.hpp>
 #include <boost/timer.hpp>
@@ -15,6 +16,9 @@ class FunctionTimerR;
   spent in multiple calls to a function. You get a function timer from
   this class, which keeps track of the time that object exists and
   adds it to the elapsed time.
+
+  If the Profiler is turned on, the function timer also creates a
+  profile zone with the description as its name.
 *******************************************************************/
 class AccumulatedTimer : public Printable<AccumulatedTimer> {
 public:
@@ -57,7 +61,8 @@ private:
 class FunctionTimerR : boost::noncopyable {
 public:
   FunctionTimerR(const AccumulatedTimer& At, bool Auto_log)  
-    : at(At), auto_log(Auto_log) {}
+    : zone(Profiler::enabled() ? At.desc.c_str() : 0),
+      at(At), auto_log(Auto_log) {}
   ~FunctionTimerR() 
   { 
     at.elapsed_ += t.elapsed(); 
@@ -68,6 +73,7 @@ public:
     }
   }
 private:
+  ProfileScope zone;
   const AccumulatedTimer& at;
   boost::timer t;
   bool auto_log;
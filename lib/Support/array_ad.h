@@ -2,6 +2,7 @@
 #define ARRAY_AD_H
 #include "auto_derivative.h"
 #include "fp_exception.h"
+#include "jacobian_column_group.h"
 
 // Turn on trace messages, useful for debugging problems with this class.
 // #define ARRAY_AD_DIAGNOSTIC
@@ -33,6 +34,17 @@ namespace FullPhysics {
   We can get odd floating point errors (particularly on Ubuntu), 
   if we copy garbage values. So even though we don't use the
   Jacobian, if the data is constant, we initialize it to 0.
+
+  Most of the Jacobians we calculate are sparse, only depending on a
+  small part of the state vector. The storage is always dense, but
+  the code that creates an ArrayAd can optionally attach a
+  JacobianColumnGroup giving the columns that might be nonzero (see
+  column_group). This gets passed along by copies, reference,
+  copy(), and assignment from another ArrayAd. Anything else that
+  changes the Jacobian (resize, assignment from an Array, or a
+  scalar) clears it, since we no longer know what is nonzero. If you
+  modify the Jacobian directly (e.g., through jacobian()), you need
+  to update or clear the column group yourself.
   
 *******************************************************************/
 
@@ -49,7 +61,7 @@ public:
     val = blitz::value(V);
   }
   ArrayAd(const ArrayAd<T, D>& V)
-    : val(V.val), jac(V.jac), is_const(V.is_const) 
+    : val(V.val), jac(V.jac), is_const(V.is_const), col_group(V.col_group)
   { 
     ARRAY_AD_DIAGNOSTIC_MSG;
   }
@@ -76,6 +88,7 @@ public:
 	jac = V.jac;
       }
     }
+    col_group = V.col_group;
     return *this;
   }
   ArrayAd(const blitz::Array<T, D>& Val, const blitz::Array<T, D+1>& Jac, 
@@ -161,11 +174,13 @@ public:
     jac.resize(s2);
     jac = 0;
     is_const = (nvar ==0);
+    col_group.reset();
   }
   void resize(const blitz::TinyVector<int, D>& Shape, int nvar)
   {
     val.resize(Shape);
     is_const = (nvar ==0);
+    col_group.reset();
     blitz::TinyVector<int, D + 1> s2;
     for(int i = 0; i < D; ++i)
       s2(i) = Shape(i);
@@ -178,6 +193,7 @@ public:
   { 
     val.resize(n1); jac.resize(n1, std::max(nvar, 1)); 
     is_const = (nvar == 0); 
+    col_group.reset();
     if(is_const)
       jac = 0;
   }
@@ -185,6 +201,7 @@ public:
   { 
     val.resize(n1, n2); jac.resize(n1, n2, std::max(nvar, 1)); 
     is_const = (nvar == 0); 
+    col_group.reset();
     if(is_const)
       jac = 0;
   }
@@ -192,6 +209,7 @@ public:
   { 
     val.resize(n1, n2, n3); jac.resize(n1, n2, n3, std::max(nvar, 1)); 
     is_const = (nvar == 0); 
+    col_group.reset();
     if(is_const)
       jac = 0;
   }
@@ -200,6 +218,7 @@ public:
     val.resize(n1, n2, n3, n4); 
     jac.resize(n1, n2, n3, n4, std::max(nvar, 1)); 
     is_const = (nvar == 0); 
+    col_group.reset();
     if(is_const)
       jac = 0;
   }
@@ -208,6 +227,7 @@ public:
     val.resize(n1, n2, n3, n4, n5); 
     jac.resize(n1, n2, n3, n4, n5, std::max(nvar, 1)); 
     is_const = (nvar == 0); 
+    col_group.reset();
     if(is_const)
       jac = 0;
   }
@@ -309,15 +329,18 @@ public:
     return res;
   }
   ArrayAd& operator=(const blitz::Array<T, D>& V)
-  {  ARRAY_AD_DIAGNOSTIC_MSG; val = V; jac = 0; return *this; }
+  {  ARRAY_AD_DIAGNOSTIC_MSG; val = V; jac = 0; col_group.reset(); 
+    return *this; }
   ArrayAd& operator=(const T& V)
-  { ARRAY_AD_DIAGNOSTIC_MSG; val = V; jac = 0; return *this; }
+  { ARRAY_AD_DIAGNOSTIC_MSG; val = V; jac = 0; col_group.reset(); 
+    return *this; }
   ArrayAd& operator=(const AutoDerivative<T>& V)
   { ARRAY_AD_DIAGNOSTIC_MSG; 
     val = V.value(); 
     blitz::IndexPlaceholder<D> ig;
     if(!is_constant())
       jac = V.gradient()(ig); 
+    col_group.reset();
     return *this; 
   }
   ArrayAd<T, 1> operator()(const blitz::Range& r1) const
@@ -358,9 +381,45 @@ public:
   int depth() const {return val.depth();}
   bool is_constant() const {return is_const;}
   void reference(const ArrayAd<T, D>& V)
-  { val.reference(V.val); jac.reference(V.jac); is_const = V.is_const;}
+  { val.reference(V.val); jac.reference(V.jac); is_const = V.is_const;
+    col_group = V.col_group; }
   ArrayAd<T, D> copy() const
-  { return ArrayAd<T,D>(val.copy(), jac.copy(), is_const); }
+  { ArrayAd<T, D> res(val.copy(), jac.copy(), is_const); 
+    res.col_group = col_group;
+    return res;
+  }
+
+//-----------------------------------------------------------------------
+/// The columns of the Jacobian that might be nonzero, for each index
+/// of the last dimension of value(). This may be a null pointer, in
+/// which case we don't know anything about the Jacobian and any
+/// column might be nonzero.
+//-----------------------------------------------------------------------
+
+  const boost::shared_ptr<const JacobianColumnGroup>& column_group() const
+  { return col_group; }
+
+//-----------------------------------------------------------------------
+/// Set the columns of the Jacobian that might be nonzero. The
+/// JacobianColumnGroup is shared with all the copies of this object,
+/// so it shouldn't be modified after this. You can pass a null
+/// pointer to clear this.
+//-----------------------------------------------------------------------
+
+  void column_group(const boost::shared_ptr<const JacobianColumnGroup>& G)
+  {
+    if(G && (G->number_slot() != val.extent(D - 1) ||
+	     G->number_variable() != number_variable())) {
+      Exception e;
+      e << "JacobianColumnGroup has " << G->number_slot() << " slots and "
+	<< G->number_variable() << " variables, ArrayAd has "
+	<< val.extent(D - 1) << " slots and " << number_variable() 
+	<< " variables";
+      throw e;
+    }
+    col_group = G;
+  }
+  void clear_column_group() { col_group.reset(); }
   int number_variable() const 
   {
     if(is_const)
@@ -378,6 +437,7 @@ private:
   blitz::Array<T, D> val;
   blitz::Array<T, D + 1> jac;
   bool is_const;
+  boost::shared_ptr<const JacobianColumnGroup> col_group;
 };
 }
 #endif
@@ -37,4 +37,53 @@ BOOST_AUTO_TEST_CASE(io_test)
   BOOST_CHECK_ARRAYAD_CLOSE(adin, ad);
 }
 
+BOOST_AUTO_TEST_CASE(column_group)
+{
+  ArrayAd<double, 2> ad(3, 2, 6);
+  ad.value() = 1;
+  ad.jacobian() = 0;
+  ad.jacobian()(0, 0, 1) = 1;
+  ad.jacobian()(2, 0, 2) = 2;
+  ad.jacobian()(1, 0, 5) = 3;
+  ad.jacobian()(1, 1, 4) = 4;
+  boost::shared_ptr<JacobianColumnGroup> g = 
+    JacobianColumnGroup::find(ad.jacobian());
+  BOOST_CHECK_EQUAL(g->number_slot(), 2);
+  BOOST_CHECK_EQUAL((int) g->group(0).size(), 2);
+  BOOST_CHECK_EQUAL(g->group(0)[0].first(), 1);
+  BOOST_CHECK_EQUAL(g->group(0)[0].last(), 2);
+  BOOST_CHECK_EQUAL(g->group(0)[1].first(), 5);
+  BOOST_CHECK_EQUAL(g->group(0)[1].last(), 5);
+  BOOST_CHECK_EQUAL(g->number_column(0), 3);
+  BOOST_CHECK_EQUAL(g->number_column(1), 1);
+  std::vector<Range> u = g->group_union();
+  BOOST_CHECK_EQUAL((int) u.size(), 2);
+  BOOST_CHECK_EQUAL(u[0].first(), 1);
+  BOOST_CHECK_EQUAL(u[0].last(), 2);
+  BOOST_CHECK_EQUAL(u[1].first(), 4);
+  BOOST_CHECK_EQUAL(u[1].last(), 5);
+
+  ad.column_group(g);
+  BOOST_CHECK(ad.column_group());
+  // Copies and reference keep the column group
+  ArrayAd<double, 2> ad2(ad);
+  BOOST_CHECK(ad2.column_group() == g);
+  BOOST_CHECK(ad.copy().column_group() == g);
+  ArrayAd<double, 2> ad3;
+  ad3.reference(ad);
+  BOOST_CHECK(ad3.column_group() == g);
+  ArrayAd<double, 2> ad4;
+  ad4 = ad;
+  BOOST_CHECK(ad4.column_group() == g);
+  // Anything else clears it.
+  ad3 = 1.0;
+  BOOST_CHECK(!ad3.column_group());
+  ad2.resize(3, 2, 6);
+  BOOST_CHECK(!ad2.column_group());
+  BOOST_CHECK(!ad(Range::all(), 0).column_group());
+  // Wrong size is an error.
+  boost::shared_ptr<JacobianColumnGroup> gbad(new JacobianColumnGroup(3, 6));
+  BOOST_CHECK_THROW(ad.column_group(gbad), Exception);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,219 @@
+#include "benchmark_support.h"
+#include "fp_exception.h"
+#include <boost/algorithm/string.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <sys/time.h>
+
+using namespace FullPhysics;
+
+void BenchmarkResult::print(std::ostream& Os) const
+{
+  Os << "Benchmark " << name << ": median " << median << " s, min "
+     << min << " s, max " << max << " s (" << number_repeat << " repeats)";
+}
+
+//-----------------------------------------------------------------------
+/// Wall clock time in seconds.
+//-----------------------------------------------------------------------
+
+static double benchmark_time()
+{
+  struct timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+//-----------------------------------------------------------------------
+/// All the results so far.
+//-----------------------------------------------------------------------
+
+std::vector<BenchmarkResult>& Benchmark::results()
+{
+  static std::vector<BenchmarkResult> res;
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Run a benchmark. The results are returned, and also saved in
+/// results().
+//-----------------------------------------------------------------------
+
+BenchmarkResult Benchmark::run(const std::string& Name,
+			       const boost::function<void ()>& F,
+			       int Number_repeat)
+{
+  if(getenv("L2_FP_BENCHMARK_REPEAT"))
+    Number_repeat =
+      boost::lexical_cast<int>(getenv("L2_FP_BENCHMARK_REPEAT"));
+  range_min_check(Number_repeat, 1);
+  F();				// Warm up
+  std::vector<double> t;
+  for(int i = 0; i < Number_repeat; ++i) {
+    double tstart = benchmark_time();
+    F();
+    t.push_back(benchmark_time() - tstart);
+  }
+  std::sort(t.begin(), t.end());
+  BenchmarkResult r;
+  r.name = Name;
+  r.number_repeat = Number_repeat;
+  r.min = t.front();
+  r.max = t.back();
+  r.median = (t.size() % 2 == 1 ? t[t.size() / 2] :
+	      (t[t.size() / 2 - 1] + t[t.size() / 2]) / 2);
+  r.mean = 0;
+  BOOST_FOREACH(double v, t)
+    r.mean += v;
+  r.mean /= t.size();
+  results().push_back(r);
+  return r;
+}
+
+//-----------------------------------------------------------------------
+/// Read a CSV file written by write_csv.
+//-----------------------------------------------------------------------
+
+std::map<std::string, BenchmarkResult>
+Benchmark::read_csv(const std::string& Fname)
+{
+  std::ifstream in(Fname.c_str());
+  if(!in.good())
+    throw Exception("Trouble opening benchmark baseline " + Fname);
+  std::map<std::string, BenchmarkResult> res;
+  std::string ln;
+  getline(in, ln);		// Skip header
+  while(getline(in, ln)) {
+    if(ln == "")
+      continue;
+    std::vector<std::string> f;
+    boost::split(f, ln, boost::is_any_of(","));
+    if(f.size() != 6) {
+      Exception e;
+      e << "Bad line in benchmark baseline " << Fname << ": " << ln;
+      throw e;
+    }
+    BenchmarkResult r;
+    r.name = f[0];
+    r.number_repeat = boost::lexical_cast<int>(f[1]);
+    r.min = boost::lexical_cast<double>(f[2]);
+    r.median = boost::lexical_cast<double>(f[3]);
+    r.mean = boost::lexical_cast<double>(f[4]);
+    r.max = boost::lexical_cast<double>(f[5]);
+    res[r.name] = r;
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Baseline we compare against, if L2_FP_BENCHMARK_BASELINE is set.
+//-----------------------------------------------------------------------
+
+const std::map<std::string, BenchmarkResult>& Benchmark::baseline()
+{
+  static bool read = false;
+  static std::map<std::string, BenchmarkResult> res;
+  if(!read) {
+    if(getenv("L2_FP_BENCHMARK_BASELINE"))
+      res = read_csv(getenv("L2_FP_BENCHMARK_BASELINE"));
+    read = true;
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Compare a result to the baseline. Returns true if this is a
+/// regression, and fills in Msg with a description. If we don't have
+/// a baseline for this benchmark we always return false.
+//-----------------------------------------------------------------------
+
+bool Benchmark::regression(const BenchmarkResult& R, std::string& Msg)
+{
+  std::map<std::string, BenchmarkResult>::const_iterator i =
+    baseline().find(R.name);
+  if(i == baseline().end()) {
+    Msg = "No baseline for benchmark " + R.name;
+    return false;
+  }
+  double tol = 0.2;
+  if(getenv("L2_FP_BENCHMARK_TOLERANCE"))
+    tol = boost::lexical_cast<double>(getenv("L2_FP_BENCHMARK_TOLERANCE"));
+  double ratio = R.median / i->second.median;
+  std::ostringstream os;
+  os << "Benchmark " << R.name << " median " << R.median
+     << " s, baseline " << i->second.median << " s (ratio "
+     << std::setprecision(3) << ratio << ")";
+  Msg = os.str();
+  return ratio > 1 + tol;
+}
+
+//-----------------------------------------------------------------------
+/// Write the results as CSV.
+//-----------------------------------------------------------------------
+
+void Benchmark::write_csv(std::ostream& Os)
+{
+  Os << "name,number_repeat,min,median,mean,max\n"
+     << std::setprecision(9);
+  BOOST_FOREACH(const BenchmarkResult& r, results())
+    Os << r.name << "," << r.number_repeat << "," << r.min << ","
+       << r.median << "," << r.mean << "," << r.max << "\n";
+}
+
+//-----------------------------------------------------------------------
+/// Write the results as JSON.
+//-----------------------------------------------------------------------
+
+void Benchmark::write_json(std::ostream& Os)
+{
+  Os << "{\"benchmarks\": [" << std::setprecision(9);
+  for(int i = 0; i < (int) results().size(); ++i) {
+    const BenchmarkResult& r = results()[i];
+    Os << (i == 0 ? "\n" : ",\n")
+       << "  {\"name\": \"" << r.name << "\", \"number_repeat\": "
+       << r.number_repeat << ", \"min\": " << r.min
+       << ", \"median\": " << r.median << ", \"mean\": " << r.mean
+       << ", \"max\": " << r.max << "}";
+  }
+  Os << "]}\n";
+}
+
+//-----------------------------------------------------------------------
+/// Write the results to the file given by L2_FP_BENCHMARK_OUTPUT, if
+/// it is set.
+//-----------------------------------------------------------------------
+
+void Benchmark::write_report()
+{
+  if(!getenv("L2_FP_BENCHMARK_OUTPUT"))
+    return;
+  std::string fname = getenv("L2_FP_BENCHMARK_OUTPUT");
+  std::ofstream out(fname.c_str());
+  if(!out.good())
+    throw Exception("Trouble opening benchmark output " + fname);
+  if(boost::ends_with(fname, ".json"))
+    write_json(out);
+  else
+    write_csv(out);
+}
+
+//-----------------------------------------------------------------------
+/// Run a benchmark, and check it against the baseline (if we have
+/// one). This is meant to be called inside of a BOOST_AUTO_TEST_CASE.
+//-----------------------------------------------------------------------
+
+void FullPhysics::benchmark(const std::string& Name,
+			    const boost::function<void ()>& F,
+			    int Number_repeat)
+{
+  BenchmarkResult r = Benchmark::run(Name, F, Number_repeat);
+  BOOST_TEST_MESSAGE(r);
+  std::string msg;
+  bool regressed = Benchmark::regression(r, msg);
+  BOOST_CHECK_MESSAGE(!regressed, msg);
+}
@@ -0,0 +1,66 @@
+#ifndef BENCHMARK_SUPPORT_H
+#define BENCHMARK_SUPPORT_H
+#include "unit_test_support.h"
+#include "printable.h"
+#include <boost/function.hpp>
+#include <map>
+#include <vector>
+
+namespace FullPhysics {
+/****************************************************************//**
+  Timing results for one benchmark. Times are wall clock, in seconds.
+*******************************************************************/
+
+class BenchmarkResult : public Printable<BenchmarkResult> {
+public:
+  BenchmarkResult() : number_repeat(0), min(0), median(0), mean(0), max(0) {}
+  std::string name;
+  int number_repeat;
+  double min, median, mean, max;
+  void print(std::ostream& Os) const;
+};
+
+/****************************************************************//**
+  This is used by the benchmarks in lib/benchmark_all (see
+  "make benchmark"). These reuse the unit test fixtures
+  (e.g., ConfigurationFixture) so the benchmarks always run on the
+  same data.
+
+  Each benchmark runs the function once to warm up (e.g., fill caches
+  and read data from files), then times Number_repeat calls. We
+  report the median, which is less sensitive to other activity on the
+  machine than the mean.
+
+  The behavior is controlled by environment variables:
+
+  \li L2_FP_BENCHMARK_REPEAT - Override the number of repeats.
+  \li L2_FP_BENCHMARK_OUTPUT - File to write the results to. If the
+      name ends in ".json" we write JSON, otherwise CSV.
+  \li L2_FP_BENCHMARK_BASELINE - CSV file with results from an
+      earlier run (i.e., a previous L2_FP_BENCHMARK_OUTPUT). If
+      given, a benchmark fails if its median time is more than
+      the tolerance slower than the baseline.
+  \li L2_FP_BENCHMARK_TOLERANCE - Fractional tolerance used when
+      comparing to the baseline, default is 0.2 (i.e., 20% slower).
+*******************************************************************/
+
+class Benchmark {
+public:
+  static BenchmarkResult run(const std::string& Name,
+			     const boost::function<void ()>& F,
+			     int Number_repeat = 5);
+  static bool regression(const BenchmarkResult& R, std::string& Msg);
+  static void write_csv(std::ostream& Os);
+  static void write_json(std::ostream& Os);
+  static void write_report();
+  static std::map<std::string, BenchmarkResult> read_csv
+  (const std::string& Fname);
+  static std::vector<BenchmarkResult>& results();
+private:
+  static const std::map<std::string, BenchmarkResult>& baseline();
+};
+
+void benchmark(const std::string& Name, const boost::function<void ()>& F,
+	       int Number_repeat = 5);
+}
+#endif
@@ -1,4 +1,11 @@
 #include "hdf_file.h"
+#include "logger.h"
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <sstream>
+#include <sys/time.h>
 
 using namespace FullPhysics;
 using namespace blitz;
@@ -259,7 +266,7 @@ REGISTER_LUA_END()
 //-----------------------------------------------------------------------
 
 HdfFile::HdfFile(const std::string& Fname, Mode M)
-: fname(Fname), mode_(M)
+: fname(Fname), mode_(M), max_cache(M == READ ? 100 : 0)
 {
   unsigned int flag;
   switch(M) {
@@ -289,6 +296,170 @@ HdfFile::HdfFile(const std::string& Fname, Mode M)
   }
 }
     
+//-----------------------------------------------------------------------
+/// Destructor. If L2_FP_HDF_READ_STATISTIC is set, write the read
+/// statistics to the Logger.
+//-----------------------------------------------------------------------
+
+HdfFile::~HdfFile()
+{
+  if(getenv("L2_FP_HDF_READ_STATISTIC") && read_stat.size() > 0) {
+    std::ostringstream os;
+    print_read_statistic(os);
+    Logger::info() << os.str();
+  }
+  clear_dataset_cache();
+}
+
+//-----------------------------------------------------------------------
+/// Set the maximum number of DataSets we keep open. Setting this to 0
+/// turns the cache off. Note that this is ignored for files that
+/// aren't opened in READ mode.
+//-----------------------------------------------------------------------
+
+void HdfFile::dataset_cache_size(int V)
+{
+  range_min_check(V, 0);
+  max_cache = (mode_ == READ ? V : 0);
+  while((int) dataset_cache.size() > max_cache) {
+    dataset_cache.erase(lru_list.back());
+    lru_list.pop_back();
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Close all the DataSets we are keeping open.
+//-----------------------------------------------------------------------
+
+void HdfFile::clear_dataset_cache() const
+{
+  dataset_cache.clear();
+  lru_list.clear();
+  scratch_handle = HdfDataSetHandle();
+}
+
+//-----------------------------------------------------------------------
+/// Open the given DataSet, and fill in the handle.
+//-----------------------------------------------------------------------
+
+void HdfFile::open_dataset(const std::string& Dataname, 
+			   HdfDataSetHandle& H) const
+{
+  H.d = h->openDataSet(Dataname);
+  H.fs = H.d.getSpace();
+  H.dims.resize(H.fs.getSimpleExtentNdims());
+  if(H.dims.size() > 0)
+    H.fs.getSimpleExtentDims(&H.dims[0], NULL);
+  H.last_start.clear();
+  H.last_size.clear();
+}
+
+//-----------------------------------------------------------------------
+/// Return the opened DataSet for the given name. This uses the cache
+/// if it is turned on, otherwise we just open the DataSet. 
+///
+/// This is used by the read functions, you don't normally call this
+/// directly. The handle is only valid until the next call.
+//-----------------------------------------------------------------------
+
+HdfDataSetHandle& HdfFile::dataset_handle(const std::string& Dataname) const
+{
+  if(max_cache == 0) {
+    open_dataset(Dataname, scratch_handle);
+    return scratch_handle;
+  }
+  std::map<std::string, HdfDataSetHandle>::iterator i = 
+    dataset_cache.find(Dataname);
+  if(i != dataset_cache.end()) {
+    // Move to the front of the LRU list
+    lru_list.splice(lru_list.begin(), lru_list, i->second.lru);
+    return i->second;
+  }
+  HdfDataSetHandle hd;
+  open_dataset(Dataname, hd);
+  if((int) dataset_cache.size() >= max_cache) {
+    dataset_cache.erase(lru_list.back());
+    lru_list.pop_back();
+  }
+  lru_list.push_front(Dataname);
+  hd.lru = lru_list.begin();
+  return dataset_cache[Dataname] = hd;
+}
+
+//-----------------------------------------------------------------------
+/// Select the given hyperslab in the file DataSpace, and set up the
+/// memory DataSpace to match. If this is the same size as the last
+/// hyperslab we reuse the memory DataSpace, and if it is the same
+/// hyperslab we don't need to do anything.
+//-----------------------------------------------------------------------
+
+void HdfDataSetHandle::select_hyperslab(const hsize_t* Start, 
+					const hsize_t* Size)
+{
+  int rank = (int) dims.size();
+  bool same_size = ((int) last_size.size() == rank &&
+		    std::equal(Size, Size + rank, last_size.begin()));
+  if(same_size && std::equal(Start, Start + rank, last_start.begin()))
+    return;
+  fs.selectHyperslab(H5S_SELECT_SET, Size, Start);
+  if(!same_size) {
+    ms = DataSpace(rank, Size);
+    last_size.assign(Size, Size + rank);
+  }
+  last_start.assign(Start, Start + rank);
+}
+
+//-----------------------------------------------------------------------
+/// Wall clock time in seconds.
+//-----------------------------------------------------------------------
+
+static double hdf_read_time()
+{
+  struct timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec + t.tv_usec * 1e-6;
+}
+
+HdfReadTimer::HdfReadTimer(const HdfFile& F, const std::string& Dataname,
+			   double Number_byte)
+  : f(F), dname(Dataname), nbyte(Number_byte), start(hdf_read_time())
+{
+}
+
+HdfReadTimer::~HdfReadTimer()
+{
+  HdfReadStatistic& s = f.read_stat[dname];
+  ++s.number_read;
+  s.number_byte += nbyte;
+  s.time += hdf_read_time() - start;
+}
+
+//-----------------------------------------------------------------------
+/// Print the read statistics, sorted so the datasets that took the
+/// most time come first.
+//-----------------------------------------------------------------------
+
+void HdfFile::print_read_statistic(std::ostream& Os) const
+{
+  std::vector<std::pair<double, std::string> > order;
+  double total = 0;
+  typedef std::map<std::string, HdfReadStatistic>::value_type vtype;
+  BOOST_FOREACH(const vtype& v, read_stat) {
+    order.push_back(std::make_pair(-v.second.time, v.first));
+    total += v.second.time;
+  }
+  std::sort(order.begin(), order.end());
+  Os << "HDF read statistics for " << fname << " (total time " 
+     << total << " s):\n";
+  for(int i = 0; i < (int) order.size(); ++i) {
+    const HdfReadStatistic& st = read_stat.find(order[i].second)->second;
+    Os << "  " << std::left << std::setw(60) << order[i].second << std::right
+       << " " << std::setw(8) << st.number_read << " reads "
+       << std::setw(14) << st.number_byte << " bytes "
+       << std::setw(12) << st.time << " s\n";
+  }
+}
+
 //-----------------------------------------------------------------------
 /// Determine if Dataname contains a group, and if it does then create
 /// it if we haven't already done so.
@@ -522,6 +693,95 @@ void HdfFile::write_type(const std::string& Dataname, const H5::DataType& P)
   // we just ignore this if we don't recognize the type.
 }
 
+//-----------------------------------------------------------------------
+/// Create an extendible, chunked field. This is the untemplated part
+/// of create_extendible_field.
+//-----------------------------------------------------------------------
+
+void HdfFile::create_extendible(const std::string& Dataname, 
+				const H5::DataType& P,
+				int Rank, const int* Chunk_shape,
+				int Deflate_level, bool Shuffle)
+{
+  try {
+    create_group_if_needed(Dataname, *h);
+    std::vector<hsize_t> dim(Rank), maxdim(Rank), chunk(Rank);
+    for(int i = 0; i < Rank; ++i) {
+      dim[i] = maxdim[i] = Chunk_shape[i];
+      // HDF doesn't allow chunks of size 0.
+      chunk[i] = std::max(Chunk_shape[i], 1);
+    }
+    dim[0] = 0;
+    maxdim[0] = H5S_UNLIMITED;
+    DataSpace ds(Rank, &dim[0], &maxdim[0]);
+    DSetCreatPropList plist;
+    plist.setChunk(Rank, &chunk[0]);
+    if(Shuffle)
+      plist.setShuffle();
+    if(Deflate_level > 0)
+      plist.setDeflate(Deflate_level);
+    h->createDataSet(Dataname, P, ds, plist);
+  } catch(const H5::Exception& e) {
+    Exception en;
+    en << "While creating field " << Dataname
+       << " for the file '" << fname
+       << "' a HDF 5 Exception thrown:\n"
+       << "  " << e.getDetailMsg();
+    throw en;
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Write rows to a field created by create_extendible. This is the
+/// untemplated part of write_field_rows.
+//-----------------------------------------------------------------------
+
+void HdfFile::write_rows(const std::string& Dataname, int Start_row,
+			 int Rank, const int* Shape, const void* Data,
+			 const H5::DataType& Mem_type)
+{
+  try {
+    DataSet d = h->openDataSet(Dataname);
+    DataSpace fs = d.getSpace();
+    if(fs.getSimpleExtentNdims() != Rank) {
+      Exception e;
+      e << "Field " << Dataname << " has rank " 
+	<< fs.getSimpleExtentNdims() << ", but we are writing data of rank "
+	<< Rank;
+      throw e;
+    }
+    std::vector<hsize_t> sz(Rank), count(Rank), start(Rank, 0);
+    fs.getSimpleExtentDims(&sz[0]);
+    for(int i = 0; i < Rank; ++i) {
+      count[i] = Shape[i];
+      if(i > 0 && sz[i] != count[i]) {
+	Exception e;
+	e << "Rows written to field " << Dataname 
+	  << " need to be the same size as the existing rows";
+	throw e;
+      }
+    }
+    start[0] = Start_row;
+    if(sz[0] < start[0] + count[0]) {
+      sz[0] = start[0] + count[0];
+      d.extend(&sz[0]);
+      fs = d.getSpace();
+    }
+    if(count[0] == 0)
+      return;
+    fs.selectHyperslab(H5S_SELECT_SET, &count[0], &start[0]);
+    DataSpace ms(Rank, &count[0]);
+    d.write(Data, Mem_type, ms, fs);
+  } catch(const H5::Exception& e) {
+    Exception en;
+    en << "While writing field " << Dataname
+       << " for the file '" << fname
+       << "' a HDF 5 Exception thrown:\n"
+       << "  " << e.getDetailMsg();
+    throw en;
+  }
+}
+
 void HdfFile::print(std::ostream& Os) const
 {
   Os << "HdfFile: \n" 
@@ -7,11 +7,65 @@
 #include <blitz/array.h>
 #include <boost/shared_ptr.hpp>
 #include <H5Cpp.h>
+#include <list>
+#include <map>
 #include <vector>
 #include <stdint.h>
 #include <string.h>
 
 namespace FullPhysics {
+class HdfFile;
+
+/****************************************************************//**
+  Statistics for the reads done for one dataset, see
+  HdfFile::read_statistic.
+*******************************************************************/
+
+class HdfReadStatistic {
+public:
+  HdfReadStatistic() : number_read(0), number_byte(0), time(0) {}
+  int number_read;
+  double number_byte;
+  /// Wall clock time in seconds.
+  double time;
+};
+
+// Helper classes for HdfFile.
+// Don't have Doxygen document these classes.
+/// @cond
+//-----------------------------------------------------------------------
+// An opened DataSet, along with its DataSpace in the file and the
+// memory DataSpace used for the last hyperslab read. When we read the
+// same size hyperslab again (e.g., one sounding at a time, or one
+// chunk of an ABSCO table at a time) we reuse these rather than
+// creating them again.
+//-----------------------------------------------------------------------
+class HdfDataSetHandle {
+public:
+  H5::DataSet d;
+  H5::DataSpace fs;
+  H5::DataSpace ms;
+  std::vector<hsize_t> dims, last_start, last_size;
+  std::list<std::string>::iterator lru;
+  void select_hyperslab(const hsize_t* Start, const hsize_t* Size);
+};
+
+//-----------------------------------------------------------------------
+// Add the time and size of a read to the HdfFile read statistics when
+// this goes out of scope.
+//-----------------------------------------------------------------------
+class HdfReadTimer {
+public:
+  HdfReadTimer(const HdfFile& F, const std::string& Dataname, 
+	       double Number_byte);
+  ~HdfReadTimer();
+private:
+  const HdfFile& f;
+  const std::string& dname;
+  double nbyte, start;
+};
+/// @endcond
+
 /****************************************************************//**
   This class reads and writes a HDF5 file. Note that this is just a
   thin layer on top of the HDF 5 libraries to make the file operations
@@ -34,13 +88,25 @@ namespace FullPhysics {
 
   Note that in what is a fairly odd convention, we add a trailing '\0'
   in our fixed length string, so there is one extra character.
+
+  For files opened in READ mode, we keep the most recently used
+  DataSets open (see dataset_cache_size), so reading the same dataset
+  over and over (e.g., AbscoHdf reading the next chunk of a table)
+  doesn't need to look up the dataset by name and open it each
+  time. Files opened for writing don't use the cache, since writing
+  can change the datasets.
+
+  We also collect statistics for each dataset read (number of reads,
+  bytes and time), see read_statistic. If the environment variable
+  L2_FP_HDF_READ_STATISTIC is set, these are written to the Logger
+  when the file is closed.
 *******************************************************************/
 
 class HdfFile : public Printable<HdfFile> {
 public:
   enum Mode {READ, CREATE, READ_WRITE};
   HdfFile(const std::string& Fname, Mode M = READ);
-  virtual ~HdfFile() {}
+  virtual ~HdfFile();
 
 //-----------------------------------------------------------------------
 /// Check to see if an object (such as a Dataset) is in the file.
@@ -102,6 +168,16 @@ public:
   template<class T, int D> void write_field(const std::string& Dataname,
 					    const blitz::Array<T, D>& Data,
 					    H5::DataType P);
+  template<class T, int D> void 
+  create_extendible_field(const std::string& Dataname,
+			  const blitz::TinyVector<int, D>& Chunk_shape,
+			  int Deflate_level = 0, bool Shuffle = false);
+  template<class T, int D> void 
+  write_field_rows(const std::string& Dataname, int Start_row,
+		   const blitz::Array<T, D>& Data);
+  template<int D> void 
+  write_field_rows(const std::string& Dataname, int Start_row,
+		   const blitz::Array<std::string, D>& Data);
   void dimension_metadata(const std::string& Name, 
 			  const std::string& Description,
 			  int Size);
@@ -123,7 +199,31 @@ public:
 /// close (e.g., for a unit test)
 //-----------------------------------------------------------------------
 
-  void close() { h->close(); }
+  void close() { clear_dataset_cache(); h->close(); }
+
+//-----------------------------------------------------------------------
+/// Maximum number of DataSets we keep open. This is 0 for files that
+/// aren't opened in READ mode.
+//-----------------------------------------------------------------------
+
+  int dataset_cache_size() const { return max_cache; }
+  void dataset_cache_size(int V);
+  void clear_dataset_cache() const;
+
+//-----------------------------------------------------------------------
+/// Statistics for the reads done so far, by dataset name.
+//-----------------------------------------------------------------------
+
+  const std::map<std::string, HdfReadStatistic>& read_statistic() const
+  { return read_stat; }
+
+//-----------------------------------------------------------------------
+/// Reset the read statistics, e.g., at the start of a sounding.
+//-----------------------------------------------------------------------
+
+  void reset_read_statistic() { read_stat.clear(); }
+  void print_read_statistic(std::ostream& Os) const;
+  HdfDataSetHandle& dataset_handle(const std::string& Dataname) const;
 
 //-----------------------------------------------------------------------
 /// File name
@@ -155,9 +255,16 @@ public:
   H5::H5File& h5_file() { return *h; };
   const H5::H5File& h5_file() const { return *h; };
 private:
+  friend class HdfReadTimer;
   boost::shared_ptr<H5::H5File> h;
   std::string fname;
   Mode mode_;
+  int max_cache;
+  mutable std::list<std::string> lru_list;
+  mutable std::map<std::string, HdfDataSetHandle> dataset_cache;
+  mutable HdfDataSetHandle scratch_handle;
+  mutable std::map<std::string, HdfReadStatistic> read_stat;
+  void open_dataset(const std::string& Dataname, HdfDataSetHandle& H) const;
   void create_group_if_needed(const std::string& Dataname, 
 			      H5::H5Location& Parent);
   H5::Attribute open_attribute(const std::string& Aname) const;
@@ -167,6 +274,14 @@ private:
   bool is_present(const std::string& Objname, 
 		  const H5::H5Location& Parent) const;
   void write_type(const std::string& Dataname, const H5::DataType& P);
+  template<class T> H5::DataType extendible_type() const 
+  { return pred_data<T>(); }
+  void create_extendible(const std::string& Dataname, const H5::DataType& P,
+			 int Rank, const int* Chunk_shape,
+			 int Deflate_level, bool Shuffle);
+  void write_rows(const std::string& Dataname, int Start_row,
+		  int Rank, const int* Shape, const void* Data,
+		  const H5::DataType& Mem_type);
 };
 
 template<> inline H5::PredType HdfFile::pred_arr<int>() const 
@@ -177,6 +292,8 @@ template<> inline H5::PredType HdfFile::pred_arr<double>() const
 {return H5::PredType::NATIVE_DOUBLE;}
 template<> inline H5::PredType HdfFile::pred_arr<float>() const 
 {return H5::PredType::NATIVE_FLOAT;}
+template<> inline H5::PredType HdfFile::pred_arr<unsigned short>() const 
+{return H5::PredType::NATIVE_USHORT;}
 template<> inline H5::PredType HdfFile::pred_data<int>() const 
 {return H5::PredType::NATIVE_INT32;}
 template<> inline H5::PredType HdfFile::pred_data<int64_t>() const 
@@ -185,6 +302,10 @@ template<> inline H5::PredType HdfFile::pred_data<double>() const
 {return H5::PredType::NATIVE_DOUBLE;}
 template<> inline H5::PredType HdfFile::pred_data<float>() const
 {return H5::PredType::NATIVE_FLOAT;}
+template<> inline H5::PredType HdfFile::pred_data<unsigned short>() const
+{return H5::PredType::NATIVE_UINT16;}
+template<> inline H5::DataType HdfFile::extendible_type<std::string>() const
+{return H5::StrType(H5::PredType::C_S1, H5T_VARIABLE);}
 
 //-----------------------------------------------------------------------
 /// Read the given attribute attached to a group or dataset.
@@ -314,20 +435,16 @@ blitz::TinyVector<int,D> read_shape(const HdfFile& hf,
 				    const std::string& Dataname) const
 {
   try {
-    using namespace H5;
-    DataSet d = h.openDataSet(Dataname);
-    DataSpace ds = d.getSpace();
-    if(ds.getSimpleExtentNdims() != D) {
+    HdfDataSetHandle& hd = hf.dataset_handle(Dataname);
+    if((int) hd.dims.size() != D) {
       Exception e;
       e << "Dataset " << Dataname << " does not have the expected rank of " 
 	<< D;
       throw e;
     }
-    hsize_t dims[D];
-    ds.getSimpleExtentDims(dims, NULL);
     blitz::TinyVector<int,D> dims2;
     for(int i = 0; i < D; ++i)
-      dims2(i) = (int) dims[i];
+      dims2(i) = (int) hd.dims[i];
     return dims2;
   } catch(const H5::Exception& e) {
     Exception en;
@@ -350,21 +467,19 @@ blitz::Array<T, D> read_field(const HdfFile& hf,
 {
   try {
   using namespace H5;
-  DataSet d = h.openDataSet(Dataname);
-  DataSpace ds = d.getSpace();
-  if(ds.getSimpleExtentNdims() != D) {
+  HdfDataSetHandle& hd = hf.dataset_handle(Dataname);
+  if((int) hd.dims.size() != D) {
     Exception e;
     e << "Dataset " << Dataname << " does not have the expected rank of " 
       << D;
     throw e;
   }
-  hsize_t dims[D];
-  ds.getSimpleExtentDims(dims, NULL);
   blitz::TinyVector<int,D> dims2;
   for(int i = 0; i < D; ++i)
-    dims2(i) = (int) dims[i];
+    dims2(i) = (int) hd.dims[i];
   blitz::Array<T, D> res(dims2);
-  d.read(res.dataFirst(), hf.pred_arr<T>());
+  HdfReadTimer tm(hf, Dataname, (double) res.size() * sizeof(T));
+  hd.d.read(res.dataFirst(), hf.pred_arr<T>());
   return res;
   } catch(const H5::Exception& e) {
     Exception en;
@@ -384,18 +499,17 @@ blitz::Array<T, D> read_field(const HdfFile& hf,
 {
   try {
   using namespace H5;
-  DataSet d = h.openDataSet(Dataname);
-  DataSpace ds = d.getSpace();
-  if(ds.getSimpleExtentNdims() != D) {
+  HdfDataSetHandle& hd = hf.dataset_handle(Dataname);
+  if((int) hd.dims.size() != D) {
     Exception e;
     e << "Dataset " << Dataname << " does not have the expected rank of " 
       << D;
     throw e;
   }
-  DataSpace ms(D, &Size[0]);
-  ds.selectHyperslab(H5S_SELECT_SET, &Size[0], &Start[0]);
+  hd.select_hyperslab(&Start[0], &Size[0]);
   blitz::Array<T, D> res(Size);
-  d.read(res.dataFirst(), hf.pred_arr<T>(), ms, ds);
+  HdfReadTimer tm(hf, Dataname, (double) res.size() * sizeof(T));
+  hd.d.read(res.dataFirst(), hf.pred_arr<T>(), hd.ms, hd.fs);
   return res;
   } catch(const H5::Exception& e) {
     Exception en;
@@ -417,19 +531,17 @@ blitz::Array<std::string, D> read_field(const HdfFile& hf,
 {
   try {
   using namespace H5;
-  DataSet d = h.openDataSet(Dataname);
-  DataSpace ds = d.getSpace();
-  if(ds.getSimpleExtentNdims() != D) {
+  HdfDataSetHandle& hd = hf.dataset_handle(Dataname);
+  DataSet& d = hd.d;
+  if((int) hd.dims.size() != D) {
     Exception e;
     e << "Dataset " << Dataname << " does not have the expected rank of " 
       << D;
     throw e;
   }
-  hsize_t dims[D];
-  ds.getSimpleExtentDims(dims, NULL);
   blitz::TinyVector<int,D> dims2;
   for(int i = 0; i < D; ++i)
-    dims2(i) = (int) dims[i];
+    dims2(i) = (int) hd.dims[i];
 
   DataType dt = d.getDataType();
   blitz::Array<std::string, D> result_data(dims2);
@@ -479,16 +591,17 @@ blitz::Array<std::string, D> read_field(const HdfFile& hf,
 {
   try {
   using namespace H5;
-  DataSet d = h.openDataSet(Dataname);
-  DataSpace ds = d.getSpace();
-  if(ds.getSimpleExtentNdims() != D) {
+  HdfDataSetHandle& hd = hf.dataset_handle(Dataname);
+  DataSet& d = hd.d;
+  if((int) hd.dims.size() != D) {
     Exception e;
     e << "Dataset " << Dataname << " does not have the expected rank of " 
       << D;
     throw e;
   }
-  DataSpace ms(D, &Size[0]);
-  ds.selectHyperslab(H5S_SELECT_SET, &Size[0], &Start[0]);
+  hd.select_hyperslab(&Start[0], &Size[0]);
+  DataSpace& ms = hd.ms;
+  DataSpace& ds = hd.fs;
   DataType dt = d.getDataType();
   blitz::Array<std::string, D> result_data(Size);
   if(dt.isVariableStr()) {
@@ -653,10 +766,10 @@ T HdfFile::read_field(const std::string& Dataname) const
 {
   try {
     using namespace H5;
-    DataSet d = h->openDataSet(Dataname);
-    DataSpace ds = d.getSpace();
+    HdfDataSetHandle& hd = dataset_handle(Dataname);
     T res;
-    d.read(&res, pred_arr<T>());
+    HdfReadTimer tm(*this, Dataname, (double) sizeof(T));
+    hd.d.read(&res, pred_arr<T>());
     return res;
   } catch(const H5::Exception& e) {
     Exception en;
@@ -1003,5 +1116,65 @@ template<class T> inline void HdfFile::write_field(const std::string& Dataname,
   }
 }
 
+//-----------------------------------------------------------------------
+/// Create a field that we can add rows to later with
+/// write_field_rows. The field starts out with 0 rows, the first
+/// dimension is unlimited. The other dimensions are fixed at the
+/// size given in Chunk_shape, which also gives the HDF chunk
+/// size. Chunk_shape(0) is the number of rows in each chunk.
+///
+/// You can optionally request that the data be compressed, using the
+/// deflate filter (with Deflate_level 1 - 9, 0 means no
+/// compression). Shuffle turns on the byte shuffle filter, which
+/// usually improves the compression of floating point data.
+///
+/// std::string fields are written as variable length strings, there
+/// isn't support for fixed length strings.
+//-----------------------------------------------------------------------
+
+template<class T, int D> inline void
+HdfFile::create_extendible_field(const std::string& Dataname,
+				 const blitz::TinyVector<int, D>& Chunk_shape,
+				 int Deflate_level, bool Shuffle)
+{
+  H5::DataType p = extendible_type<T>();
+  create_extendible(Dataname, p, D, Chunk_shape.data(), Deflate_level, 
+		    Shuffle);
+  if(p.getClass() == H5T_STRING)
+    write_attribute(Dataname + "/Type", "VarLenStr");
+  else
+    write_type(Dataname, p);
+}
+
+//-----------------------------------------------------------------------
+/// Write rows to a field created by create_extendible_field,
+/// starting at Start_row. The field is extended if needed. All the
+/// dimensions other than the first one need to match the size given
+/// when we created the field.
+//-----------------------------------------------------------------------
+
+template<class T, int D> inline void
+HdfFile::write_field_rows(const std::string& Dataname, int Start_row,
+			  const blitz::Array<T, D>& Data)
+{
+  blitz::Array<T, D> data2 = to_c_order_const(Data);
+  write_rows(Dataname, Start_row, D, data2.shape().data(), 
+	     data2.dataFirst(), pred_arr<T>());
+}
+
+template<int D> inline void
+HdfFile::write_field_rows(const std::string& Dataname, int Start_row,
+			  const blitz::Array<std::string, D>& Data)
+{
+  blitz::Array<std::string, D> data2 = to_c_order_const(Data);
+  blitz::Array<const char*, D> data3(data2.shape());
+  typename blitz::Array<std::string, D>::const_iterator i1;
+  typename blitz::Array<const char*, D>::iterator i2 = data3.begin();
+  for(i1 = data2.begin(); i1 != data2.end(); ++i1, ++i2)
+    *i2 = i1->c_str();
+  write_rows(Dataname, Start_row, D, data3.shape().data(), 
+	     data3.dataFirst(), extendible_type<std::string>());
+}
+
 }
 #endif
@@ -133,6 +133,40 @@ BOOST_AUTO_TEST_CASE(write)
   BOOST_CHECK_EQUAL(att5read[1], "string2");
 }
 
+BOOST_AUTO_TEST_CASE(dataset_cache)
+{
+  HdfFile h(test_data_dir() + "l1b.h5");
+  BOOST_CHECK_EQUAL(h.dataset_cache_size(), 100);
+  std::string fname = "/FootprintGeometry/footprint_stokes_coefficients";
+  Array<double, 4> st = h.read_field<double, 4>(fname);
+  TinyVector<int, 4> start, size;
+  start = 0, 0, 0, 0;
+  size = 1, st.cols(), 1, st.extent(fourthDim);
+  // Read hyperslabs of the same size, and a different size, to
+  // make sure the cached selection gets updated correctly.
+  for(int i = 0; i < st.extent(thirdDim); ++i) {
+    start(2) = i;
+    Array<double, 4> st2 = h.read_field<double, 4>(fname, start, size);
+    BOOST_CHECK_MATRIX_CLOSE(st2(0, Range::all(), 0, Range::all()),
+			     st(0, Range::all(), i, Range::all()));
+  }
+  start(2) = 0;
+  size(2) = st.extent(thirdDim);
+  BOOST_CHECK_MATRIX_CLOSE(h.read_field<double, 4>(fname, start, size)
+			   (0, Range::all(), Range::all(), Range::all()),
+			   st(0, Range::all(), Range::all(), Range::all()));
+  BOOST_CHECK_EQUAL(h.read_statistic().find(fname)->second.number_read,
+		    st.extent(thirdDim) + 2);
+  h.dataset_cache_size(0);
+  Array<double, 4> st3 = h.read_field<double, 4>(fname);
+  BOOST_CHECK_MATRIX_CLOSE(st3(0, Range::all(), 0, Range::all()),
+			   st(0, Range::all(), 0, Range::all()));
+  h.reset_read_statistic();
+  BOOST_CHECK_EQUAL((int) h.read_statistic().size(), 0);
+  HdfFile hw("hdf_file_cache.h5", HdfFile::CREATE);
+  BOOST_CHECK_EQUAL(hw.dataset_cache_size(), 0);
+}
+
 BOOST_AUTO_TEST_CASE(bad_data)
 {
   BOOST_CHECK_THROW(HdfFile h(test_data_dir() + "bad_file"), 
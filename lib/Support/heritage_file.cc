@@ -1,8 +1,16 @@
 #include "heritage_file.h"
 #include "fstream_compress.h"
 #include "environment_substitute.h"
-#include <boost/regex.hpp>
 #include <boost/foreach.hpp>
+#include <boost/algorithm/string.hpp>
+#include <boost/functional/hash.hpp>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <strings.h>
 #include <sys/stat.h>
 #include "unistd.h"
 using namespace FullPhysics;
@@ -55,136 +63,249 @@ HeritageFile::HeritageFile(const std::string& Fname)
   parse_file(Fname);
 }
 
+int HeritageFile::number_cache_read_ = 0;
+
+/// @cond
+namespace {
 //-----------------------------------------------------------------------
-/// Make a pass through the data and just count the number of
-/// blocks. We do this because we treat blocks with a count of 1
-/// different than with a count > 1.
+/// A line of the keyword part of a heritage file, after we have
+/// stripped comments and replaced environment variables. We
+/// recognize the handful of line types with simple scanning rather
+/// than regular expressions, since the files can be thousands of
+/// lines long.
 //-----------------------------------------------------------------------
 
-void HeritageFile::parse_file_block_count(const std::string& fname)
+class HeritageLine {
+public:
+  enum LineType {BLANK, BEGIN_HEADER, END_HEADER, BEGIN_SECTION, 
+		 END_SECTION, ASSIGN, UNRECOGNIZED};
+  LineType type;
+  int line;
+  // Section name for BEGIN_SECTION and END_SECTION, keyword and
+  // value for ASSIGN.
+  std::string key, value;
+  HeritageLine(const std::string& Ln, int Line);
+private:
+  bool match_begin_end(const std::string& Ln, const char* Kw);
+};
+
+inline bool is_word(char c)
 {
-  IstreamCompress ifn(fname);
-  if(!ifn.good())
-    throw Exception("Trouble reading file " + fname);
-  ifn.exceptions(std::ifstream::badbit);
-  std::string ln;
-  // We handle "HEADER" blocks a little differently. We only have one
-  // in a file, and after a HEADER block we may have matrix data. We
-  // also leave HEADER outside of the keyword. So track when we enter
-  // a header.
-  bool have_header = false;
-  bool done_with_header = false;
-  std::vector<std::string> keyword;
-  int line = 0;			// Keep track of the line we are
-				// reading so we can report it in any
-				// error message
-  try {
-    while(!ifn.eof() && ifn.good() && !done_with_header) {
-      getline(ifn, ln);
-      line++;
-      if(ifn.good()) {
+  return isalnum((unsigned char) c) || c == '_';
+}
 
-// -----------------------------------------------------------------------
-// Strip off comments, and replace environment variables.
-// -----------------------------------------------------------------------
+inline bool has_word(const std::string& Ln)
+{
+  for(std::string::const_iterator i = Ln.begin(); i != Ln.end(); ++i)
+    if(is_word(*i))
+      return true;
+  return false;
+}
 
-	ln = ln.substr(0,ln.find("#"));
-	ln = environment_substitute(ln);
-	boost::smatch m;
+//-----------------------------------------------------------------------
+/// Strip trailing spaces from the range [Start, End) of Ln, and
+/// return it as a string.
+//-----------------------------------------------------------------------
 
-// -----------------------------------------------------------------------
-// Check if we are:
-//   1) In a HEADER block.
-// -----------------------------------------------------------------------
+inline std::string trim_space(const std::string& Ln, size_t Start, size_t End)
+{
+  while(Start < End && Ln[Start] == ' ')
+    ++Start;
+  while(End > Start && Ln[End - 1] == ' ')
+    --End;
+  return Ln.substr(Start, End - Start);
+}
 
-	if(boost::regex_match(ln, m, boost::regex("(?i) *begin +header *"))) {
-	  have_header = true;
-	  if(keyword.size() !=0)
-	    throw Exception(
-"Error reading file. Have a HEADER block nested inside of another block"
-			    );
+//-----------------------------------------------------------------------
+/// Match lines like " begin foo ", where "begin" is given as Kw. We
+/// fill in key with the section name.
+//-----------------------------------------------------------------------
 
-// -----------------------------------------------------------------------
-//   2) Ending a HEADER block.
-// -----------------------------------------------------------------------
+bool HeritageLine::match_begin_end(const std::string& Ln, const char* Kw)
+{
+  size_t i = Ln.find_first_not_of(' ');
+  size_t n = strlen(Kw);
+  if(i == std::string::npos || Ln.size() < i + n ||
+     strncasecmp(Ln.c_str() + i, Kw, n) != 0)
+    return false;
+  i += n;
+  size_t j = Ln.find_first_not_of(' ', i);
+  if(j == i || j == std::string::npos)
+    return false;
+  size_t k = j;
+  while(k < Ln.size() && is_word(Ln[k]))
+    ++k;
+  if(k == j || Ln.find_first_not_of(' ', k) != std::string::npos)
+    return false;
+  key.assign(Ln, j, k - j);
+  return true;
+}
 
-	} else if(boost::regex_match(ln, m, boost::regex("(?i) *end +header *"))) {
-	  if(!have_header)
-	    throw Exception(
- "Error reading file. End of header seen before header started"
-			    );
-	  done_with_header = true;
+HeritageLine::HeritageLine(const std::string& Ln, int Line)
+  : line(Line)
+{
+  if(match_begin_end(Ln, "begin"))
+    type = (boost::iequals(key, "header") ? BEGIN_HEADER : BEGIN_SECTION);
+  else if(match_begin_end(Ln, "end"))
+    type = (boost::iequals(key, "header") ? END_HEADER : END_SECTION);
+  else {
+    size_t eq = Ln.find('=');
+    if(eq != std::string::npos)
+      key = trim_space(Ln, 0, eq);
+    if(eq != std::string::npos && key != "") {
+      type = ASSIGN;
+      value = trim_space(Ln, eq + 1, Ln.size());
+    } else
+      type = (has_word(Ln) ? UNRECOGNIZED : BLANK);
+  }
+}
 
-// -----------------------------------------------------------------------
-//   3) Beginning a section
-// -----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+/// Add a section to the stack of keyword paths.
+//-----------------------------------------------------------------------
 
-	} else if(boost::regex_match(ln, m, boost::regex("(?i) *begin +(\\w+) *"))) {
-	  std::string t = m[1];
-	  keyword.push_back(t);
-	  std::string valkey = keyword[0];
-	  for(int i = 1; i < (int) keyword.size(); ++i)
-	    valkey = valkey + "/" + keyword[i];
-	  boost::to_lower(valkey);
-	  if(section_to_count.count(valkey) == 0)
-	    section_to_count[valkey] = 1;
-	  else 
-	    section_to_count[valkey] += 1;
+inline void push_path(std::vector<std::string>& Path, const std::string& Key)
+{
+  std::string t = Key;
+  boost::to_lower(t);
+  Path.push_back(Path.size() == 0 ? t : Path.back() + "/" + t);
+}
 
-// -----------------------------------------------------------------------
-//   4) Ending a section
-// -----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+/// Strip off comments, and replace environment variables. We note if
+/// we did any replacement, since the results then depend on more than
+/// the file contents.
+//-----------------------------------------------------------------------
 
-	} else if(boost::regex_match(ln, m, boost::regex("(?i) *end +(\\w+) *"))) {
-	  std::string t = m[1];
-	  if(keyword.size() < 1 ||
-	     keyword.back() != t)
-	    throw Exception(
-"Error reading file. Expected to end section for\n"
-"'" + keyword.back() + "' instead section end was for '" +  t + "'");
-	  keyword.pop_back();
+inline void prepare_line(std::string& Ln, bool& Env_used)
+{
+  size_t c = Ln.find('#');
+  if(c != std::string::npos)
+    Ln.erase(c);
+  if(Ln.find("$(") != std::string::npos) {
+    Ln = environment_substitute(Ln);
+    Env_used = true;
+  }
+}
 
-// -----------------------------------------------------------------------
-//   5) Giving the name in a section
-// -----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+/// Binary reading and writing for the sidecar cache.
+//-----------------------------------------------------------------------
 
-	} else if(boost::regex_match(ln, m, boost::regex("(?i) *name *= *(.+?) *"))) {
-	  if(!have_header && keyword.size() >= 1) {
-	    std::string valkey = keyword[0];
-	    for(int i = 1; i < (int) keyword.size(); ++i)
-	      valkey = valkey + "/" + keyword[i];
-	    boost::to_lower(valkey);
-	    section_and_index_to_name[valkey][section_to_count[valkey] - 1] = 
-	      m[1];
-	  }
+const int heritage_cache_version = 2;
 
-// -----------------------------------------------------------------------
-//   6) Skip other data for now, we handle that in second pass.
-// -----------------------------------------------------------------------
+//-----------------------------------------------------------------------
+/// Canonical absolute path of a file, so the same file reached
+/// through different relative paths or symbolic links shares a cache.
+/// If the file doesn't exist we just return the name we were given.
+//-----------------------------------------------------------------------
 
-	} else {
-	}
-      }
-    }
-    if(keyword.size() != 0)
-      throw Exception(
-"Error reading file. Missing end of section for '" + 
-keyword.back() + "'");
-  } catch(Exception& exc) {
-    exc << "\nFile: " << fname << "\n"
-	<< "Line: " << line;
-    throw;
+inline std::string canonical_name(const std::string& Fname)
+{
+  char buf[PATH_MAX];
+  if(!realpath(Fname.c_str(), buf))
+    return Fname;
+  return std::string(buf);
+}
+
+//-----------------------------------------------------------------------
+/// What we check to decide if the cache is up to date. A file can be
+/// rewritten several times in a second, so we use the modification
+/// time to the nanosecond along with the size and inode.
+//-----------------------------------------------------------------------
+
+class FileStamp {
+public:
+  long long mtime_sec, mtime_nsec, size, inode;
+  FileStamp() : mtime_sec(0), mtime_nsec(0), size(0), inode(0) {}
+  FileStamp(const struct stat& Buf)
+    : mtime_sec(Buf.st_mtime),
+#ifdef __APPLE__
+      mtime_nsec(Buf.st_mtimespec.tv_nsec),
+#else
+      mtime_nsec(Buf.st_mtim.tv_nsec),
+#endif
+      size(Buf.st_size), inode(Buf.st_ino) {}
+  bool operator==(const FileStamp& S) const
+  { return mtime_sec == S.mtime_sec && mtime_nsec == S.mtime_nsec &&
+      size == S.size && inode == S.inode; }
+};
+
+template<class T> inline void cache_write(std::ostream& Os, const T& V)
+{
+  Os.write(reinterpret_cast<const char*>(&V), sizeof(T));
+}
+
+inline void cache_write(std::ostream& Os, const std::string& V)
+{
+  cache_write(Os, (int) V.size());
+  Os.write(V.data(), V.size());
+}
+
+template<class K, class T> inline void 
+cache_write(std::ostream& Os, const std::map<K, T>& V)
+{
+  cache_write(Os, (int) V.size());
+  for(typename std::map<K, T>::const_iterator i = V.begin(); i != V.end();
+      ++i) {
+    cache_write(Os, i->first);
+    cache_write(Os, i->second);
   }
 }
 
+template<class T> inline void cache_read(std::istream& Is, T& V)
+{
+  Is.read(reinterpret_cast<char*>(&V), sizeof(T));
+}
+
+inline void cache_read(std::istream& Is, std::string& V)
+{
+  int n = 0;
+  cache_read(Is, n);
+  if(!Is.good() || n < 0)
+    throw Exception("Bad heritage file cache");
+  V.resize(n);
+  if(n > 0)
+    Is.read(&V[0], n);
+}
+
+template<class K, class T> inline void 
+cache_read(std::istream& Is, std::map<K, T>& V)
+{
+  int n = 0;
+  cache_read(Is, n);
+  if(!Is.good() || n < 0)
+    throw Exception("Bad heritage file cache");
+  for(int i = 0; i < n; ++i) {
+    K k;
+    cache_read(Is, k);
+    cache_read(Is, V[k]);
+  }
+}
+}
+/// @endcond
+
 //-----------------------------------------------------------------------
 /// Parse the given file, and add the keyword information from that
 /// file to the keyword list.
+///
+/// We read the keyword part of the file once, and then make two
+/// passes through the lines we found. The first pass counts the
+/// number of blocks, because we treat blocks with a count of 1
+/// different than with a count > 1. The second pass fills in the
+/// values.
 //-----------------------------------------------------------------------
 
 void HeritageFile::parse_file(const std::string& fname)
 {
-  parse_file_block_count(fname);
+  // The cache holds everything read from one file, so we can only
+  // use it for the first file we parse.
+  std::string cfname;
+  if(keyword_to_value.empty() && section_to_count.empty() &&
+     data_.size() == 0)
+    cfname = cache_file_name(fname);
+  if(cfname != "" && read_cache(fname, cfname))
+    return;
   IstreamCompress ifn(fname);
   if(!ifn.good())
     throw Exception("Trouble reading file " + fname);
@@ -196,148 +317,157 @@ void HeritageFile::parse_file(const std::string& fname)
   // a header.
   bool have_header = false;
   bool done_with_header = false;
+  bool env_used = false;
+  std::vector<HeritageLine> hline;
   std::vector<std::string> keyword;
-  std::map<std::string, int> cur_idx;
+  // Keyword path of each enclosing section, in lower case.
+  std::vector<std::string> path;
   int line = 0;			// Keep track of the line we are
 				// reading so we can report it in any
 				// error message
   try {
-    while(!ifn.eof() && ifn.good() && !done_with_header) {
-      getline(ifn, ln);
-      line++;
-      if(ifn.good()) {
 
 // -----------------------------------------------------------------------
-// Strip off comments, and replace environment variables.
+// First pass, read in the lines and count the number of blocks.
 // -----------------------------------------------------------------------
 
-	ln = ln.substr(0,ln.find("#"));
-	ln = environment_substitute(ln);
-	boost::smatch m;
-
-// -----------------------------------------------------------------------
-// Check if we are:
-//   1) In a HEADER block.
-// -----------------------------------------------------------------------
-
-	if(boost::regex_match(ln, m, boost::regex("(?i) *begin +header *"))) {
-	  have_header = true;
-	  if(keyword.size() !=0)
-	    throw Exception(
+    while(!done_with_header && getline(ifn, ln)) {
+      line++;
+      prepare_line(ln, env_used);
+      HeritageLine h(ln, line);
+      switch(h.type) {
+      case HeritageLine::BLANK:
+	continue;
+      case HeritageLine::BEGIN_HEADER:
+	have_header = true;
+	if(keyword.size() !=0)
+	  throw Exception(
 "Error reading file. Have a HEADER block nested inside of another block"
-			    );
-
-// -----------------------------------------------------------------------
-//   2) Ending a HEADER block.
-// -----------------------------------------------------------------------
-
-	} else if(boost::regex_match(ln, m, boost::regex("(?i) *end +header *"))) {
-	  if(!have_header)
-	    throw Exception(
+			  );
+	break;
+      case HeritageLine::END_HEADER:
+	if(!have_header)
+	  throw Exception(
  "Error reading file. End of header seen before header started"
-			    );
-	  done_with_header = true;
-
-// -----------------------------------------------------------------------
-//   3) Beginning a section
-// -----------------------------------------------------------------------
-
-	} else if(boost::regex_match(ln, m, boost::regex("(?i) *begin +(\\w+) *"))) {
-	  std::string t = m[1];
-	  keyword.push_back(t);
-	  std::string valkey = keyword[0];
-	  for(int i = 1; i < (int) keyword.size(); ++i)
-	    valkey = valkey + "/" + keyword[i];
-	  boost::to_lower(valkey);
-	  if(cur_idx.count(valkey) == 0)
-	    cur_idx[valkey] = 0;
-	  else 
-	    cur_idx[valkey] += 1;
-	  
+			  );
+	done_with_header = true;
+	break;
+      case HeritageLine::BEGIN_SECTION:
+	keyword.push_back(h.key);
+	push_path(path, h.key);
+	section_to_count[path.back()] += 1;
+	break;
+      case HeritageLine::END_SECTION:
+	if(keyword.size() < 1 ||
+	   keyword.back() != h.key)
+	  throw Exception(
+"Error reading file. Expected to end section for\n"
+"'" + (keyword.size() < 1 ? std::string("") : keyword.back()) + 
+"' instead section end was for '" +  h.key + "'");
+	keyword.pop_back();
+	path.pop_back();
+	break;
+      case HeritageLine::ASSIGN:
+	if(!have_header && path.size() >= 1 && h.value != "" &&
+	   boost::iequals(h.key, "name"))
+	  section_and_index_to_name[path.back()]
+	    [section_to_count[path.back()] - 1] = h.value;
+	break;
+      case HeritageLine::UNRECOGNIZED:
+	break;
+      }
+      hline.push_back(h);
+    }
+    if(keyword.size() != 0)
+      throw Exception(
+"Error reading file. Missing end of section for '" + 
+keyword.back() + "'");
 
 // -----------------------------------------------------------------------
-//   4) Ending a section
-// -----------------------------------------------------------------------
-
-	} else if(boost::regex_match(ln, m, boost::regex("(?i) *end +(\\w+) *"))) {
-	  std::string t = m[1];
-	  if(keyword.size() < 1 ||
-	     keyword.back() != t)
-	    throw Exception(
-"Error reading file. Expected to end section for\n"
-"'" + keyword.back() + "' instead section end was for '" +  t + "'");
-	  keyword.pop_back();
+// Second pass, fill in the values.
+// -----------------------------------------------------------------------
+
+    std::map<std::string, int> cur_idx;
+    have_header = false;
+    BOOST_FOREACH(const HeritageLine& h, hline) {
+      line = h.line;
+      switch(h.type) {
+      case HeritageLine::BLANK:
+      case HeritageLine::END_HEADER:
+	break;
+      case HeritageLine::BEGIN_HEADER:
+	have_header = true;
+	break;
+      case HeritageLine::BEGIN_SECTION:
+	{
+	  push_path(path, h.key);
+	  std::map<std::string, int>::iterator i = cur_idx.find(path.back());
+	  if(i == cur_idx.end())
+	    cur_idx[path.back()] = 0;
+	  else
+	    i->second += 1;
+	}
+	break;
+      case HeritageLine::END_SECTION:
+	path.pop_back();
+	break;
 
 // -----------------------------------------------------------------------
-//   5) Setting a value. We allow this to be empty, for keywords set
-//   to null.
+// Setting a value. We allow this to be empty, for keywords set to
+// null.
 // -----------------------------------------------------------------------
 
-	} else if(boost::regex_match(ln, m, boost::regex(" *(.+?) *= *(.*?) *"))) {
+      case HeritageLine::ASSIGN:
+	{
+	  std::string k = h.key;
+	  boost::to_lower(k);
 	  if(have_header) {
-	    std::string valkey = m[1];
-	    boost::to_lower(valkey);
-	    keyword_to_value[valkey] = m[2];
-	    keyword_to_file[valkey] = fname;
-	    keyword_to_line[valkey] = line;
-	  } else {
-	    if(keyword.size() < 1)
-	      throw Exception(
+	    keyword_to_value[k] = h.value;
+	    keyword_to_file[k] = fname;
+	    keyword_to_line[k] = line;
+	    break;
+	  } 
+	  if(path.size() < 1)
+	    throw Exception(
 "Error reading file. Value assigned outside of a\n"
 "keyword section");
 
-	    // Set up the values using the keyword path + index number
-	    // (if we have more than one block)
-	    std::string valkey = keyword[0];
-	    for(int i = 1; i < (int) keyword.size(); ++i)
-	      valkey = valkey + "/" + keyword[i];
+	  // Set up the values using the keyword path + index number
+	  // (if we have more than one block)
+	  const std::string& p = path.back();
+	  int idx = cur_idx[p];
+	  std::string valkey = p;
+	  if(section_to_count[p] > 1)
+	    valkey += "/" + boost::lexical_cast<std::string>(idx);
+	  valkey += "/" + k;
+	  keyword_to_value[valkey] = h.value;
+	  keyword_to_file[valkey] = fname;
+	  keyword_to_line[valkey] = line;
+
+	  // Record exactly the same information, but have keyword
+	  // path + "name" of the block. This may be a more
+	  // convenient way for the customer of this class to access
+	  // the data.
+	  std::map<std::string, std::map<int, std::string> >::const_iterator
+	    i = section_and_index_to_name.find(p);
+	  if(i != section_and_index_to_name.end() && i->second.count(idx) > 0) {
+	    valkey = p + "/" + i->second.find(idx)->second + "/" + k;
 	    boost::to_lower(valkey);
-	    if(section_to_count.count(valkey) > 0 &&
-	       section_to_count[valkey] > 1)
-	      valkey += "/" + 
-		boost::lexical_cast<std::string>(cur_idx[valkey]);
-	    valkey = valkey + "/" + m[1];
-	    boost::to_lower(valkey);
-	    keyword_to_value[valkey] = m[2];
+	    keyword_to_value[valkey] = h.value;
 	    keyword_to_file[valkey] = fname;
 	    keyword_to_line[valkey] = line;
-
-	    // Record exactly the same information, but have keyword
-	    // path + "name" of the block. This may be a more
-	    // convenient way for the customer of this class to access
-	    // the data.
-
-	    valkey = keyword[0];
-	    for(int i = 1; i < (int) keyword.size(); ++i)
-	      valkey = valkey + "/" + keyword[i];
-	    boost::to_lower(valkey);
-	    if(section_and_index_to_name.count(valkey) > 0 &&
-	       section_and_index_to_name[valkey].count(cur_idx[valkey]) > 0) {
-	      valkey = valkey + "/" + 
-		section_and_index_to_name[valkey][cur_idx[valkey]];
-	      valkey = valkey + "/" + m[1];
-	      boost::to_lower(valkey);
-	      keyword_to_value[valkey] = m[2];
-	      keyword_to_file[valkey] = fname;
-	      keyword_to_line[valkey] = line;
-	    }
 	  }
-
-// -----------------------------------------------------------------------
-//   6) Have a stray line.
-// -----------------------------------------------------------------------
-
-        } else if(boost::regex_search(ln, m, boost::regex("\\w"))) {
-	  throw Exception("Error reading file. Unrecognized line");
 	}
+	break;
+      case HeritageLine::UNRECOGNIZED:
+	throw Exception("Error reading file. Unrecognized line");
       }
     }
-    if(keyword.size() != 0)
-      throw Exception("Error reading file. Missing end of section for '" + 
-		      keyword.back() + "'");
 
 // -----------------------------------------------------------------------
-/// Read matrix data, if we have any.
+/// Read matrix data, if we have any. We convert the numbers directly
+/// from the line buffer, so there is no string created for each
+/// value.
 // -----------------------------------------------------------------------
 
     if(have_header && has_value("num_rows")) {
@@ -345,45 +475,169 @@ void HeritageFile::parse_file(const std::string& fname)
       int nc = value<int>("num_columns");
       data_.resize(nr, nc);
       int i = 0;
-      while(!ifn.eof() && ifn.good() && i < nr) {
-	getline(ifn, ln);
+      while(i < nr && getline(ifn, ln)) {
 	line++;
-	if(ifn.good()) {
-
-// -----------------------------------------------------------------------
-// Strip off comments, and replace environment variables.
-// -----------------------------------------------------------------------
-
-	  ln = ln.substr(0,ln.find("#"));
-	  ln = environment_substitute(ln);
+	prepare_line(ln, env_used);
+	if(!has_word(ln))
+	  continue;
 
 // -----------------------------------------------------------------------
 // Replace any "d" with "e", this is the difference in the way values
 // are expressed in fortran vs. C.
 // -----------------------------------------------------------------------
-	  
-	  boost::replace_all(ln, std::string("d"), std::string("e"));
-	  boost::smatch m;
-	  if(boost::regex_search(ln, m, boost::regex("\\w"))) {
-	    std::istringstream is(ln);
-	    is.exceptions(std::ifstream::badbit);
-	    for(int j = 0; j < nc; ++j)
-	      is >> data_(i, j);
-	    if(is.fail())
-	      throw Exception(
+
+	for(std::string::iterator c = ln.begin(); c != ln.end(); ++c)
+	  if(*c == 'd' || *c == 'D')
+	    *c = 'e';
+	const char* p = ln.c_str();
+	for(int j = 0; j < nc; ++j) {
+	  char* pend;
+	  data_(i, j) = strtod(p, &pend);
+	  if(pend == p)
+	    throw Exception(
 "Error reading file. Trouble processing a row of data");
-	    ++i;
-	  }
+	  p = pend;
 	}
+	++i;
       }
-      if(i < nr)
+      if(i < nr) {
+	line++;			// Report the line we expected data on
 	throw Exception("Error reading file. Not enough lines of data");
+      }
     }
   } catch(Exception& exc) {
     exc << "\nFile: " << fname << "\n"
 	<< "Line: " << line;
     throw;
   }
+  // If we substituted environment variables, the results depend on
+  // more than just the file so we can't cache them.
+  if(cfname != "" && !env_used)
+    write_cache(fname, cfname);
+}
+
+//-----------------------------------------------------------------------
+/// Name of the sidecar cache file for the given file, or an empty
+/// string if we aren't using a cache. This is controlled by the
+/// environment variable L2_FP_HERITAGE_CACHE_DIR.
+//-----------------------------------------------------------------------
+
+std::string HeritageFile::cache_file_name(const std::string& Fname)
+{
+  if(!getenv("L2_FP_HERITAGE_CACHE_DIR"))
+    return "";
+  std::string cname = canonical_name(Fname);
+  std::ostringstream res;
+  res << getenv("L2_FP_HERITAGE_CACHE_DIR") << "/" 
+      << cname.substr(cname.find_last_of('/') + 1) << "."
+      << std::hex << std::setw(16) << std::setfill('0') 
+      << (unsigned long long) boost::hash<std::string>()(cname) 
+      << ".cache";
+  return res.str();
+}
+
+//-----------------------------------------------------------------------
+/// Read the sidecar cache file for Fname, if it exists and is up to
+/// date (i.e., Fname has the same modification time, size and inode as
+/// when we wrote the cache). Returns true if we read the cache, false
+/// otherwise.
+//-----------------------------------------------------------------------
+
+bool HeritageFile::read_cache(const std::string& Fname, 
+			      const std::string& Cache_fname)
+{
+  struct stat buf;
+  if(stat(Fname.c_str(), &buf) != 0)
+    return false;
+  std::ifstream in(Cache_fname.c_str(), std::ios::binary);
+  if(!in.good())
+    return false;
+  try {
+    int version = 0;
+    FileStamp stamp;
+    std::string f;
+    cache_read(in, version);
+    if(!in.good() || version != heritage_cache_version)
+      return false;
+    cache_read(in, stamp);
+    if(!in.good() || !(stamp == FileStamp(buf)))
+      return false;
+    cache_read(in, f);
+    // Guard against two files that happen to have the same cache
+    // file name.
+    if(f != canonical_name(Fname))
+      return false;
+    cache_read(in, keyword_to_value);
+    cache_read(in, keyword_to_file);
+    cache_read(in, keyword_to_line);
+    cache_read(in, section_to_count);
+    cache_read(in, section_and_index_to_name);
+    int nr = 0, nc = 0;
+    cache_read(in, nr);
+    cache_read(in, nc);
+    if(!in.good() || nr < 0 || nc < 0)
+      throw Exception("Bad heritage file cache");
+    data_.resize(nr, nc);
+    if(nr * nc > 0)
+      in.read(reinterpret_cast<char*>(data_.dataFirst()), 
+	      nr * nc * sizeof(double));
+    if(in.fail())
+      throw Exception("Bad heritage file cache");
+  } catch(const Exception&) {
+    // Just ignore a bad cache, we'll read the file instead.
+    keyword_to_value.clear();
+    keyword_to_file.clear();
+    keyword_to_line.clear();
+    section_to_count.clear();
+    section_and_index_to_name.clear();
+    data_.resize(0, 0);
+    return false;
+  }
+  ++number_cache_read_;
+  return true;
+}
+
+//-----------------------------------------------------------------------
+/// Write out the sidecar cache file for Fname. We write to a
+/// temporary file and then rename it, so another process never sees a
+/// partially written cache. Failing to write the cache isn't an
+/// error, we just don't have a cache the next time.
+//-----------------------------------------------------------------------
+
+void HeritageFile::write_cache(const std::string& Fname, 
+			       const std::string& Cache_fname) const
+{
+  struct stat buf;
+  if(stat(Fname.c_str(), &buf) != 0)
+    return;
+  std::string tmpname = Cache_fname + "." + 
+    boost::lexical_cast<std::string>(getpid());
+  {
+    std::ofstream out(tmpname.c_str(), std::ios::binary);
+    if(!out.good())
+      return;
+    cache_write(out, heritage_cache_version);
+    cache_write(out, FileStamp(buf));
+    cache_write(out, canonical_name(Fname));
+    cache_write(out, keyword_to_value);
+    cache_write(out, keyword_to_file);
+    cache_write(out, keyword_to_line);
+    cache_write(out, section_to_count);
+    cache_write(out, section_and_index_to_name);
+    // data_ is always a contiguous array we created in parse_file.
+    cache_write(out, (int) data_.rows());
+    cache_write(out, (int) data_.cols());
+    if(data_.size() > 0)
+      out.write(reinterpret_cast<const char*>(data_.dataFirst()), 
+		data_.size() * sizeof(double));
+    if(!out.good()) {
+      out.close();
+      unlink(tmpname.c_str());
+      return;
+    }
+  }
+  if(rename(tmpname.c_str(), Cache_fname.c_str()) != 0)
+    unlink(tmpname.c_str());
 }
 
 //-----------------------------------------------------------------------
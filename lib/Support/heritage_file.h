@@ -63,6 +63,16 @@ namespace FullPhysics {
 
   In addition, file_value will expand out environment variables like 
   "$(abscodir)".
+
+  Some of the matrix files are large enough that parsing them takes a
+  noticeable amount of time. If the environment variable
+  L2_FP_HERITAGE_CACHE_DIR is set, we save what we read from the file
+  in a binary cache file in that directory, and read the cache
+  instead of the file the next time if the file has the same
+  modification time (to the nanosecond), size and inode. The cache is
+  keyed on the canonical absolute path of the file. We don't cache
+  files that use environment variables, since the values then depend
+  on more than the file contents.
 *******************************************************************/
 
 class HeritageFile : public Printable<HeritageFile> {
@@ -72,6 +82,14 @@ public:
   std::string file_value(const std::string& Keyword, int Block_index = 0) const;
   void parse_file(const std::string& Fname);
   void print(std::ostream& Os);
+  static std::string cache_file_name(const std::string& Fname);
+
+//-----------------------------------------------------------------------
+/// Number of times we have read a sidecar cache file rather than
+/// parsing the file, over the life of the program.
+//-----------------------------------------------------------------------
+
+  static int number_cache_read() { return number_cache_read_; }
 
 //-----------------------------------------------------------------------
 /// Matrix data. This is an zero sized matrix if we aren't actually
@@ -155,7 +173,10 @@ private:
 
   // Data, may be empty.
   blitz::Array<double, 2> data_;
-  void parse_file_block_count(const std::string& fname);
+  static int number_cache_read_;
+  bool read_cache(const std::string& Fname, const std::string& Cache_fname);
+  void write_cache(const std::string& Fname, 
+		   const std::string& Cache_fname) const;
   std::string get_value_or_exception(std::string& k, 
 				     int Block_index) const;
 
@@ -216,7 +237,8 @@ template<> inline std::string HeritageFile::value<std::string>(const
   std::string k = Keyword;
   std::string v = get_value_or_exception(k, Block_index);
   boost::smatch m;
-  if(boost::regex_match(v, m, boost::regex("\\s*\"?([^\"]*)\"?\\s*")))
+  static const boost::regex r("\\s*\"?([^\"]*)\"?\\s*");
+  if(boost::regex_match(v, m, r))
     return m[1];
   else
     return "";
@@ -233,7 +255,8 @@ std::vector<double> HeritageFile::value<std::vector<double> >
   std::string k = Keyword;
   std::string v = get_value_or_exception(k, Block_index);
   std::vector<double> res;
-  boost::sregex_token_iterator i(v.begin(), v.end(), boost::regex("\\s+"), -1);
+  static const boost::regex sep("\\s+");
+  boost::sregex_token_iterator i(v.begin(), v.end(), sep, -1);
   boost::sregex_token_iterator iend;
   if(i == iend || *i == "")		// Handle special case of an empty list
     return res;
@@ -262,7 +285,10 @@ std::vector<int> HeritageFile::value<std::vector<int> >
   std::string k = Keyword;
   std::string v = get_value_or_exception(k, Block_index);
   std::vector<int> res;
-  boost::sregex_token_iterator i(v.begin(), v.end(), boost::regex("\\s+"), -1);
+  static const boost::regex sep("\\s+");
+  static const boost::regex range_reg("(\\d+):(\\d+)");
+  static const boost::regex int_reg("(\\d+)");
+  boost::sregex_token_iterator i(v.begin(), v.end(), sep, -1);
   boost::sregex_token_iterator iend;
   if(i == iend || *i == "")		// Handle special case of an empty list
     return res;
@@ -270,12 +296,12 @@ std::vector<int> HeritageFile::value<std::vector<int> >
     boost::smatch m;
     for(; i != iend; ++i) {
       std::string ist = *i;
-      if(boost::regex_match(ist,m, boost::regex("(\\d+):(\\d+)"))) {
+      if(boost::regex_match(ist, m, range_reg)) {
 	int rstart = boost::lexical_cast<int>(m[1]);
 	int rend = boost::lexical_cast<int>(m[2]);
 	for(int j = rstart; j <= rend; ++j)
 	  res.push_back(j);
-      } else if(boost::regex_match(ist,m, boost::regex("(\\d+)"))) {
+      } else if(boost::regex_match(ist, m, int_reg)) {
 	res.push_back(boost::lexical_cast<int>(m[1]));
       } else if (ist.length() > 0) {
 	Exception e("Error reading file. The value for " + Keyword + " contains\n"
@@ -305,21 +331,19 @@ std::vector<std::string> HeritageFile::value<std::vector<std::string> >
 {
   std::string k = Keyword;
   std::string v = get_value_or_exception(k, Block_index);
+  static const boost::regex quoted_reg("\\s*\"([^\"]*)\"");
+  static const boost::regex word_reg("\\s*(\\w+)");
   boost::sregex_token_iterator icur;
   boost::sregex_token_iterator iend;
 
   // Try parsing strings in quotes seperated by spaces, ex:
   // "LABEL_1" "LABEL_2" "LABEL_3"
-  icur = boost::sregex_token_iterator(v.begin(), v.end(), 
-				      boost::regex("\\s*\"([^\"]*)\""), 
-				      1);
+  icur = boost::sregex_token_iterator(v.begin(), v.end(), quoted_reg, 1);
 
   // If nothing was found from that parsing try just unquoted word blocks, ex:
   // LABEL_1 LABEL2 LABEL_3
   if (icur == iend)
-    icur = boost::sregex_token_iterator(v.begin(), v.end(), 
-					boost::regex("\\s*(\\w+)"), 
-					1);
+    icur = boost::sregex_token_iterator(v.begin(), v.end(), word_reg, 1);
   if(icur == iend || *icur == "") // Handle special case of an empty list
     return std::vector<std::string>();
   return std::vector<std::string>(icur, iend);
@@ -1,6 +1,10 @@
 #include "heritage_file.h"
 #include "unit_test_support.h"
 #include "fp_exception.h"
+#include <cstdlib>
+#include <fstream>
+#include <sys/stat.h>
+#include <unistd.h>
 using namespace FullPhysics;
 
 BOOST_FIXTURE_TEST_SUITE(heritage_file, GlobalFixture)
@@ -167,4 +171,54 @@ BOOST_AUTO_TEST_CASE(read_column)
     -15.330923, -15.519402, -15.723299;
   BOOST_CHECK_MATRIX_CLOSE(c.data("ice"), dexpect);
 }
+BOOST_AUTO_TEST_CASE(sidecar_cache)
+{
+  std::string fname = test_data_dir() + "old_ascii/solar_cont_v1.dat";
+  setenv("L2_FP_HERITAGE_CACHE_DIR", ".", 1);
+  std::string cfname = HeritageFile::cache_file_name(fname);
+  // Same file through a different path uses the same cache
+  BOOST_CHECK_EQUAL(HeritageFile::cache_file_name(test_data_dir() + 
+				  "old_ascii/../old_ascii/solar_cont_v1.dat"),
+		    cfname);
+  BOOST_CHECK(HeritageFile::cache_file_name(test_data_dir() + 
+					    "heritage_file_test.run") !=
+	      cfname);
+  unlink(cfname.c_str());
+  int nread = HeritageFile::number_cache_read();
+  HeritageFile c(fname);
+  BOOST_CHECK_EQUAL(HeritageFile::number_cache_read(), nread);
+  struct stat buf;
+  BOOST_CHECK(stat(cfname.c_str(), &buf) == 0);
+  HeritageFile c2(fname);
+  BOOST_CHECK_EQUAL(HeritageFile::number_cache_read(), nread + 1);
+  BOOST_CHECK_EQUAL(c2.value<int>("solar_model_version"), 2);
+  BOOST_CHECK_EQUAL(c2.value<std::string>("File_ID"), "Solar Parameters");
+  BOOST_CHECK_EQUAL(c2.column_index("SOLAR"), 1);
+  BOOST_CHECK_MATRIX_CLOSE(c2.data(), c.data());
+
+  // A changed file shouldn't use the stale cache.
+  std::string tname = "heritage_file_cache_test.dat";
+  {
+    std::ifstream in(fname.c_str(), std::ios::binary);
+    std::ofstream out(tname.c_str(), std::ios::binary);
+    out << in.rdbuf();
+  }
+  std::string tcfname = HeritageFile::cache_file_name(tname);
+  unlink(tcfname.c_str());
+  HeritageFile c3(tname);
+  // Rewrite the same contents to a new file, so only the file stamp
+  // changes.
+  {
+    std::ifstream in(fname.c_str(), std::ios::binary);
+    std::ofstream out((tname + ".tmp").c_str(), std::ios::binary);
+    out << in.rdbuf();
+  }
+  rename((tname + ".tmp").c_str(), tname.c_str());
+  HeritageFile c4(tname);
+  BOOST_CHECK_EQUAL(HeritageFile::number_cache_read(), nread + 1);
+  unsetenv("L2_FP_HERITAGE_CACHE_DIR");
+  unlink(tcfname.c_str());
+  unlink(tname.c_str());
+  unlink(cfname.c_str());
+}
 BOOST_AUTO_TEST_SUITE_END()
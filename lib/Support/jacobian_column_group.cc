@@ -0,0 +1,194 @@
+#include "jacobian_column_group.h"
+#include <algorithm>
+using namespace FullPhysics;
+using namespace blitz;
+
+/// @cond
+namespace {
+  bool range_less(const Range& A, const Range& B)
+  { return A.first() < B.first(); }
+}
+/// @endcond
+
+//-----------------------------------------------------------------------
+/// Sort the ranges and combine any that overlap or touch.
+//-----------------------------------------------------------------------
+
+void JacobianColumnGroup::merge(std::vector<Range>& R)
+{
+  if(R.size() < 2)
+    return;
+  std::sort(R.begin(), R.end(), range_less);
+  std::vector<Range> res;
+  int f = R[0].first();
+  int l = R[0].last();
+  for(int i = 1; i < (int) R.size(); ++i) {
+    if(R[i].first() <= l + 1)
+      l = std::max(l, R[i].last());
+    else {
+      res.push_back(Range(f, l));
+      f = R[i].first();
+      l = R[i].last();
+    }
+  }
+  res.push_back(Range(f, l));
+  R.swap(res);
+}
+
+//-----------------------------------------------------------------------
+/// Number of columns that might be nonzero for the given slot.
+//-----------------------------------------------------------------------
+
+int JacobianColumnGroup::number_column(int Slot) const
+{
+  int res = 0;
+  for(int i = 0; i < (int) group(Slot).size(); ++i)
+    res += group(Slot)[i].length();
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// The ranges of columns that might be nonzero for any slot.
+//-----------------------------------------------------------------------
+
+std::vector<Range> JacobianColumnGroup::group_union() const
+{
+  std::vector<Range> res;
+  for(int i = 0; i < number_slot(); ++i)
+    res.insert(res.end(), grp[i].begin(), grp[i].end());
+  merge(res);
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Add the columns First through Last (inclusive) to the given slot.
+//-----------------------------------------------------------------------
+
+void JacobianColumnGroup::add(int Slot, int First, int Last)
+{
+  range_check(Slot, 0, number_slot());
+  if(First < 0 || Last >= nvar || First > Last) {
+    Exception e;
+    e << "Column range [" << First << ", " << Last
+      << "] is not valid for a Jacobian with " << nvar << " columns";
+    throw e;
+  }
+  grp[Slot].push_back(Range(First, Last));
+  merge(grp[Slot]);
+}
+
+//-----------------------------------------------------------------------
+/// Add a list of columns to the given slot. The columns should be
+/// sorted, we combine consecutive columns into one range.
+//-----------------------------------------------------------------------
+
+void JacobianColumnGroup::add(int Slot, const std::vector<int>& Column)
+{
+  range_check(Slot, 0, number_slot());
+  int i = 0;
+  while(i < (int) Column.size()) {
+    int j = i + 1;
+    while(j < (int) Column.size() && Column[j] == Column[j - 1] + 1)
+      ++j;
+    range_check(Column[i], 0, nvar);
+    range_check(Column[j - 1], 0, nvar);
+    grp[Slot].push_back(Range(Column[i], Column[j - 1]));
+    i = j;
+  }
+  merge(grp[Slot]);
+}
+
+//-----------------------------------------------------------------------
+/// Add the columns of slot G_slot of G to the given slot.
+//-----------------------------------------------------------------------
+
+void JacobianColumnGroup::add(int Slot, const JacobianColumnGroup& G,
+			      int G_slot)
+{
+  range_check(Slot, 0, number_slot());
+  if(G.number_variable() != nvar) {
+    Exception e;
+    e << "Trying to combine a JacobianColumnGroup with "
+      << G.number_variable() << " variables with one with " << nvar;
+    throw e;
+  }
+  const std::vector<Range>& r = G.group(G_slot);
+  grp[Slot].insert(grp[Slot].end(), r.begin(), r.end());
+  merge(grp[Slot]);
+}
+
+//-----------------------------------------------------------------------
+/// Add the columns of every slot of G to the given slot.
+//-----------------------------------------------------------------------
+
+void JacobianColumnGroup::add_all_slot(int Slot, const JacobianColumnGroup& G)
+{
+  for(int i = 0; i < G.number_slot(); ++i)
+    add(Slot, G, i);
+}
+
+//-----------------------------------------------------------------------
+/// Determine the column groups by looking for the nonzero columns of
+/// a Jacobian. This is for the Jacobian of a ArrayAd<double, 1>, so
+/// the first index is the slot.
+///
+/// This needs to look at every element of the Jacobian, so it is
+/// meant for Jacobians that get reused (e.g., ones that are
+/// independent of wavenumber), not ones that we calculate for each
+/// wavenumber.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<JacobianColumnGroup>
+JacobianColumnGroup::find(const Array<double, 2>& Jac)
+{
+  boost::shared_ptr<JacobianColumnGroup>
+    res(new JacobianColumnGroup(Jac.rows(), Jac.cols()));
+  for(int i = 0; i < Jac.rows(); ++i) {
+    std::vector<int> col;
+    for(int j = 0; j < Jac.cols(); ++j)
+      if(Jac(i, j) != 0)
+	col.push_back(j);
+    res->add(i, col);
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Determine the column groups by looking for the nonzero columns of
+/// a Jacobian. This is for the Jacobian of a ArrayAd<double, 2>, so
+/// the second index is the slot.
+//-----------------------------------------------------------------------
+
+boost::shared_ptr<JacobianColumnGroup>
+JacobianColumnGroup::find(const Array<double, 3>& Jac)
+{
+  boost::shared_ptr<JacobianColumnGroup>
+    res(new JacobianColumnGroup(Jac.cols(), Jac.depth()));
+  for(int i = 0; i < Jac.cols(); ++i) {
+    std::vector<int> col;
+    for(int j = 0; j < Jac.depth(); ++j)
+      for(int k = 0; k < Jac.rows(); ++k)
+	if(Jac(k, i, j) != 0) {
+	  col.push_back(j);
+	  break;
+	}
+    res->add(i, col);
+  }
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Print to a stream.
+//-----------------------------------------------------------------------
+
+void JacobianColumnGroup::print(std::ostream& Os) const
+{
+  Os << "JacobianColumnGroup:\n"
+     << "  Number variable: " << number_variable() << "\n";
+  for(int i = 0; i < number_slot(); ++i) {
+    Os << "  Slot " << i << ":";
+    for(int j = 0; j < (int) grp[i].size(); ++j)
+      Os << " [" << grp[i][j].first() << ", " << grp[i][j].last() << "]";
+    Os << "\n";
+  }
+}
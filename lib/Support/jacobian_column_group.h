@@ -0,0 +1,82 @@
+#ifndef JACOBIAN_COLUMN_GROUP_H
+#define JACOBIAN_COLUMN_GROUP_H
+#include "printable.h"
+#include "fp_exception.h"
+#include <blitz/array.h>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+
+namespace FullPhysics {
+/****************************************************************//**
+  ArrayAd stores a dense Jacobian, with one column for every state
+  vector element. For most of the quantities we calculate only a
+  small part of the state vector actually matters. The gas optical
+  depth depends on the VMR, temperature and surface pressure, the
+  aerosol optical depth depends only on the aerosol parameters, and
+  so on.
+
+  This class records which columns of a Jacobian might be
+  nonzero. We track this separately for each "slot", which is the
+  index of the last dimension of the ArrayAd value (so for
+  RtAtmosphere::intermediate_variable this is the intermediate
+  variable index). For each slot we store a sorted list of
+  nonoverlapping ranges of columns, anything outside of these ranges
+  is known to be zero.
+
+  Code that applies the chain rule (e.g., SpurrRt) can use this to
+  only loop over the columns that matter, rather than the full state
+  vector. The groups only need to be a superset of the nonzero
+  columns, it is fine (but less efficient) to include columns that
+  happen to be zero.
+
+  Once a JacobianColumnGroup is attached to an ArrayAd it is shared
+  by all the copies of that ArrayAd, so it should not be modified
+  after that.
+*******************************************************************/
+class JacobianColumnGroup : public Printable<JacobianColumnGroup> {
+public:
+//-----------------------------------------------------------------------
+/// Create an empty column group (i.e., every column is zero).
+//-----------------------------------------------------------------------
+
+  JacobianColumnGroup(int Number_slot, int Number_variable)
+    : nvar(Number_variable), grp(Number_slot) {}
+  virtual ~JacobianColumnGroup() {}
+
+//-----------------------------------------------------------------------
+/// Number of slots.
+//-----------------------------------------------------------------------
+
+  int number_slot() const { return (int) grp.size(); }
+
+//-----------------------------------------------------------------------
+/// Number of columns in the Jacobian.
+//-----------------------------------------------------------------------
+
+  int number_variable() const { return nvar; }
+
+//-----------------------------------------------------------------------
+/// The ranges of columns that might be nonzero for the given slot.
+//-----------------------------------------------------------------------
+
+  const std::vector<blitz::Range>& group(int Slot) const
+  { range_check(Slot, 0, number_slot()); return grp[Slot]; }
+
+  int number_column(int Slot) const;
+  std::vector<blitz::Range> group_union() const;
+  void add(int Slot, int First, int Last);
+  void add(int Slot, const std::vector<int>& Column);
+  void add(int Slot, const JacobianColumnGroup& G, int G_slot);
+  void add_all_slot(int Slot, const JacobianColumnGroup& G);
+  static boost::shared_ptr<JacobianColumnGroup>
+  find(const blitz::Array<double, 2>& Jac);
+  static boost::shared_ptr<JacobianColumnGroup>
+  find(const blitz::Array<double, 3>& Jac);
+  virtual void print(std::ostream& Os) const;
+private:
+  int nvar;
+  std::vector<std::vector<blitz::Range> > grp;
+  static void merge(std::vector<blitz::Range>& R);
+};
+}
+#endif
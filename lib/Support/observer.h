@@ -90,8 +90,18 @@ private:
 *******************************************************************/
 template<class T> class Observable : public virtual GenericObject {
 public:
+  Observable() : update_version_(0) {}
   virtual ~Observable() {}
 
+//-----------------------------------------------------------------------
+/// Number of times this object has notified its Observers of an
+/// update. A cache that depends on this object can record this
+/// value when it is filled, and then compare it later to determine if
+/// it is stale, rather than needing to be an Observer itself.
+//-----------------------------------------------------------------------
+
+  int update_version() const { return update_version_; }
+
 //-----------------------------------------------------------------------
 /// Add an observer 
 //-----------------------------------------------------------------------
@@ -120,6 +130,7 @@ protected:
 //-----------------------------------------------------------------------
   void notify_update_do(const T& Self)
   {
+    ++update_version_;
     clean_dead_ptr();
     BOOST_FOREACH(boost::weak_ptr<Observer<T> >& t, olist) {
       boost::shared_ptr<Observer<T> > t2 = t.lock();
@@ -186,6 +197,7 @@ protected:
   }
   std::list<boost::weak_ptr<Observer<T> > > olist;
   std::vector<boost::shared_ptr<Observer<T> > > ref_list;
+  int update_version_;
 };  
 }
 #endif
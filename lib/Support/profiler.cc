@@ -0,0 +1,518 @@
+#include "profiler.h"
+#include "fp_exception.h"
+#include <boost/thread/mutex.hpp>
+#include <boost/foreach.hpp>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <new>
+#include <time.h>
+#include <sys/time.h>
+
+using namespace FullPhysics;
+
+// Helper classes for Profiler.
+// Don't have Doxygen document these classes.
+/// @cond
+namespace FullPhysics {
+class ProfileNameLess {
+public:
+  bool operator()(const char* A, const char* B) const
+  { return strcmp(A, B) < 0; }
+};
+
+class ProfileNode : boost::noncopyable {
+public:
+  ProfileNode(const char* Name, ProfileNode* Parent)
+    : name(Name), parent(Parent) { reset(); }
+  ~ProfileNode()
+  {
+    BOOST_FOREACH(ProfileNode* c, children)
+      delete c;
+  }
+  // Return the child with the given name, or null if we don't have
+  // one yet.
+  ProfileNode* find_child(const char* Name) const
+  {
+    std::map<const char*, ProfileNode*, ProfileNameLess>::const_iterator i =
+      child_index.find(Name);
+    return (i == child_index.end() ? 0 : i->second);
+  }
+  ProfileNode* add_child(const char* Name)
+  {
+    ProfileNode* c = new ProfileNode(Name, this);
+    children.push_back(c);
+    child_index[c->name.c_str()] = c;
+    return c;
+  }
+  void add(double Elapsed, long Nalloc, long Nbytes)
+  {
+    ++count;
+    total += Elapsed;
+    min = std::min(min, Elapsed);
+    max = std::max(max, Elapsed);
+    nalloc += Nalloc;
+    nbytes += Nbytes;
+  }
+  void reset()
+  {
+    count = 0;
+    total = 0;
+    min = std::numeric_limits<double>::max();
+    max = 0;
+    nalloc = 0;
+    nbytes = 0;
+    BOOST_FOREACH(ProfileNode* c, children)
+      c->reset();
+  }
+  void write_json(std::ostream& Os, const std::string& Indent) const;
+  void print(std::ostream& Os, int Depth) const;
+  std::string name;
+  ProfileNode* parent;
+  // Children in the order they were first called, which is the order
+  // we report them. child_index is used to look up a child by name,
+  // the keys point to the child's name.
+  std::vector<ProfileNode*> children;
+  std::map<const char*, ProfileNode*, ProfileNameLess> child_index;
+  long count, nalloc, nbytes;
+  double total, min, max;
+};
+
+class ProfileThread : boost::noncopyable {
+public:
+  ProfileThread(int Id) : id(Id), root("", 0), current(&root) {}
+  int id;
+  ProfileNode root;
+  // Only used by this thread.
+  ProfileNode* current;
+  // The zones are only changed by this thread, but are read by
+  // other threads when we report or reset. We hold this lock when
+  // changing the zones, and when reading them from another
+  // thread. So this is almost never contended.
+  boost::mutex m;
+};
+}
+/// @endcond
+
+// Thread local data. We use __thread rather than
+// boost::thread_specific_ptr because this needs to be fast, and
+// because the allocation counts are updated in operator new (so can't
+// themselves allocate).
+static __thread ProfileThread* current_thread = 0;
+static __thread long alloc_count = 0;
+static __thread long alloc_bytes = 0;
+
+#ifdef FP_PROFILE
+// Replace the global operator new and delete so we can count
+// allocations. We replace all the variants the compiler might call
+// (nothrow, and with newer compilers sized delete and aligned new),
+// so the counts are complete. Dynamic exception specifications are
+// an error in C++17, so we use noexcept when we have it.
+#if __cplusplus >= 201103L
+#define FP_PROFILE_NOEXCEPT noexcept
+#else
+#define FP_PROFILE_NOEXCEPT throw()
+#endif
+
+static inline void* profile_malloc(std::size_t Size)
+{
+  ++alloc_count;
+  alloc_bytes += Size;
+  return malloc(Size == 0 ? 1 : Size);
+}
+
+void* operator new(std::size_t Size)
+{
+  void* p = profile_malloc(Size);
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t Size)
+{
+  return operator new(Size);
+}
+
+void* operator new(std::size_t Size, const std::nothrow_t&) 
+  FP_PROFILE_NOEXCEPT
+{
+  return profile_malloc(Size);
+}
+
+void* operator new[](std::size_t Size, const std::nothrow_t&) 
+  FP_PROFILE_NOEXCEPT
+{
+  return profile_malloc(Size);
+}
+
+void operator delete(void* P) FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete[](void* P) FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete(void* P, const std::nothrow_t&) FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete[](void* P, const std::nothrow_t&) FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+#ifdef __cpp_sized_deallocation
+void operator delete(void* P, std::size_t) FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete[](void* P, std::size_t) FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+#endif
+
+#ifdef __cpp_aligned_new
+static inline void* profile_aligned_malloc(std::size_t Size, 
+					   std::align_val_t Align)
+{
+  ++alloc_count;
+  alloc_bytes += Size;
+  void* p = 0;
+  std::size_t a = std::max(static_cast<std::size_t>(Align), sizeof(void*));
+  if(posix_memalign(&p, a, Size == 0 ? 1 : Size) != 0)
+    return 0;
+  return p;
+}
+
+void* operator new(std::size_t Size, std::align_val_t Align)
+{
+  void* p = profile_aligned_malloc(Size, Align);
+  if(!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](std::size_t Size, std::align_val_t Align)
+{
+  return operator new(Size, Align);
+}
+
+void* operator new(std::size_t Size, std::align_val_t Align,
+		   const std::nothrow_t&) FP_PROFILE_NOEXCEPT
+{
+  return profile_aligned_malloc(Size, Align);
+}
+
+void* operator new[](std::size_t Size, std::align_val_t Align,
+		     const std::nothrow_t&) FP_PROFILE_NOEXCEPT
+{
+  return profile_aligned_malloc(Size, Align);
+}
+
+void operator delete(void* P, std::align_val_t) FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete[](void* P, std::align_val_t) FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete(void* P, std::size_t, std::align_val_t) 
+  FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete[](void* P, std::size_t, std::align_val_t) 
+  FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete(void* P, std::align_val_t, const std::nothrow_t&) 
+  FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+
+void operator delete[](void* P, std::align_val_t, const std::nothrow_t&) 
+  FP_PROFILE_NOEXCEPT
+{
+  free(P);
+}
+#endif
+#endif
+
+//-----------------------------------------------------------------------
+/// Current time in seconds, from some arbitrary starting point.
+//-----------------------------------------------------------------------
+
+static double profile_time()
+{
+#ifdef CLOCK_MONOTONIC
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+#else
+  struct timeval t;
+  gettimeofday(&t, 0);
+  return t.tv_sec + t.tv_usec * 1e-6;
+#endif
+}
+
+//-----------------------------------------------------------------------
+/// Write a string as a JSON string, escaping any special characters.
+//-----------------------------------------------------------------------
+
+static void json_string(std::ostream& Os, const char* S)
+{
+  Os << '"';
+  for(const char* c = S; *c; ++c) {
+    if(*c == '"' || *c == '\\')
+      Os << '\\' << *c;
+    else if((unsigned char) *c < 0x20)
+      Os << ' ';
+    else
+      Os << *c;
+  }
+  Os << '"';
+}
+
+void ProfileNode::write_json(std::ostream& Os, const std::string& Indent) const
+{
+  Os << Indent << "{\"name\": ";
+  json_string(Os, name.c_str());
+  Os << ", \"count\": " << count
+     << ", \"total\": " << total
+     << ", \"mean\": " << (count > 0 ? total / count : 0.0)
+     << ", \"min\": " << (count > 0 ? min : 0.0)
+     << ", \"max\": " << max
+     << ", \"allocations\": " << nalloc
+     << ", \"allocated_bytes\": " << nbytes
+     << ", \"children\": [";
+  for(int i = 0; i < (int) children.size(); ++i) {
+    Os << (i == 0 ? "\n" : ",\n");
+    children[i]->write_json(Os, Indent + "  ");
+  }
+  Os << "]}";
+}
+
+void ProfileNode::print(std::ostream& Os, int Depth) const
+{
+  std::string nm = std::string(2 * Depth, ' ') + name;
+  Os << std::left << std::setw(50) << nm << std::right
+     << " " << std::setw(10) << count
+     << " " << std::setw(12) << total
+     << " " << std::setw(12) << (count > 0 ? total / count : 0.0)
+     << " " << std::setw(12) << (count > 0 ? min : 0.0)
+     << " " << std::setw(12) << max
+     << " " << std::setw(12) << nalloc << "\n";
+  BOOST_FOREACH(const ProfileNode* c, children)
+    c->print(Os, Depth + 1);
+}
+
+//-----------------------------------------------------------------------
+/// List of all the threads that have used the profiler. We use a
+/// function static rather than a class static so we don't need to
+/// worry about the order of static initialization.
+//-----------------------------------------------------------------------
+
+static boost::mutex& thread_list_mutex()
+{
+  static boost::mutex m;
+  return m;
+}
+
+std::vector<boost::shared_ptr<ProfileThread> >& Profiler::thread_list()
+{
+  static std::vector<boost::shared_ptr<ProfileThread> > tlist;
+  return tlist;
+}
+
+//-----------------------------------------------------------------------
+/// Return the data for the current thread, creating it if this is the
+/// first time the thread has used the profiler. The data is kept
+/// after the thread exits, so it can still be reported.
+//-----------------------------------------------------------------------
+
+ProfileThread& Profiler::thread()
+{
+  if(!current_thread) {
+    boost::mutex::scoped_lock lk(thread_list_mutex());
+    boost::shared_ptr<ProfileThread> t(new ProfileThread((int) thread_list().size()));
+    thread_list().push_back(t);
+    current_thread = t.get();
+  }
+  return *current_thread;
+}
+
+//-----------------------------------------------------------------------
+/// Return true if the code was compiled with the profiler turned on
+/// (i.e., FP_PROFILE was defined).
+//-----------------------------------------------------------------------
+
+bool Profiler::enabled()
+{
+#ifdef FP_PROFILE
+  return true;
+#else
+  return false;
+#endif
+}
+
+//-----------------------------------------------------------------------
+/// Reset all the timings and counts to zero. This is typically done
+/// at the start of each sounding.
+//-----------------------------------------------------------------------
+
+void Profiler::reset()
+{
+  boost::mutex::scoped_lock lk(thread_list_mutex());
+  BOOST_FOREACH(boost::shared_ptr<ProfileThread>& t, thread_list()) {
+    boost::mutex::scoped_lock lk2(t->m);
+    t->root.reset();
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Number of memory allocations done by the current thread. This is
+/// only counted if the profiler is enabled, otherwise this is
+/// always 0.
+//-----------------------------------------------------------------------
+
+long Profiler::allocation_count()
+{
+  return alloc_count;
+}
+
+//-----------------------------------------------------------------------
+/// Number of bytes allocated by the current thread. This is
+/// only counted if the profiler is enabled, otherwise this is
+/// always 0.
+//-----------------------------------------------------------------------
+
+long Profiler::allocation_bytes()
+{
+  return alloc_bytes;
+}
+
+//-----------------------------------------------------------------------
+/// Write out the profile as JSON. Times are all in seconds. Each
+/// thread has a tree of zones, with the times for each zone including
+/// the time spent in its children.
+//-----------------------------------------------------------------------
+
+void Profiler::write_json(std::ostream& Os)
+{
+  boost::mutex::scoped_lock lk(thread_list_mutex());
+  std::streamsize prec = Os.precision(9);
+  Os << "{\"profile_enabled\": " << (enabled() ? "true" : "false")
+     << ",\n \"threads\": [";
+  for(int i = 0; i < (int) thread_list().size(); ++i) {
+    ProfileThread& t = *thread_list()[i];
+    boost::mutex::scoped_lock lk2(t.m);
+    Os << (i == 0 ? "\n" : ",\n")
+       << "  {\"thread\": " << t.id << ", \"zones\": [";
+    for(int j = 0; j < (int) t.root.children.size(); ++j) {
+      Os << (j == 0 ? "\n" : ",\n");
+      t.root.children[j]->write_json(Os, "    ");
+    }
+    Os << "]}";
+  }
+  Os << "]}\n";
+  Os.precision(prec);
+}
+
+//-----------------------------------------------------------------------
+/// Write out the profile as JSON to the given file.
+//-----------------------------------------------------------------------
+
+void Profiler::write_json(const std::string& Fname)
+{
+  std::ofstream out(Fname.c_str());
+  if(!out.good())
+    throw Exception("Trouble opening profile file " + Fname);
+  write_json(out);
+  if(!out.good())
+    throw Exception("Trouble writing profile file " + Fname);
+}
+
+void Profiler::print(std::ostream& Os) const
+{
+  boost::mutex::scoped_lock lk(thread_list_mutex());
+  std::ios_base::fmtflags flags = Os.flags();
+  std::streamsize prec = Os.precision(6);
+  Os.setf(std::ios_base::fixed, std::ios_base::floatfield);
+  Os << "Profiler (times in seconds):\n";
+  BOOST_FOREACH(const boost::shared_ptr<ProfileThread>& t, thread_list()) {
+    boost::mutex::scoped_lock lk2(t->m);
+    Os << "Thread " << t->id << "\n"
+       << std::left << std::setw(50) << "Zone" << std::right
+       << " " << std::setw(10) << "Count"
+       << " " << std::setw(12) << "Total"
+       << " " << std::setw(12) << "Mean"
+       << " " << std::setw(12) << "Min"
+       << " " << std::setw(12) << "Max"
+       << " " << std::setw(12) << "Alloc" << "\n";
+    BOOST_FOREACH(const ProfileNode* c, t->root.children)
+      c->print(Os, 0);
+  }
+  Os.flags(flags);
+  Os.precision(prec);
+}
+
+//-----------------------------------------------------------------------
+/// Start timing the zone with the given name. If Name is null, we
+/// don't do anything.
+///
+/// Only this thread adds zones to its tree, so we can look up an
+/// existing zone without locking. We only need the lock the first
+/// time a zone is called, when we add it.
+//-----------------------------------------------------------------------
+
+ProfileScope::ProfileScope(const char* Name)
+  : thr(0), node(0), start(0), alloc_count_start(0), alloc_bytes_start(0)
+{
+  if(!Name)
+    return;
+  thr = &Profiler::thread();
+  node = thr->current->find_child(Name);
+  if(!node) {
+    boost::mutex::scoped_lock lk(thr->m);
+    node = thr->current->add_child(Name);
+  }
+  thr->current = node;
+  alloc_count_start = alloc_count;
+  alloc_bytes_start = alloc_bytes;
+  start = profile_time();
+}
+
+//-----------------------------------------------------------------------
+/// Stop timing, and add the results to the zone.
+//-----------------------------------------------------------------------
+
+ProfileScope::~ProfileScope()
+{
+  if(!thr)
+    return;
+  double elapsed = profile_time() - start;
+  {
+    boost::mutex::scoped_lock lk(thr->m);
+    node->add(elapsed, alloc_count - alloc_count_start,
+	      alloc_bytes - alloc_bytes_start);
+  }
+  thr->current = node->parent;
+}
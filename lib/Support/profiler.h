@@ -0,0 +1,126 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+#include "printable.h"
+#include <boost/noncopyable.hpp>
+#include <boost/shared_ptr.hpp>
+#include <vector>
+#include <string>
+
+namespace FullPhysics {
+class ProfileNode;
+class ProfileThread;
+
+/****************************************************************//**
+  This is a simple hierarchical profiler.
+
+  You mark a section of code to profile by putting the macro
+  FP_PROFILE_SCOPE("name") at the start of a block. This creates a
+  ProfileScope that times everything until the end of the block. The
+  zones nest, so if the function "A" has a zone and calls "B" which
+  also has a zone, we separately report the time spent in "A", and
+  the time spent in "B" when called from "A". For each zone we
+  collect the number of calls, the total/minimum/maximum time per
+  call and the number of memory allocations.
+
+  Each thread has its own set of zones, so code run in other threads
+  doesn't get mixed in with the main thread.
+
+  The profiler is only turned on if the code is compiled with
+  FP_PROFILE defined (configure with "--enable-profile"). Otherwise
+  FP_PROFILE_SCOPE expands to nothing, so there is no overhead at all
+  in a normal build. When it is turned on we also replace the global
+  operator new to count allocations, so this shouldn't be used for
+  production runs.
+
+  The existing AccumulatedTimer objects also create a zone, with the
+  name given to the AccumulatedTimer, so these are included in the
+  profile.
+
+  The results can be printed as a table, or written as JSON (see
+  write_json) so they can be collected for each sounding and
+  aggregated across an orbit (see the support/utils/profile_summary
+  script).
+*******************************************************************/
+
+class Profiler : public Printable<Profiler> {
+public:
+  virtual ~Profiler() {}
+  static bool enabled();
+  static void reset();
+  static void write_json(std::ostream& Os);
+  static void write_json(const std::string& Fname);
+  static long allocation_count();
+  static long allocation_bytes();
+  virtual void print(std::ostream& Os) const;
+private:
+  friend class ProfileScope;
+  static ProfileThread& thread();
+  static std::vector<boost::shared_ptr<ProfileThread> >& thread_list();
+};
+
+/****************************************************************//**
+  This times a zone from when it is created to when it is
+  destroyed. You don't normally use this directly, instead use the
+  macro FP_PROFILE_SCOPE so the code can be compiled out if the
+  profiler isn't turned on.
+
+  A null Name gives a scope that doesn't do anything. This allows a
+  class to always have a ProfileScope member, so its layout doesn't
+  depend on FP_PROFILE, and only time a zone if Profiler::enabled().
+*******************************************************************/
+
+class ProfileScope : boost::noncopyable {
+public:
+  ProfileScope(const char* Name);
+  ~ProfileScope();
+private:
+  ProfileThread* thr;
+  ProfileNode* node;
+  double start;
+  long alloc_count_start, alloc_bytes_start;
+};
+
+/****************************************************************//**
+  This counts the memory allocations done by the current thread
+  while this object exists. This can be used to check that a loop
+  has reached a steady state where it no longer allocates memory
+  (e.g., after a ScratchArena has grown to its full size).
+
+  Like the rest of the Profiler, allocations are only counted if
+  the code is compiled with FP_PROFILE defined. Otherwise count()
+  and bytes() always return 0, check Profiler::enabled() before
+  depending on the results.
+*******************************************************************/
+
+class AllocationCounter : boost::noncopyable {
+public:
+  AllocationCounter() 
+    : count_start(Profiler::allocation_count()),
+      bytes_start(Profiler::allocation_bytes()) {}
+
+//-----------------------------------------------------------------------
+/// Number of allocations since this object was created.
+//-----------------------------------------------------------------------
+
+  long count() const { return Profiler::allocation_count() - count_start; }
+
+//-----------------------------------------------------------------------
+/// Number of bytes allocated since this object was created.
+//-----------------------------------------------------------------------
+
+  long bytes() const { return Profiler::allocation_bytes() - bytes_start; }
+private:
+  long count_start, bytes_start;
+};
+}
+
+#define FP_PROFILE_CAT2(A, B) A ## B
+#define FP_PROFILE_CAT(A, B) FP_PROFILE_CAT2(A, B)
+#ifdef FP_PROFILE
+#define FP_PROFILE_SCOPE(Name) \
+  FullPhysics::ProfileScope FP_PROFILE_CAT(fp_profile_scope_, __LINE__)(Name)
+#else
+#define FP_PROFILE_SCOPE(Name)
+#endif
+
+#endif
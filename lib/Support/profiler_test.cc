@@ -0,0 +1,68 @@
+#include "unit_test_support.h"
+#include "profiler.h"
+#include <boost/thread/thread.hpp>
+
+using namespace FullPhysics;
+
+void profiler_test_thread()
+{
+  ProfileScope s("profiler_test_thread");
+}
+
+BOOST_FIXTURE_TEST_SUITE(profiler, GlobalFixture)
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  Profiler::reset();
+  for(int i = 0; i < 3; ++i) {
+    ProfileScope s("profiler_test_outer");
+    ProfileScope s2("profiler_test_inner");
+  }
+  std::ostringstream os;
+  Profiler::write_json(os);
+  BOOST_CHECK(os.str().find("{\"name\": \"profiler_test_outer\", \"count\": 3,")
+	      != std::string::npos);
+  BOOST_CHECK(os.str().find("{\"name\": \"profiler_test_inner\", \"count\": 3,")
+	      != std::string::npos);
+  // Inner zone should be nested in the outer one.
+  BOOST_CHECK(os.str().find("profiler_test_outer") < 
+	      os.str().find("profiler_test_inner"));
+  Profiler p;
+  std::ostringstream os2;
+  os2 << p;
+  BOOST_CHECK(os2.str().find("  profiler_test_inner") != std::string::npos);
+  Profiler::reset();
+  std::ostringstream os3;
+  Profiler::write_json(os3);
+  BOOST_CHECK(os3.str().find("{\"name\": \"profiler_test_outer\", \"count\": 0,")
+	      != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(null_name)
+{
+  Profiler::reset();
+  {
+    ProfileScope s("profiler_test_null_outer");
+    ProfileScope s2(0);
+    ProfileScope s3("profiler_test_null_inner");
+  }
+  std::ostringstream os;
+  Profiler::write_json(os);
+  // The null scope doesn't add a zone, so inner is directly under
+  // outer.
+  BOOST_CHECK(os.str().find("\"children\": [\n      {\"name\": \"profiler_test_null_inner\"")
+	      != std::string::npos);
+}
+
+BOOST_AUTO_TEST_CASE(thread)
+{
+  Profiler::reset();
+  boost::thread t(profiler_test_thread);
+  t.join();
+  std::ostringstream os;
+  Profiler::write_json(os);
+  BOOST_CHECK(os.str().find("{\"name\": \"profiler_test_thread\", \"count\": 1,")
+	      != std::string::npos);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
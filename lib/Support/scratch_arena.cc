@@ -0,0 +1,150 @@
+#include "scratch_arena.h"
+#include <algorithm>
+using namespace FullPhysics;
+
+const std::size_t ScratchArena::alignment;
+
+//-----------------------------------------------------------------------
+/// Constructor. You can optionally give the initial size in bytes,
+/// otherwise we get memory the first time it is needed.
+//-----------------------------------------------------------------------
+
+ScratchArena::ScratchArena(std::size_t Initial_size)
+: cur_block(0), cur_offset(0), used(0), high_water(0), nheap_alloc(0)
+{
+  if(Initial_size > 0)
+    add_block(Initial_size);
+}
+
+//-----------------------------------------------------------------------
+/// Copy constructor. This gives a new empty arena, the memory in use
+/// belongs to A.
+//-----------------------------------------------------------------------
+
+ScratchArena::ScratchArena(const ScratchArena& A)
+: Printable<ScratchArena>(),
+  cur_block(0), cur_offset(0), used(0), high_water(0), nheap_alloc(0)
+{
+}
+
+//-----------------------------------------------------------------------
+/// Assignment. Like the copy constructor, this gives a new empty
+/// arena.
+//-----------------------------------------------------------------------
+
+ScratchArena& ScratchArena::operator=(const ScratchArena& A)
+{
+  if(this != &A) {
+    if(used != 0)
+      throw Exception("Can't assign to a ScratchArena that has memory in use");
+    block.clear();
+    block_base.clear();
+    block_size.clear();
+    cur_block = 0;
+    cur_offset = 0;
+    high_water = 0;
+    nheap_alloc = 0;
+  }
+  return *this;
+}
+
+//-----------------------------------------------------------------------
+/// Add a new block of memory with at least the given size.
+//-----------------------------------------------------------------------
+
+void ScratchArena::add_block(std::size_t Nbyte)
+{
+  std::size_t n = (Nbyte + alignment - 1) / alignment * alignment;
+  boost::shared_array<char> b(new char[n + alignment]);
+  std::size_t off = reinterpret_cast<std::size_t>(b.get()) % alignment;
+  block.push_back(b);
+  block_base.push_back(b.get() + (off == 0 ? 0 : alignment - off));
+  block_size.push_back(n);
+  ++nheap_alloc;
+}
+
+//-----------------------------------------------------------------------
+/// Total size of the memory held by the arena.
+//-----------------------------------------------------------------------
+
+std::size_t ScratchArena::capacity() const
+{
+  std::size_t res = 0;
+  for(int i = 0; i < (int) block_size.size(); ++i)
+    res += block_size[i];
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Get the given number of bytes from the arena. You don't normally
+/// call this directly, instead use array or array_ad.
+//-----------------------------------------------------------------------
+
+void* ScratchArena::allocate(std::size_t Nbyte)
+{
+  std::size_t n = std::max((Nbyte + alignment - 1) / alignment * alignment,
+			   alignment);
+  // Move to the next block if there isn't room in this one. We
+  // double the size each time we need more memory, so this
+  // happens only a few times before we reach a steady state.
+  while(cur_block < (int) block.size() && 
+	cur_offset + n > block_size[cur_block]) {
+    ++cur_block;
+    cur_offset = 0;
+  }
+  if(cur_block == (int) block.size())
+    add_block(std::max(n, std::max(2 * capacity(), (std::size_t) 65536)));
+  void* res = block_base[cur_block] + cur_offset;
+  cur_offset += n;
+  used += n;
+  high_water = std::max(high_water, used);
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Return the current position in the arena, which can be passed to
+/// release. You normally use Scope rather than calling this
+/// directly.
+//-----------------------------------------------------------------------
+
+ScratchArena::Mark ScratchArena::mark() const
+{
+  Mark res = {cur_block, cur_offset, used};
+  return res;
+}
+
+//-----------------------------------------------------------------------
+/// Give back all the memory handed out since mark() returned M. 
+///
+/// If we had to add blocks, then once all the memory has been
+/// returned we replace the blocks with one block big enough for the
+/// most memory we have handed out at once. This way the next pass
+/// through the code using the arena fits in one block.
+//-----------------------------------------------------------------------
+
+void ScratchArena::release(const Mark& M)
+{
+  cur_block = M.block;
+  cur_offset = M.offset;
+  used = M.used;
+  if(used == 0 && block.size() > 1) {
+    std::size_t n = high_water;
+    block.clear();
+    block_base.clear();
+    block_size.clear();
+    add_block(n);
+  }
+}
+
+//-----------------------------------------------------------------------
+/// Print to a stream.
+//-----------------------------------------------------------------------
+
+void ScratchArena::print(std::ostream& Os) const
+{
+  Os << "ScratchArena:\n"
+     << "  Capacity:               " << capacity() << "\n"
+     << "  Bytes used:             " << bytes_used() << "\n"
+     << "  High water mark:        " << high_water_mark() << "\n"
+     << "  Number heap allocation: " << number_heap_allocation() << "\n";
+}
@@ -0,0 +1,173 @@
+#ifndef SCRATCH_ARENA_H
+#define SCRATCH_ARENA_H
+#include "printable.h"
+#include "array_ad.h"
+#include <boost/shared_array.hpp>
+#include <vector>
+
+namespace FullPhysics {
+/****************************************************************//**
+  Much of our code is called once per high resolution wavenumber, and
+  creates a number of short lived blitz::Array and ArrayAd
+  temporaries each time. Each of these is a trip through malloc and
+  free, which adds up (and shows up clearly in a profile).
+
+  This class is a simple arena that these temporaries can use for
+  their memory instead. We hand out memory from a large block by just
+  moving a pointer forward, and get it back all at once by moving the
+  pointer back (see Scope). Once the arena has grown to the size
+  needed by one pass through the code using it, there are no further
+  allocations at all.
+
+  The typical use is to have a mutable ScratchArena in a class, and
+  then in the function called for each wavenumber:
+
+  \code
+    ScratchArena::Scope scope(arena);
+    blitz::Array<double, 2> scratch(arena.array<double>(n1, n2));
+    ArrayAd<double, 1> t(arena.array_ad<double>(n1, nvar));
+    ...
+  \endcode
+
+  All the memory handed out after the Scope was created is returned
+  when it goes out of scope. The arrays don't own their memory, so
+  it is up to you to make sure they don't outlive the Scope. In
+  particular, don't return them, or store a reference to them in
+  something that lives longer. Copying the values somewhere else
+  (e.g., with operator= into an existing array, or with copy()) is
+  fine. Note also that resizing one of these arrays moves it to
+  normal heap memory, which is safe but gives up the advantage of
+  using the arena.
+
+  The memory isn't initialized, same as a newly created
+  blitz::Array. The exception is array_ad with 0 variables, where we
+  set the Jacobian to 0 like ArrayAd does.
+
+  This is not thread safe, each thread needs to use its own
+  ScratchArena. Copying a ScratchArena gives a new empty arena, since
+  the memory in use belongs to the original object.
+*******************************************************************/
+class ScratchArena : public Printable<ScratchArena> {
+public:
+  ScratchArena(std::size_t Initial_size = 0);
+  ScratchArena(const ScratchArena& A);
+  ScratchArena& operator=(const ScratchArena& A);
+  virtual ~ScratchArena() {}
+
+/****************************************************************//**
+  Position in the arena, used to release memory.
+*******************************************************************/
+  struct Mark {
+    int block;
+    std::size_t offset, used;
+  };
+
+/****************************************************************//**
+  Release all the memory taken from the arena while this object
+  exists.
+*******************************************************************/
+  class Scope {
+  public:
+    Scope(ScratchArena& A) : a(A), m(A.mark()) {}
+    ~Scope() { a.release(m); }
+  private:
+    Scope(const Scope&);
+    Scope& operator=(const Scope&);
+    ScratchArena& a;
+    Mark m;
+  };
+
+  void* allocate(std::size_t Nbyte);
+  Mark mark() const;
+  void release(const Mark& M);
+
+//-----------------------------------------------------------------------
+/// Release everything handed out by the arena.
+//-----------------------------------------------------------------------
+
+  void reset() { Mark m = {0, 0, 0}; release(m); }
+
+//-----------------------------------------------------------------------
+/// Number of bytes currently handed out.
+//-----------------------------------------------------------------------
+
+  std::size_t bytes_used() const { return used; }
+
+//-----------------------------------------------------------------------
+/// The most bytes that have been handed out at once.
+//-----------------------------------------------------------------------
+
+  std::size_t high_water_mark() const { return high_water; }
+
+//-----------------------------------------------------------------------
+/// Total size of the memory held by the arena.
+//-----------------------------------------------------------------------
+
+  std::size_t capacity() const;
+
+//-----------------------------------------------------------------------
+/// Number of times the arena had to get more memory from the
+/// heap. Once the code using the arena reaches a steady state, this
+/// should stop changing.
+//-----------------------------------------------------------------------
+
+  int number_heap_allocation() const { return nheap_alloc; }
+
+//-----------------------------------------------------------------------
+/// Return a blitz::Array that uses memory from the arena.
+//-----------------------------------------------------------------------
+
+  template<class T, int D> blitz::Array<T, D>
+  array(const blitz::TinyVector<int, D>& Shape)
+  {
+    std::size_t n = 1;
+    for(int i = 0; i < D; ++i)
+      n *= Shape(i);
+    T* d = static_cast<T*>(allocate(n * sizeof(T)));
+    return blitz::Array<T, D>(d, Shape, blitz::neverDeleteData);
+  }
+  template<class T> blitz::Array<T, 1> array(int n1)
+  { return array<T, 1>(blitz::TinyVector<int, 1>(n1)); }
+  template<class T> blitz::Array<T, 2> array(int n1, int n2)
+  { return array<T, 2>(blitz::TinyVector<int, 2>(n1, n2)); }
+  template<class T> blitz::Array<T, 3> array(int n1, int n2, int n3)
+  { return array<T, 3>(blitz::TinyVector<int, 3>(n1, n2, n3)); }
+
+//-----------------------------------------------------------------------
+/// Return a ArrayAd that uses memory from the arena.
+//-----------------------------------------------------------------------
+
+  template<class T, int D> ArrayAd<T, D>
+  array_ad(const blitz::TinyVector<int, D>& Shape, int Nvar)
+  {
+    blitz::TinyVector<int, D + 1> s2;
+    for(int i = 0; i < D; ++i)
+      s2(i) = Shape(i);
+    s2(D) = std::max(Nvar, 1);
+    blitz::Array<T, D + 1> jac(array<T, D + 1>(s2));
+    if(Nvar == 0)
+      jac = 0;
+    return ArrayAd<T, D>(array<T, D>(Shape), jac, Nvar == 0);
+  }
+  template<class T> ArrayAd<T, 1> array_ad(int n1, int Nvar)
+  { return array_ad<T, 1>(blitz::TinyVector<int, 1>(n1), Nvar); }
+  template<class T> ArrayAd<T, 2> array_ad(int n1, int n2, int Nvar)
+  { return array_ad<T, 2>(blitz::TinyVector<int, 2>(n1, n2), Nvar); }
+  template<class T> ArrayAd<T, 3> array_ad(int n1, int n2, int n3, int Nvar)
+  { return array_ad<T, 3>(blitz::TinyVector<int, 3>(n1, n2, n3), Nvar); }
+
+  virtual void print(std::ostream& Os) const;
+private:
+  // Memory is aligned to this many bytes.
+  static const std::size_t alignment = 64;
+  std::vector<boost::shared_array<char> > block;
+  // Start of each block, adjusted for alignment.
+  std::vector<char*> block_base;
+  std::vector<std::size_t> block_size;
+  int cur_block;
+  std::size_t cur_offset, used, high_water;
+  int nheap_alloc;
+  void add_block(std::size_t Nbyte);
+};
+}
+#endif
@@ -0,0 +1,74 @@
+#include "scratch_arena.h"
+#include "profiler.h"
+#include "unit_test_support.h"
+
+using namespace FullPhysics;
+using namespace blitz;
+
+BOOST_FIXTURE_TEST_SUITE(scratch_arena, GlobalFixture)
+
+BOOST_AUTO_TEST_CASE(basic)
+{
+  ScratchArena arena;
+  BOOST_CHECK_EQUAL(arena.capacity(), (std::size_t) 0);
+  {
+    ScratchArena::Scope scope(arena);
+    Array<double, 2> a(arena.array<double>(3, 4));
+    a = 1;
+    BOOST_CHECK_EQUAL(a.rows(), 3);
+    BOOST_CHECK_EQUAL(a.cols(), 4);
+    BOOST_CHECK(reinterpret_cast<std::size_t>(a.data()) % 64 == 0);
+    BOOST_CHECK(arena.bytes_used() >= 3 * 4 * sizeof(double));
+    {
+      ScratchArena::Scope scope2(arena);
+      std::size_t used = arena.bytes_used();
+      ArrayAd<double, 1> b(arena.array_ad<double>(3, 2));
+      BOOST_CHECK(!b.is_constant());
+      BOOST_CHECK_EQUAL(b.number_variable(), 2);
+      ArrayAd<double, 1> c(arena.array_ad<double>(3, 0));
+      BOOST_CHECK(c.is_constant());
+      BOOST_CHECK_CLOSE(max(abs(c.jacobian())), 0.0, 1e-8);
+      BOOST_CHECK(arena.bytes_used() > used);
+      // Memory from the arena shouldn't overlap
+      BOOST_CHECK(b.value().data() >= a.data() + 12 ||
+		  b.value().data() + 3 <= a.data());
+    }
+    BOOST_CHECK(arena.bytes_used() >= 3 * 4 * sizeof(double));
+    BOOST_CHECK_CLOSE(sum(a), 12.0, 1e-8);
+  }
+  BOOST_CHECK_EQUAL(arena.bytes_used(), (std::size_t) 0);
+  BOOST_CHECK(arena.high_water_mark() > 0);
+}
+
+BOOST_AUTO_TEST_CASE(steady_state)
+{
+  // Use more memory than the initial block, so we need to grow the
+  // arena. After the first pass, we should be in one block and
+  // shouldn't allocate any more memory.
+  ScratchArena arena(1024);
+  for(int i = 0; i < 2; ++i) {
+    ScratchArena::Scope scope(arena);
+    for(int j = 0; j < 10; ++j) {
+      Array<double, 1> t(arena.array<double>(10000));
+      t = j;
+    }
+  }
+  int nalloc = arena.number_heap_allocation();
+  std::size_t cap = arena.capacity();
+  BOOST_CHECK(cap >= 10 * 10000 * sizeof(double));
+  AllocationCounter count;
+  for(int i = 0; i < 5; ++i) {
+    ScratchArena::Scope scope(arena);
+    for(int j = 0; j < 10; ++j) {
+      Array<double, 1> t(arena.array<double>(10000));
+      t = j;
+    }
+  }
+  BOOST_CHECK_EQUAL(arena.number_heap_allocation(), nalloc);
+  BOOST_CHECK_EQUAL(arena.capacity(), cap);
+  // Allocations are only counted if the profiler is turned on.
+  if(Profiler::enabled())
+    BOOST_CHECK_EQUAL(count.count(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -116,21 +116,45 @@ public:
 	++si;
       }
   }
+
+//-----------------------------------------------------------------------
+/// Update the coefficients from the StateVector.
+///
+/// We only notify our Observers if the coefficients (value or
+/// Jacobian) actually changed. The StateVector updates every
+/// SubStateVectorObserver each time any part of it changes, so
+/// this keeps a change to one part (e.g., the surface) from
+/// invalidating caches that depend on a different part (e.g., gas
+/// absorption). We always notify on the first update, so Observers
+/// see the initial state vector.
+//-----------------------------------------------------------------------
+
   virtual void update_sub_state(const ArrayAd<double, 1>& Sv_sub,
 				const blitz::Array<double, 2>& Cov)
   {
+    using namespace blitz;
+    bool changed = (Observable<Base>::update_version() == 0);
     if (Sv_sub.rows() > 0) {
       cov.reference(Cov.copy());
       int si = 0;
-      coeff.resize_number_variable(Sv_sub.number_variable());
+      if(coeff.number_variable() != Sv_sub.number_variable()) {
+	coeff.resize_number_variable(Sv_sub.number_variable());
+	changed = true;
+      }
       for(int i = 0; i < coeff.rows(); ++i)
 	if(used_flag(i)) {
+	  if(!changed &&
+	     (coeff.value()(i) != Sv_sub.value()(si) ||
+	      any(coeff.jacobian()(i, Range::all()) != 
+		  Sv_sub.jacobian()(si, Range::all()))))
+	    changed = true;
 	  coeff(i) = Sv_sub(si);
 	  ++si;
 	}
     }
     update_sub_state_hook();
-    Observable<Base>::notify_update_do(*this);
+    if(changed)
+      Observable<Base>::notify_update_do(*this);
   }
 
 //-----------------------------------------------------------------------
@@ -0,0 +1,30 @@
+// This creates the "main()" needed to run all the benchmarks. This is
+// done by boost, like lib/test_all.cc. We also add a global fixture
+// that writes out the benchmark results once all the benchmarks have
+// run.
+
+#define BOOST_TEST_MODULE "Full Physics Benchmarks"
+#include <boost/test/included/unit_test.hpp>
+#include "benchmark_support.h"
+#include <iostream>
+
+/// @cond
+class BenchmarkReport {
+public:
+  BenchmarkReport() {}
+  // We can't throw from a destructor, so just report any problem
+  // writing the results.
+  ~BenchmarkReport() 
+  { 
+    try {
+      FullPhysics::Benchmark::write_report(); 
+    } catch(const std::exception& e) {
+      std::cerr << "Error writing benchmark report:\n" << e.what() << "\n";
+    } catch(...) {
+      std::cerr << "Unknown error writing benchmark report\n";
+    }
+  }
+};
+
+BOOST_GLOBAL_FIXTURE(BenchmarkReport);
+/// @endcond
@@ -10,7 +10,29 @@
 // when we build. But we still need to supply this to get the
 // directors=1 and allprotected=1 set.
 
-%module(directors="1", allprotected="1") full_physics
+%module(directors="1", allprotected="1", threads="1") full_physics
+
+//--------------------------------------------------------------
+// We build with thread support so we can release the python GIL
+// around long running calls (e.g., ForwardModel::radiance_all),
+// letting other python threads run. This is off by default, since
+// most calls are short and releasing the GIL has a cost. Use
+// %python_release_gil to turn this on for a particular function.
+//
+// Note that releasing the GIL doesn't make the C++ objects thread
+// safe. Python code shouldn't call into the same objects from
+// another thread while one of these calls is running. Directors
+// (python classes derived from C++ ones) reacquire the GIL when
+// they are called, so they still work. We only turn off
+// "threadallow" (releasing the GIL), not "threadblock" (taking it
+// back), which is what the directors use.
+//--------------------------------------------------------------
+
+%feature("nothreadallow");
+
+%define %python_release_gil(NAME)
+%feature("nothreadallow", "0") NAME;
+%enddef
 
 %{
 #include <boost/shared_ptr.hpp>
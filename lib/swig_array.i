@@ -127,75 +127,22 @@ public:
 %define %array_template(NAME,TYPE,DIM)
 
 //--------------------------------------------------------------
-// Convert to numpy. Note that there is a complication in the 
-// lifetime of the pointed to array. numpy can't take ownership
-// of the memory in the blitz::Array, since it wasn't allocated
-// by python. Instead, numpy just points to the memory. To ensure
-// that the blitz::Array memory isn't freeded, we also stash a
-// python object wrapping around the blitz::Array that holds onto
-// the object. This gets placed in a special area set up by numpy
-// exactly for this purpose called "BASE". When the numpy array 
-// get deleted, it also deletes the numpy. If this is the only
-// reference to the blitz::Array memory, then the memory gets
-// cleaned up then.
+// Convert to numpy. This doesn't copy the data, instead the numpy
+// array is a read only view of the blitz::Array memory. See
+// to_numpy_view for a description of how we handle the lifetime of
+// the memory.
 //--------------------------------------------------------------
 
 %typemap(out) blitz::Array<TYPE, DIM> {
-  npy_intp dims[DIM], stride[DIM];
-  for(int i = 0; i < DIM; ++i) {
-    dims[i] = $1.extent(i);
-    // Note numpy stride is in terms of bytes, while blitz in in terms
-    // of type T.
-    stride[i] = $1.stride(i) * sizeof(TYPE);
-  }
-  $result = PyArray_New(&PyArray_Type, DIM, dims, type_to_npy<TYPE>(), 
-			stride, $1.data(), 0, 0, 0);
-  blitz::Array<TYPE, DIM>* t = new blitz::Array<TYPE, DIM>($1);
-  PyArray_SetBaseObject
-    ((PyArrayObject *)$result,
-     SWIG_NewPointerObj(SWIG_as_voidptr(t), 
-			$descriptor(blitz::Array<TYPE, DIM>*), 
-			SWIG_POINTER_NEW | 0 ));
+  $result = to_numpy_view<TYPE, DIM>($1, $descriptor(blitz::Array<TYPE, DIM>*));
 }
 
-//--------------------------------------------------------------
-// Convert to numpy. See description above for lifetime issues.
-//--------------------------------------------------------------
-
 %typemap(out) const blitz::Array<TYPE, DIM>& {
-  npy_intp dims[DIM], stride[DIM];
-  for(int i = 0; i < DIM; ++i) {
-    dims[i] = $1->extent(i);
-    // Note numpy stride is in terms of bytes, while blitz in in terms
-    // of type T.
-    stride[i] = $1->stride(i) * sizeof(TYPE);
-  }
-  $result = PyArray_New(&PyArray_Type, DIM, dims, type_to_npy<TYPE>(), 
-			stride, $1->data(), 0, 0, 0);
-  blitz::Array<TYPE, DIM>* t = new blitz::Array<TYPE, DIM>(*$1);
-  PyArray_SetBaseObject
-    ((PyArrayObject *)$result,
-     SWIG_NewPointerObj(SWIG_as_voidptr(t), 
-			$descriptor(blitz::Array<TYPE, DIM>*), 
-			SWIG_POINTER_NEW | 0 ));
+  $result = to_numpy_view<TYPE, DIM>(*$1, $descriptor(blitz::Array<TYPE, DIM>*));
 }
 
 %typemap(out) blitz::Array<TYPE, DIM>& {
-  npy_intp dims[DIM], stride[DIM];
-  for(int i = 0; i < DIM; ++i) {
-    dims[i] = $1->extent(i);
-    // Note numpy stride is in terms of bytes, while blitz in in terms
-    // of type T.
-    stride[i] = $1->stride(i) * sizeof(TYPE);
-  }
-  $result = PyArray_New(&PyArray_Type, DIM, dims, type_to_npy<TYPE>(), 
-			stride, $1->data(), 0, 0, 0);
-  blitz::Array<TYPE, DIM>* t = new blitz::Array<TYPE, DIM>(*$1);
-  PyArray_SetBaseObject
-    ((PyArrayObject *)$result,
-     SWIG_NewPointerObj(SWIG_as_voidptr(t), 
-			$descriptor(blitz::Array<TYPE, DIM>*), 
-			SWIG_POINTER_NEW | 0 ));
+  $result = to_numpy_view<TYPE, DIM>(*$1, $descriptor(blitz::Array<TYPE, DIM>*));
 }
 
 //--------------------------------------------------------------
@@ -207,21 +154,8 @@ public:
 }
 
 %typemap(argout) blitz::Array<TYPE, DIM>& OUTPUT {
-  npy_intp dims[DIM], stride[DIM];
-  for(int i = 0; i < DIM; ++i) {
-    dims[i] = $1->extent(i);
-    // Note numpy stride is in terms of bytes, while blitz in in terms
-    // of type T.
-    stride[i] = $1->stride(i) * sizeof(TYPE);
-  }
-  PyObject *res = PyArray_New(&PyArray_Type, DIM, dims, type_to_npy<TYPE>(), 
-			stride, $1->data(), 0, 0, 0);
-  blitz::Array<TYPE, DIM>* t = new blitz::Array<TYPE, DIM>(*$1);
-  PyArray_SetBaseObject
-    ((PyArrayObject *)res,
-     SWIG_NewPointerObj(SWIG_as_voidptr(t), 
-			$descriptor(blitz::Array<TYPE, DIM>*), 
-			SWIG_POINTER_NEW | 0 ));
+  PyObject *res = 
+    to_numpy_view<TYPE, DIM>(*$1, $descriptor(blitz::Array<TYPE, DIM>*));
   $result = SWIG_AppendOutput($result, res);
 }
 
@@ -239,7 +173,9 @@ public:
     numpy.obj = to_numpy<TYPE>($input);
     if(!numpy.obj)
       return NULL;
-    a.reference(to_blitz_array<TYPE, DIM>(numpy));
+    if(!blitz_array_from_view<TYPE, DIM>
+       (numpy.obj, $descriptor(blitz::Array<TYPE, DIM>*), a))
+      a.reference(to_blitz_array<TYPE, DIM>(numpy));
     $1 = &a;
   }
 }
@@ -264,7 +200,8 @@ public:
 //--------------------------------------------------------------
 // Convert any type first to a numpy array (doesn't copy if 
 // already a numpy array), and then set blitz array to point to
-// this.
+// this. If this is a view of a blitz::Array, we share the memory
+// with it so the data stays around if the C++ code holds onto it.
 //--------------------------------------------------------------
 
 %typemap(in) blitz::Array<TYPE, DIM> (PythonObject numpy) 
@@ -272,7 +209,9 @@ public:
   numpy.obj = to_numpy<TYPE>($input);
   if(!numpy.obj)
     return NULL;
-  $1 = to_blitz_array<TYPE, DIM>(numpy);
+  if(!blitz_array_from_view<TYPE, DIM>
+     (numpy.obj, $descriptor(blitz::Array<TYPE, DIM>*), $1))
+    $1 = to_blitz_array<TYPE, DIM>(numpy);
 }
 
 //--------------------------------------------------------------
@@ -287,22 +226,7 @@ public:
 
 %typemap(directorin) const blitz::Array<TYPE, DIM>& 
 {
-  npy_intp dims[DIM], stride[DIM];
-  for(int i = 0; i < DIM; ++i) {
-    dims[i] = $1.extent(i);
-    // Note numpy stride is in terms of bytes, while blitz in in terms
-    // of type T.
-    stride[i] = $1.stride(i) * sizeof(TYPE);
-  }
-  PyObject* res = PyArray_New(&PyArray_Type, DIM, dims, type_to_npy<TYPE>(), 
-			      stride, const_cast<TYPE*>($1.data()), 0, 0, 0);
-  blitz::Array<TYPE, DIM>* t = new blitz::Array<TYPE, DIM>($1);
-  PyArray_SetBaseObject
-    ((PyArrayObject *)res,
-     SWIG_NewPointerObj(SWIG_as_voidptr(t), 
-			$descriptor(blitz::Array<TYPE, DIM>*), 
-			SWIG_POINTER_NEW | 0 ));
-  $input = res;
+  $input = to_numpy_view<TYPE, DIM>($1, $descriptor(blitz::Array<TYPE, DIM>*));
 }
 
 //--------------------------------------------------------------
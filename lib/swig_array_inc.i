@@ -112,5 +112,79 @@ template<class T, int D> inline blitz::Array<T, D>
 			    blitz::neverDeleteData);
 }
 
+//--------------------------------------------------------------
+// Create a numpy array that is a view of the data in a
+// blitz::Array, without copying. numpy can't take ownership of
+// the memory since it wasn't allocated by python. Instead, we
+// stash a python object wrapping a blitz::Array that shares the
+// same memory block in the numpy "BASE". The memory then stays
+// around until both the numpy array and any C++ object using it
+// are done with it.
+//
+// The numpy array is read only, so python code can't change a C++
+// object's data behind its back (e.g., without the object
+// notifying its observers). Use copy() in python to get an array
+// that can be modified.
+//--------------------------------------------------------------
+
+template<class T, int D> inline PyObject* 
+to_numpy_view(const blitz::Array<T, D>& A, swig_type_info* Blitz_type)
+{
+  npy_intp dims[D], stride[D];
+  for(int i = 0; i < D; ++i) {
+    dims[i] = A.extent(i);
+    // Note numpy stride is in terms of bytes, while blitz in in terms
+    // of type T.
+    stride[i] = A.stride(i) * sizeof(T);
+  }
+  PyObject* res = PyArray_New(&PyArray_Type, D, dims, type_to_npy<T>(), 
+			      stride, const_cast<T*>(A.data()), 0, 0, 0);
+  if(!res)
+    return 0;
+  blitz::Array<T, D>* t = new blitz::Array<T, D>(A);
+  PyArray_SetBaseObject
+    ((PyArrayObject *)res,
+     SWIG_NewPointerObj(SWIG_as_voidptr(t), Blitz_type, 
+			SWIG_POINTER_NEW | 0 ));
+  return res;
+}
+
+//--------------------------------------------------------------
+// If a numpy array is a view created by to_numpy_view (e.g., a
+// Jacobian we got from one C++ object that we are passing to
+// another), then set Res to reference the original blitz::Array
+// and return true. This shares the memory block, so the data
+// stays around as long as C++ needs it without us needing to
+// copy it.
+//
+// Returns false if this isn't such a view, or if it is a slice
+// that doesn't exactly match the original blitz::Array.
+//--------------------------------------------------------------
+
+template<class T, int D> inline bool
+blitz_array_from_view(PyObject* Numpy_obj, swig_type_info* Blitz_type,
+		      blitz::Array<T, D>& Res)
+{
+  if(!Numpy_obj || !PyArray_Check(Numpy_obj))
+    return false;
+  PyArrayObject* numpy = (PyArrayObject*) Numpy_obj;
+  PyObject* base = PyArray_BASE(numpy);
+  blitz::Array<T, D>* b = 0;
+  if(!base || 
+     !SWIG_IsOK(SWIG_ConvertPtr(base, (void**) &b, Blitz_type, 0)) || 
+     !b)
+    return false;
+  if(PyArray_NDIM(numpy) != D || 
+     PyArray_TYPE(numpy) != type_to_npy<T>() ||
+     PyArray_DATA(numpy) != (void*) b->data())
+    return false;
+  for(int i = 0; i < D; ++i)
+    if(PyArray_DIM(numpy, i) != b->extent(i) ||
+       PyArray_STRIDE(numpy, i) != (npy_intp) (b->stride(i) * sizeof(T)))
+      return false;
+  Res.reference(*b);
+  return true;
+}
+
 %}
 
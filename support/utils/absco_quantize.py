@@ -0,0 +1,302 @@
+#!/usr/bin/env python
+
+from __future__ import print_function
+from __future__ import division
+import sys
+import numpy as np
+import h5py
+from optparse import OptionParser
+
+# Convert an ABSCO table to the reduced precision form read by AbscoHdf
+# (see lib/Implementation/absco_hdf.h), and report how well the
+# converted table matches the original.
+#
+# The absorption is stored as 16 bit unsigned integers q. For each
+# pressure and wavenumber we have an offset and scale for the log of
+# the absorption, and the value is 0 if q is 0 and
+# exp(offset + scale * q) otherwise. The scale is chosen so that
+# q = 1 to 65535 covers the range of the nonzero values at that
+# pressure and wavenumber (i.e., across the temperature and broadener
+# VMR), so the relative error is at most scale / 2.
+#
+# Values smaller than --min-ratio times the largest value at the same
+# pressure and wavenumber are stored as 0, so a few tiny values don't
+# stretch the range for all the others. Negative values (which can
+# appear in the far wings of some tables) are also stored as 0; the
+# report gives the number of both.
+
+QMAX = 65535
+
+def absorption_name(fin):
+    gindex = fin["Gas_Index"][()]
+    if(isinstance(gindex, np.ndarray)):
+        gindex = gindex.flatten()[0]
+    if(isinstance(gindex, bytes)):
+        gindex = gindex.decode("ascii")
+    gindex = gindex.split("\0")[0]
+    return "Gas_%s_Absorption" % gindex
+
+def table_4d(d):
+    '''Return a function to read a range of wavenumbers of the table as
+    a 4d double array, adding a broadener dimension for 3d tables.'''
+    if(len(d.shape) == 4):
+        return lambda s, e: np.asarray(d[:, :, :, s:e], dtype=np.float64)
+    return lambda s, e: np.asarray(d[:, :, s:e],
+                                   dtype=np.float64)[:, :, np.newaxis, :]
+
+def quantize(v, min_ratio):
+    '''Quantize a number_pressure x number_temperature x number_broadener
+    x number_wn array. Returns q (with the same shape), and the log
+    offset and log scale (number_pressure x number_wn). Also returns
+    the number of values set to 0 because they were too small, and the
+    number of negative values.'''
+    vmax = v.max(axis=(1, 2))
+    thresh = (vmax * min_ratio)[:, np.newaxis, np.newaxis, :]
+    nneg = int(np.count_nonzero(v < 0))
+    use = (v > thresh) & (v > 0)
+    nsmall = int(np.count_nonzero((v > 0) & ~use))
+    with np.errstate(divide="ignore"):
+        lv = np.where(use, np.log(np.where(use, v, 1)), 0)
+    lmin = np.where(use, lv, np.inf).min(axis=(1, 2))
+    lmax = np.where(use, lv, -np.inf).max(axis=(1, 2))
+    have = np.isfinite(lmin)
+    lmin = np.where(have, lmin, 0)
+    lmax = np.where(have, lmax, 0)
+    scale = (lmax - lmin) / (QMAX - 1)
+    offset = lmin - scale
+    # A constant value still needs q = 1, which is fine with a 0 scale.
+    sc = np.where(scale > 0, scale, 1)
+    q = np.rint((lv - lmin[:, np.newaxis, np.newaxis, :]) /
+                sc[:, np.newaxis, np.newaxis, :]) + 1
+    q = np.where(use, np.clip(q, 1, QMAX), 0).astype(np.uint16)
+    return q, offset, scale, nsmall, nneg
+
+def dequantize(q, offset, scale):
+    return np.where(q == 0, 0.0,
+                    np.exp(offset[:, np.newaxis, np.newaxis, :] +
+                           scale[:, np.newaxis, np.newaxis, :] * q))
+
+def copy_attrs(src, dest):
+    for k, v in src.attrs.items():
+        dest.attrs[k] = v
+
+def convert(fin_name, fout_name, min_ratio, nwn_chunk):
+    fin = h5py.File(fin_name, "r")
+    fout = h5py.File(fout_name, "w")
+    copy_attrs(fin, fout)
+    aname = absorption_name(fin)
+    for k in fin.keys():
+        if(k != aname):
+            fin.copy(k, fout)
+    din = fin[aname]
+    nwn = din.shape[-1]
+    np_ = din.shape[0]
+    dout = fout.create_dataset(aname, din.shape, dtype=np.uint16,
+                               chunks=din.chunks)
+    copy_attrs(din, dout)
+    doff = fout.create_dataset(aname + "_Log_Offset", (np_, nwn),
+                               dtype=np.float64)
+    dscale = fout.create_dataset(aname + "_Log_Scale", (np_, nwn),
+                                 dtype=np.float64)
+    read = table_4d(din)
+    nsmall = 0
+    nneg = 0
+    for s in range(0, nwn, nwn_chunk):
+        e = min(s + nwn_chunk, nwn)
+        q, offset, scale, ns, nn = quantize(read(s, e), min_ratio)
+        nsmall += ns
+        nneg += nn
+        if(len(din.shape) == 4):
+            dout[:, :, :, s:e] = q
+        else:
+            dout[:, :, s:e] = q[:, :, 0, :]
+        doff[:, s:e] = offset
+        dscale[:, s:e] = scale
+    fout.close()
+    fin.close()
+    print("Wrote %s" % fout_name)
+    print("Values stored as 0 because they were < %g of the maximum: %d" %
+          (min_ratio, nsmall))
+    print("Negative values stored as 0: %d" % nneg)
+
+def table_report(forig, fquant, nwn_chunk):
+    '''Compare every entry of the quantized table with the original.'''
+    aname = absorption_name(forig)
+    read_orig = table_4d(forig[aname])
+    dq = fquant[aname]
+    doff = fquant[aname + "_Log_Offset"]
+    dscale = fquant[aname + "_Log_Scale"]
+    read_q = table_4d(dq)
+    nwn = dq.shape[-1]
+    max_rel = 0.0
+    sum_rel2 = 0.0
+    nval = 0
+    nzeroed = 0
+    for s in range(0, nwn, nwn_chunk):
+        e = min(s + nwn_chunk, nwn)
+        v = read_orig(s, e)
+        vq = dequantize(read_q(s, e), doff[:, s:e], dscale[:, s:e])
+        pos = vq > 0
+        rel = np.abs(vq[pos] - v[pos]) / v[pos]
+        if(rel.size > 0):
+            max_rel = max(max_rel, rel.max())
+        sum_rel2 += (rel * rel).sum()
+        nval += rel.size
+        nzeroed += int(np.count_nonzero((v != 0) & ~pos))
+    print("Table entries compared:     %d" % nval)
+    print("Max relative difference:    %g" % max_rel)
+    print("RMS relative difference:    %g" %
+          (np.sqrt(sum_rel2 / nval) if nval > 0 else 0))
+    print("Nonzero entries stored as 0: %d" % nzeroed)
+
+class TableInterpolate(object):
+    '''Interpolate the table at a set of pressure, temperature and
+    broadener VMR, the same way AbscoInterpolator does.'''
+    def __init__(self, f, press, temp, bvmr):
+        aname = absorption_name(f)
+        self.d = f[aname]
+        self.quantized = (self.d.dtype == np.uint16)
+        if(self.quantized):
+            self.doff = f[aname + "_Log_Offset"]
+            self.dscale = f[aname + "_Log_Scale"]
+        self.read = table_4d(self.d)
+        pgrid = f["Pressure"][:]
+        tgrid = f["Temperature"][:]
+        bgrid = f["Broadener_01_VMR"][:] if "Broadener_01_VMR" in f else None
+        self.ip, self.fp = self.interpol(press, pgrid)
+        self.itp1 = np.empty(self.ip.shape, dtype=int)
+        self.itp2 = np.empty(self.ip.shape, dtype=int)
+        self.ftp1 = np.empty(press.shape)
+        self.ftp2 = np.empty(press.shape)
+        for i in range(press.shape[0]):
+            self.itp1[i], self.ftp1[i] = self.interpol(temp[i],
+                                                       tgrid[self.ip[i], :])
+            self.itp2[i], self.ftp2[i] = self.interpol(temp[i],
+                                                       tgrid[self.ip[i] + 1, :])
+        if(bgrid is None or bgrid.shape[0] == 1):
+            self.ib = np.zeros(press.shape, dtype=int)
+            self.ib2 = self.ib
+            self.fb = np.ones(press.shape)
+        else:
+            self.ib, self.fb = self.interpol(bvmr, bgrid)
+            self.ib2 = self.ib + 1
+
+    @staticmethod
+    def interpol(x, xv):
+        i = np.searchsorted(xv, x) - 1
+        i = np.clip(i, 0, xv.shape[0] - 2)
+        return i, (x - xv[i]) / (xv[i + 1] - xv[i])
+
+    def __call__(self, s, e):
+        '''Return number_level x (e - s) cross sections.'''
+        a = self.read(s, e)
+        if(self.quantized):
+            a = dequantize(a.astype(np.uint16), self.doff[:, s:e],
+                           self.dscale[:, s:e])
+        ip, fp, fb = self.ip, self.fp[:, np.newaxis], self.fb[:, np.newaxis]
+        ftp1 = self.ftp1[:, np.newaxis]
+        ftp2 = self.ftp2[:, np.newaxis]
+        def tinterp(ib):
+            t11 = (a[ip, self.itp1, ib, :] * (1 - ftp1) +
+                   a[ip, self.itp1 + 1, ib, :] * ftp1)
+            t12 = (a[ip + 1, self.itp2, ib, :] * (1 - ftp2) +
+                   a[ip + 1, self.itp2 + 1, ib, :] * ftp2)
+            return t11 * (1 - fp) + t12 * fp
+        return tinterp(self.ib) * (1 - fb) + tinterp(self.ib2) * fb
+
+def l2_profiles(l2):
+    '''Return the pressure, temperature and H2O VMR levels for each
+    sounding in a L2 output file, as a list of arrays. The retrieved
+    temperature and H2O are the meteorology profiles with the retrieved
+    temperature offset and H2O scale factor applied.'''
+    rr = l2["/RetrievalResults"]
+    plev = rr["vector_pressure_levels_met"][:]
+    tlev = rr["temperature_profile_met"][:]
+    qlev = rr["specific_humidity_profile_met"][:]
+    nsnd = plev.shape[0]
+    toff = (rr["temperature_offset_fph"][:] if "temperature_offset_fph" in rr
+            else np.zeros(nsnd))
+    hscale = (rr["h2o_scale_factor"][:] if "h2o_scale_factor" in rr
+              else np.ones(nsnd))
+    res = []
+    for k in range(nsnd):
+        # Profiles are padded with fill values.
+        good = (plev[k, :] > 0) & (tlev[k, :] > 0) & (qlev[k, :] >= 0)
+        q = qlev[k, good]
+        # Specific humidity to H2O VMR
+        vmr = q / (1 - q) * (28.9644 / 18.01528) * hscale[k]
+        res.append((plev[k, good], tlev[k, good] + toff[k], vmr))
+    return res
+
+def sounding_report(forig, fquant, l2_files, nwn_chunk):
+    '''Compare cross sections and a column optical depth proxy at the
+    retrieved pressure, temperature and H2O profiles in L2 output
+    files (e.g., the regression test soundings).'''
+    nwn = forig[absorption_name(forig)].shape[-1]
+    print("%-40s %8s %14s %14s" % ("Sounding", "Index", "Max rel xsec",
+                                    "Max rel column"))
+    for fn in l2_files:
+        with h5py.File(fn, "r") as l2:
+            for k, (p, t, b) in enumerate(l2_profiles(l2)):
+                iorig = TableInterpolate(forig, p, t, b)
+                iquant = TableInterpolate(fquant, p, t, b)
+                dp = np.abs(np.diff(p))
+                max_rel = 0.0
+                max_rel_col = 0.0
+                for s in range(0, nwn, nwn_chunk):
+                    e = min(s + nwn_chunk, nwn)
+                    x = iorig(s, e)
+                    xq = iquant(s, e)
+                    pos = x > 0
+                    if(np.any(pos)):
+                        max_rel = max(max_rel, (np.abs(xq[pos] - x[pos]) /
+                                                x[pos]).max())
+                    # Trapezoid column, proportional to the gas optical
+                    # depth for a constant VMR.
+                    col = (0.5 * (x[1:, :] + x[:-1, :]) *
+                           dp[:, np.newaxis]).sum(axis=0)
+                    colq = (0.5 * (xq[1:, :] + xq[:-1, :]) *
+                            dp[:, np.newaxis]).sum(axis=0)
+                    pos = col > 0
+                    if(np.any(pos)):
+                        max_rel_col = max(max_rel_col,
+                           (np.abs(colq[pos] - col[pos]) / col[pos]).max())
+                print("%-40s %8d %14g %14g" % (fn[-40:], k, max_rel,
+                                                max_rel_col))
+
+def main():
+    parser = OptionParser(usage="""usage: %prog [options] <input ABSCO> <output ABSCO>
+       %prog --report [options] <input ABSCO> <quantized ABSCO> [L2 output file...]
+
+Convert an ABSCO table to the 16 bit log quantized form read by
+AbscoHdf. With --report, compare a quantized table with the original,
+both entry by entry and for the cross sections at the retrieved
+profiles in the given L2 output files (e.g., the regression soundings).""")
+    parser.add_option("--report", dest="report", action="store_true",
+                      default=False,
+                      help="Report the accuracy of a quantized table")
+    parser.add_option("--min-ratio", dest="min_ratio", type="float",
+                      default=1e-12,
+                      help="Store values smaller than this times the largest value at the same pressure and wavenumber as 0 (default %default)")
+    parser.add_option("--wn-chunk", dest="nwn_chunk", type="int",
+                      default=1000,
+                      help="Number of wavenumbers to process at one time (default %default)")
+    parser.add_option("--skip-table", dest="skip_table", action="store_true",
+                      default=False,
+                      help="With --report, don't compare every table entry, just the L2 soundings")
+    (options, args) = parser.parse_args()
+    if(len(args) < 2 or (not options.report and len(args) != 2)):
+        parser.print_help()
+        sys.exit(1)
+    if(not options.report):
+        convert(args[0], args[1], options.min_ratio, options.nwn_chunk)
+        return
+    forig = h5py.File(args[0], "r")
+    fquant = h5py.File(args[1], "r")
+    if(not options.skip_table):
+        table_report(forig, fquant, options.nwn_chunk)
+    if(len(args) > 2):
+        sounding_report(forig, fquant, args[2:], options.nwn_chunk)
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+
+from __future__ import print_function
+import os
+import sys
+import json
+from optparse import OptionParser
+
+# Aggregate the profiles written by l2_fp when the profiler is
+# turned on (see lib/Support/profiler.h). Each sounding writes a
+# <output>.profile.json file, this combines all of them (e.g., all the
+# soundings in an orbit) and reports the time spent in each zone.
+
+def find_profile_files(paths):
+    for p in paths:
+        if os.path.isfile(p):
+            yield p
+            continue
+        for dirpath, dirnames, filenames in os.walk(p):
+            for fn in filenames:
+                if fn.endswith(".profile.json"):
+                    yield os.path.join(dirpath, fn)
+
+def add_zone(summary, path, zone):
+    zpath = path + (zone["name"],)
+    s = summary.setdefault(zpath, { "soundings" : 0, "count" : 0, 
+                                    "total" : 0.0, "min" : None, 
+                                    "max" : 0.0, "allocations" : 0 })
+    if(zone["count"] > 0):
+        s["soundings"] += 1
+        s["count"] += zone["count"]
+        s["total"] += zone["total"]
+        s["min"] = zone["min"] if s["min"] is None else min(s["min"], zone["min"])
+        s["max"] = max(s["max"], zone["max"])
+        s["allocations"] += zone["allocations"]
+    for c in zone["children"]:
+        add_zone(summary, zpath, c)
+
+def summarize(fnames):
+    '''Return a dictionary going from the zone path (as a tuple) to the
+    combined statistics for that zone. All the threads are combined.'''
+    summary = {}
+    nfile = 0
+    for fn in fnames:
+        with open(fn) as f:
+            prof = json.load(f)
+        nfile += 1
+        for t in prof["threads"]:
+            for z in t["zones"]:
+                add_zone(summary, (), z)
+    return nfile, summary
+
+def main():
+    parser = OptionParser(usage="usage: %prog [options] [file or directory...]\n\nSummarize the l2_fp profiles found in the given files or directories\n(default is the current directory).")
+    parser.add_option("--csv", dest="csv", action="store_true", default=False,
+                      help="Write the report as CSV")
+    (options, args) = parser.parse_args()
+    if(len(args) == 0):
+        args = ["."]
+    nfile, summary = summarize(find_profile_files(args))
+    if(nfile == 0):
+        print("No profile files found", file=sys.stderr)
+        sys.exit(1)
+    if(options.csv):
+        print("zone,soundings,count,total,mean,min,max,allocations")
+    else:
+        print("Summary of %d profiles (times in seconds)" % nfile)
+        print("%-60s %9s %10s %12s %12s %12s %12s %12s" % 
+              ("Zone", "Soundings", "Count", "Total", "Mean", "Min", "Max", 
+               "Alloc"))
+    for zpath in sorted(summary.keys()):
+        s = summary[zpath]
+        mean = s["total"] / s["count"] if s["count"] > 0 else 0.0
+        smin = s["min"] if s["min"] is not None else 0.0
+        if(options.csv):
+            print('"%s",%d,%d,%g,%g,%g,%g,%d' % 
+                  ("/".join(zpath), s["soundings"], s["count"], s["total"], 
+                   mean, smin, s["max"], s["allocations"]))
+        else:
+            nm = "  " * (len(zpath) - 1) + zpath[-1]
+            print("%-60s %9d %10d %12.6f %12.6f %12.6f %12.6f %12d" % 
+                  (nm, s["soundings"], s["count"], s["total"], mean, smin, 
+                   s["max"], s["allocations"]))
+
+if __name__ == "__main__":
+    main()